@@ -0,0 +1,1424 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_binary.c - librdf binary RDF dump parser and serializer
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+/*
+ * The redland-binary syntax is a compact dump of statements for
+ * reloading without tokenising text or repeating term strings.
+ *
+ * It starts with the 8 byte magic LIBRDF_BINARY_MAGIC and a version
+ * byte followed by a sequence of blocks.  A block is:
+ *
+ *   varint  number of new terms N
+ *   varint  number of statements M
+ *   N term records, given the next term IDs counting up from 0
+ *   M statement records
+ *
+ * and a block of 0 terms and 0 statements ends the document.
+ *
+ * A term record is a type byte and the term strings, each a varint
+ * length and the bytes:
+ *   'U' URI string
+ *   'B' blank node identifier
+ *   'L' literal value, language, varint datatype URI term ID + 1 or 0
+ *
+ * A statement record is 4 varints: the subject, predicate and object
+ * term IDs and the graph term ID + 1 or 0 for none, each zigzag
+ * encoded as the difference from the same field of the previous
+ * statement.  Varints are unsigned LEB128.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#include <redland.h>
+
+
+#define LIBRDF_BINARY_SYNTAX_NAME "redland-binary"
+#define LIBRDF_BINARY_SYNTAX_LABEL "Redland Binary RDF"
+#define LIBRDF_BINARY_MIME_TYPE "application/x-redland-binary"
+
+#define LIBRDF_BINARY_MAGIC "\211RDFBIN\n"
+#define LIBRDF_BINARY_MAGIC_LEN 8
+#define LIBRDF_BINARY_VERSION 1
+
+/* Most statements written in one block */
+#define LIBRDF_BINARY_BLOCK_STATEMENTS 4096
+
+/* Size of the buffer input is read into */
+#define LIBRDF_BINARY_READ_BUFFER_SIZE 65536
+
+/* Initial number of slots in the serializer term table (power of 2) */
+#define LIBRDF_BINARY_TERMS_INITIAL_SIZE 1024
+
+
+static unsigned long
+librdf_binary_zigzag_encode(long value)
+{
+  if(value < 0)
+    return ((unsigned long)(-(value + 1)) << 1) | 1;
+  return (unsigned long)value << 1;
+}
+
+
+static long
+librdf_binary_zigzag_decode(unsigned long value)
+{
+  if(value & 1)
+    return -(long)(value >> 1) - 1;
+  return (long)(value >> 1);
+}
+
+
+static int
+librdf_binary_write_varint(librdf_raptor_buffer* buffer, unsigned long value)
+{
+  unsigned char bytes[(sizeof(value) * 8 + 6) / 7];
+  size_t length = 0;
+
+  while(value >= 0x80) {
+    bytes[length++] = (unsigned char)((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  bytes[length++] = (unsigned char)value;
+
+  return librdf_raptor_buffer_write(buffer, bytes, length);
+}
+
+
+static int
+librdf_binary_write_string(librdf_raptor_buffer* buffer,
+                           const unsigned char* string, size_t length)
+{
+  if(!string)
+    length = 0;
+
+  return librdf_binary_write_varint(buffer, (unsigned long)length) ||
+         (length && librdf_raptor_buffer_write(buffer, string, length));
+}
+
+
+
+/* serializer */
+
+typedef struct {
+  unsigned long hash;
+  /* encoded term in the keys buffer; length 0 is an empty slot */
+  size_t offset;
+  size_t length;
+  unsigned long id;
+} librdf_binary_term_entry;
+
+typedef struct {
+  librdf_serializer *serializer;
+
+  /* term dictionary of the document being written */
+  librdf_raptor_buffer keys;
+  librdf_binary_term_entry* entries;
+  size_t entries_size;
+  unsigned long terms_count;
+
+  /* encoding of the term being looked up */
+  librdf_raptor_buffer key;
+
+  /* block being written */
+  librdf_raptor_buffer block_terms;
+  librdf_raptor_buffer block_statements;
+  unsigned long block_terms_count;
+  unsigned long block_statements_count;
+
+  /* fields of the previous statement */
+  unsigned long previous[4];
+
+  raptor_iostream* iostr;
+} librdf_binary_serializer_context;
+
+
+static int
+librdf_serializer_binary_init(librdf_serializer *serializer, void *context)
+{
+  librdf_binary_serializer_context* scontext = (librdf_binary_serializer_context*)context;
+
+  scontext->serializer = serializer;
+
+  return 0;
+}
+
+
+/*
+ * librdf_serializer_binary_reset:
+ * @scontext: serializer context
+ *
+ * INTERNAL - Forget the terms and statements of the last document
+ */
+static void
+librdf_serializer_binary_reset(librdf_binary_serializer_context* scontext)
+{
+  librdf_raptor_buffer_clear(&scontext->keys);
+  librdf_raptor_buffer_clear(&scontext->key);
+  librdf_raptor_buffer_clear(&scontext->block_terms);
+  librdf_raptor_buffer_clear(&scontext->block_statements);
+
+  if(scontext->entries) {
+    LIBRDF_FREE(librdf_binary_term_entry*, scontext->entries);
+    scontext->entries = NULL;
+  }
+  scontext->entries_size = 0;
+  scontext->terms_count = 0;
+  scontext->block_terms_count = 0;
+  scontext->block_statements_count = 0;
+  memset(scontext->previous, 0, sizeof(scontext->previous));
+}
+
+
+static void
+librdf_serializer_binary_terminate(void *context)
+{
+  librdf_serializer_binary_reset((librdf_binary_serializer_context*)context);
+}
+
+
+static unsigned long
+librdf_serializer_binary_hash(const unsigned char* data, size_t length)
+{
+  unsigned long hash = 2166136261UL;
+
+  while(length--) {
+    hash ^= *data++;
+    hash *= 16777619UL;
+  }
+
+  return hash;
+}
+
+
+static int
+librdf_serializer_binary_grow_terms(librdf_binary_serializer_context* scontext)
+{
+  librdf_binary_term_entry* entries;
+  size_t size;
+  size_t i;
+
+  size = scontext->entries_size ? scontext->entries_size << 1 :
+                                  LIBRDF_BINARY_TERMS_INITIAL_SIZE;
+  entries = LIBRDF_CALLOC(librdf_binary_term_entry*, size, sizeof(*entries));
+  if(!entries)
+    return 1;
+
+  for(i = 0; i < scontext->entries_size; i++) {
+    librdf_binary_term_entry* entry = &scontext->entries[i];
+    size_t j;
+
+    if(!entry->length)
+      continue;
+
+    for(j = entry->hash & (size - 1); entries[j].length; j = (j + 1) & (size - 1))
+      ;
+    entries[j] = *entry;
+  }
+
+  if(scontext->entries)
+    LIBRDF_FREE(librdf_binary_term_entry*, scontext->entries);
+  scontext->entries = entries;
+  scontext->entries_size = size;
+
+  return 0;
+}
+
+
+/*
+ * librdf_serializer_binary_get_term_id:
+ * @scontext: serializer context
+ * @term: term
+ * @id_p: address to store the term ID
+ *
+ * INTERNAL - Get the ID of a term, adding a term record to the block if new
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_serializer_binary_get_term_id(librdf_binary_serializer_context* scontext,
+                                     raptor_term* term,
+                                     unsigned long* id_p)
+{
+  librdf_binary_term_entry* entry;
+  unsigned long datatype_id = 0;
+  unsigned long hash;
+  const unsigned char* string;
+  size_t length;
+  size_t i;
+
+  scontext->key.length = 0;
+  if(librdf_raptor_buffer_write_term(&scontext->key, term))
+    return 1;
+
+  hash = librdf_serializer_binary_hash(scontext->key.data, scontext->key.length);
+  if(scontext->entries) {
+    for(i = hash & (scontext->entries_size - 1); scontext->entries[i].length;
+        i = (i + 1) & (scontext->entries_size - 1)) {
+      entry = &scontext->entries[i];
+      if(entry->hash == hash && entry->length == scontext->key.length &&
+         !memcmp(scontext->keys.data + entry->offset, scontext->key.data,
+                 entry->length)) {
+        *id_p = entry->id;
+        return 0;
+      }
+    }
+  }
+
+  /* a new term; a datatype URI is added as a term first */
+  if(term->type == RAPTOR_TERM_TYPE_LITERAL && term->value.literal.datatype) {
+    raptor_term* datatype;
+    int rc;
+
+    datatype = raptor_new_term_from_uri(term->world,
+                                        term->value.literal.datatype);
+    if(!datatype)
+      return 1;
+    rc = librdf_serializer_binary_get_term_id(scontext, datatype, &datatype_id);
+    raptor_free_term(datatype);
+    if(rc)
+      return 1;
+    datatype_id++;
+
+    scontext->key.length = 0;
+    if(librdf_raptor_buffer_write_term(&scontext->key, term))
+      return 1;
+  }
+
+  if((scontext->terms_count + 1) * 4 > scontext->entries_size * 3 &&
+     librdf_serializer_binary_grow_terms(scontext))
+    return 1;
+
+  for(i = hash & (scontext->entries_size - 1); scontext->entries[i].length;
+      i = (i + 1) & (scontext->entries_size - 1))
+    ;
+  entry = &scontext->entries[i];
+
+  entry->offset = scontext->keys.length;
+  if(librdf_raptor_buffer_write(&scontext->keys, scontext->key.data,
+                                scontext->key.length))
+    return 1;
+  entry->hash = hash;
+  entry->length = scontext->key.length;
+  entry->id = scontext->terms_count++;
+
+  switch(term->type) {
+    case RAPTOR_TERM_TYPE_URI:
+      string = raptor_uri_as_counted_string(term->value.uri, &length);
+      if(librdf_raptor_buffer_write(&scontext->block_terms, "U", 1) ||
+         librdf_binary_write_string(&scontext->block_terms, string, length))
+        return 1;
+      break;
+
+    case RAPTOR_TERM_TYPE_BLANK:
+      if(librdf_raptor_buffer_write(&scontext->block_terms, "B", 1) ||
+         librdf_binary_write_string(&scontext->block_terms,
+                                    term->value.blank.string,
+                                    term->value.blank.string_len))
+        return 1;
+      break;
+
+    case RAPTOR_TERM_TYPE_LITERAL:
+      if(librdf_raptor_buffer_write(&scontext->block_terms, "L", 1) ||
+         librdf_binary_write_string(&scontext->block_terms,
+                                    term->value.literal.string,
+                                    term->value.literal.string_len) ||
+         librdf_binary_write_string(&scontext->block_terms,
+                                    term->value.literal.language,
+                                    term->value.literal.language_len) ||
+         librdf_binary_write_varint(&scontext->block_terms, datatype_id))
+        return 1;
+      break;
+
+    case RAPTOR_TERM_TYPE_UNKNOWN:
+    default:
+      return 1;
+  }
+  scontext->block_terms_count++;
+
+  *id_p = entry->id;
+  return 0;
+}
+
+
+/*
+ * librdf_serializer_binary_flush_block:
+ * @scontext: serializer context
+ *
+ * INTERNAL - Write the block of new terms and statements
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_serializer_binary_flush_block(librdf_binary_serializer_context* scontext)
+{
+  librdf_raptor_buffer header;
+  int rc = 0;
+
+  memset(&header, 0, sizeof(header));
+  if(librdf_binary_write_varint(&header, scontext->block_terms_count) ||
+     librdf_binary_write_varint(&header, scontext->block_statements_count))
+    rc = 1;
+  else if(raptor_iostream_write_bytes(header.data, 1, header.length,
+                                      scontext->iostr) != (int)header.length)
+    rc = 1;
+  else if(scontext->block_terms.length &&
+          raptor_iostream_write_bytes(scontext->block_terms.data, 1,
+                                      scontext->block_terms.length,
+                                      scontext->iostr) != (int)scontext->block_terms.length)
+    rc = 1;
+  else if(scontext->block_statements.length &&
+          raptor_iostream_write_bytes(scontext->block_statements.data, 1,
+                                      scontext->block_statements.length,
+                                      scontext->iostr) != (int)scontext->block_statements.length)
+    rc = 1;
+  librdf_raptor_buffer_clear(&header);
+
+  scontext->block_terms.length = 0;
+  scontext->block_statements.length = 0;
+  scontext->block_terms_count = 0;
+  scontext->block_statements_count = 0;
+
+  return rc;
+}
+
+
+static int
+librdf_serializer_binary_serialize_statement(librdf_binary_serializer_context* scontext,
+                                             librdf_statement* statement,
+                                             librdf_node* graph)
+{
+  unsigned long fields[4];
+  int i;
+
+  if(!statement->subject || !statement->predicate || !statement->object)
+    return 1;
+
+  if(librdf_serializer_binary_get_term_id(scontext, statement->subject,
+                                          &fields[0]) ||
+     librdf_serializer_binary_get_term_id(scontext, statement->predicate,
+                                          &fields[1]) ||
+     librdf_serializer_binary_get_term_id(scontext, statement->object,
+                                          &fields[2]))
+    return 1;
+
+  fields[3] = 0;
+  if(graph) {
+    if(librdf_serializer_binary_get_term_id(scontext, graph, &fields[3]))
+      return 1;
+    fields[3]++;
+  }
+
+  for(i = 0; i < 4; i++) {
+    long delta = (long)(fields[i] - scontext->previous[i]);
+
+    if(librdf_binary_write_varint(&scontext->block_statements,
+                                  librdf_binary_zigzag_encode(delta)))
+      return 1;
+    scontext->previous[i] = fields[i];
+  }
+  scontext->block_statements_count++;
+
+  if(scontext->block_statements_count == LIBRDF_BINARY_BLOCK_STATEMENTS)
+    return librdf_serializer_binary_flush_block(scontext);
+
+  return 0;
+}
+
+
+static int
+librdf_serializer_binary_serialize_stream_to_iostream(void *context,
+                                                      librdf_uri* base_uri,
+                                                      librdf_stream *stream,
+                                                      raptor_iostream* iostr)
+{
+  librdf_binary_serializer_context* scontext = (librdf_binary_serializer_context*)context;
+  unsigned char version = LIBRDF_BINARY_VERSION;
+  int rc = 0;
+
+  if(!iostr)
+    return 1;
+
+  if(!stream) {
+    raptor_free_iostream(iostr);
+    return 1;
+  }
+
+  librdf_serializer_binary_reset(scontext);
+  scontext->iostr = iostr;
+
+  if(raptor_iostream_write_bytes(LIBRDF_BINARY_MAGIC, 1,
+                                 LIBRDF_BINARY_MAGIC_LEN, iostr) != LIBRDF_BINARY_MAGIC_LEN ||
+     raptor_iostream_write_bytes(&version, 1, 1, iostr) != 1)
+    rc = 1;
+
+  while(!rc && !librdf_stream_end(stream)) {
+    librdf_statement *statement = librdf_stream_get_object(stream);
+    librdf_node *graph = librdf_stream_get_context2(stream);
+
+    rc = librdf_serializer_binary_serialize_statement(scontext, statement,
+                                                      graph);
+    librdf_stream_next(stream);
+  }
+
+  /* the last statements then an empty block to end the document */
+  if(!rc && scontext->block_statements_count)
+    rc = librdf_serializer_binary_flush_block(scontext);
+  if(!rc)
+    rc = librdf_serializer_binary_flush_block(scontext);
+
+  if(rc)
+    librdf_log(scontext->serializer->world, 0, LIBRDF_LOG_ERROR,
+               LIBRDF_FROM_SERIALIZER, NULL,
+               "Cannot serialize statements as %s", LIBRDF_BINARY_SYNTAX_NAME);
+
+  scontext->iostr = NULL;
+  raptor_free_iostream(iostr);
+  librdf_serializer_binary_reset(scontext);
+
+  return rc;
+}
+
+
+static int
+librdf_serializer_binary_serialize_model_to_iostream(void *context,
+                                                     librdf_uri* base_uri,
+                                                     librdf_model *model,
+                                                     raptor_iostream* iostr)
+{
+  librdf_stream *stream;
+  int rc;
+
+  if(!iostr)
+    return 1;
+
+  stream = librdf_model_as_stream(model);
+  if(!stream) {
+    raptor_free_iostream(iostr);
+    return 1;
+  }
+
+  rc = librdf_serializer_binary_serialize_stream_to_iostream(context, base_uri,
+                                                             stream, iostr);
+  librdf_free_stream(stream);
+
+  return rc;
+}
+
+
+static int
+librdf_serializer_binary_serialize_stream_to_file_handle(void *context,
+                                                         FILE *handle,
+                                                         librdf_uri* base_uri,
+                                                         librdf_stream *stream)
+{
+  librdf_binary_serializer_context* scontext = (librdf_binary_serializer_context*)context;
+  raptor_iostream *iostr;
+
+  iostr = raptor_new_iostream_to_file_handle(scontext->serializer->world->raptor_world_ptr,
+                                             handle);
+  return librdf_serializer_binary_serialize_stream_to_iostream(context, base_uri,
+                                                               stream, iostr);
+}
+
+
+static int
+librdf_serializer_binary_serialize_model_to_file_handle(void *context,
+                                                        FILE *handle,
+                                                        librdf_uri* base_uri,
+                                                        librdf_model *model)
+{
+  librdf_binary_serializer_context* scontext = (librdf_binary_serializer_context*)context;
+  raptor_iostream *iostr;
+
+  iostr = raptor_new_iostream_to_file_handle(scontext->serializer->world->raptor_world_ptr,
+                                             handle);
+  return librdf_serializer_binary_serialize_model_to_iostream(context, base_uri,
+                                                              model, iostr);
+}
+
+
+static unsigned char*
+librdf_serializer_binary_serialize_stream_to_counted_string(void *context,
+                                                           librdf_uri* base_uri,
+                                                           librdf_stream *stream,
+                                                           size_t* length_p)
+{
+  librdf_binary_serializer_context* scontext = (librdf_binary_serializer_context*)context;
+  raptor_iostream *iostr;
+  void *string = NULL;
+  size_t string_length = 0;
+
+  iostr = raptor_new_iostream_to_string(scontext->serializer->world->raptor_world_ptr,
+                                        &string, &string_length, malloc);
+  if(!iostr)
+    return NULL;
+
+  /* the string is complete once the iostream is freed */
+  if(librdf_serializer_binary_serialize_stream_to_iostream(context, base_uri,
+                                                           stream, iostr)) {
+    if(string)
+      raptor_free_memory(string);
+    return NULL;
+  }
+
+  if(length_p)
+    *length_p = string_length;
+
+  return (unsigned char*)string;
+}
+
+
+static unsigned char*
+librdf_serializer_binary_serialize_model_to_counted_string(void *context,
+                                                          librdf_uri* base_uri,
+                                                          librdf_model *model,
+                                                          size_t* length_p)
+{
+  unsigned char *string;
+  librdf_stream *stream;
+
+  stream = librdf_model_as_stream(model);
+  if(!stream)
+    return NULL;
+
+  string = librdf_serializer_binary_serialize_stream_to_counted_string(context,
+                                                                      base_uri,
+                                                                      stream,
+                                                                      length_p);
+  librdf_free_stream(stream);
+
+  return string;
+}
+
+
+static void
+librdf_serializer_binary_register_factory(librdf_serializer_factory *factory)
+{
+  factory->context_length = sizeof(librdf_binary_serializer_context);
+
+  factory->init  = librdf_serializer_binary_init;
+  factory->terminate = librdf_serializer_binary_terminate;
+
+  factory->serialize_stream_to_file_handle = librdf_serializer_binary_serialize_stream_to_file_handle;
+  factory->serialize_model_to_file_handle = librdf_serializer_binary_serialize_model_to_file_handle;
+  factory->serialize_stream_to_counted_string = librdf_serializer_binary_serialize_stream_to_counted_string;
+  factory->serialize_model_to_counted_string = librdf_serializer_binary_serialize_model_to_counted_string;
+  factory->serialize_stream_to_iostream = librdf_serializer_binary_serialize_stream_to_iostream;
+  factory->serialize_model_to_iostream = librdf_serializer_binary_serialize_model_to_iostream;
+}
+
+
+/**
+ * librdf_serializer_binary_constructor:
+ * @world: redland world object
+ *
+ * INTERNAL - Register the redland-binary serializer.
+ *
+ **/
+void
+librdf_serializer_binary_constructor(librdf_world *world)
+{
+  librdf_serializer_register_factory(world, LIBRDF_BINARY_SYNTAX_NAME,
+                                     LIBRDF_BINARY_SYNTAX_LABEL,
+                                     LIBRDF_BINARY_MIME_TYPE, NULL,
+                                     &librdf_serializer_binary_register_factory);
+}
+
+
+
+/* parser */
+
+typedef struct {
+  librdf_parser *parser;
+} librdf_binary_parser_context;
+
+typedef struct {
+  librdf_binary_parser_context* pcontext;
+
+  raptor_iostream* iostr;
+  /* when the iostream was made here and is freed on finish */
+  int free_iostr;
+  /* when reading from a file; closed on finish if close_fh */
+  FILE *fh;
+  int close_fh;
+  /* when reading from a copy of a string */
+  unsigned char* string;
+
+  unsigned char buffer[LIBRDF_BINARY_READ_BUFFER_SIZE];
+  size_t buffer_offset;
+  size_t buffer_length;
+
+  /* terms of the document so far, indexed by term ID */
+  librdf_node** terms;
+  unsigned long terms_count;
+  unsigned long terms_size;
+
+  /* statements left to read in the current block */
+  unsigned long block_statements;
+  /* fields of the previous statement */
+  unsigned long previous[4];
+
+  /* string values of the term being read */
+  librdf_raptor_buffer value;
+  librdf_raptor_buffer language;
+
+  librdf_statement* current;
+  /* shared context node of the current statement or NULL */
+  librdf_node* current_graph;
+
+  /* graph of the run of statements being added to a model or NULL */
+  librdf_node* run_graph;
+  /* non 0 when the model being added to supports contexts */
+  int run_contexts;
+
+  int finished;
+  int error;
+} librdf_binary_parser_stream_context;
+
+
+static int
+librdf_parser_binary_init(librdf_parser *parser, void *context)
+{
+  librdf_binary_parser_context* pcontext = (librdf_binary_parser_context*)context;
+
+  pcontext->parser = parser;
+
+  return 0;
+}
+
+
+static void
+librdf_parser_binary_terminate(void *context)
+{
+  /* nothing to free */
+}
+
+
+static void
+librdf_parser_binary_error(librdf_binary_parser_stream_context* scontext,
+                           const char* message)
+{
+  if(!scontext->error)
+    librdf_log(scontext->pcontext->parser->world, 0, LIBRDF_LOG_ERROR,
+               LIBRDF_FROM_PARSER, NULL, "%s parsing %s",
+               message, LIBRDF_BINARY_SYNTAX_NAME);
+  scontext->error = 1;
+  scontext->finished = 1;
+}
+
+
+/*
+ * librdf_parser_binary_read:
+ * @scontext: stream context
+ * @data: address to store bytes or NULL to append them to @buffer
+ * @buffer: buffer to append bytes to when @data is NULL
+ * @length: number of bytes to read
+ *
+ * INTERNAL - Read bytes of input
+ *
+ * Return value: non 0 on failure or early end of input
+ */
+static int
+librdf_parser_binary_read(librdf_binary_parser_stream_context* scontext,
+                          unsigned char* data, librdf_raptor_buffer* buffer,
+                          size_t length)
+{
+  while(length) {
+    size_t available = scontext->buffer_length - scontext->buffer_offset;
+    const unsigned char* p = scontext->buffer + scontext->buffer_offset;
+
+    if(!available) {
+      int count;
+
+      count = raptor_iostream_read_bytes(scontext->buffer, 1,
+                                         LIBRDF_BINARY_READ_BUFFER_SIZE,
+                                         scontext->iostr);
+      if(count <= 0)
+        return 1;
+      scontext->buffer_offset = 0;
+      scontext->buffer_length = (size_t)count;
+      continue;
+    }
+
+    if(available > length)
+      available = length;
+
+    if(data) {
+      memcpy(data, p, available);
+      data += available;
+    } else if(librdf_raptor_buffer_write(buffer, p, available))
+      return 1;
+
+    scontext->buffer_offset += available;
+    length -= available;
+  }
+
+  return 0;
+}
+
+
+static int
+librdf_parser_binary_read_varint(librdf_binary_parser_stream_context* scontext,
+                                 unsigned long* value_p)
+{
+  unsigned long value = 0;
+  unsigned int shift = 0;
+  unsigned char byte;
+
+  do {
+    if(shift >= sizeof(value) * 8 ||
+       librdf_parser_binary_read(scontext, &byte, NULL, 1))
+      return 1;
+    value |= (unsigned long)(byte & 0x7f) << shift;
+    shift += 7;
+  } while(byte & 0x80);
+
+  *value_p = value;
+  return 0;
+}
+
+
+/* read a string into an empty, NUL terminated buffer */
+static int
+librdf_parser_binary_read_string(librdf_binary_parser_stream_context* scontext,
+                                 librdf_raptor_buffer* buffer)
+{
+  unsigned long length;
+
+  buffer->length = 0;
+  if(librdf_parser_binary_read_varint(scontext, &length) ||
+     librdf_parser_binary_read(scontext, NULL, buffer, (size_t)length) ||
+     librdf_raptor_buffer_write(buffer, "", 1))
+    return 1;
+  buffer->length--;
+
+  return 0;
+}
+
+
+/*
+ * librdf_parser_binary_read_term:
+ * @scontext: stream context
+ *
+ * INTERNAL - Read a term record and give it the next term ID
+ *
+ * Blank nodes get new identifiers since the dictionary already
+ * holds each one only once.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_binary_read_term(librdf_binary_parser_stream_context* scontext)
+{
+  librdf_world* world = scontext->pcontext->parser->world;
+  librdf_node* node = NULL;
+  librdf_uri* datatype_uri = NULL;
+  unsigned long datatype_id;
+  unsigned char type;
+
+  if(librdf_parser_binary_read(scontext, &type, NULL, 1))
+    return 1;
+
+  switch(type) {
+    case 'U':
+      if(librdf_parser_binary_read_string(scontext, &scontext->value))
+        return 1;
+      node = librdf_new_node_from_counted_uri_string(world,
+                                                     scontext->value.data,
+                                                     scontext->value.length);
+      break;
+
+    case 'B':
+      if(librdf_parser_binary_read_string(scontext, &scontext->value))
+        return 1;
+      node = librdf_new_node_from_blank_identifier(world, NULL);
+      break;
+
+    case 'L':
+      if(librdf_parser_binary_read_string(scontext, &scontext->value) ||
+         librdf_parser_binary_read_string(scontext, &scontext->language) ||
+         librdf_parser_binary_read_varint(scontext, &datatype_id))
+        return 1;
+      if(datatype_id) {
+        if(datatype_id > scontext->terms_count ||
+           !librdf_node_is_resource(scontext->terms[datatype_id - 1]))
+          return 1;
+        datatype_uri = librdf_node_get_uri(scontext->terms[datatype_id - 1]);
+      }
+      node = librdf_new_node_from_typed_counted_literal(world,
+                                                        scontext->value.data,
+                                                        scontext->value.length,
+                                                        scontext->language.length ? (const char*)scontext->language.data : NULL,
+                                                        scontext->language.length,
+                                                        datatype_uri);
+      break;
+
+    default:
+      return 1;
+  }
+
+  if(!node)
+    return 1;
+
+  if(scontext->terms_count == scontext->terms_size) {
+    unsigned long size = scontext->terms_size ? scontext->terms_size << 1 : 1024;
+    librdf_node** terms;
+
+    terms = LIBRDF_MALLOC(librdf_node**, size * sizeof(*terms));
+    if(!terms) {
+      librdf_free_node(node);
+      return 1;
+    }
+    if(scontext->terms) {
+      memcpy(terms, scontext->terms, scontext->terms_count * sizeof(*terms));
+      LIBRDF_FREE(librdf_node**, scontext->terms);
+    }
+    scontext->terms = terms;
+    scontext->terms_size = size;
+  }
+
+  scontext->terms[scontext->terms_count++] = node;
+  return 0;
+}
+
+
+/*
+ * librdf_parser_binary_get_next_statement:
+ * @scontext: stream context
+ *
+ * INTERNAL - Read the next statement into current, reading blocks as needed
+ */
+static void
+librdf_parser_binary_get_next_statement(librdf_binary_parser_stream_context* scontext)
+{
+  librdf_world* world = scontext->pcontext->parser->world;
+  unsigned long fields[4];
+  int i;
+
+  scontext->current = NULL;
+  scontext->current_graph = NULL;
+
+  while(!scontext->finished && !scontext->block_statements) {
+    unsigned long terms_count;
+
+    if(librdf_parser_binary_read_varint(scontext, &terms_count) ||
+       librdf_parser_binary_read_varint(scontext, &scontext->block_statements)) {
+      librdf_parser_binary_error(scontext, "Unexpected end of input");
+      return;
+    }
+
+    if(!terms_count && !scontext->block_statements) {
+      scontext->finished = 1;
+      return;
+    }
+
+    while(terms_count--) {
+      if(librdf_parser_binary_read_term(scontext)) {
+        librdf_parser_binary_error(scontext, "Bad term");
+        return;
+      }
+    }
+  }
+
+  if(scontext->finished)
+    return;
+
+  for(i = 0; i < 4; i++) {
+    unsigned long value;
+
+    if(librdf_parser_binary_read_varint(scontext, &value)) {
+      librdf_parser_binary_error(scontext, "Unexpected end of input");
+      return;
+    }
+    fields[i] = scontext->previous[i] +
+                (unsigned long)librdf_binary_zigzag_decode(value);
+    scontext->previous[i] = fields[i];
+  }
+  scontext->block_statements--;
+
+  if(fields[0] >= scontext->terms_count ||
+     fields[1] >= scontext->terms_count ||
+     fields[2] >= scontext->terms_count ||
+     fields[3] > scontext->terms_count) {
+    librdf_parser_binary_error(scontext, "Bad term ID");
+    return;
+  }
+
+  scontext->current = librdf_new_statement_from_nodes(world,
+                                                      librdf_new_node_from_node(scontext->terms[fields[0]]),
+                                                      librdf_new_node_from_node(scontext->terms[fields[1]]),
+                                                      librdf_new_node_from_node(scontext->terms[fields[2]]));
+  if(!scontext->current) {
+    librdf_parser_binary_error(scontext, "Out of memory");
+    return;
+  }
+
+  if(fields[3])
+    scontext->current_graph = scontext->terms[fields[3] - 1];
+}
+
+
+static int
+librdf_parser_binary_serialise_end_of_stream(void* context)
+{
+  librdf_binary_parser_stream_context* scontext = (librdf_binary_parser_stream_context*)context;
+
+  return !scontext->current;
+}
+
+
+static int
+librdf_parser_binary_serialise_next_statement(void* context)
+{
+  librdf_binary_parser_stream_context* scontext = (librdf_binary_parser_stream_context*)context;
+
+  if(scontext->current)
+    librdf_free_statement(scontext->current);
+  librdf_parser_binary_get_next_statement(scontext);
+
+  return !scontext->current;
+}
+
+
+static void*
+librdf_parser_binary_serialise_get_statement(void* context, int flags)
+{
+  librdf_binary_parser_stream_context* scontext = (librdf_binary_parser_stream_context*)context;
+
+  switch(flags) {
+    case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      return scontext->current;
+
+    case LIBRDF_ITERATOR_GET_METHOD_GET_CONTEXT:
+      return scontext->current_graph;
+
+    default:
+      librdf_log(scontext->pcontext->parser->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
+                 "Unknown iterator method flag %d", flags);
+      return NULL;
+  }
+}
+
+
+static void
+librdf_parser_binary_serialise_finished(void* context)
+{
+  librdf_binary_parser_stream_context* scontext = (librdf_binary_parser_stream_context*)context;
+  unsigned long i;
+
+  if(!scontext)
+    return;
+
+  if(scontext->current)
+    librdf_free_statement(scontext->current);
+
+  for(i = 0; i < scontext->terms_count; i++)
+    librdf_free_node(scontext->terms[i]);
+  if(scontext->terms)
+    LIBRDF_FREE(librdf_node**, scontext->terms);
+
+  librdf_raptor_buffer_clear(&scontext->value);
+  librdf_raptor_buffer_clear(&scontext->language);
+
+  if(scontext->iostr && scontext->free_iostr)
+    raptor_free_iostream(scontext->iostr);
+  if(scontext->fh && scontext->close_fh)
+    fclose(scontext->fh);
+  if(scontext->string)
+    LIBRDF_FREE(char*, scontext->string);
+
+  LIBRDF_FREE(librdf_binary_parser_stream_context, scontext);
+}
+
+
+/*
+ * librdf_parser_binary_new_stream_context:
+ * @pcontext: parser context
+ * @fh: file handle to read or NULL
+ * @close_fh: non 0 to close @fh when finished
+ * @string: string to read or NULL
+ * @length: length of @string
+ * @iostr: iostream to read or NULL (not owned)
+ *
+ * INTERNAL - Start reading a document and its first statement
+ *
+ * Return value: new stream context or NULL on failure
+ */
+static librdf_binary_parser_stream_context*
+librdf_parser_binary_new_stream_context(librdf_binary_parser_context* pcontext,
+                                        FILE *fh, int close_fh,
+                                        const unsigned char* string,
+                                        size_t length,
+                                        raptor_iostream* iostr)
+{
+  librdf_world* world = pcontext->parser->world;
+  librdf_binary_parser_stream_context* scontext;
+  unsigned char magic[LIBRDF_BINARY_MAGIC_LEN + 1];
+
+  scontext = LIBRDF_CALLOC(librdf_binary_parser_stream_context*, 1,
+                           sizeof(*scontext));
+  if(!scontext) {
+    if(fh && close_fh)
+      fclose(fh);
+    return NULL;
+  }
+  scontext->pcontext = pcontext;
+  scontext->fh = fh;
+  scontext->close_fh = close_fh;
+
+  if(fh)
+    scontext->iostr = librdf_new_iostream_from_compressed_file_handle(world, fh);
+  else if(string) {
+    /* keep a copy since statements are read as the stream is used */
+    scontext->string = LIBRDF_MALLOC(unsigned char*, length);
+    if(scontext->string) {
+      memcpy(scontext->string, string, length);
+      scontext->iostr = raptor_new_iostream_from_string(world->raptor_world_ptr,
+                                                        scontext->string,
+                                                        length);
+    }
+  }
+
+  if(scontext->iostr)
+    scontext->free_iostr = 1;
+  else
+    scontext->iostr = iostr;
+
+  if(!scontext->iostr) {
+    librdf_parser_binary_serialise_finished(scontext);
+    return NULL;
+  }
+
+  if(librdf_parser_binary_read(scontext, magic, NULL, sizeof(magic)) ||
+     memcmp(magic, LIBRDF_BINARY_MAGIC, LIBRDF_BINARY_MAGIC_LEN))
+    librdf_parser_binary_error(scontext, "Not a binary RDF document");
+  else if(magic[LIBRDF_BINARY_MAGIC_LEN] != LIBRDF_BINARY_VERSION)
+    librdf_parser_binary_error(scontext, "Unsupported version");
+  else
+    librdf_parser_binary_get_next_statement(scontext);
+
+  return scontext;
+}
+
+
+static librdf_stream*
+librdf_parser_binary_new_stream(librdf_binary_parser_context* pcontext,
+                                librdf_binary_parser_stream_context* scontext)
+{
+  librdf_stream *stream;
+
+  if(!scontext)
+    return NULL;
+
+  if(scontext->error) {
+    librdf_parser_binary_serialise_finished(scontext);
+    return NULL;
+  }
+
+  stream = librdf_new_stream(pcontext->parser->world,
+                             (void*)scontext,
+                             &librdf_parser_binary_serialise_end_of_stream,
+                             &librdf_parser_binary_serialise_next_statement,
+                             &librdf_parser_binary_serialise_get_statement,
+                             &librdf_parser_binary_serialise_finished);
+  if(!stream)
+    librdf_parser_binary_serialise_finished(scontext);
+
+  return stream;
+}
+
+
+static int
+librdf_parser_binary_run_end_of_stream(void* context)
+{
+  librdf_binary_parser_stream_context* scontext = (librdf_binary_parser_stream_context*)context;
+
+  return !scontext->current ||
+         (scontext->run_contexts && scontext->current_graph != scontext->run_graph);
+}
+
+
+static int
+librdf_parser_binary_run_next_statement(void* context)
+{
+  librdf_binary_parser_stream_context* scontext = (librdf_binary_parser_stream_context*)context;
+
+  librdf_free_statement(scontext->current);
+  librdf_parser_binary_get_next_statement(scontext);
+
+  return librdf_parser_binary_run_end_of_stream(context);
+}
+
+
+static void
+librdf_parser_binary_run_finished(void* context)
+{
+  /* the stream context is owned by librdf_parser_binary_add_to_model */
+}
+
+
+/*
+ * librdf_parser_binary_add_to_model:
+ * @scontext: stream context
+ * @model: model
+ *
+ * INTERNAL - Add all the statements of a document to a model
+ *
+ * Each run of statements in the same graph is added in one call, so
+ * storages that batch additions see the whole run.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_binary_add_to_model(librdf_binary_parser_stream_context* scontext,
+                                  librdf_model* model)
+{
+  librdf_world* world;
+  librdf_stream* stream;
+  int rc = 0;
+
+  if(!scontext)
+    return 1;
+
+  world = scontext->pcontext->parser->world;
+  scontext->run_contexts = librdf_model_supports_contexts(model);
+  while(!rc && scontext->current) {
+    scontext->run_graph = scontext->run_contexts ? scontext->current_graph : NULL;
+
+    stream = librdf_new_stream(world, (void*)scontext,
+                               &librdf_parser_binary_run_end_of_stream,
+                               &librdf_parser_binary_run_next_statement,
+                               &librdf_parser_binary_serialise_get_statement,
+                               &librdf_parser_binary_run_finished);
+    if(!stream) {
+      rc = 1;
+      break;
+    }
+
+    if(scontext->run_graph)
+      rc = librdf_model_context_add_statements(model, scontext->run_graph,
+                                               stream);
+    else
+      rc = librdf_model_add_statements(model, stream);
+    librdf_free_stream(stream);
+  }
+
+  if(rc)
+    librdf_log(world, 0, LIBRDF_LOG_FATAL, LIBRDF_FROM_PARSER, NULL,
+               "Cannot add statements to model");
+
+  if(scontext->error)
+    rc = 1;
+
+  librdf_parser_binary_serialise_finished(scontext);
+
+  return rc;
+}
+
+
+static FILE*
+librdf_parser_binary_open_file(librdf_binary_parser_context* pcontext,
+                               librdf_uri* uri)
+{
+  char* filename;
+  FILE* fh;
+
+  filename = (char*)librdf_uri_to_filename(uri);
+  if(!filename) {
+    librdf_log(pcontext->parser->world, 0, LIBRDF_LOG_ERROR,
+               LIBRDF_FROM_PARSER, NULL,
+               "%s parser can only read file: URIs, not '%s'",
+               LIBRDF_BINARY_SYNTAX_NAME, librdf_uri_as_string(uri));
+    return NULL;
+  }
+
+  fh = fopen(filename, "rb");
+  if(!fh)
+    librdf_log(pcontext->parser->world, 0, LIBRDF_LOG_ERROR,
+               LIBRDF_FROM_PARSER, NULL, "failed to open file '%s' - %s",
+               filename, strerror(errno));
+  SYSTEM_FREE(filename);
+
+  return fh;
+}
+
+
+static librdf_stream*
+librdf_parser_binary_parse_file_as_stream(void *context, librdf_uri *uri,
+                                          librdf_uri *base_uri)
+{
+  librdf_binary_parser_context* pcontext = (librdf_binary_parser_context*)context;
+  FILE* fh;
+
+  fh = librdf_parser_binary_open_file(pcontext, uri);
+  if(!fh)
+    return NULL;
+
+  return librdf_parser_binary_new_stream(pcontext,
+                                         librdf_parser_binary_new_stream_context(pcontext, fh, 1, NULL, 0, NULL));
+}
+
+
+static int
+librdf_parser_binary_parse_file_into_model(void *context, librdf_uri *uri,
+                                           librdf_uri *base_uri,
+                                           librdf_model *model)
+{
+  librdf_binary_parser_context* pcontext = (librdf_binary_parser_context*)context;
+  FILE* fh;
+
+  fh = librdf_parser_binary_open_file(pcontext, uri);
+  if(!fh)
+    return 1;
+
+  return librdf_parser_binary_add_to_model(librdf_parser_binary_new_stream_context(pcontext, fh, 1, NULL, 0, NULL),
+                                           model);
+}
+
+
+static librdf_stream*
+librdf_parser_binary_parse_file_handle_as_stream(void *context, FILE *fh,
+                                                 int close_fh,
+                                                 librdf_uri *base_uri)
+{
+  librdf_binary_parser_context* pcontext = (librdf_binary_parser_context*)context;
+
+  return librdf_parser_binary_new_stream(pcontext,
+                                         librdf_parser_binary_new_stream_context(pcontext, fh, close_fh, NULL, 0, NULL));
+}
+
+
+static int
+librdf_parser_binary_parse_file_handle_into_model(void *context, FILE *fh,
+                                                  int close_fh,
+                                                  librdf_uri *base_uri,
+                                                  librdf_model *model)
+{
+  librdf_binary_parser_context* pcontext = (librdf_binary_parser_context*)context;
+
+  return librdf_parser_binary_add_to_model(librdf_parser_binary_new_stream_context(pcontext, fh, close_fh, NULL, 0, NULL),
+                                           model);
+}
+
+
+static librdf_stream*
+librdf_parser_binary_parse_counted_string_as_stream(void *context,
+                                                    const unsigned char *string,
+                                                    size_t length,
+                                                    librdf_uri *base_uri)
+{
+  librdf_binary_parser_context* pcontext = (librdf_binary_parser_context*)context;
+
+  return librdf_parser_binary_new_stream(pcontext,
+                                         librdf_parser_binary_new_stream_context(pcontext, NULL, 0, string, length, NULL));
+}
+
+
+static int
+librdf_parser_binary_parse_counted_string_into_model(void *context,
+                                                     const unsigned char *string,
+                                                     size_t length,
+                                                     librdf_uri *base_uri,
+                                                     librdf_model *model)
+{
+  librdf_binary_parser_context* pcontext = (librdf_binary_parser_context*)context;
+
+  return librdf_parser_binary_add_to_model(librdf_parser_binary_new_stream_context(pcontext, NULL, 0, string, length, NULL),
+                                           model);
+}
+
+
+static librdf_stream*
+librdf_parser_binary_parse_iostream_as_stream(void *context,
+                                              raptor_iostream *iostream,
+                                              librdf_uri *base_uri)
+{
+  librdf_binary_parser_context* pcontext = (librdf_binary_parser_context*)context;
+
+  return librdf_parser_binary_new_stream(pcontext,
+                                         librdf_parser_binary_new_stream_context(pcontext, NULL, 0, NULL, 0, iostream));
+}
+
+
+static int
+librdf_parser_binary_parse_iostream_into_model(void *context,
+                                               raptor_iostream *iostream,
+                                               librdf_uri *base_uri,
+                                               librdf_model *model)
+{
+  librdf_binary_parser_context* pcontext = (librdf_binary_parser_context*)context;
+
+  return librdf_parser_binary_add_to_model(librdf_parser_binary_new_stream_context(pcontext, NULL, 0, NULL, 0, iostream),
+                                           model);
+}
+
+
+static void
+librdf_parser_binary_register_factory(librdf_parser_factory *factory)
+{
+  factory->context_length = sizeof(librdf_binary_parser_context);
+
+  factory->init  = librdf_parser_binary_init;
+  factory->terminate = librdf_parser_binary_terminate;
+
+  /* only file: URIs, via the parse_file methods */
+  factory->parse_file_as_stream = librdf_parser_binary_parse_file_as_stream;
+  factory->parse_file_into_model = librdf_parser_binary_parse_file_into_model;
+  factory->parse_file_handle_as_stream = librdf_parser_binary_parse_file_handle_as_stream;
+  factory->parse_file_handle_into_model = librdf_parser_binary_parse_file_handle_into_model;
+  factory->parse_counted_string_as_stream = librdf_parser_binary_parse_counted_string_as_stream;
+  factory->parse_counted_string_into_model = librdf_parser_binary_parse_counted_string_into_model;
+  factory->parse_iostream_as_stream = librdf_parser_binary_parse_iostream_as_stream;
+  factory->parse_iostream_into_model = librdf_parser_binary_parse_iostream_into_model;
+}
+
+
+/**
+ * librdf_parser_binary_constructor:
+ * @world: redland world object
+ *
+ * INTERNAL - Register the redland-binary parser.
+ *
+ **/
+void
+librdf_parser_binary_constructor(librdf_world *world)
+{
+  librdf_parser_register_factory(world, LIBRDF_BINARY_SYNTAX_NAME,
+                                 LIBRDF_BINARY_SYNTAX_LABEL,
+                                 LIBRDF_BINARY_MIME_TYPE, NULL,
+                                 &librdf_parser_binary_register_factory);
+}
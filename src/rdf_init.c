@@ -162,6 +162,8 @@ librdf_new_world(void)
   world->genid_base = 1;
 #endif
   world->genid_counter = 1;
+
+  world->query_cache_size = LIBRDF_QUERY_CACHE_SIZE;
   
 #ifdef MODULAR_LIBRDF
   world->ltdl_opened = !(lt_dlinit());
@@ -477,12 +479,15 @@ librdf_world_set_feature(librdf_world* world, librdf_uri* feature,
 {
   librdf_uri* genid_base;
   librdf_uri* genid_counter;
+  librdf_uri* query_cache_size;
   int rc= -1;
 
   genid_counter = librdf_new_uri(world,
                                  (const unsigned char*)LIBRDF_WORLD_FEATURE_GENID_COUNTER);
   genid_base = librdf_new_uri(world,
                               (const unsigned char*)LIBRDF_WORLD_FEATURE_GENID_BASE);
+  query_cache_size = librdf_new_uri(world,
+                                    (const unsigned char*)LIBRDF_WORLD_FEATURE_QUERY_CACHE_SIZE);
 
   if(librdf_uri_equals(feature, genid_base)) {
     if(!librdf_node_is_resource(value))
@@ -518,10 +523,22 @@ librdf_world_set_feature(librdf_world* world, librdf_uri* feature,
 #endif
       rc = 0;
     }
+  } else if(librdf_uri_equals(feature, query_cache_size)) {
+    if(!librdf_node_is_literal(value))
+      rc = 1;
+    else {
+      long size = atol((const char*)librdf_node_get_literal_value(value));
+      if(size < 0)
+        size = 0;
+
+      librdf_query_cache_resize(world, (int)size);
+      rc = 0;
+    }
   }
 
   librdf_free_uri(genid_base);
   librdf_free_uri(genid_counter);
+  librdf_free_uri(query_cache_size);
 
   return rc;
 }
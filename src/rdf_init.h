@@ -101,6 +101,15 @@ void* librdf_calloc_memory(size_t nmemb, size_t size);
  */
 #define LIBRDF_WORLD_FEATURE_GENID_COUNTER "http://feature.librdf.org/genid-counter"
 
+/**
+ * LIBRDF_WORLD_FEATURE_QUERY_CACHE_SIZE:
+ *
+ * World feature to set the number of parsed queries kept for reuse
+ * by librdf_new_query_from_cache().  The value is an integer literal,
+ * 0 disables the cache.
+ */
+#define LIBRDF_WORLD_FEATURE_QUERY_CACHE_SIZE "http://feature.librdf.org/query-cache-size"
+
 REDLAND_API
 librdf_node* librdf_world_get_feature(librdf_world* world, librdf_uri *feature);
 REDLAND_API
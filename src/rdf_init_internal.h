@@ -44,6 +44,8 @@ typedef struct rasqal_world_s rasqal_world;
 #endif
 #endif
 
+typedef struct librdf_raptor_bnode_map_s librdf_raptor_bnode_map;
+
 struct librdf_world_s
 {
   void *error_user_data;
@@ -83,6 +85,11 @@ struct librdf_world_s
   /* List of query factories */
   librdf_query_factory* query_factories;
 
+  /* Cache of parsed queries, most recently used first */
+  struct librdf_query_cache_entry_s* query_cache;
+  int query_cache_count;
+  int query_cache_size;
+
   /* List of digest factories */
   librdf_digest_factory *digests;
 
@@ -151,7 +158,7 @@ struct librdf_world_s
   int raptor_world_allocated_here;
 
   /* bnode id (raptor => internal) map during parsing */
-  librdf_hash *bnode_hash;
+  librdf_raptor_bnode_map *bnode_map;
 
   librdf_raptor_init_handler raptor_init_handler;
   void* raptor_init_handler_user_data;
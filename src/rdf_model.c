@@ -465,6 +465,28 @@ librdf_model_size(librdf_model* model)
 }
 
 
+/**
+ * librdf_model_get_modification_count:
+ * @model: #librdf_model object
+ *
+ * Get the number of modifications made to the model.
+ *
+ * The count changes whenever statements, contexts or sub-models are
+ * added or removed or a transaction is ended through the model API, so
+ * it can be used to tell if anything derived from the model is out of
+ * date.  Changes made directly to the underlying storage are not seen.
+ *
+ * Return value: modification count
+ **/
+unsigned long
+librdf_model_get_modification_count(librdf_model* model)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(model, librdf_model, 0);
+
+  return model->modification_count;
+}
+
+
 /**
  * librdf_model_add_statement:
  * @model: model object
@@ -494,6 +516,7 @@ librdf_model_add_statement(librdf_model* model, librdf_statement* statement)
   if(!librdf_statement_is_complete(statement))
     return 1;
 
+  model->modification_count++;
   return model->factory->add_statement(model, statement);
 }
 
@@ -520,6 +543,7 @@ librdf_model_add_statements(librdf_model* model, librdf_stream* statement_stream
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(model, librdf_model, 1);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement_stream, librdf_statement, 1);
 
+  model->modification_count++;
   return model->factory->add_statements(model, statement_stream);
 }
 
@@ -708,6 +732,7 @@ librdf_model_remove_statement(librdf_model* model, librdf_statement* statement)
   if(!librdf_statement_is_complete(statement))
     return 1;
 
+  model->modification_count++;
   return model->factory->remove_statement(model, statement);
 }
 
@@ -1020,6 +1045,7 @@ librdf_model_add_submodel(librdf_model* model, librdf_model* sub_model)
   if(librdf_list_add(l, sub_model))
     return 1;
   
+  model->modification_count++;
   return 0;
 }
 
@@ -1049,6 +1075,7 @@ librdf_model_remove_submodel(librdf_model* model, librdf_model* sub_model)
   if(!librdf_list_remove(l, sub_model))
     return 1;
   
+  model->modification_count++;
   return 0;
 }
 
@@ -1249,6 +1276,7 @@ librdf_model_context_add_statement(librdf_model* model,
     return 1;
   }
 
+  model->modification_count++;
   return model->factory->context_add_statement(model, context, statement);
 }
 
@@ -1285,8 +1313,10 @@ librdf_model_context_add_statements(librdf_model* model,
     return 1;
   }
 
-  if(model->factory->context_add_statements)
+  if(model->factory->context_add_statements) {
+    model->modification_count++;
     return model->factory->context_add_statements(model, context, stream);
+  }
 
   while(!librdf_stream_end(stream)) {
     librdf_statement* statement=librdf_stream_get_object(stream);
@@ -1335,6 +1365,7 @@ librdf_model_context_remove_statement(librdf_model* model,
     return 1;
   }
 
+  model->modification_count++;
   return model->factory->context_remove_statement(model, context, statement);
 }
 
@@ -1363,8 +1394,10 @@ librdf_model_context_remove_statements(librdf_model* model,
     return 1;
   }
 
-  if(model->factory->context_remove_statements)
+  if(model->factory->context_remove_statements) {
+    model->modification_count++;
     return model->factory->context_remove_statements(model, context);
+  }
 
   stream=librdf_model_context_as_stream(model, context);
   if(!stream)
@@ -1644,6 +1677,9 @@ librdf_model_set_feature(librdf_model* model, librdf_uri* feature,
  * If options is given then the match is made according to
  * the given options.  If options is NULL, this is equivalent
  * to librdf_model_find_statements_in_context.
+ *
+ * The "limit" option gives the most statements the caller will read
+ * so a storage may stop early; storages are free to ignore it.
  * 
  * Return value:  #librdf_stream of matching statements (may be empty) or NULL on failure
  **/
@@ -1661,6 +1697,8 @@ librdf_model_find_statements_with_options(librdf_model* model,
 
   if(model->factory->find_statements_with_options)
     return model->factory->find_statements_with_options(model, statement, context_node, options);
+  else if(!context_node)
+    return librdf_model_find_statements(model, statement);
   else
     return librdf_model_find_statements_in_context(model, statement, context_node);
 }
@@ -1851,8 +1889,10 @@ librdf_model_transaction_start_with_handle(librdf_model* model, void* handle)
 int
 librdf_model_transaction_commit(librdf_model* model) 
 {
-  if(model->factory->transaction_commit)
+  if(model->factory->transaction_commit) {
+    model->modification_count++;
     return model->factory->transaction_commit(model);
+  }
   else
     return 1;
 }
@@ -1869,8 +1909,10 @@ librdf_model_transaction_commit(librdf_model* model)
 int
 librdf_model_transaction_rollback(librdf_model* model) 
 {
-  if(model->factory->transaction_rollback)
+  if(model->factory->transaction_rollback) {
+    model->modification_count++;
     return model->factory->transaction_rollback(model);
+  }
   else
     return 1;
 }
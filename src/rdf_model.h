@@ -66,6 +66,8 @@ void librdf_free_model(librdf_model *model);
 /* functions / methods */
 REDLAND_API
 int librdf_model_size(librdf_model* model);
+REDLAND_API
+unsigned long librdf_model_get_modification_count(librdf_model* model);
 
 /* add statements */
 REDLAND_API
@@ -51,6 +51,9 @@ struct librdf_model_s {
   /* context : model implementation user data */
   void *context;
 
+  /* modification_count: bumped by every change made through the model API */
+  unsigned long modification_count;
+
   struct librdf_model_factory_s* factory;
 };
 
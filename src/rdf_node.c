@@ -1391,6 +1391,121 @@ librdf_node_write(librdf_node* node, raptor_iostream *iostr)
   return 0;
 }
 
+
+/*
+ * librdf_node_encoded_write:
+ * @buffer: node encoded by librdf_node_encode()
+ * @length: buffer size
+ * @size_p: pointer to store the size of the encoded node or NULL
+ * @iostr: iostream to write to or NULL to only check the encoding
+ *
+ * INTERNAL - Write an encoded node in N-Triples format without decoding it
+ *
+ * Writes the same as librdf_node_write() of the decoded node.
+ *
+ * Return value: non-0 on failure (bad encoding)
+ */
+int
+librdf_node_encoded_write(const unsigned char *buffer, size_t length,
+                          size_t *size_p, raptor_iostream *iostr)
+{
+  size_t header_length;
+  size_t string_length;
+  size_t datatype_uri_length = 0;
+  size_t language_length;
+  size_t total_length;
+  const unsigned char *p;
+
+  /* absolute minimum - first byte is type */
+  if(length < 1)
+    return 1;
+
+  switch(buffer[0]) {
+    case 'R': /* URI / Resource */
+    case 'B': /* RAPTOR_TERM_TYPE_BLANK */
+      if(length < 3)
+        return 1;
+
+      string_length = LIBRDF_GOOD_CAST(size_t, (buffer[1] << 8) | buffer[2]);
+      total_length = 3 + string_length + 1;
+      if(total_length > length)
+        return 1;
+
+      if(!iostr)
+        break;
+
+      if(buffer[0] == 'R') {
+        raptor_iostream_write_byte('<', iostr);
+        raptor_string_ntriples_write(buffer + 3, string_length, '>', iostr);
+        raptor_iostream_write_byte('>', iostr);
+      } else {
+        raptor_iostream_counted_string_write("_:", 2, iostr);
+        raptor_iostream_counted_string_write(buffer + 3, string_length, iostr);
+      }
+      break;
+
+    case 'L': /* Old encoding form for Literal */
+    case 'M': /* Literal for Redland 0.9.12+ */
+    case 'N': /* Literal for redland 1.0.5+ (long literal) */
+      if(buffer[0] == 'N') {
+        header_length = 8;
+        if(length < header_length)
+          return 1;
+        string_length = LIBRDF_GOOD_CAST(size_t, ((size_t)buffer[1] << 24) | ((size_t)buffer[2] << 16) | ((size_t)buffer[3] << 8) | buffer[4]);
+      } else {
+        header_length = 6;
+        if(length < header_length)
+          return 1;
+        if(buffer[0] == 'L')
+          string_length = LIBRDF_GOOD_CAST(size_t, (buffer[2] << 8) | buffer[3]);
+        else
+          string_length = LIBRDF_GOOD_CAST(size_t, (buffer[1] << 8) | buffer[2]);
+      }
+
+      /* the old encoding has no datatype URI */
+      if(buffer[0] != 'L')
+        datatype_uri_length = LIBRDF_GOOD_CAST(size_t, (buffer[header_length - 3] << 8) | buffer[header_length - 2]);
+      language_length = buffer[header_length - 1];
+
+      total_length = header_length + string_length + 1;
+      if(datatype_uri_length)
+        total_length += datatype_uri_length + 1;
+      if(language_length)
+        total_length += language_length + 1;
+      if(total_length > length)
+        return 1;
+
+      if(!iostr)
+        break;
+
+      p = buffer + header_length;
+      raptor_iostream_write_byte('"', iostr);
+      raptor_string_ntriples_write(p, string_length, '"', iostr);
+      raptor_iostream_write_byte('"', iostr);
+      p += string_length + 1;
+
+      if(language_length) {
+        raptor_iostream_write_byte('@', iostr);
+        raptor_iostream_counted_string_write(p + (datatype_uri_length ? datatype_uri_length + 1 : 0),
+                                             language_length, iostr);
+      }
+      if(datatype_uri_length) {
+        raptor_iostream_counted_string_write("^^<", 3, iostr);
+        raptor_string_ntriples_write(p, datatype_uri_length, '>', iostr);
+        raptor_iostream_write_byte('>', iostr);
+      }
+      break;
+
+    default:
+      return 1;
+  }
+
+  if(size_p)
+    *size_p = total_length;
+
+  return 0;
+}
+
 #endif /* STANDALONE */
 
 
@@ -80,6 +80,8 @@ struct librdf_node_s
 void librdf_init_node(librdf_world* world);
 void librdf_finish_node(librdf_world* world);
 
+int librdf_node_encoded_write(const unsigned char *buffer, size_t length, size_t *size_p, raptor_iostream *iostr);
+
 /* exported public in error but never usable */
 librdf_digest* librdf_node_get_digest(librdf_node* node);
 
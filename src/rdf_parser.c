@@ -53,6 +53,7 @@ void
 librdf_init_parser(librdf_world *world)
 {
   librdf_parser_raptor_constructor(world);
+  librdf_parser_binary_constructor(world);
 }
 
 
@@ -1048,6 +1049,598 @@ static const unsigned char *file_content[URI_STRING_COUNT] = {
   (const unsigned char*)TURTLE_CONTENT
 };
 
+/* Lines of the batching test, in runs of one graph */
+#define BATCH_TEST_LINES 600
+#define BATCH_TEST_RUN 100
+#define BATCH_TEST_GRAPHS 3
+
+
+static int
+test_count_stream(librdf_stream* stream)
+{
+  int count = 0;
+
+  if(!stream)
+    return -1;
+
+  for(; !librdf_stream_end(stream); librdf_stream_next(stream))
+    count++;
+  librdf_free_stream(stream);
+
+  return count;
+}
+
+
+/* Parse N-Quads switching graph every run of lines into a model with
+ * contexts, so statements are added in full batches and in batches cut
+ * short by a change of context.
+ */
+static int
+test_parse_batches(librdf_world* world, const char* program)
+{
+  librdf_storage* storage;
+  librdf_model* model;
+  librdf_parser* parser;
+  char* content;
+  size_t length = 0;
+  int failures = 0;
+  int i;
+
+  fprintf(stderr, "%s: Testing adding parsed statements in batches\n",
+          program);
+
+  parser = librdf_new_parser(world, "nquads", NULL, NULL);
+  if(!parser) {
+    fprintf(stderr, "%s: WARNING Failed to create new parser named 'nquads'\n",
+            program);
+    return 0;
+  }
+
+  storage = librdf_new_storage(world, "hashes", "test",
+                               "hash-type='memory',contexts='yes'");
+  model = storage ? librdf_new_model(world, storage, NULL) : NULL;
+  content = (char*)malloc(BATCH_TEST_LINES * 100);
+  if(!model || !content) {
+    fprintf(stderr, "%s: Failed to create model or content\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; i < BATCH_TEST_LINES; i++)
+    length += sprintf(content + length,
+                      "<http://example.org/s%d> <http://example.org/p> \"%d\" <http://example.org/g%d> .\n",
+                      i, i, (i / BATCH_TEST_RUN) % BATCH_TEST_GRAPHS);
+
+  if(librdf_parser_parse_counted_string_into_model(parser,
+                                                   (const unsigned char*)content,
+                                                   length, NULL, model)) {
+    fprintf(stderr, "%s: Failed to parse N-Quads into model\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  if(librdf_model_size(model) != BATCH_TEST_LINES) {
+    fprintf(stderr, "%s: Model size is %d triples, expected %d\n", program,
+            librdf_model_size(model), BATCH_TEST_LINES);
+    failures++;
+  }
+
+  for(i = 0; i < BATCH_TEST_GRAPHS; i++) {
+    char uri_string[40];
+    librdf_node* context;
+    int count;
+
+    sprintf(uri_string, "http://example.org/g%d", i);
+    context = librdf_new_node_from_uri_string(world,
+                                              (const unsigned char*)uri_string);
+    count = test_count_stream(librdf_model_context_as_stream(model, context));
+    librdf_free_node(context);
+    if(count != BATCH_TEST_LINES / BATCH_TEST_GRAPHS) {
+      fprintf(stderr, "%s: Graph %s has %d triples, expected %d\n", program,
+              uri_string, count, BATCH_TEST_LINES / BATCH_TEST_GRAPHS);
+      failures++;
+    }
+  }
+
+  tidy:
+  if(content)
+    free(content);
+  if(model)
+    librdf_free_model(model);
+  if(storage)
+    librdf_free_storage(storage);
+  librdf_free_parser(parser);
+
+  return failures;
+}
+
+
+/* The threaded parse test file is larger than one parse chunk, with
+ * each blank node used throughout it */
+#define THREADS_TEST_FILE "test-threads.nt"
+#define THREADS_TEST_LINES 30000
+#define THREADS_TEST_BNODES 1000
+#define THREADS_TEST_ERROR_LINE 25001
+
+
+/* line of the first error logged with a line number, or 0 */
+static int test_error_line;
+
+/* namespaces seen by the last test_parse_threads_file() parse */
+static int test_namespaces_count;
+
+
+static int REDLAND_CALLBACK_STDCALL
+test_log_handler(void *user_data, librdf_log_message *message)
+{
+  raptor_locator* locator;
+
+  if(librdf_log_message_level(message) != LIBRDF_LOG_ERROR || test_error_line)
+    return 1;
+
+  locator = librdf_log_message_locator(message);
+  if(locator && raptor_locator_line(locator) > 0)
+    test_error_line = raptor_locator_line(locator);
+  return 1;
+}
+
+
+static int
+test_write_threads_file(int error_line)
+{
+  FILE* fh;
+  int i;
+
+  fh = fopen(THREADS_TEST_FILE, "w");
+  if(!fh)
+    return 1;
+
+  for(i = 0; i < THREADS_TEST_LINES; i++) {
+    if(i + 1 == error_line)
+      fputs("this is not N-Triples\n", fh);
+    else
+      fprintf(fh, "_:b%d <http://example.org/property> \"value %d\" .\n",
+              i % THREADS_TEST_BNODES, i);
+  }
+
+  return fclose(fh) ? 1 : 0;
+}
+
+
+/* Parse a file of the given syntax into a model, or as a stream added
+ * to the model, with the given number of threads.
+ *
+ * Return value: number of the line of the first error, 0 if the
+ * parse succeeded or <0 if it failed without a line number
+ */
+static int
+test_parse_threads_file(librdf_world* world, const char* syntax,
+                        librdf_uri* uri, librdf_model* model, int threads,
+                        int as_stream)
+{
+  librdf_parser* parser;
+  int rc;
+
+  parser = librdf_new_parser(world, syntax, NULL, NULL);
+  if(!parser)
+    return -1;
+
+  if(threads > 1) {
+    librdf_uri* feature;
+    librdf_node* value;
+    char threads_string[10];
+
+    sprintf(threads_string, "%d", threads);
+    feature = librdf_new_uri(world, (const unsigned char*)LIBRDF_PARSER_FEATURE_THREADS);
+    value = librdf_new_node_from_literal(world,
+                                         (const unsigned char*)threads_string,
+                                         NULL, 0);
+    librdf_parser_set_feature(parser, feature, value);
+    librdf_free_node(value);
+    librdf_free_uri(feature);
+  }
+
+  test_error_line = 0;
+  if(as_stream) {
+    librdf_stream* stream;
+
+    stream = librdf_parser_parse_as_stream(parser, uri, NULL);
+    rc = stream ? 0 : 1;
+    if(stream) {
+      librdf_model_add_statements(model, stream);
+      librdf_free_stream(stream);
+    }
+  } else
+    rc = librdf_parser_parse_into_model(parser, uri, NULL, model);
+
+  test_namespaces_count = librdf_parser_get_namespaces_seen_count(parser);
+  librdf_free_parser(parser);
+
+  if(test_error_line)
+    return test_error_line;
+  return rc ? -1 : 0;
+}
+
+
+/* Check a model has the statements of the threads test file, with
+ * each blank node label giving the same node on every line.
+ */
+static int
+test_check_threads_model(librdf_world* world, librdf_model* model)
+{
+  librdf_node* predicate;
+  librdf_node* subjects[2];
+  librdf_iterator* iterator;
+  int lines[2] = { 0, THREADS_TEST_LINES - THREADS_TEST_BNODES };
+  int count = 0;
+  int failed = 0;
+  int i;
+
+  if(librdf_model_size(model) != THREADS_TEST_LINES)
+    return 1;
+
+  predicate = librdf_new_node_from_uri_string(world,
+                                              (const unsigned char*)"http://example.org/property");
+
+  /* the first and one of the last lines share a label */
+  for(i = 0; i < 2; i++) {
+    char value[20];
+    librdf_node* object;
+
+    sprintf(value, "value %d", lines[i]);
+    object = librdf_new_node_from_literal(world, (const unsigned char*)value,
+                                          NULL, 0);
+    subjects[i] = librdf_model_get_source(model, predicate, object);
+    librdf_free_node(object);
+  }
+
+  if(!subjects[0] || !subjects[1] ||
+     !librdf_node_is_blank(subjects[0]) ||
+     !librdf_node_equals(subjects[0], subjects[1]))
+    failed = 1;
+  else {
+    iterator = librdf_model_get_targets(model, subjects[0], predicate);
+    for(; iterator && !librdf_iterator_end(iterator);
+        librdf_iterator_next(iterator))
+      count++;
+    if(iterator)
+      librdf_free_iterator(iterator);
+    if(count != THREADS_TEST_LINES / THREADS_TEST_BNODES)
+      failed = 1;
+  }
+
+  for(i = 0; i < 2; i++) {
+    if(subjects[i])
+      librdf_free_node(subjects[i]);
+  }
+  librdf_free_node(predicate);
+
+  return failed;
+}
+
+
+/* Compare serial and threaded parses of an N-Triples file larger than
+ * one parse chunk, into a model and as a stream, and the line numbers
+ * of an error in a later chunk.
+ */
+static int
+test_parse_threads(librdf_world* world, const char* program)
+{
+  librdf_uri* uri;
+  int failures = 0;
+  int test;
+
+  fprintf(stderr, "%s: Testing parsing N-Triples on several threads\n",
+          program);
+
+  if(test_write_threads_file(0)) {
+    fprintf(stderr, "%s: Failed to write '%s'\n", program, THREADS_TEST_FILE);
+    return 1;
+  }
+  uri = librdf_new_uri_from_filename(world, THREADS_TEST_FILE);
+
+  librdf_world_set_logger(world, NULL, test_log_handler);
+
+  /* serial, threads into a model, threads as a stream */
+  for(test = 0; test < 3; test++) {
+    librdf_storage* storage;
+    librdf_model* model;
+    int rc;
+
+    storage = librdf_new_storage(world, "hashes", "test", "hash-type='memory'");
+    model = librdf_new_model(world, storage, NULL);
+    rc = test_parse_threads_file(world, "ntriples", uri, model,
+                                 test ? 4 : 1, test == 2);
+    if(rc || test_check_threads_model(world, model)) {
+      fprintf(stderr, "%s: Parse %d of '%s' returned %d with %d triples\n",
+              program, test, THREADS_TEST_FILE, rc, librdf_model_size(model));
+      failures++;
+    }
+    librdf_free_model(model);
+    librdf_free_storage(storage);
+  }
+
+  if(test_write_threads_file(THREADS_TEST_ERROR_LINE)) {
+    fprintf(stderr, "%s: Failed to write '%s'\n", program, THREADS_TEST_FILE);
+    failures++;
+  } else {
+    for(test = 0; test < 2; test++) {
+      librdf_storage* storage;
+      librdf_model* model;
+      int rc;
+
+      storage = librdf_new_storage(world, "hashes", "test", "hash-type='memory'");
+      model = librdf_new_model(world, storage, NULL);
+      rc = test_parse_threads_file(world, "ntriples", uri, model,
+                                   test ? 4 : 1, 0);
+      if(rc != THREADS_TEST_ERROR_LINE) {
+        fprintf(stderr, "%s: Parse %d of '%s' reported error line %d, expected %d\n",
+                program, test, THREADS_TEST_FILE, rc, THREADS_TEST_ERROR_LINE);
+        failures++;
+      }
+      librdf_free_model(model);
+      librdf_free_storage(storage);
+    }
+  }
+
+  librdf_world_set_logger(world, NULL, NULL);
+  librdf_free_uri(uri);
+  remove(THREADS_TEST_FILE);
+
+  return failures;
+}
+
+
+/* The pipeline test file is several pipeline chunks long.  Even lines
+ * use blank node labels like the identifiers raptor generates, odd
+ * lines anonymous blank nodes.
+ */
+#define PIPELINE_TEST_FILE "test-pipeline.ttl"
+#define PIPELINE_TEST_LINES 20000
+#define PIPELINE_TEST_BNODES 100
+#define PIPELINE_TEST_ERROR_LINE 15001
+
+
+static int
+test_write_pipeline_file(int error_line)
+{
+  FILE* fh;
+  int i;
+
+  fh = fopen(PIPELINE_TEST_FILE, "w");
+  if(!fh)
+    return 1;
+
+  fputs("@prefix ex: <http://example.org/> .\n", fh);
+  for(i = 0; i < PIPELINE_TEST_LINES; i++) {
+    if(i + 2 == error_line)
+      fputs("this is not Turtle .\n", fh);
+    else if(i % 2)
+      fprintf(fh, "[ ex:property \"value %d\" ] .\n", i);
+    else
+      fprintf(fh, "_:genid%d ex:property \"value %d\" .\n",
+              i % PIPELINE_TEST_BNODES, i);
+  }
+
+  return fclose(fh) ? 1 : 0;
+}
+
+
+/* Check a model has the statements of the pipeline test file, with
+ * each blank node label giving one node and no anonymous blank node
+ * the same as a labelled one.
+ */
+static int
+test_check_pipeline_model(librdf_world* world, librdf_model* model)
+{
+  librdf_node* predicate;
+  librdf_node* object;
+  librdf_node* subject;
+  librdf_statement* partial;
+  librdf_stream* stream;
+  int count = 0;
+
+  if(librdf_model_size(model) != PIPELINE_TEST_LINES)
+    return 1;
+
+  predicate = librdf_new_node_from_uri_string(world,
+                                              (const unsigned char*)"http://example.org/property");
+  object = librdf_new_node_from_literal(world, (const unsigned char*)"value 2",
+                                        NULL, 0);
+  subject = librdf_model_get_source(model, predicate, object);
+  librdf_free_node(object);
+  librdf_free_node(predicate);
+  if(!subject)
+    return 1;
+
+  partial = librdf_new_statement_from_nodes(world, subject, NULL, NULL);
+  stream = librdf_model_find_statements(model, partial);
+  count = test_count_stream(stream);
+  librdf_free_statement(partial);
+
+  return count != PIPELINE_TEST_LINES / PIPELINE_TEST_BNODES;
+}
+
+
+/* Compare serial and pipeline parses of a Turtle file, into a model
+ * and as a stream, the namespaces they see and the line numbers of an
+ * error in a later chunk.
+ */
+static int
+test_parse_pipeline(librdf_world* world, const char* program)
+{
+  librdf_uri* uri;
+  int failures = 0;
+  int test;
+
+  fprintf(stderr, "%s: Testing parsing Turtle on another thread\n", program);
+
+  if(test_write_pipeline_file(0)) {
+    fprintf(stderr, "%s: Failed to write '%s'\n", program, PIPELINE_TEST_FILE);
+    return 1;
+  }
+  uri = librdf_new_uri_from_filename(world, PIPELINE_TEST_FILE);
+
+  librdf_world_set_logger(world, NULL, test_log_handler);
+
+  /* serial, pipeline into a model, pipeline as a stream */
+  for(test = 0; test < 3; test++) {
+    librdf_storage* storage;
+    librdf_model* model;
+    int rc;
+
+    storage = librdf_new_storage(world, "hashes", "test", "hash-type='memory'");
+    model = librdf_new_model(world, storage, NULL);
+    rc = test_parse_threads_file(world, "turtle", uri, model,
+                                 test ? 2 : 1, test == 2);
+    if(rc || test_check_pipeline_model(world, model) ||
+       test_namespaces_count != 1) {
+      fprintf(stderr, "%s: Parse %d of '%s' returned %d with %d triples and %d namespaces\n",
+              program, test, PIPELINE_TEST_FILE, rc,
+              librdf_model_size(model), test_namespaces_count);
+      failures++;
+    }
+    librdf_free_model(model);
+    librdf_free_storage(storage);
+  }
+
+  if(test_write_pipeline_file(PIPELINE_TEST_ERROR_LINE)) {
+    fprintf(stderr, "%s: Failed to write '%s'\n", program, PIPELINE_TEST_FILE);
+    failures++;
+  } else {
+    for(test = 0; test < 2; test++) {
+      librdf_storage* storage;
+      librdf_model* model;
+      int rc;
+
+      storage = librdf_new_storage(world, "hashes", "test", "hash-type='memory'");
+      model = librdf_new_model(world, storage, NULL);
+      rc = test_parse_threads_file(world, "turtle", uri, model,
+                                   test ? 2 : 1, 0);
+      if(rc != PIPELINE_TEST_ERROR_LINE) {
+        fprintf(stderr, "%s: Parse %d of '%s' reported error line %d, expected %d\n",
+                program, test, PIPELINE_TEST_FILE, rc, PIPELINE_TEST_ERROR_LINE);
+        failures++;
+      }
+      librdf_free_model(model);
+      librdf_free_storage(storage);
+    }
+  }
+
+  librdf_world_set_logger(world, NULL, NULL);
+  librdf_free_uri(uri);
+  remove(PIPELINE_TEST_FILE);
+
+  return failures;
+}
+
+
+/* The mapped file test is many parse buffers long */
+#define MAPPED_TEST_FILE "test-mapped.ttl"
+#define MAPPED_TEST_LINES 2000
+
+
+/* Parse a Turtle file, which is read from a memory map where
+ * supported, into a model and as a stream and check both give the
+ * statements of parsing the same content from a string.
+ */
+static int
+test_parse_mapped(librdf_world* world, const char* program)
+{
+  librdf_storage* storages[3];
+  librdf_model* models[3];
+  librdf_parser* parser;
+  librdf_stream* stream;
+  librdf_uri* uri;
+  char* content;
+  size_t length = 0;
+  FILE* fh;
+  int failures = 0;
+  int i;
+
+  fprintf(stderr, "%s: Testing parsing a file from memory\n", program);
+
+  parser = librdf_new_parser(world, "turtle", NULL, NULL);
+  if(!parser) {
+    fprintf(stderr, "%s: WARNING Failed to create new parser named 'turtle'\n",
+            program);
+    return 0;
+  }
+
+  content = (char*)malloc(MAPPED_TEST_LINES * 100);
+  if(!content) {
+    librdf_free_parser(parser);
+    return 1;
+  }
+  for(i = 0; i < MAPPED_TEST_LINES; i++)
+    length += sprintf(content + length,
+                      "<http://example.org/s%d> <http://example.org/p> \"value %d\"@en .\n",
+                      i % 100, i);
+
+  fh = fopen(MAPPED_TEST_FILE, "w");
+  if(!fh || fwrite(content, 1, length, fh) != length || fclose(fh)) {
+    fprintf(stderr, "%s: Failed to write '%s'\n", program, MAPPED_TEST_FILE);
+    free(content);
+    librdf_free_parser(parser);
+    return 1;
+  }
+  uri = librdf_new_uri_from_filename(world, MAPPED_TEST_FILE);
+
+  for(i = 0; i < 3; i++) {
+    storages[i] = librdf_new_storage(world, "hashes", "test",
+                                     "hash-type='memory'");
+    models[i] = librdf_new_model(world, storages[i], NULL);
+  }
+
+  /* from a string, from the file into a model, from the file as a stream */
+  librdf_parser_parse_counted_string_into_model(parser,
+                                                (const unsigned char*)content,
+                                                length, uri, models[0]);
+  librdf_parser_parse_into_model(parser, uri, NULL, models[1]);
+  stream = librdf_parser_parse_as_stream(parser, uri, NULL);
+  if(stream) {
+    librdf_model_add_statements(models[2], stream);
+    librdf_free_stream(stream);
+  }
+
+  if(librdf_model_size(models[0]) != MAPPED_TEST_LINES) {
+    fprintf(stderr, "%s: Parsing the string returned %d triples, expected %d\n",
+            program, librdf_model_size(models[0]), MAPPED_TEST_LINES);
+    failures++;
+  }
+
+  for(i = 1; i < 3; i++) {
+    int missing = 0;
+
+    stream = librdf_model_as_stream(models[0]);
+    for(; !librdf_stream_end(stream); librdf_stream_next(stream)) {
+      if(!librdf_model_contains_statement(models[i],
+                                          librdf_stream_get_object(stream)))
+        missing++;
+    }
+    librdf_free_stream(stream);
+
+    if(librdf_model_size(models[i]) != MAPPED_TEST_LINES || missing) {
+      fprintf(stderr, "%s: Parse %d of '%s' returned %d triples, %d missing, expected %d\n",
+              program, i, MAPPED_TEST_FILE, librdf_model_size(models[i]),
+              missing, MAPPED_TEST_LINES);
+      failures++;
+    }
+  }
+
+  for(i = 0; i < 3; i++) {
+    librdf_free_model(models[i]);
+    librdf_free_storage(storages[i]);
+  }
+  librdf_free_uri(uri);
+  remove(MAPPED_TEST_FILE);
+  free(content);
+  librdf_free_parser(parser);
+
+  return failures;
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -1292,6 +1885,12 @@ main(int argc, char *argv[])
   }
 
 
+  failures += test_parse_batches(world, program);
+  failures += test_parse_threads(world, program);
+  failures += test_parse_pipeline(world, program);
+  failures += test_parse_mapped(world, program);
+
+
   fprintf(stderr, "%s: Freeing URIs\n", program);
   for (testi = 0; testi < URI_STRING_COUNT; testi++) {
     librdf_free_uri(uris[testi]);
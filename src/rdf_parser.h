@@ -101,6 +101,19 @@ librdf_uri_filter_func librdf_parser_get_uri_filter(librdf_parser* parser, void*
  */
 #define LIBRDF_PARSER_FEATURE_WARNING_COUNT "http://feature.librdf.org/parser-warning-count"
 
+/**
+ * LIBRDF_PARSER_FEATURE_THREADS:
+ *
+ * Parser feature URI string for the number of threads used to parse
+ * files, into a model or as a stream.  N-Triples and N-Quads are split
+ * between that many threads; other syntaxes are parsed on one other
+ * thread while the calling thread adds the statements.  The default of
+ * 1 parses on the calling thread.  Raptor options set on the parser
+ * apply to every thread.  Not used with a URI filter or compressed
+ * files.  Only used when built with thread support.
+ */
+#define LIBRDF_PARSER_FEATURE_THREADS "http://feature.librdf.org/parser-threads"
+
 REDLAND_API
 librdf_node* librdf_parser_get_feature(librdf_parser* parser, librdf_uri *feature);
 REDLAND_API
@@ -101,6 +101,7 @@ void librdf_init_parser(librdf_world *world);
 void librdf_finish_parser(librdf_world *world);
 
 void librdf_parser_raptor_constructor(librdf_world* world);
+void librdf_parser_binary_constructor(librdf_world* world);
 void librdf_parser_raptor_destructor(void);
 
 
@@ -39,6 +39,15 @@
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_SYS_STAT_H)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define LIBRDF_PARSER_RAPTOR_USE_MMAP 1
+#endif
 
 #include <redland.h>
 
@@ -63,9 +72,33 @@ typedef struct {
 
   raptor_www *www;              /* raptor stream */
   void *stream_context;         /* librdf_parser_raptor_stream_context* */
+
+  /* threads used to parse line-based syntaxes */
+  int threads;
+
+  /* raptor option values set with librdf_parser_set_feature() or
+   * NULL, for setting on the parsers of threads */
+  char* options[RAPTOR_OPTION_LAST + 1];
 } librdf_parser_raptor_context;
 
 
+/* Number of parsed statements added to a model at once */
+#define LIBRDF_PARSER_RAPTOR_BATCH_SIZE 256
+
+/* Initial number of slots of the pending statements ring buffer */
+#define LIBRDF_PARSER_RAPTOR_PENDING_SIZE 64
+
+/* Number of finished statements kept by a stream for reuse */
+#define LIBRDF_PARSER_RAPTOR_SPARE_SIZE 256
+
+#ifdef WITH_THREADS
+/* Most threads a parallel parse can use */
+#define LIBRDF_PARSER_RAPTOR_MAX_THREADS 64
+
+typedef struct librdf_parser_raptor_parallel_s librdf_parser_raptor_parallel;
+#endif
+
+
 typedef struct {
   librdf_parser_raptor_context* pcontext; /* parser context */
 
@@ -77,18 +110,64 @@ typedef struct {
   /* when finished */
   int finished;
 
+  /* when reading from a compressed file */
+  raptor_iostream *iostream;
+
+#ifdef LIBRDF_PARSER_RAPTOR_USE_MMAP
+  /* when reading from a file mapped into memory */
+  unsigned char *map;
+  size_t map_length;
+  size_t map_offset;
+#endif
+
   /* when storing into a model - librdf_parser_raptor_parse_uri_into_model */
   librdf_model *model;
 
   /* The set of statements pending is a sequence, with 'current'
-   * as the first entry and any remaining ones held in 'statements'.
-   * The latter are filled by the parser
-   * sequence is empty := current=NULL and librdf_list_size(statements)=0
+   * as the first entry and any remaining ones held in 'pending',
+   * a ring buffer of pending_size slots with pending_count statements
+   * starting at pending_head.  The latter are filled by the parser
+   * sequence is empty := current=NULL and pending_count=0
    */
   librdf_statement* current; /* current statement */
-  librdf_list* statements;
+  librdf_statement** pending;
+  int pending_size;
+  int pending_head;
+  int pending_count;
+
+  /* finished statements emptied of nodes, reused for parsed ones */
+  librdf_statement* spare[LIBRDF_PARSER_RAPTOR_SPARE_SIZE];
+  int spare_count;
+
+  /* when storing into a model, statements waiting to be added in one
+   * add_statements or context_add_statements call */
+  librdf_statement* batch[LIBRDF_PARSER_RAPTOR_BATCH_SIZE];
+  int batch_count;
+  /* context node of the batched statements or NULL */
+  librdf_node* batch_context;
+  /* non 0 after adding a batch to the model failed */
+  int batch_failed;
+
+#ifdef WITH_THREADS
+  /* when parsing on other threads */
+  librdf_parser_raptor_parallel* parallel;
+#endif
 } librdf_parser_raptor_stream_context;
 
+#ifdef WITH_THREADS
+static librdf_parser_raptor_parallel* librdf_parser_raptor_new_parallel(librdf_parser_raptor_context* pcontext, FILE *fh, librdf_uri *base_uri);
+static void librdf_parser_raptor_free_parallel(librdf_parser_raptor_parallel* parallel);
+static int librdf_parser_raptor_parallel_next_chunk(librdf_parser_raptor_stream_context* scontext);
+static int librdf_parser_raptor_can_parse_parallel(librdf_parser_raptor_context* pcontext);
+#endif
+
+
+/* stream over the statements of a batch */
+typedef struct {
+  librdf_parser_raptor_stream_context* scontext;
+  int offset;
+} librdf_parser_raptor_batch_stream_context;
+
 
 static int
 librdf_parser_raptor_relay_filter(void* user_data, raptor_uri* uri)
@@ -126,7 +205,7 @@ librdf_parser_raptor_init(librdf_parser *parser, void *context)
   if(!pcontext->rdf_parser)
     return 1;
 
-  librdf_raptor_reset_bnode_hash(parser->world);
+  librdf_raptor_reset_bnode_map(parser->world);
 
   return 0;
 }
@@ -143,8 +222,9 @@ static void
 librdf_parser_raptor_terminate(void *context)
 {
   librdf_parser_raptor_context* pcontext=(librdf_parser_raptor_context*)context;
+  int i;
 
-  librdf_raptor_free_bnode_hash(pcontext->parser->world);
+  librdf_raptor_reset_bnode_map(pcontext->parser->world);
   
   if(pcontext->stream_context)
     librdf_parser_raptor_serialise_finished(pcontext->stream_context);
@@ -159,6 +239,264 @@ librdf_parser_raptor_terminate(void *context)
     raptor_free_sequence(pcontext->nspace_prefixes);
   if(pcontext->nspace_uris)
     raptor_free_sequence(pcontext->nspace_uris);
+
+  for(i = 0; i <= RAPTOR_OPTION_LAST; i++) {
+    if(pcontext->options[i])
+      LIBRDF_FREE(char*, pcontext->options[i]);
+  }
+}
+
+
+static int
+librdf_parser_raptor_batch_end_of_stream(void* context)
+{
+  librdf_parser_raptor_batch_stream_context* bcontext=(librdf_parser_raptor_batch_stream_context*)context;
+
+  return bcontext->offset >= bcontext->scontext->batch_count;
+}
+
+
+static int
+librdf_parser_raptor_batch_next_statement(void* context)
+{
+  librdf_parser_raptor_batch_stream_context* bcontext=(librdf_parser_raptor_batch_stream_context*)context;
+
+  bcontext->offset++;
+  return bcontext->offset >= bcontext->scontext->batch_count;
+}
+
+
+static void*
+librdf_parser_raptor_batch_get_statement(void* context, int flags)
+{
+  librdf_parser_raptor_batch_stream_context* bcontext=(librdf_parser_raptor_batch_stream_context*)context;
+
+  if(bcontext->offset >= bcontext->scontext->batch_count)
+    return NULL;
+
+  switch(flags) {
+    case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      return bcontext->scontext->batch[bcontext->offset];
+
+    case LIBRDF_ITERATOR_GET_METHOD_GET_CONTEXT:
+      return bcontext->scontext->batch_context;
+
+    default:
+      return NULL;
+  }
+}
+
+
+static void
+librdf_parser_raptor_batch_finished(void* context)
+{
+  /* the batch stream context is owned by the caller */
+}
+
+
+/*
+ * librdf_parser_raptor_push_statement:
+ * @scontext: stream context
+ * @statement: parsed statement (ownership taken on success)
+ *
+ * INTERNAL - Append a statement to the pending ring buffer
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_push_statement(librdf_parser_raptor_stream_context* scontext,
+                                    librdf_statement* statement)
+{
+  if(scontext->pending_count == scontext->pending_size) {
+    librdf_statement** pending;
+    int size;
+    int i;
+
+    size=scontext->pending_size ? scontext->pending_size << 1 :
+                                  LIBRDF_PARSER_RAPTOR_PENDING_SIZE;
+    pending=LIBRDF_MALLOC(librdf_statement**, size * sizeof(*pending));
+    if(!pending)
+      return 1;
+
+    /* unwrap the ring into the start of the new buffer */
+    for(i=0; i < scontext->pending_count; i++)
+      pending[i]=scontext->pending[(scontext->pending_head + i) % scontext->pending_size];
+
+    if(scontext->pending)
+      LIBRDF_FREE(librdf_statement**, scontext->pending);
+    scontext->pending=pending;
+    scontext->pending_size=size;
+    scontext->pending_head=0;
+  }
+
+  scontext->pending[(scontext->pending_head + scontext->pending_count) % scontext->pending_size]=statement;
+  scontext->pending_count++;
+
+  return 0;
+}
+
+
+/*
+ * librdf_parser_raptor_pop_statement:
+ * @scontext: stream context
+ *
+ * INTERNAL - Remove the first statement from the pending ring buffer
+ *
+ * Return value: statement or NULL if none are pending
+ */
+static librdf_statement*
+librdf_parser_raptor_pop_statement(librdf_parser_raptor_stream_context* scontext)
+{
+  librdf_statement* statement;
+
+  if(!scontext->pending_count)
+    return NULL;
+
+  statement=scontext->pending[scontext->pending_head];
+  scontext->pending_head=(scontext->pending_head + 1) % scontext->pending_size;
+  scontext->pending_count--;
+
+  return statement;
+}
+
+
+/*
+ * librdf_parser_raptor_release_statement:
+ * @scontext: stream context
+ * @statement: finished statement
+ *
+ * INTERNAL - Free a statement or keep it for reuse
+ *
+ * A statement still shared by a user of the stream is freed, which
+ * only drops this reference.
+ */
+static void
+librdf_parser_raptor_release_statement(librdf_parser_raptor_stream_context* scontext,
+                                       librdf_statement* statement)
+{
+  if(statement->usage == 1 &&
+     scontext->spare_count < LIBRDF_PARSER_RAPTOR_SPARE_SIZE) {
+    librdf_statement_clear(statement);
+    scontext->spare[scontext->spare_count++]=statement;
+  } else
+    librdf_free_statement(statement);
+}
+
+
+/*
+ * librdf_parser_raptor_clear_batch:
+ * @scontext: stream context
+ *
+ * INTERNAL - Free the batched statements without adding them
+ */
+static void
+librdf_parser_raptor_clear_batch(librdf_parser_raptor_stream_context* scontext)
+{
+  int i;
+
+  for(i=0; i < scontext->batch_count; i++)
+    librdf_parser_raptor_release_statement(scontext, scontext->batch[i]);
+  scontext->batch_count=0;
+
+  if(scontext->batch_context) {
+    librdf_free_node(scontext->batch_context);
+    scontext->batch_context=NULL;
+  }
+}
+
+
+/*
+ * librdf_parser_raptor_flush_batch:
+ * @scontext: stream context
+ *
+ * INTERNAL - Add the batched statements to the model in one call
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_flush_batch(librdf_parser_raptor_stream_context* scontext)
+{
+  librdf_world* world=scontext->pcontext->parser->world;
+  librdf_parser_raptor_batch_stream_context bcontext;
+  librdf_stream* stream;
+  int rc;
+
+  if(!scontext->batch_count)
+    return 0;
+
+  bcontext.scontext=scontext;
+  bcontext.offset=0;
+
+  stream=librdf_new_stream(world, &bcontext,
+                           &librdf_parser_raptor_batch_end_of_stream,
+                           &librdf_parser_raptor_batch_next_statement,
+                           &librdf_parser_raptor_batch_get_statement,
+                           &librdf_parser_raptor_batch_finished);
+  if(!stream)
+    rc=1;
+  else {
+    if(scontext->batch_context)
+      rc=librdf_model_context_add_statements(scontext->model,
+                                             scontext->batch_context, stream);
+    else
+      rc=librdf_model_add_statements(scontext->model, stream);
+    librdf_free_stream(stream);
+  }
+
+  librdf_parser_raptor_clear_batch(scontext);
+
+  if(rc) {
+    scontext->batch_failed=1;
+    librdf_log(world,
+               0, LIBRDF_LOG_FATAL, LIBRDF_FROM_PARSER, NULL,
+               "Cannot add statements to model");
+  }
+
+  return rc;
+}
+
+
+/*
+ * librdf_parser_raptor_add_to_batch:
+ * @scontext: stream context
+ * @statement: statement to add to the model (ownership taken)
+ * @context_node: statement context node or NULL (ownership taken)
+ *
+ * INTERNAL - Queue a parsed statement for adding to the model
+ *
+ * Once adding a batch has failed, further statements are dropped.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_add_to_batch(librdf_parser_raptor_stream_context* scontext,
+                                  librdf_statement* statement,
+                                  librdf_node* context_node)
+{
+  /* a batch holds statements of one context only */
+  if(scontext->batch_count &&
+     !(context_node ? (scontext->batch_context &&
+                       librdf_node_equals(context_node, scontext->batch_context))
+                    : !scontext->batch_context))
+    librdf_parser_raptor_flush_batch(scontext);
+
+  if(scontext->batch_failed) {
+    librdf_parser_raptor_release_statement(scontext, statement);
+    if(context_node)
+      librdf_free_node(context_node);
+    return 1;
+  }
+
+  if(!scontext->batch_count)
+    scontext->batch_context=context_node;
+  else if(context_node)
+    librdf_free_node(context_node);
+
+  scontext->batch[scontext->batch_count++]=statement;
+  if(scontext->batch_count == LIBRDF_PARSER_RAPTOR_BATCH_SIZE)
+    return librdf_parser_raptor_flush_batch(scontext);
+
+  return 0;
 }
 
 
@@ -179,14 +517,23 @@ librdf_parser_raptor_new_statement_handler(void *context,
   librdf_world* world=scontext->pcontext->parser->world;
   int rc;
 
-  statement=librdf_new_statement(world);
-  if(!statement)
+  /* the parse is being aborted */
+  if(scontext->batch_failed)
     return;
 
-  if(rstatement->subject->type == RAPTOR_TERM_TYPE_BLANK) {
-    node = librdf_new_node_from_blank_identifier(world, (const unsigned char*)rstatement->subject->value.blank.string);
-  } else if (rstatement->subject->type == RAPTOR_TERM_TYPE_URI) {
-    node = librdf_new_node_from_uri(world, (librdf_uri*)rstatement->subject->value.uri);
+  if(scontext->spare_count)
+    statement=scontext->spare[--scontext->spare_count];
+  else {
+    statement=librdf_new_statement(world);
+    if(!statement)
+      return;
+  }
+
+  /* librdf nodes are raptor terms so share the parser's subject,
+   * predicate and URI or blank object terms rather than copying them */
+  if(rstatement->subject->type == RAPTOR_TERM_TYPE_BLANK ||
+     rstatement->subject->type == RAPTOR_TERM_TYPE_URI) {
+    node = raptor_term_copy(rstatement->subject);
   } else {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
@@ -208,7 +555,7 @@ librdf_parser_raptor_new_statement_handler(void *context,
 
 
   if(rstatement->predicate->type == RAPTOR_TERM_TYPE_URI) {
-    node = librdf_new_node_from_uri(world, (librdf_uri*)rstatement->predicate->value.uri);
+    node = raptor_term_copy(rstatement->predicate);
   } else {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
@@ -233,10 +580,9 @@ librdf_parser_raptor_new_statement_handler(void *context,
                                               rstatement->object->value.literal.string,
                                               (const char *)rstatement->object->value.literal.language,
                                               (librdf_uri*)rstatement->object->value.literal.datatype);
-  } else if(rstatement->object->type == RAPTOR_TERM_TYPE_BLANK) {
-    node = librdf_new_node_from_blank_identifier(world, rstatement->object->value.blank.string);
-  } else if(rstatement->object->type == RAPTOR_TERM_TYPE_URI) {
-    node = librdf_new_node_from_uri(world, (librdf_uri*)rstatement->object->value.uri);
+  } else if(rstatement->object->type == RAPTOR_TERM_TYPE_BLANK ||
+            rstatement->object->type == RAPTOR_TERM_TYPE_URI) {
+    node = raptor_term_copy(rstatement->object);
   } else {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
@@ -266,23 +612,21 @@ librdf_parser_raptor_new_statement_handler(void *context,
 #endif
 
   if(scontext->model) {
+    node=NULL;
     if(librdf_model_supports_contexts(scontext->model) &&
        rstatement->graph &&
        (rstatement->graph->type == RAPTOR_TERM_TYPE_URI ||
-        rstatement->graph->type == RAPTOR_TERM_TYPE_BLANK)) {
+        rstatement->graph->type == RAPTOR_TERM_TYPE_BLANK))
       node = librdf_new_node_from_uri(world, (librdf_uri*)rstatement->graph->value.uri);
-      rc = librdf_model_context_add_statement(scontext->model, node, statement);
-      librdf_free_node(node);
-    } else {
-      rc = librdf_model_add_statement(scontext->model, statement);
-    }
-    librdf_free_statement(statement);
-  } else {
-    rc=librdf_list_add(scontext->statements, statement);
-    if(rc)
-      librdf_free_statement(statement);
+
+    if(librdf_parser_raptor_add_to_batch(scontext, statement, node))
+      raptor_parser_parse_abort(scontext->pcontext->rdf_parser);
+    return;
   }
+
+  rc=librdf_parser_raptor_push_statement(scontext, statement);
   if(rc) {
+    librdf_free_statement(statement);
     librdf_log(world,
                0, LIBRDF_LOG_FATAL, LIBRDF_FROM_PARSER, NULL,
                "Cannot add statement to model");
@@ -291,27 +635,23 @@ librdf_parser_raptor_new_statement_handler(void *context,
 
 
 /*
- * librdf_parser_raptor_namespace_handler - helper callback function for raptor RDF when a namespace is seen
- * @context: context for callback
- * @statement: raptor_statement
+ * librdf_parser_raptor_add_namespace:
+ * @pcontext: parser context
+ * @uri: namespace URI (not owned)
+ * @prefix: namespace prefix or NULL
+ * @prefix_length: length of @prefix
  *
- * Adds the statement to the list of statements.
+ * INTERNAL - Record a namespace seen by the parse unless its URI was seen
  */
 static void
-librdf_parser_raptor_namespace_handler(void* user_data,
-                                       raptor_namespace *nspace)
+librdf_parser_raptor_add_namespace(librdf_parser_raptor_context* pcontext,
+                                   librdf_uri* uri,
+                                   const unsigned char* prefix,
+                                   size_t prefix_length)
 {
-  librdf_parser_raptor_context* pcontext=(librdf_parser_raptor_context*)user_data;
-  const unsigned char* prefix;
   unsigned char* nprefix;
-  size_t prefix_length;
-  librdf_uri* uri;
   int i;
 
-  uri=(librdf_uri*)raptor_namespace_get_uri(nspace);
-  if(!uri)
-    return;
-
   for(i=0; i < raptor_sequence_size(pcontext->nspace_uris); i++) {
     librdf_uri* u=(librdf_uri*)raptor_sequence_get_at(pcontext->nspace_uris, i);
     if(librdf_uri_equals(uri, u))
@@ -322,7 +662,6 @@ librdf_parser_raptor_namespace_handler(void* user_data,
   uri=librdf_new_uri_from_uri(uri);
   raptor_sequence_push(pcontext->nspace_uris, uri);
 
-  prefix=raptor_namespace_get_counted_prefix(nspace, &prefix_length);
   if(prefix) {
     nprefix = LIBRDF_MALLOC(unsigned char*, prefix_length + 1);
     /* FIXME: what if nprefix alloc failed? now just pushes NULL to sequence */
@@ -334,14 +673,59 @@ librdf_parser_raptor_namespace_handler(void* user_data,
 }
 
 
-/* FIXME: Yeah?  What about it? */
-#define RAPTOR_IO_BUFFER_LEN 1024
+/*
+ * librdf_parser_raptor_namespace_handler - helper callback function for raptor RDF when a namespace is seen
+ * @context: context for callback
+ * @statement: raptor_statement
+ *
+ * Adds the statement to the list of statements.
+ */
+static void
+librdf_parser_raptor_namespace_handler(void* user_data,
+                                       raptor_namespace *nspace)
+{
+  librdf_parser_raptor_context* pcontext=(librdf_parser_raptor_context*)user_data;
+  const unsigned char* prefix;
+  size_t prefix_length;
+  librdf_uri* uri;
+
+  uri=(librdf_uri*)raptor_namespace_get_uri(nspace);
+  if(!uri)
+    return;
+
+  prefix=raptor_namespace_get_counted_prefix(nspace, &prefix_length);
+  librdf_parser_raptor_add_namespace(pcontext, uri, prefix, prefix_length);
+}
+
+
+/* Size of the file chunks parsed at a time.  On the calling thread
+ * the statements found in a chunk wait in the stream context until
+ * they are read, so this bounds how far parsing runs ahead of the
+ * stream consumer.
+ */
+#define RAPTOR_IO_BUFFER_LEN 8192
+
+
+/* if all of the file or compressed file input has been read */
+static int
+librdf_parser_raptor_input_eof(librdf_parser_raptor_stream_context *context)
+{
+  if(context->iostream)
+    return raptor_iostream_read_eof(context->iostream);
+
+  return feof(context->fh);
+}
 
 
 /*
  * librdf_parser_raptor_get_next_statement - helper function to get the next statement
  * @context: serialisation context
  *
+ * Without parser threads, parsing and the consumer of the stream take
+ * turns on the calling thread: another chunk is only parsed once all
+ * the statements of the previous one have been read.  With threads,
+ * statements are taken from chunks parsed ahead by the threads.
+ *
  * Return value: >0 if a statement found, 0 at end of file, or <0 on error
  */
 static int
@@ -353,11 +737,70 @@ librdf_parser_raptor_get_next_statement(librdf_parser_raptor_stream_context *con
     return 0;
 
   context->current=NULL;
-  while(!feof(context->fh)) {
+
+#ifdef WITH_THREADS
+  if(context->parallel) {
+    /* take parsed chunks until one has statements */
+    while(!context->pending_count) {
+      status = librdf_parser_raptor_parallel_next_chunk(context);
+      if(status <= 0)
+        break;
+    }
+
+    if(context->pending_count) {
+      context->current=librdf_parser_raptor_pop_statement(context);
+      status=1;
+    } else
+      context->finished=1;
+
+    return status;
+  }
+#endif
+
+#ifdef LIBRDF_PARSER_RAPTOR_USE_MMAP
+  if(context->map) {
+    /* parse slices of the mapped file in place */
+    while(context->map_offset < context->map_length) {
+      size_t len = context->map_length - context->map_offset;
+      int ret;
+
+      if(len > RAPTOR_IO_BUFFER_LEN)
+        len = RAPTOR_IO_BUFFER_LEN;
+
+      ret = raptor_parser_parse_chunk(context->pcontext->rdf_parser,
+                                      context->map + context->map_offset, len,
+                                      (context->map_offset + len == context->map_length));
+      context->map_offset += len;
+
+      if(ret) {
+        status=(-1);
+        break; /* failed and done */
+      }
+
+      /* parsing found at least 1 statement, return */
+      if(context->pending_count) {
+        context->current=librdf_parser_raptor_pop_statement(context);
+        status=1;
+        break;
+      }
+    }
+
+    if(context->map_offset == context->map_length || status <1)
+      context->finished=1;
+
+    return status;
+  }
+#endif
+
+  while(!librdf_parser_raptor_input_eof(context)) {
     size_t len;
     int ret;
 
-    len = fread(buffer, 1, RAPTOR_IO_BUFFER_LEN, context->fh);
+    if(context->iostream)
+      len = (size_t)raptor_iostream_read_bytes(buffer, 1, RAPTOR_IO_BUFFER_LEN,
+                                               context->iostream);
+    else
+      len = fread(buffer, 1, RAPTOR_IO_BUFFER_LEN, context->fh);
     ret = raptor_parser_parse_chunk(context->pcontext->rdf_parser, buffer, len,
                                     (len < RAPTOR_IO_BUFFER_LEN));
 
@@ -367,8 +810,8 @@ librdf_parser_raptor_get_next_statement(librdf_parser_raptor_stream_context *con
     }
 
     /* parsing found at least 1 statement, return */
-    if(librdf_list_size(context->statements)) {
-      context->current=(librdf_statement*)librdf_list_pop(context->statements);
+    if(context->pending_count) {
+      context->current=librdf_parser_raptor_pop_statement(context);
       status=1;
       break;
     }
@@ -377,40 +820,133 @@ librdf_parser_raptor_get_next_statement(librdf_parser_raptor_stream_context *con
       break;
   }
 
-  if(feof(context->fh) || status <1)
+  if(librdf_parser_raptor_input_eof(context) || status <1)
     context->finished=1;
 
   return status;
 }
 
 
+#ifdef LIBRDF_PARSER_RAPTOR_USE_MMAP
+
+/* Size of the slices of a mapped file parsed at a time into a model */
+#define LIBRDF_PARSER_RAPTOR_MAP_SLICE_SIZE (4 * 1024 * 1024)
+
 /*
- * librdf_parser_raptor_parse_file_handle_as_stream:
- * @context: parser context
- * @fh: FILE* of content source
- * @close_fh: if true to fclose(fh) on finish
- * @base_uri: #librdf_uri URI of the content location
+ * librdf_parser_raptor_map_file:
+ * @fh: file handle
+ * @length_p: address to store the mapped length
  *
- * Retrieve content from FILE* @fh and parse it into a #librdf_stream.
+ * INTERNAL - Map a regular file into memory for reading
  *
- **/
-static librdf_stream*
-librdf_parser_raptor_parse_file_handle_as_stream(void *context,
-                                                 FILE *fh, int close_fh,
-                                                 librdf_uri *base_uri)
+ * Only a file handle that has not been read from yet is mapped, so
+ * pipes, terminals and partly read files use stdio.
+ *
+ * Return value: mapped file or NULL if it cannot be mapped
+ */
+static unsigned char*
+librdf_parser_raptor_map_file(FILE *fh, size_t *length_p)
 {
-  librdf_parser_raptor_context* pcontext=(librdf_parser_raptor_context*)context;
-  librdf_parser_raptor_stream_context* scontext;
-  librdf_stream *stream;
-  int rc;
-  int need_base_uri;
-  const raptor_syntax_description *desc;
+  struct stat st;
+  void *map;
+  size_t length;
 
-  librdf_world_open(pcontext->parser->world);
+  if(ftell(fh) != 0)
+    return NULL;
 
-  desc = raptor_parser_get_description(pcontext->rdf_parser);
-  if(!desc) {
-    librdf_log(pcontext->parser->world,
+  if(fstat(fileno(fh), &st) || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    return NULL;
+
+  length = (size_t)st.st_size;
+  if((off_t)length != st.st_size)
+    return NULL;
+
+  map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(fh), 0);
+  if(map == MAP_FAILED)
+    return NULL;
+
+#ifdef HAVE_MADVISE
+  madvise(map, length, MADV_SEQUENTIAL);
+#endif
+
+  *length_p = length;
+  return (unsigned char*)map;
+}
+
+
+/*
+ * librdf_parser_raptor_parse_mapped_file:
+ * @pcontext: parser context
+ * @fh: file handle
+ * @base_uri: base URI or NULL
+ * @status_p: address to store the parse status
+ *
+ * INTERNAL - Parse a whole file from memory if it can be mapped
+ *
+ * Return value: non 0 if the file was mapped and parsed
+ */
+static int
+librdf_parser_raptor_parse_mapped_file(librdf_parser_raptor_context* pcontext,
+                                       FILE *fh, librdf_uri *base_uri,
+                                       int *status_p)
+{
+  unsigned char *map;
+  size_t length = 0;
+  size_t offset;
+  int status;
+
+  map = librdf_parser_raptor_map_file(fh, &length);
+  if(!map)
+    return 0;
+
+  status = raptor_parser_parse_start(pcontext->rdf_parser, (raptor_uri*)base_uri);
+  for(offset = 0; !status && offset < length; ) {
+    size_t len = length - offset;
+
+    if(len > LIBRDF_PARSER_RAPTOR_MAP_SLICE_SIZE)
+      len = LIBRDF_PARSER_RAPTOR_MAP_SLICE_SIZE;
+
+    status = raptor_parser_parse_chunk(pcontext->rdf_parser, map + offset, len,
+                                       (offset + len == length));
+    offset += len;
+  }
+
+  munmap(map, length);
+
+  *status_p = status;
+  return 1;
+}
+
+#endif
+
+
+/*
+ * librdf_parser_raptor_parse_file_handle_as_stream:
+ * @context: parser context
+ * @fh: FILE* of content source
+ * @close_fh: if true to fclose(fh) on finish
+ * @base_uri: #librdf_uri URI of the content location
+ *
+ * Retrieve content from FILE* @fh and parse it into a #librdf_stream.
+ *
+ **/
+static librdf_stream*
+librdf_parser_raptor_parse_file_handle_as_stream(void *context,
+                                                 FILE *fh, int close_fh,
+                                                 librdf_uri *base_uri)
+{
+  librdf_parser_raptor_context* pcontext=(librdf_parser_raptor_context*)context;
+  librdf_parser_raptor_stream_context* scontext;
+  librdf_stream *stream;
+  int rc;
+  int need_base_uri;
+  const raptor_syntax_description *desc;
+
+  librdf_world_open(pcontext->parser->world);
+
+  desc = raptor_parser_get_description(pcontext->rdf_parser);
+  if(!desc) {
+    librdf_log(pcontext->parser->world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
                "Could not get description for %s parser",
                pcontext->parser_name);
@@ -438,10 +974,6 @@ librdf_parser_raptor_parse_file_handle_as_stream(void *context,
   scontext->pcontext=pcontext;
   pcontext->stream_context=scontext;
 
-  scontext->statements=librdf_new_list(pcontext->parser->world);
-  if(!scontext->statements)
-    goto oom;
-
   if(pcontext->nspace_prefixes)
     raptor_free_sequence(pcontext->nspace_prefixes);
   pcontext->nspace_prefixes=raptor_new_sequence(free, NULL);
@@ -463,6 +995,21 @@ librdf_parser_raptor_parse_file_handle_as_stream(void *context,
 
   scontext->fh=fh;
   scontext->close_fh=close_fh;
+  if(librdf_raptor_get_file_compression(fh) != LIBRDF_COMPRESSION_NONE) {
+    scontext->iostream=librdf_new_iostream_from_compressed_file_handle(pcontext->parser->world, fh);
+    if(!scontext->iostream)
+      goto oom;
+  }
+#ifdef WITH_THREADS
+  else if(librdf_parser_raptor_can_parse_parallel(pcontext) &&
+          (scontext->parallel=librdf_parser_raptor_new_parallel(pcontext, fh, base_uri))) {
+    /* parsed on other threads */
+  }
+#endif
+#ifdef LIBRDF_PARSER_RAPTOR_USE_MMAP
+  else
+    scontext->map=librdf_parser_raptor_map_file(fh, &scontext->map_length);
+#endif
 
   if(pcontext->parser->uri_filter)
     raptor_parser_set_uri_filter(pcontext->rdf_parser,
@@ -474,7 +1021,7 @@ librdf_parser_raptor_parse_file_handle_as_stream(void *context,
 
   rc = raptor_parser_parse_start(pcontext->rdf_parser, (raptor_uri*)base_uri);
   if(!rc) {
-    /* start parsing; initialises scontext->statements, scontext->current */
+    /* start parsing; initialises scontext->pending, scontext->current */
     librdf_parser_raptor_get_next_statement(scontext);
 
     stream=librdf_new_stream(pcontext->parser->world,
@@ -605,10 +1152,6 @@ librdf_parser_raptor_parse_as_stream_common(void *context, librdf_uri *uri,
   scontext->pcontext=pcontext;
   pcontext->stream_context=scontext;
 
-  scontext->statements=librdf_new_list(pcontext->parser->world);
-  if(!scontext->statements)
-    goto oom;
-
   if(pcontext->nspace_prefixes)
     raptor_free_sequence(pcontext->nspace_prefixes);
   pcontext->nspace_prefixes=raptor_new_sequence(free, NULL);
@@ -627,190 +1170,1191 @@ librdf_parser_raptor_parse_as_stream_common(void *context, librdf_uri *uri,
   raptor_parser_set_namespace_handler(pcontext->rdf_parser, pcontext,
                                       librdf_parser_raptor_namespace_handler);
 
-  if(pcontext->parser->uri_filter)
-    raptor_parser_set_uri_filter(pcontext->rdf_parser,
-                                 librdf_parser_raptor_relay_filter,
-                                 pcontext->parser);
+  if(pcontext->parser->uri_filter)
+    raptor_parser_set_uri_filter(pcontext->rdf_parser,
+                                 librdf_parser_raptor_relay_filter,
+                                 pcontext->parser);
+
+  if(uri) {
+    const char *accept_h;
+
+    if(pcontext->www)
+      raptor_free_www(pcontext->www);
+
+    pcontext->www = raptor_new_www(pcontext->parser->world->raptor_world_ptr);
+    if(!pcontext->www)
+      goto oom;
+
+    accept_h=raptor_parser_get_accept_header(pcontext->rdf_parser);
+    if(accept_h) {
+      raptor_www_set_http_accept(pcontext->www, accept_h);
+      raptor_free_memory((void*)accept_h);
+    }
+
+    raptor_www_set_write_bytes_handler(pcontext->www,
+                                       librdf_parser_raptor_parse_uri_as_stream_write_bytes_handler,
+                                       scontext);
+
+    status = raptor_parser_parse_start(pcontext->rdf_parser, (raptor_uri*)base_uri);
+    if(status) {
+      raptor_free_www(pcontext->www);
+
+      pcontext->www = NULL;
+      librdf_parser_raptor_serialise_finished((void*)scontext);
+      return NULL;
+    }
+
+    raptor_www_fetch(pcontext->www, (raptor_uri*)uri);
+    raptor_parser_parse_chunk(pcontext->rdf_parser, NULL, 0, 1);
+
+    raptor_free_www(pcontext->www);
+
+    pcontext->www = NULL;
+  } else if (string) {
+    status = raptor_parser_parse_start(pcontext->rdf_parser,
+                                       (raptor_uri*)base_uri);
+    if(status) {
+      librdf_parser_raptor_serialise_finished((void*)scontext);
+      return NULL;
+    }
+
+    if(!length)
+      length = strlen((const char*)string);
+
+    raptor_parser_parse_chunk(pcontext->rdf_parser, string, length, 1);
+  } else if (iostream) {
+    status = raptor_parser_parse_start(pcontext->rdf_parser, (raptor_uri*)base_uri);
+    if(status) {
+      librdf_parser_raptor_serialise_finished((void*)scontext);
+      return NULL;
+    }
+
+    status = raptor_parser_parse_iostream(pcontext->rdf_parser,
+                                          iostream,
+                                          (raptor_uri*)base_uri);
+    if(status) {
+      librdf_parser_raptor_serialise_finished((void*)scontext);
+      return NULL;
+    }
+  } else {
+    /* All three of URI, string and iostream are null.  That's a coding error. */
+    librdf_parser_raptor_serialise_finished((void*)scontext);
+    return NULL;
+  }
+
+
+  /* get first statement, else is empty */
+  scontext->current=librdf_parser_raptor_pop_statement(scontext);
+
+  stream=librdf_new_stream(pcontext->parser->world,
+                           (void*)scontext,
+                           &librdf_parser_raptor_serialise_end_of_stream,
+                           &librdf_parser_raptor_serialise_next_statement,
+                           &librdf_parser_raptor_serialise_get_statement,
+                           &librdf_parser_raptor_serialise_finished);
+  if(!stream)
+    goto oom;
+
+  return stream;
+
+  /* Clean up and report an error on OOM */
+  oom:
+  librdf_parser_raptor_serialise_finished((void*)scontext);
+  librdf_log(pcontext->parser->world,
+             0, LIBRDF_LOG_FATAL, LIBRDF_FROM_PARSER, NULL,
+             "Out of memory");
+  return NULL;
+}
+
+
+/**
+ * librdf_parser_raptor_parse_uri_as_stream:
+ * @context: parser context
+ * @uri: #librdf_uri URI of content source
+ * @base_uri: #librdf_uri URI of the content location or NULL if the same
+ *
+ * Retrieve the content at URI and parse it into a librdf_stream.
+ *
+ *
+ **/
+static librdf_stream*
+librdf_parser_raptor_parse_uri_as_stream(void *context, librdf_uri *uri,
+                                         librdf_uri *base_uri)
+{
+  return librdf_parser_raptor_parse_as_stream_common(context, uri,
+                                                     NULL, 0,
+                                                     0,
+                                                     base_uri);
+}
+
+
+/**
+ * librdf_parser_raptor_parse_string_as_stream:
+ * @context: parser context
+ * @string: string content to parse
+ * @base_uri: #librdf_uri URI of the content location or NULL if the same
+ *
+ * Parse the content in a string and return a librdf_stream.
+ *
+ *
+ **/
+static librdf_stream*
+librdf_parser_raptor_parse_string_as_stream(void *context,
+                                            const unsigned char *string,
+                                            librdf_uri *base_uri)
+{
+  return librdf_parser_raptor_parse_as_stream_common(context, NULL,
+                                                     string, 0,
+                                                     0,
+                                                     base_uri);
+}
+
+
+/**
+ * librdf_parser_raptor_parse_counted_string_as_stream:
+ * @context: parser context
+ * @string: string content to parse
+ * @length: length of the string content (must be >0)
+ * @base_uri: the base URI to use
+ *
+ * Parse a counted string of content to a librdf_stream of statements.
+ *
+ * Return value: #librdf_stream of statements or NULL
+ **/
+static librdf_stream*
+librdf_parser_raptor_parse_counted_string_as_stream(void *context,
+                                                    const unsigned char *string,
+                                                    size_t length,
+                                                    librdf_uri* base_uri)
+{
+  return librdf_parser_raptor_parse_as_stream_common(context, NULL,
+                                                     string, length,
+                                                     0,
+                                                     base_uri);
+}
+
+/**
+ * librdf_parser_raptor_parse_iostream_as_stream:
+ * @context: parser context
+ * @iostream: iostream content to parse
+ * @base_uri: #librdf_uri URI of the content location or NULL if the same
+ *
+ * Parse the content in an iostream and return a librdf_stream.
+ *
+ *
+ **/
+static librdf_stream*
+librdf_parser_raptor_parse_iostream_as_stream(void *context,
+                                              raptor_iostream *iostream,
+                                              librdf_uri *base_uri)
+{
+  return librdf_parser_raptor_parse_as_stream_common(context, NULL,
+                                                     0, 0,
+                                                     iostream,
+                                                     base_uri);
+}
+
+
+#ifdef WITH_THREADS
+
+/*
+ * librdf_parser_raptor_is_line_based:
+ * @pcontext: parser context
+ *
+ * INTERNAL - Check if the parser syntax has a statement per line
+ *
+ * Return value: non 0 for N-Triples or N-Quads
+ */
+static int
+librdf_parser_raptor_is_line_based(librdf_parser_raptor_context* pcontext)
+{
+  return !strcmp(pcontext->parser_name, "ntriples") ||
+         !strcmp(pcontext->parser_name, "nquads");
+}
+
+
+/* Size of the input chunks handed to the threads of a parallel parse */
+#define LIBRDF_PARSER_RAPTOR_CHUNK_SIZE (1024 * 1024)
+
+/* Size of the encoded statements the pipeline thread parses into a
+ * chunk before handing it over, and the number of chunks it can get
+ * ahead of the calling thread */
+#define LIBRDF_PARSER_RAPTOR_PIPELINE_CHUNK_SIZE (64 * 1024)
+#define LIBRDF_PARSER_RAPTOR_PIPELINE_CHUNKS 4
+
+typedef enum {
+  LIBRDF_PARSER_RAPTOR_CHUNK_FREE,
+  LIBRDF_PARSER_RAPTOR_CHUNK_READY,
+  LIBRDF_PARSER_RAPTOR_CHUNK_PARSING,
+  LIBRDF_PARSER_RAPTOR_CHUNK_DONE
+} librdf_parser_raptor_chunk_state;
+
+/* Lines of input and the statements parsed from them.  A statement
+ * is encoded as four terms written by librdf_raptor_buffer_write_term().
+ * A namespace seen by a pipeline parse is encoded between them as 'N',
+ * the prefix and the URI, written by librdf_raptor_buffer_write_string().
+ */
+typedef struct {
+  librdf_parser_raptor_chunk_state state;
+
+  char *input;
+  size_t input_length;
+  size_t input_size;
+
+  librdf_raptor_buffer output;
+  /* number of newlines in the input */
+  int lines;
+
+  int errors;
+  /* first error message or NULL */
+  char *error;
+  /* line of the first error in the chunk or 0 if unknown */
+  int error_line;
+} librdf_parser_raptor_chunk;
+
+/* A parallel parse splits line-based syntaxes at newlines into chunks
+ * parsed by a pool of threads.  Other syntaxes are parsed as a
+ * pipeline: one thread parses all the input in order into chunks of
+ * encoded statements, while the calling thread makes nodes from them
+ * and adds them to the model.
+ */
+struct librdf_parser_raptor_parallel_s {
+  const char *parser_name;
+  /* non 0 for a pipeline parse */
+  int pipeline;
+  /* base URI string or NULL */
+  char *base_uri_string;
+  /* raptor option values set on the parser, see librdf_parser_raptor_context */
+  char **options;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  librdf_parser_raptor_chunk *chunks;
+  int chunks_count;
+  /* number of the next chunk a thread will parse */
+  int next_parse;
+  int shutdown;
+  /* non 0 once the pipeline thread handed over its last chunk */
+  int finished;
+
+  /* only used by the pipeline thread */
+  FILE *pipeline_fh;
+  int genid;
+
+  /* the rest is only used by the calling thread */
+  FILE *fh;
+  librdf_uri *base_uri;
+
+  pthread_t threads[LIBRDF_PARSER_RAPTOR_MAX_THREADS];
+  int threads_count;
+
+  /* input read after the last complete line */
+  char *pending;
+  size_t pending_length;
+  size_t pending_size;
+
+  /* chunks handed to threads and chunks whose statements were taken */
+  int read_count;
+  int added_count;
+  int eof;
+  int status;
+  /* line number of the first line of the next chunk taken */
+  int line;
+};
+
+
+/*
+ * librdf_parser_raptor_parallel_statement_handler:
+ * @user_data: address of the chunk being parsed
+ * @rstatement: parsed statement
+ *
+ * INTERNAL - Record a statement parsed by a parallel parse thread
+ *
+ * Only the strings are copied; nodes are made by the calling thread.
+ */
+static void
+librdf_parser_raptor_parallel_statement_handler(void *user_data,
+                                                raptor_statement *rstatement)
+{
+  librdf_parser_raptor_chunk* chunk = *(librdf_parser_raptor_chunk**)user_data;
+  size_t length = chunk->output.length;
+
+  if(librdf_raptor_buffer_write_term(&chunk->output, rstatement->subject) ||
+     librdf_raptor_buffer_write_term(&chunk->output, rstatement->predicate) ||
+     librdf_raptor_buffer_write_term(&chunk->output, rstatement->object) ||
+     librdf_raptor_buffer_write_term(&chunk->output, rstatement->graph)) {
+    /* drop the partly written record so the output ends on a whole one */
+    chunk->output.length = length;
+    chunk->errors++;
+  }
+}
+
+
+static void
+librdf_parser_raptor_parallel_log_handler(void *user_data,
+                                          raptor_log_message *message)
+{
+  librdf_parser_raptor_chunk* chunk = *(librdf_parser_raptor_chunk**)user_data;
+  size_t length;
+
+  if(!chunk || message->level < RAPTOR_LOG_LEVEL_ERROR)
+    return;
+
+  chunk->errors++;
+  if(chunk->error || !message->text)
+    return;
+
+  if(message->locator && message->locator->line > 0)
+    chunk->error_line = message->locator->line;
+
+  length = strlen(message->text);
+  chunk->error = LIBRDF_MALLOC(char*, length + 1);
+  if(chunk->error)
+    memcpy(chunk->error, message->text, length + 1);
+}
+
+
+static void
+librdf_parser_raptor_parallel_namespace_handler(void *user_data,
+                                                raptor_namespace *nspace)
+{
+  librdf_parser_raptor_chunk* chunk = *(librdf_parser_raptor_chunk**)user_data;
+  const unsigned char* prefix;
+  const unsigned char* uri_string;
+  size_t prefix_length;
+  size_t uri_length;
+  size_t length;
+  raptor_uri* uri;
+
+  uri = raptor_namespace_get_uri(nspace);
+  if(!chunk || !uri)
+    return;
+
+  prefix = raptor_namespace_get_counted_prefix(nspace, &prefix_length);
+  uri_string = raptor_uri_as_counted_string(uri, &uri_length);
+  length = chunk->output.length;
+  if(librdf_raptor_buffer_write(&chunk->output, "N", 1) ||
+     librdf_raptor_buffer_write_string(&chunk->output, prefix, prefix_length) ||
+     librdf_raptor_buffer_write_string(&chunk->output, uri_string, uri_length)) {
+    chunk->output.length = length;
+    chunk->errors++;
+  }
+}
+
+
+/*
+ * librdf_parser_raptor_parallel_open:
+ * @parallel: parallel parse
+ * @chunk_p: address of the chunk the thread is parsing into
+ * @rparser_p: address to store the new raptor parser or NULL on failure
+ * @base_uri_p: address to store the new base URI or NULL
+ *
+ * INTERNAL - Make the raptor world and parser of a parse thread
+ *
+ * Each thread has its own raptor world so that no raptor or librdf
+ * objects are shared with other threads.  The raptor options set on
+ * the librdf parser are set on the thread's parser too.
+ *
+ * Return value: new raptor world or NULL on failure
+ */
+static raptor_world*
+librdf_parser_raptor_parallel_open(librdf_parser_raptor_parallel* parallel,
+                                   librdf_parser_raptor_chunk** chunk_p,
+                                   raptor_parser** rparser_p,
+                                   raptor_uri** base_uri_p)
+{
+  raptor_world* rworld;
+  raptor_parser* rparser = NULL;
+  int i;
+
+  *rparser_p = NULL;
+  *base_uri_p = NULL;
+
+  rworld = raptor_new_world();
+  if(!rworld)
+    return NULL;
+  if(raptor_world_open(rworld)) {
+    raptor_free_world(rworld);
+    return NULL;
+  }
+
+  raptor_world_set_log_handler(rworld, chunk_p,
+                               librdf_parser_raptor_parallel_log_handler);
+  rparser = raptor_new_parser(rworld, parallel->parser_name);
+  if(rparser) {
+    raptor_parser_set_statement_handler(rparser, chunk_p,
+                                        librdf_parser_raptor_parallel_statement_handler);
+    raptor_parser_set_namespace_handler(rparser, chunk_p,
+                                        librdf_parser_raptor_parallel_namespace_handler);
+    for(i = 0; i <= RAPTOR_OPTION_LAST; i++) {
+      if(parallel->options[i])
+        raptor_parser_set_option(rparser, (raptor_option)i,
+                                 parallel->options[i], 0);
+    }
+  }
+  if(parallel->base_uri_string)
+    *base_uri_p = raptor_new_uri(rworld,
+                                 (const unsigned char*)parallel->base_uri_string);
+
+  *rparser_p = rparser;
+  return rworld;
+}
+
+
+static void
+librdf_parser_raptor_parallel_close(raptor_world* rworld,
+                                    raptor_parser* rparser,
+                                    raptor_uri* base_uri)
+{
+  if(base_uri)
+    raptor_free_uri(base_uri);
+  if(rparser)
+    raptor_free_parser(rparser);
+  if(rworld)
+    raptor_free_world(rworld);
+}
+
+
+/*
+ * librdf_parser_raptor_parallel_thread:
+ * @arg: parallel parse
+ *
+ * INTERNAL - Parse ready chunks in order until the parse is shut down
+ *
+ * Return value: NULL
+ */
+static void*
+librdf_parser_raptor_parallel_thread(void* arg)
+{
+  librdf_parser_raptor_parallel* parallel = (librdf_parser_raptor_parallel*)arg;
+  librdf_parser_raptor_chunk* chunk = NULL;
+  raptor_world* rworld;
+  raptor_parser* rparser;
+  raptor_uri* base_uri;
+
+  rworld = librdf_parser_raptor_parallel_open(parallel, &chunk, &rparser,
+                                              &base_uri);
+
+  pthread_mutex_lock(&parallel->mutex);
+  while(1) {
+    librdf_parser_raptor_chunk* next;
+    const char* p;
+    const char* end;
+
+    next = &parallel->chunks[parallel->next_parse % parallel->chunks_count];
+    if(parallel->shutdown)
+      break;
+    if(next->state != LIBRDF_PARSER_RAPTOR_CHUNK_READY) {
+      pthread_cond_wait(&parallel->cond, &parallel->mutex);
+      continue;
+    }
+
+    next->state = LIBRDF_PARSER_RAPTOR_CHUNK_PARSING;
+    parallel->next_parse++;
+    pthread_mutex_unlock(&parallel->mutex);
+
+    chunk = next;
+    chunk->output.length = 0;
+    if(!rparser ||
+       raptor_parser_parse_start(rparser, base_uri) ||
+       raptor_parser_parse_chunk(rparser, (const unsigned char*)chunk->input,
+                                 chunk->input_length, 1)) {
+      if(!chunk->errors)
+        chunk->errors++;
+    }
+    chunk = NULL;
+
+    /* counted here so the calling thread can number lines in errors */
+    next->lines = 0;
+    end = next->input + next->input_length;
+    for(p = next->input; (p = (const char*)memchr(p, '\n', (size_t)(end - p))); p++)
+      next->lines++;
+
+    pthread_mutex_lock(&parallel->mutex);
+    next->state = LIBRDF_PARSER_RAPTOR_CHUNK_DONE;
+    pthread_cond_broadcast(&parallel->cond);
+  }
+  pthread_mutex_unlock(&parallel->mutex);
+
+  librdf_parser_raptor_parallel_close(rworld, rparser, base_uri);
+
+  return NULL;
+}
+
+
+/*
+ * librdf_parser_raptor_pipeline_generate_id:
+ * @user_data: parallel parse
+ * @user_bnodeid: blank node identifier from the syntax or NULL
+ *
+ * INTERNAL - Make a blank node identifier in the pipeline thread
+ *
+ * Identifiers from the syntax and generated ones are given different
+ * first characters so they cannot collide.  The calling thread maps
+ * them to world-unique ones like a serial parse does.
+ *
+ * Return value: new identifier or NULL on failure
+ */
+static unsigned char*
+librdf_parser_raptor_pipeline_generate_id(void *user_data,
+                                          unsigned char *user_bnodeid)
+{
+  librdf_parser_raptor_parallel* parallel = (librdf_parser_raptor_parallel*)user_data;
+  unsigned char* id;
+  size_t length;
+
+  if(user_bnodeid) {
+    length = strlen((const char*)user_bnodeid);
+    id = LIBRDF_MALLOC(unsigned char*, length + 2);
+    if(id) {
+      id[0] = 'u';
+      memcpy(id + 1, user_bnodeid, length + 1);
+    }
+    raptor_free_memory(user_bnodeid);
+  } else {
+    id = LIBRDF_MALLOC(unsigned char*, 2 + sizeof(int) * 3);
+    if(id)
+      sprintf((char*)id, "g%d", ++parallel->genid);
+  }
+
+  return id;
+}
+
+
+/*
+ * librdf_parser_raptor_pipeline_thread:
+ * @arg: parallel parse
+ *
+ * INTERNAL - Parse all of the input into free chunks in order
+ *
+ * The thread waits for the calling thread to free a chunk when all
+ * of them are full, so parsing runs at most
+ * LIBRDF_PARSER_RAPTOR_PIPELINE_CHUNKS chunks ahead of adding.
+ *
+ * Return value: NULL
+ */
+static void*
+librdf_parser_raptor_pipeline_thread(void* arg)
+{
+  librdf_parser_raptor_parallel* parallel = (librdf_parser_raptor_parallel*)arg;
+  librdf_parser_raptor_chunk* chunk = NULL;
+  raptor_world* rworld;
+  raptor_parser* rparser;
+  raptor_uri* base_uri;
+  unsigned char buffer[RAPTOR_IO_BUFFER_LEN];
+  int failed;
+  int is_end = 0;
+  int count;
+
+  rworld = librdf_parser_raptor_parallel_open(parallel, &chunk, &rparser,
+                                              &base_uri);
+  if(rworld)
+    raptor_world_set_generate_bnodeid_handler(rworld, parallel,
+                                              librdf_parser_raptor_pipeline_generate_id);
+  failed = !rparser || raptor_parser_parse_start(rparser, base_uri);
+
+  for(count = 0; !is_end; count++) {
+    librdf_parser_raptor_chunk* next;
+
+    next = &parallel->chunks[count % parallel->chunks_count];
+    pthread_mutex_lock(&parallel->mutex);
+    while(next->state != LIBRDF_PARSER_RAPTOR_CHUNK_FREE && !parallel->shutdown)
+      pthread_cond_wait(&parallel->cond, &parallel->mutex);
+    if(parallel->shutdown) {
+      pthread_mutex_unlock(&parallel->mutex);
+      break;
+    }
+    next->state = LIBRDF_PARSER_RAPTOR_CHUNK_PARSING;
+    pthread_mutex_unlock(&parallel->mutex);
+
+    chunk = next;
+    chunk->output.length = 0;
+    chunk->lines = 0;
+    if(failed) {
+      chunk->errors++;
+      is_end = 1;
+    }
+
+    while(!is_end &&
+          chunk->output.length < LIBRDF_PARSER_RAPTOR_PIPELINE_CHUNK_SIZE) {
+      size_t len;
+
+      len = fread(buffer, 1, RAPTOR_IO_BUFFER_LEN, parallel->pipeline_fh);
+      is_end = (len < RAPTOR_IO_BUFFER_LEN);
+      if(raptor_parser_parse_chunk(rparser, buffer, len, is_end) &&
+         !chunk->errors)
+        chunk->errors++;
+      /* like a parallel parse, nothing after the first error is parsed */
+      if(chunk->errors)
+        is_end = 1;
+    }
+    chunk = NULL;
+
+    pthread_mutex_lock(&parallel->mutex);
+    next->state = LIBRDF_PARSER_RAPTOR_CHUNK_DONE;
+    pthread_cond_broadcast(&parallel->cond);
+    pthread_mutex_unlock(&parallel->mutex);
+  }
+
+  pthread_mutex_lock(&parallel->mutex);
+  parallel->finished = 1;
+  pthread_cond_broadcast(&parallel->cond);
+  pthread_mutex_unlock(&parallel->mutex);
+
+  librdf_parser_raptor_parallel_close(rworld, rparser, base_uri);
+
+  return NULL;
+}
+
+
+/*
+ * librdf_parser_raptor_parallel_read:
+ * @parallel: parallel parse
+ * @chunk: chunk to fill
+ *
+ * INTERNAL - Read the next complete lines of input into a chunk
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_parallel_read(librdf_parser_raptor_parallel* parallel,
+                                   librdf_parser_raptor_chunk* chunk)
+{
+  FILE *fh = parallel->fh;
+  size_t length;
+  size_t i;
+
+  length = parallel->pending_length + LIBRDF_PARSER_RAPTOR_CHUNK_SIZE;
+  if(chunk->input_size < length) {
+    if(chunk->input)
+      LIBRDF_FREE(char*, chunk->input);
+    chunk->input = LIBRDF_MALLOC(char*, length);
+    if(!chunk->input) {
+      chunk->input_size = 0;
+      return 1;
+    }
+    chunk->input_size = length;
+  }
+
+  memcpy(chunk->input, parallel->pending, parallel->pending_length);
+  length = parallel->pending_length;
+  parallel->pending_length = 0;
+
+  while(1) {
+    size_t len;
+
+    if(length == chunk->input_size) {
+      /* a line longer than the chunk size */
+      char *input = LIBRDF_MALLOC(char*, chunk->input_size << 1);
+      if(!input)
+        return 1;
+      memcpy(input, chunk->input, length);
+      LIBRDF_FREE(char*, chunk->input);
+      chunk->input = input;
+      chunk->input_size <<= 1;
+    }
+
+    len = fread(chunk->input + length, 1, chunk->input_size - length, fh);
+    length += len;
+    if(!len) {
+      /* end of input: the last line need not end with a newline */
+      chunk->input_length = length;
+      return ferror(fh) ? 1 : 0;
+    }
+
+    for(i = length; i > 0; i--) {
+      if(chunk->input[i - 1] == '\n')
+        break;
+    }
+    if(i)
+      break;
+  }
+
+  /* keep the partial last line for the next chunk */
+  chunk->input_length = i;
+  parallel->pending_length = length - i;
+  if(parallel->pending_size < parallel->pending_length) {
+    if(parallel->pending)
+      LIBRDF_FREE(char*, parallel->pending);
+    parallel->pending = LIBRDF_MALLOC(char*, parallel->pending_length);
+    if(!parallel->pending) {
+      parallel->pending_size = 0;
+      return 1;
+    }
+    parallel->pending_size = parallel->pending_length;
+  }
+  memcpy(parallel->pending, chunk->input + i, parallel->pending_length);
+
+  return 0;
+}
+
+
+/*
+ * librdf_parser_raptor_parallel_read_term:
+ * @world: redland world
+ * @p: address of the encoded term, moved past it
+ * @node_p: address to store the new node or NULL for no term
+ *
+ * INTERNAL - Make a node from a term encoded by a parse thread
+ *
+ * Blank node identifiers are mapped the same way as for a serial
+ * parse, so identifiers are consistent across all the chunks.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_parallel_read_term(librdf_world* world,
+                                        const unsigned char** p,
+                                        librdf_node** node_p)
+{
+  const unsigned char* string;
+  const unsigned char* language;
+  const unsigned char* datatype;
+  size_t length;
+  size_t language_length;
+  size_t datatype_length;
+  unsigned char* id;
+  librdf_uri* datatype_uri = NULL;
+  char type = (char)**p;
+
+  (*p)++;
+  *node_p = NULL;
+
+  switch(type) {
+    case 'U':
+      string = librdf_raptor_buffer_read_string(p, &length);
+      *node_p = librdf_new_node_from_counted_uri_string(world, string, length);
+      break;
+
+    case 'B':
+      string = librdf_raptor_buffer_read_string(p, &length);
+      id = librdf_raptor_map_bnodeid(world, string);
+      if(id) {
+        *node_p = librdf_new_node_from_blank_identifier(world, id);
+        LIBRDF_FREE(char*, id);
+      }
+      break;
 
-  if(uri) {
-    const char *accept_h;
+    case 'L':
+      string = librdf_raptor_buffer_read_string(p, &length);
+      language = librdf_raptor_buffer_read_string(p, &language_length);
+      datatype = librdf_raptor_buffer_read_string(p, &datatype_length);
+      if(datatype_length) {
+        datatype_uri = librdf_new_uri(world, datatype);
+        if(!datatype_uri)
+          return 1;
+      }
+      *node_p = librdf_new_node_from_typed_counted_literal(world,
+                                                           string, length,
+                                                           language_length ? (const char*)language : NULL,
+                                                           language_length,
+                                                           datatype_uri);
+      if(datatype_uri)
+        librdf_free_uri(datatype_uri);
+      break;
 
-    if(pcontext->www)
-      raptor_free_www(pcontext->www);
+    case '-':
+      return 0;
 
-    pcontext->www = raptor_new_www(pcontext->parser->world->raptor_world_ptr);
-    if(!pcontext->www)
-      goto oom;
+    default:
+      return 1;
+  }
 
-    accept_h=raptor_parser_get_accept_header(pcontext->rdf_parser);
-    if(accept_h) {
-      raptor_www_set_http_accept(pcontext->www, accept_h);
-      raptor_free_memory((void*)accept_h);
-    }
+  return *node_p ? 0 : 1;
+}
 
-    raptor_www_set_write_bytes_handler(pcontext->www,
-                                       librdf_parser_raptor_parse_uri_as_stream_write_bytes_handler,
-                                       scontext);
 
-    status = raptor_parser_parse_start(pcontext->rdf_parser, (raptor_uri*)base_uri);
-    if(status) {
-      raptor_free_www(pcontext->www);
+/*
+ * librdf_parser_raptor_parallel_add_chunk:
+ * @scontext: stream context
+ * @chunk: parsed chunk
+ *
+ * INTERNAL - Take the statements and namespaces parsed from a chunk
+ *
+ * When parsing into a model the statements are added to it, otherwise
+ * they are queued for reading from the stream.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_parallel_add_chunk(librdf_parser_raptor_stream_context* scontext,
+                                        librdf_parser_raptor_chunk* chunk)
+{
+  librdf_world* world = scontext->pcontext->parser->world;
+  const unsigned char* p = chunk->output.data;
+  const unsigned char* end = chunk->output.data + chunk->output.length;
 
-      pcontext->www = NULL;
-      librdf_parser_raptor_serialise_finished((void*)scontext);
-      return NULL;
+  while(p < end) {
+    librdf_node* nodes[4];
+    librdf_statement* statement;
+    int i;
+
+    if(*p == 'N') {
+      const unsigned char* prefix;
+      const unsigned char* uri_string;
+      size_t prefix_length;
+      size_t uri_length;
+      librdf_uri* uri;
+
+      p++;
+      prefix = librdf_raptor_buffer_read_string(&p, &prefix_length);
+      uri_string = librdf_raptor_buffer_read_string(&p, &uri_length);
+      uri = librdf_new_uri2(world, uri_string, uri_length);
+      if(!uri)
+        return 1;
+      librdf_parser_raptor_add_namespace(scontext->pcontext, uri,
+                                         prefix_length ? prefix : NULL,
+                                         prefix_length);
+      librdf_free_uri(uri);
+      continue;
     }
 
-    raptor_www_fetch(pcontext->www, (raptor_uri*)uri);
-    raptor_parser_parse_chunk(pcontext->rdf_parser, NULL, 0, 1);
-
-    raptor_free_www(pcontext->www);
+    for(i = 0; i < 4; i++) {
+      if(librdf_parser_raptor_parallel_read_term(world, &p, &nodes[i])) {
+        while(i >= 0) {
+          if(nodes[i])
+            librdf_free_node(nodes[i]);
+          i--;
+        }
+        return 1;
+      }
+    }
 
-    pcontext->www = NULL;
-  } else if (string) {
-    status = raptor_parser_parse_start(pcontext->rdf_parser,
-                                       (raptor_uri*)base_uri);
-    if(status) {
-      librdf_parser_raptor_serialise_finished((void*)scontext);
-      return NULL;
+    if(!nodes[0] || !nodes[1] || !nodes[2]) {
+      for(i = 0; i < 4; i++) {
+        if(nodes[i])
+          librdf_free_node(nodes[i]);
+      }
+      return 1;
     }
 
-    if(!length)
-      length = strlen((const char*)string);
+    statement = librdf_new_statement_from_nodes(world, nodes[0], nodes[1],
+                                                nodes[2]);
+    if(!statement) {
+      if(nodes[3])
+        librdf_free_node(nodes[3]);
+      return 1;
+    }
 
-    raptor_parser_parse_chunk(pcontext->rdf_parser, string, length, 1);
-  } else if (iostream) {
-    status = raptor_parser_parse_start(pcontext->rdf_parser, (raptor_uri*)base_uri);
-    if(status) {
-      librdf_parser_raptor_serialise_finished((void*)scontext);
-      return NULL;
+    /* like a serial parse, a stream has no contexts */
+    if(nodes[3] &&
+       (!scontext->model || !librdf_model_supports_contexts(scontext->model))) {
+      librdf_free_node(nodes[3]);
+      nodes[3] = NULL;
     }
 
-    status = raptor_parser_parse_iostream(pcontext->rdf_parser,
-                                          iostream,
-                                          (raptor_uri*)base_uri);
-    if(status) {
-      librdf_parser_raptor_serialise_finished((void*)scontext);
-      return NULL;
+    if(scontext->model) {
+      if(librdf_parser_raptor_add_to_batch(scontext, statement, nodes[3]))
+        return 1;
+    } else if(librdf_parser_raptor_push_statement(scontext, statement)) {
+      librdf_free_statement(statement);
+      return 1;
     }
-  } else {
-    /* All three of URI, string and iostream are null.  That's a coding error. */
-    librdf_parser_raptor_serialise_finished((void*)scontext);
-    return NULL;
   }
 
+  return 0;
+}
 
-  /* get first statement, else is empty */
-  scontext->current=(librdf_statement*)librdf_list_pop(scontext->statements);
 
-  stream=librdf_new_stream(pcontext->parser->world,
-                           (void*)scontext,
-                           &librdf_parser_raptor_serialise_end_of_stream,
-                           &librdf_parser_raptor_serialise_next_statement,
-                           &librdf_parser_raptor_serialise_get_statement,
-                           &librdf_parser_raptor_serialise_finished);
-  if(!stream)
-    goto oom;
+/*
+ * librdf_parser_raptor_new_parallel:
+ * @pcontext: parser context
+ * @fh: file to parse
+ * @base_uri: base URI or NULL
+ *
+ * INTERNAL - Start the threads of a parallel or pipeline parse
+ *
+ * Return value: new parallel parse or NULL if the threads could not be started
+ */
+static librdf_parser_raptor_parallel*
+librdf_parser_raptor_new_parallel(librdf_parser_raptor_context* pcontext,
+                                  FILE *fh, librdf_uri *base_uri)
+{
+  librdf_world* world = pcontext->parser->world;
+  librdf_parser_raptor_parallel* parallel;
+  int i;
 
-  return stream;
+  parallel = LIBRDF_CALLOC(librdf_parser_raptor_parallel*, 1,
+                           sizeof(*parallel));
+  if(!parallel)
+    return NULL;
 
-  /* Clean up and report an error on OOM */
-  oom:
-  librdf_parser_raptor_serialise_finished((void*)scontext);
-  librdf_log(pcontext->parser->world,
-             0, LIBRDF_LOG_FATAL, LIBRDF_FROM_PARSER, NULL,
-             "Out of memory");
+  parallel->parser_name = pcontext->parser_name;
+  parallel->pipeline = !librdf_parser_raptor_is_line_based(pcontext);
+  parallel->options = pcontext->options;
+  parallel->line = 1;
+  /* the file is read by the pipeline thread or the calling thread */
+  if(parallel->pipeline)
+    parallel->pipeline_fh = fh;
+  else
+    parallel->fh = fh;
+
+  /* the stream can outlive the caller's base URI */
+  if(base_uri) {
+    size_t length;
+    const unsigned char* string;
+
+    string = librdf_uri_as_counted_string(base_uri, &length);
+    parallel->base_uri_string = LIBRDF_MALLOC(char*, length + 1);
+    parallel->base_uri = librdf_new_uri_from_uri(base_uri);
+    if(!parallel->base_uri_string || !parallel->base_uri)
+      goto failed;
+    memcpy(parallel->base_uri_string, string, length + 1);
+  }
+
+  if(parallel->pipeline)
+    parallel->chunks_count = LIBRDF_PARSER_RAPTOR_PIPELINE_CHUNKS;
+  else
+    parallel->chunks_count = pcontext->threads * 2;
+  parallel->chunks = LIBRDF_CALLOC(librdf_parser_raptor_chunk*,
+                                   LIBRDF_GOOD_CAST(size_t, parallel->chunks_count),
+                                   sizeof(librdf_parser_raptor_chunk));
+  if(!parallel->chunks)
+    goto failed;
+
+  pthread_mutex_init(&parallel->mutex, NULL);
+  pthread_cond_init(&parallel->cond, NULL);
+
+  if(parallel->pipeline) {
+    if(!pthread_create(&parallel->threads[0], NULL,
+                       librdf_parser_raptor_pipeline_thread, parallel))
+      parallel->threads_count++;
+  } else {
+    for(i = 0; i < pcontext->threads; i++) {
+      if(pthread_create(&parallel->threads[parallel->threads_count], NULL,
+                        librdf_parser_raptor_parallel_thread, parallel))
+        break;
+      parallel->threads_count++;
+    }
+  }
+
+  if(!parallel->threads_count) {
+    librdf_log(world, 0, LIBRDF_LOG_WARN, LIBRDF_FROM_PARSER, NULL,
+               "Cannot start parser threads, parsing on one thread");
+    pthread_cond_destroy(&parallel->cond);
+    pthread_mutex_destroy(&parallel->mutex);
+    goto failed;
+  }
+
+  return parallel;
+
+  failed:
+  if(parallel->chunks)
+    LIBRDF_FREE(librdf_parser_raptor_chunk*, parallel->chunks);
+  if(parallel->base_uri)
+    librdf_free_uri(parallel->base_uri);
+  if(parallel->base_uri_string)
+    LIBRDF_FREE(char*, parallel->base_uri_string);
+  LIBRDF_FREE(librdf_parser_raptor_parallel, parallel);
   return NULL;
 }
 
 
-/**
- * librdf_parser_raptor_parse_uri_as_stream:
- * @context: parser context
- * @uri: #librdf_uri URI of content source
- * @base_uri: #librdf_uri URI of the content location or NULL if the same
- *
- * Retrieve the content at URI and parse it into a librdf_stream.
- *
+/*
+ * librdf_parser_raptor_free_parallel:
+ * @parallel: parallel parse
  *
- **/
-static librdf_stream*
-librdf_parser_raptor_parse_uri_as_stream(void *context, librdf_uri *uri,
-                                         librdf_uri *base_uri)
+ * INTERNAL - Stop the threads of a parallel parse and free it
+ */
+static void
+librdf_parser_raptor_free_parallel(librdf_parser_raptor_parallel* parallel)
 {
-  return librdf_parser_raptor_parse_as_stream_common(context, uri,
-                                                     NULL, 0,
-                                                     0,
-                                                     base_uri);
+  int i;
+
+  pthread_mutex_lock(&parallel->mutex);
+  parallel->shutdown = 1;
+  pthread_cond_broadcast(&parallel->cond);
+  pthread_mutex_unlock(&parallel->mutex);
+
+  for(i = 0; i < parallel->threads_count; i++)
+    pthread_join(parallel->threads[i], NULL);
+
+  pthread_cond_destroy(&parallel->cond);
+  pthread_mutex_destroy(&parallel->mutex);
+
+  for(i = 0; i < parallel->chunks_count; i++) {
+    if(parallel->chunks[i].input)
+      LIBRDF_FREE(char*, parallel->chunks[i].input);
+    librdf_raptor_buffer_clear(&parallel->chunks[i].output);
+    if(parallel->chunks[i].error)
+      LIBRDF_FREE(char*, parallel->chunks[i].error);
+  }
+  LIBRDF_FREE(librdf_parser_raptor_chunk*, parallel->chunks);
+  if(parallel->pending)
+    LIBRDF_FREE(char*, parallel->pending);
+  if(parallel->base_uri)
+    librdf_free_uri(parallel->base_uri);
+  if(parallel->base_uri_string)
+    LIBRDF_FREE(char*, parallel->base_uri_string);
+
+  LIBRDF_FREE(librdf_parser_raptor_parallel, parallel);
 }
 
 
-/**
- * librdf_parser_raptor_parse_string_as_stream:
- * @context: parser context
- * @string: string content to parse
- * @base_uri: #librdf_uri URI of the content location or NULL if the same
+/*
+ * librdf_parser_raptor_parallel_next_chunk:
+ * @scontext: stream context with a parallel parse
  *
- * Parse the content in a string and return a librdf_stream.
+ * INTERNAL - Take the statements of the next parsed chunk
  *
+ * Keeps two chunks per thread filled with input, then waits for the
+ * oldest one to be parsed and takes its statements, so statements
+ * come in input order and input is read at most that far ahead.  The
+ * pipeline thread reads its own input, so for a pipeline parse this
+ * only waits for the next chunk.
  *
- **/
-static librdf_stream*
-librdf_parser_raptor_parse_string_as_stream(void *context,
-                                            const unsigned char *string,
-                                            librdf_uri *base_uri)
+ * Return value: >0 if a chunk was taken, 0 at the end of input or <0 on failure
+ */
+static int
+librdf_parser_raptor_parallel_next_chunk(librdf_parser_raptor_stream_context* scontext)
 {
-  return librdf_parser_raptor_parse_as_stream_common(context, NULL,
-                                                     string, 0,
-                                                     0,
-                                                     base_uri);
+  librdf_parser_raptor_context* pcontext = scontext->pcontext;
+  librdf_world* world = pcontext->parser->world;
+  librdf_parser_raptor_parallel* parallel = scontext->parallel;
+  librdf_parser_raptor_chunk* chunk;
+  int done;
+
+  if(parallel->status)
+    return -1;
+
+  while(!parallel->pipeline && !parallel->eof &&
+        parallel->read_count - parallel->added_count < parallel->chunks_count) {
+    chunk = &parallel->chunks[parallel->read_count % parallel->chunks_count];
+    if(librdf_parser_raptor_parallel_read(parallel, chunk)) {
+      librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
+                 "Cannot read parser input");
+      parallel->status = 1;
+      parallel->eof = 1;
+      break;
+    }
+    if(!chunk->input_length) {
+      parallel->eof = 1;
+      break;
+    }
+
+    pthread_mutex_lock(&parallel->mutex);
+    chunk->state = LIBRDF_PARSER_RAPTOR_CHUNK_READY;
+    pthread_cond_broadcast(&parallel->cond);
+    pthread_mutex_unlock(&parallel->mutex);
+    parallel->read_count++;
+  }
+
+  if(!parallel->pipeline && parallel->added_count == parallel->read_count)
+    return parallel->status ? -1 : 0;
+
+  /* the pipeline thread finishes after handing over its last chunk */
+  chunk = &parallel->chunks[parallel->added_count % parallel->chunks_count];
+  pthread_mutex_lock(&parallel->mutex);
+  while(chunk->state != LIBRDF_PARSER_RAPTOR_CHUNK_DONE && !parallel->finished)
+    pthread_cond_wait(&parallel->cond, &parallel->mutex);
+  done = (chunk->state == LIBRDF_PARSER_RAPTOR_CHUNK_DONE);
+  pthread_mutex_unlock(&parallel->mutex);
+
+  if(!done)
+    return 0;
+
+  /* like a serial parse, nothing after the first error is taken; the
+   * records before it are whole as a failed write is dropped */
+  if(!parallel->status) {
+    if(librdf_parser_raptor_parallel_add_chunk(scontext, chunk))
+      parallel->status = 1;
+    if(chunk->errors) {
+      raptor_locator locator;
+
+      memset(&locator, 0, sizeof(locator));
+      locator.uri = (raptor_uri*)parallel->base_uri;
+      locator.line = chunk->error_line ?
+                     parallel->line + chunk->error_line - 1 : -1;
+      locator.column = -1;
+      locator.byte = -1;
+
+      pcontext->errors += chunk->errors;
+      librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, &locator,
+                 "%s", chunk->error ? chunk->error : "Parsing failed");
+      parallel->status = 1;
+    }
+    if(parallel->status)
+      parallel->eof = 1;
+  }
+  parallel->line += chunk->lines;
+
+  chunk->errors = 0;
+  chunk->error_line = 0;
+  if(chunk->error) {
+    LIBRDF_FREE(char*, chunk->error);
+    chunk->error = NULL;
+  }
+  pthread_mutex_lock(&parallel->mutex);
+  chunk->state = LIBRDF_PARSER_RAPTOR_CHUNK_FREE;
+  /* the pipeline thread may be waiting for a free chunk */
+  pthread_cond_broadcast(&parallel->cond);
+  pthread_mutex_unlock(&parallel->mutex);
+  parallel->added_count++;
+
+  return parallel->status ? -1 : 1;
 }
 
 
-/**
- * librdf_parser_raptor_parse_counted_string_as_stream:
- * @context: parser context
- * @string: string content to parse
- * @length: length of the string content (must be >0)
- * @base_uri: the base URI to use
+/*
+ * librdf_parser_raptor_parse_parallel_into_model:
+ * @scontext: stream context with the model to add to
+ * @fh: file to parse
+ * @base_uri: base URI or NULL
+ * @status_p: address to store the parse status
  *
- * Parse a counted string of content to a librdf_stream of statements.
+ * INTERNAL - Parse on other threads into a model
  *
- * Return value: #librdf_stream of statements or NULL
- **/
-static librdf_stream*
-librdf_parser_raptor_parse_counted_string_as_stream(void *context,
-                                                    const unsigned char *string,
-                                                    size_t length,
-                                                    librdf_uri* base_uri)
+ * A line-based syntax is split at newlines into chunks that are
+ * parsed by a pool of threads.  Other syntaxes are parsed by one
+ * pipeline thread.  Meanwhile the calling thread makes nodes from the
+ * results and adds them to the model in input order.
+ *
+ * Return value: non 0 if the threads were started and the file parsed
+ */
+static int
+librdf_parser_raptor_parse_parallel_into_model(librdf_parser_raptor_stream_context* scontext,
+                                               FILE *fh,
+                                               librdf_uri *base_uri,
+                                               int *status_p)
 {
-  return librdf_parser_raptor_parse_as_stream_common(context, NULL,
-                                                     string, length,
-                                                     0,
-                                                     base_uri);
+  int rc;
+
+  scontext->parallel = librdf_parser_raptor_new_parallel(scontext->pcontext,
+                                                         fh, base_uri);
+  if(!scontext->parallel)
+    return 0;
+
+  while((rc = librdf_parser_raptor_parallel_next_chunk(scontext)) > 0)
+    ;
+
+  librdf_parser_raptor_free_parallel(scontext->parallel);
+  scontext->parallel = NULL;
+
+  *status_p = (rc < 0);
+  return 1;
 }
 
-/**
- * librdf_parser_raptor_parse_iostream_as_stream:
- * @context: parser context
- * @iostream: iostream content to parse
- * @base_uri: #librdf_uri URI of the content location or NULL if the same
+
+/*
+ * librdf_parser_raptor_can_parse_parallel:
+ * @pcontext: parser context
  *
- * Parse the content in an iostream and return a librdf_stream.
+ * INTERNAL - Check threads are wanted and can be used
  *
+ * A URI filter is a librdf callback so it is only called from a parse
+ * on the calling thread.
  *
- **/
-static librdf_stream*
-librdf_parser_raptor_parse_iostream_as_stream(void *context,
-                                              raptor_iostream *iostream,
-                                              librdf_uri *base_uri)
+ * Return value: non 0 if a parallel or pipeline parse can be used
+ */
+static int
+librdf_parser_raptor_can_parse_parallel(librdf_parser_raptor_context* pcontext)
 {
-  return librdf_parser_raptor_parse_as_stream_common(context, NULL,
-                                                     0, 0,
-                                                     iostream,
-                                                     base_uri);
+  return pcontext->threads > 1 && !pcontext->parser->uri_filter;
 }
 
+#endif
+
 
 /*
  * librdf_parser_raptor_parse_into_model_common:
@@ -846,6 +2390,8 @@ librdf_parser_raptor_parse_into_model_common(void *context,
   librdf_parser_raptor_stream_context* scontext;
   int need_base_uri;
   const raptor_syntax_description *desc;
+  char* filename = NULL;
+  FILE* file_fh = NULL;
 
   if(!base_uri)
     base_uri=uri;
@@ -906,7 +2452,49 @@ librdf_parser_raptor_parse_into_model_common(void *context,
                                  librdf_parser_raptor_relay_filter,
                                  pcontext->parser);
 
-  if(uri) {
+  /* local files are read here so they can be decompressed, mapped
+   * or split between threads */
+  if(uri && librdf_uri_is_file_uri(uri)) {
+    filename = (char*)librdf_uri_to_filename(uri);
+    if(filename) {
+      file_fh = fopen(filename, "r");
+      if(!file_fh) {
+        librdf_log(pcontext->parser->world, 0, LIBRDF_LOG_ERROR,
+                   LIBRDF_FROM_PARSER, NULL, "failed to open file '%s' - %s",
+                   filename, strerror(errno));
+        SYSTEM_FREE(filename);
+        librdf_parser_raptor_serialise_finished((void*)scontext);
+        return 1;
+      }
+      fh = file_fh;
+    }
+  }
+
+  if(fh && librdf_raptor_get_file_compression(fh) != LIBRDF_COMPRESSION_NONE) {
+    raptor_iostream* compressed;
+
+    compressed = librdf_new_iostream_from_compressed_file_handle(pcontext->parser->world, fh);
+    if(compressed) {
+      status = raptor_parser_parse_iostream(pcontext->rdf_parser, compressed,
+                                            (raptor_uri*)base_uri);
+      raptor_free_iostream(compressed);
+    } else
+      status = 1;
+#ifdef WITH_THREADS
+  } else if(fh && librdf_parser_raptor_can_parse_parallel(pcontext) &&
+            librdf_parser_raptor_parse_parallel_into_model(scontext, fh,
+                                                           base_uri, &status)) {
+    /* parsed on other threads */
+#endif
+#ifdef LIBRDF_PARSER_RAPTOR_USE_MMAP
+  } else if(fh && librdf_parser_raptor_parse_mapped_file(pcontext, fh,
+                                                         base_uri, &status)) {
+    /* parsed from memory */
+#endif
+  } else if(fh) {
+    status = raptor_parser_parse_file_stream(pcontext->rdf_parser, fh, filename,
+                                             (raptor_uri*)base_uri);
+  } else if(uri) {
     status = raptor_parser_parse_uri(pcontext->rdf_parser, (raptor_uri*)uri,
                                      (raptor_uri*)base_uri);
   } else if (string != NULL) {
@@ -916,8 +2504,6 @@ librdf_parser_raptor_parse_into_model_common(void *context,
         length = strlen((const char*)string);
       status = raptor_parser_parse_chunk(pcontext->rdf_parser, string, length, 1);
     }
-  } else if(fh) {
-    status = raptor_parser_parse_file_stream(pcontext->rdf_parser, fh, NULL, (raptor_uri*)base_uri);
   } else if(iostream) {
     status = raptor_parser_parse_iostream(pcontext->rdf_parser, iostream,  (raptor_uri*)base_uri);
   } else {
@@ -925,6 +2511,14 @@ librdf_parser_raptor_parse_into_model_common(void *context,
     status = -1;
   }
 
+  if(file_fh)
+    fclose(file_fh);
+  if(filename)
+    SYSTEM_FREE(filename);
+
+  if(librdf_parser_raptor_flush_batch(scontext) || scontext->batch_failed)
+    status = 1;
+
   librdf_parser_raptor_serialise_finished((void*)scontext);
 
   return status;
@@ -1078,7 +2672,7 @@ librdf_parser_raptor_serialise_end_of_stream(void* context)
 {
   librdf_parser_raptor_stream_context* scontext=(librdf_parser_raptor_stream_context*)context;
 
-  return (!scontext->current && !librdf_list_size(scontext->statements));
+  return (!scontext->current && !scontext->pending_count);
 }
 
 
@@ -1095,12 +2689,13 @@ librdf_parser_raptor_serialise_next_statement(void* context)
 {
   librdf_parser_raptor_stream_context* scontext=(librdf_parser_raptor_stream_context*)context;
 
-  librdf_free_statement(scontext->current);
+  if(scontext->current)
+    librdf_parser_raptor_release_statement(scontext, scontext->current);
   scontext->current=NULL;
 
   /* get another statement if there is one */
   while(!scontext->current) {
-    scontext->current=(librdf_statement*)librdf_list_pop(scontext->statements);
+    scontext->current=librdf_parser_raptor_pop_statement(scontext);
     if(scontext->current)
       break;
 
@@ -1165,11 +2760,29 @@ librdf_parser_raptor_serialise_finished(void* context)
     if(scontext->current)
       librdf_free_statement(scontext->current);
 
-    if(scontext->statements) {
-      while((statement=(librdf_statement*)librdf_list_pop(scontext->statements)))
-        librdf_free_statement(statement);
-      librdf_free_list(scontext->statements);
-    }
+    while((statement=librdf_parser_raptor_pop_statement(scontext)))
+      librdf_free_statement(statement);
+    if(scontext->pending)
+      LIBRDF_FREE(librdf_statement**, scontext->pending);
+
+    librdf_parser_raptor_clear_batch(scontext);
+
+    while(scontext->spare_count)
+      librdf_free_statement(scontext->spare[--scontext->spare_count]);
+
+    if(scontext->iostream)
+      raptor_free_iostream(scontext->iostream);
+
+#ifdef WITH_THREADS
+    /* stop the threads before the file handle is closed */
+    if(scontext->parallel)
+      librdf_parser_raptor_free_parallel(scontext->parallel);
+#endif
+
+#ifdef LIBRDF_PARSER_RAPTOR_USE_MMAP
+    if(scontext->map)
+      munmap(scontext->map, scontext->map_length);
+#endif
 
     if(scontext->fh && scontext->close_fh)
       fclose(scontext->fh);
@@ -1177,7 +2790,7 @@ librdf_parser_raptor_serialise_finished(void* context)
     if(scontext->pcontext)
       scontext->pcontext->stream_context = NULL;
 
-    librdf_raptor_reset_bnode_hash(world);
+    librdf_raptor_reset_bnode_map(world);
 
     LIBRDF_FREE(librdf_parser_raptor_context, scontext);
   }
@@ -1206,6 +2819,10 @@ librdf_parser_raptor_get_feature(void* context, librdf_uri *feature)
     sprintf((char*)intbuffer, "%d", pcontext->warnings);
     return librdf_new_node_from_typed_literal(pcontext->parser->world,
                                               intbuffer, NULL, NULL);
+  } else if(!strcmp((const char*)uri_string, LIBRDF_PARSER_FEATURE_THREADS)) {
+    sprintf((char*)intbuffer, "%d", pcontext->threads ? pcontext->threads : 1);
+    return librdf_new_node_from_typed_literal(pcontext->parser->world,
+                                              intbuffer, NULL, NULL);
   } else {
     /* raptor2: try a raptor option */
     raptor_option feature_i;
@@ -1236,6 +2853,25 @@ librdf_parser_raptor_set_feature(void* context,
   if(!feature)
     return 1;
 
+  if(!strcmp((const char*)librdf_uri_as_string(feature),
+             LIBRDF_PARSER_FEATURE_THREADS)) {
+    long threads;
+
+    if(!librdf_node_is_literal(value))
+      return 1;
+
+    threads = strtol((const char*)librdf_node_get_literal_value(value),
+                     NULL, 10);
+    if(threads < 1)
+      return 1;
+#ifdef WITH_THREADS
+    if(threads > LIBRDF_PARSER_RAPTOR_MAX_THREADS)
+      threads = LIBRDF_PARSER_RAPTOR_MAX_THREADS;
+#endif
+    pcontext->threads = (int)threads;
+    return 0;
+  }
+
   /* try a raptor feature */
   feature_i = raptor_world_get_option_from_uri(pcontext->parser->world->raptor_world_ptr, (raptor_uri*)feature);
   if((int)feature_i < 0)
@@ -1246,8 +2882,19 @@ librdf_parser_raptor_set_feature(void* context,
 
   value_s=(const unsigned char*)librdf_node_get_literal_value(value);
 
-  return raptor_parser_set_option(pcontext->rdf_parser, feature_i,
-                                  (const char *)value_s, 0);
+  if(raptor_parser_set_option(pcontext->rdf_parser, feature_i,
+                              (const char *)value_s, 0))
+    return 1;
+
+  /* remembered for the parsers of threads */
+  if(pcontext->options[feature_i])
+    LIBRDF_FREE(char*, pcontext->options[feature_i]);
+  pcontext->options[feature_i] = LIBRDF_MALLOC(char*, strlen((const char*)value_s) + 1);
+  if(!pcontext->options[feature_i])
+    return 1;
+  strcpy(pcontext->options[feature_i], (const char*)value_s);
+
+  return 0;
 }
 
 
@@ -39,6 +39,18 @@
 #include <stdlib.h>
 #endif
 
+/* for gettimeofday */
+#if TIME_WITH_SYS_TIME
+#include <sys/time.h>
+#include <time.h>
+#else
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
+#endif
+
 #include <redland.h>
 #include <rdf_query.h>
 
@@ -47,6 +59,7 @@
 
 /* prototypes for helper functions */
 static void librdf_delete_query_factories(librdf_world *world);
+static void librdf_query_clear_profiles(librdf_query* query);
 
 
 /**
@@ -90,6 +103,8 @@ librdf_init_query(librdf_world *world)
 void
 librdf_finish_query(librdf_world *world) 
 {
+  /* cached queries may refer to the rasqal world */
+  librdf_query_cache_resize(world, 0);
   librdf_query_rasqal_destructor(world);
   librdf_delete_query_factories(world);
 }
@@ -459,6 +474,252 @@ librdf_new_query_from_factory(librdf_world *world,
 }
 
 
+/*
+ * librdf_query_cache_entry_clear - free the query and key held by a query cache entry
+ *
+ * Must be called without holding the world mutex since freeing the
+ * query takes it.
+ */
+static void
+librdf_query_cache_entry_clear(librdf_query_cache_entry* entry)
+{
+  if(entry->query)
+    librdf_free_query(entry->query);
+  if(entry->query_string)
+    LIBRDF_FREE(char*, entry->query_string);
+  if(entry->base_uri)
+    librdf_free_uri(entry->base_uri);
+  memset(entry, 0, sizeof(*entry));
+}
+
+
+/**
+ * librdf_query_cache_resize:
+ * @world: redland world object
+ * @size: maximum number of cached queries, 0 to disable the cache
+ *
+ * INTERNAL - Set the size of the world query cache.
+ *
+ * The least recently used queries are dropped if the cache shrinks.
+ **/
+void
+librdf_query_cache_resize(librdf_world *world, int size)
+{
+  librdf_query_cache_entry* cache = NULL;
+  librdf_query_cache_entry entry;
+
+  while(1) {
+#ifdef WITH_THREADS
+    pthread_mutex_lock(world->mutex);
+#endif
+    if(world->query_cache_count <= size)
+      break;
+
+    entry = world->query_cache[--world->query_cache_count];
+#ifdef WITH_THREADS
+    pthread_mutex_unlock(world->mutex);
+#endif
+    librdf_query_cache_entry_clear(&entry);
+  }
+
+  if(world->query_cache && size != world->query_cache_size) {
+    if(size > 0) {
+      cache = LIBRDF_CALLOC(librdf_query_cache_entry*, LIBRDF_GOOD_CAST(size_t, size),
+                            sizeof(*cache));
+      if(!cache)
+        goto unlock;
+      if(world->query_cache_count)
+        memcpy(cache, world->query_cache,
+               LIBRDF_GOOD_CAST(size_t, world->query_cache_count) * sizeof(*cache));
+    }
+    LIBRDF_FREE(librdf_query_cache_entry*, world->query_cache);
+    world->query_cache = cache;
+  }
+  world->query_cache_size = size;
+
+  unlock:
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(world->mutex);
+#endif
+  return;
+}
+
+
+/*
+ * librdf_query_reset - remove the settings of the last user of a cached query
+ */
+static void
+librdf_query_reset(librdf_query* query)
+{
+  query->timeout = 0;
+  query->max_triples = 0;
+  query->max_rows = 0;
+  query->workers = 0;
+  query->cancelled = 0;
+
+  query->profiling = 0;
+  librdf_query_clear_profiles(query);
+
+  if(query->factory->reset)
+    query->factory->reset(query);
+  else if(query->factory->bind_variable)
+    query->factory->bind_variable(query, NULL, NULL);
+}
+
+
+/**
+ * librdf_new_query_from_cache:
+ * @world: redland world object
+ * @name: the name identifying the query language
+ * @uri: the URI identifying the query language (or NULL)
+ * @query_string: the query string
+ * @base_uri: the base URI of the query string (or NULL)
+ *
+ * Constructor - get a #librdf_query object from the world query cache.
+ *
+ * Returns a query previously made for the same language, query string
+ * and base URI that is not otherwise in use, so that the parsed and
+ * prepared query is reused.  Variable bindings, limit and offset
+ * changes, the results cache, resource limits and profiling set by
+ * the previous user are all removed.
+ * Otherwise a new query is created and added to the cache, dropping
+ * the least recently used one if the cache is full.
+ *
+ * The size of the cache is set with the world feature
+ * #LIBRDF_WORLD_FEATURE_QUERY_CACHE_SIZE.
+ *
+ * The query must be freed with librdf_free_query() as usual.
+ *
+ * Return value: a #librdf_query object or NULL on failure
+ */
+librdf_query*
+librdf_new_query_from_cache(librdf_world *world,
+                            const char *name, librdf_uri *uri,
+                            const unsigned char *query_string,
+                            librdf_uri* base_uri)
+{
+  librdf_query_factory* factory;
+  librdf_query_cache_entry entry;
+  librdf_query_cache_entry evicted;
+  librdf_query* query = NULL;
+  size_t len;
+  int i;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_string, string, NULL);
+
+  librdf_world_open(world);
+
+  factory = librdf_get_query_factory(world, name, uri);
+  if(!factory)
+    return NULL;
+
+#ifdef WITH_THREADS
+  pthread_mutex_lock(world->mutex);
+#endif
+
+  for(i = 0; i < world->query_cache_count; i++) {
+    librdf_query_cache_entry* e = &world->query_cache[i];
+
+    if(e->factory != factory ||
+       strcmp((const char*)e->query_string, (const char*)query_string))
+      continue;
+    if(e->base_uri != base_uri &&
+       (!e->base_uri || !base_uri || !librdf_uri_equals(e->base_uri, base_uri)))
+      continue;
+
+    /* only reuse a query that nobody else holds or has results from */
+    if(e->query->usage == 1) {
+      entry = *e;
+      memmove(&world->query_cache[1], &world->query_cache[0],
+              LIBRDF_GOOD_CAST(size_t, i) * sizeof(entry));
+      world->query_cache[0] = entry;
+
+      query = entry.query;
+      query->usage++;
+    }
+    break;
+  }
+
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(world->mutex);
+#endif
+
+  if(query) {
+    librdf_query_reset(query);
+    return query;
+  }
+
+  query = librdf_new_query_from_factory(world, factory, name, uri,
+                                        query_string, base_uri);
+  if(!query || i < world->query_cache_count || world->query_cache_size <= 0)
+    return query;
+
+  memset(&entry, 0, sizeof(entry));
+  entry.factory = factory;
+  len = strlen((const char*)query_string);
+  entry.query_string = LIBRDF_MALLOC(unsigned char*, len + 1);
+  if(!entry.query_string)
+    return query;
+  memcpy(entry.query_string, query_string, len + 1);
+  if(base_uri)
+    entry.base_uri = librdf_new_uri_from_uri(base_uri);
+
+#ifdef WITH_THREADS
+  pthread_mutex_lock(world->mutex);
+#endif
+
+  if(!world->query_cache && world->query_cache_size > 0)
+    world->query_cache = LIBRDF_CALLOC(librdf_query_cache_entry*,
+                                       LIBRDF_GOOD_CAST(size_t, world->query_cache_size),
+                                       sizeof(entry));
+
+  memset(&evicted, 0, sizeof(evicted));
+  if(world->query_cache) {
+    if(world->query_cache_count == world->query_cache_size)
+      evicted = world->query_cache[--world->query_cache_count];
+
+    memmove(&world->query_cache[1], &world->query_cache[0],
+            LIBRDF_GOOD_CAST(size_t, world->query_cache_count) * sizeof(entry));
+    entry.query = query;
+    query->usage++;
+    world->query_cache[0] = entry;
+    world->query_cache_count++;
+  } else
+    evicted = entry;
+
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(world->mutex);
+#endif
+
+  librdf_query_cache_entry_clear(&evicted);
+
+  return query;
+}
+
+
+/*
+ * librdf_query_clear_profiles - free the triple pattern profiles of a query
+ */
+static void
+librdf_query_clear_profiles(librdf_query* query)
+{
+  int i;
+
+  for(i = 0; i < query->profiles_count; i++) {
+    librdf_query_profile* profile = query->profiles[i];
+
+    if(profile->pattern)
+      librdf_free_statement(profile->pattern);
+    if(profile->context)
+      librdf_free_node(profile->context);
+    if(profile->access)
+      LIBRDF_FREE(char*, profile->access);
+    LIBRDF_FREE(librdf_query_profile, profile);
+  }
+  query->profiles_count = 0;
+}
+
+
 /**
  * librdf_free_query:
  * @query: #librdf_query object
@@ -468,15 +729,31 @@ librdf_new_query_from_factory(librdf_world *world,
 void
 librdf_free_query(librdf_query* query) 
 {
+  int usage;
+
   if(!query)
     return;
-  
-  if(--query->usage)
+
+  /* the world query cache checks usage under the same lock */
+#ifdef WITH_THREADS
+  pthread_mutex_lock(query->world->mutex);
+#endif
+  usage = --query->usage;
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(query->world->mutex);
+#endif
+  if(usage)
     return;
   
   if(query->factory)
     query->factory->terminate(query);
 
+  librdf_query_clear_profiles(query);
+  if(query->profiles)
+    LIBRDF_FREE(librdf_query_profile**, query->profiles);
+  if(query->profile_keys)
+    LIBRDF_FREE(void**, query->profile_keys);
+
   if(query->context)
     LIBRDF_FREE(librdf_query_context, query->context);
 
@@ -494,7 +771,13 @@ librdf_query_add_query_result(librdf_query *query,
   query_results->next=query->results;
   query->results=query_results;
   /* add reference to ensure query lives as long as this runs */
+#ifdef WITH_THREADS
+  pthread_mutex_lock(query->world->mutex);
+#endif
   query->usage++;
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(query->world->mutex);
+#endif
 }
 
 
@@ -520,6 +803,22 @@ librdf_query_remove_query_result(librdf_query *query,
 }
 
 
+/*
+ * librdf_query_get_time - INTERNAL - get the current time in seconds
+ */
+double
+librdf_query_get_time(void)
+{
+#ifdef HAVE_GETTIMEOFDAY
+  struct timeval tv;
+
+  if(!gettimeofday(&tv, NULL))
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+#endif
+  return (double)time(NULL);
+}
+
+
 /**
  * librdf_query_execute:
  * @query: #librdf_query object
@@ -540,10 +839,20 @@ librdf_query_execute(librdf_query* query, librdf_model* model)
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, librdf_query, NULL);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(model, librdf_model, NULL);
 
+  query->stopped = 0;
+  query->triples_count = 0;
+  librdf_query_clear_profiles(query);
+  if(query->timeout > 0)
+    query->deadline = librdf_query_get_time() + (double)query->timeout / 1000.0;
+
   if(query->factory->execute) {
     if((results=query->factory->execute(query, model)))
       librdf_query_add_query_result(query, results);
   }
+
+  /* a cancel made before or during a failed execution is used up */
+  if(!results)
+    query->cancelled = 0;
   
   return results;
 }
@@ -634,6 +943,386 @@ librdf_query_set_offset(librdf_query *query, int offset)
   return -1;
 }
 
+
+/**
+ * librdf_query_bind_variable:
+ * @query: #librdf_query query object
+ * @name: variable name or NULL to remove all bindings
+ * @value: #librdf_node value or NULL to remove the binding
+ *
+ * Bind a query variable to a value for following executions.
+ *
+ * The query is parsed once and each librdf_query_execute() then runs
+ * it with the variable replaced by @value, so that a query can be
+ * reused for different constants.  The @value node is copied.
+ *
+ * Return value: non-0 on failure (<0 if not supported by the query language)
+ **/
+int
+librdf_query_bind_variable(librdf_query *query, const char *name,
+                           librdf_node *value)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, librdf_query, 1);
+
+  if(query->factory->bind_variable)
+    return query->factory->bind_variable(query, name, value);
+
+  return -1;
+}
+
+
+/**
+ * librdf_query_set_results_cache:
+ * @query: #librdf_query query object
+ * @enable: non-0 to cache results
+ *
+ * Set whether query results are kept for repeated executions.
+ *
+ * When enabled, the results of an execution are kept in memory and
+ * a following librdf_query_execute() on the same model with the same
+ * variable bindings returns them again without evaluating the query,
+ * as long as the model modification count
+ * (see librdf_model_get_modification_count()) has not changed.
+ * Only one set of results from a query can be read at a time.
+ *
+ * Return value: non-0 on failure (<0 if not supported by the query language)
+ **/
+int
+librdf_query_set_results_cache(librdf_query *query, int enable)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, librdf_query, 1);
+
+  if(query->factory->set_results_cache)
+    return query->factory->set_results_cache(query, enable);
+
+  return -1;
+}
+
+
+/**
+ * librdf_query_set_resource_limits:
+ * @query: #librdf_query query object
+ * @timeout: maximum execution time in milliseconds or 0 for no limit
+ * @max_triples: maximum number of triples matched in the model or 0 for no limit
+ * @max_rows: maximum number of result rows or 0 for no limit
+ *
+ * Set limits on the resources used by each execution of the query.
+ *
+ * When a limit is exceeded, an error is logged and the results end
+ * early: librdf_query_results_next() returns failure,
+ * librdf_query_results_finished() returns true and
+ * librdf_query_results_get_boolean() returns <0.  If the limit is
+ * exceeded during librdf_query_execute(), it fails.  The limits are
+ * checked as triples are matched and rows returned, so the time limit
+ * cannot interrupt a long step that matches no triples such as sorting.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+librdf_query_set_resource_limits(librdf_query *query, long timeout,
+                                 long max_triples, long max_rows)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, librdf_query, 1);
+
+  if(timeout < 0 || max_triples < 0 || max_rows < 0)
+    return 1;
+
+  query->timeout = timeout;
+  query->max_triples = max_triples;
+  query->max_rows = max_rows;
+
+  return 0;
+}
+
+
+/**
+ * librdf_query_set_workers:
+ * @query: #librdf_query query object
+ * @workers: most threads to use, 0 or 1 to use only the calling thread
+ *
+ * Set the most threads used to scan the storage for each triple pattern.
+ *
+ * The count is passed to the storage as the "workers" option of
+ * librdf_storage_find_statements_with_options().  Storages that can
+ * scan their statements on several threads, such as "trees" when a
+ * pattern has no index, split a large scan between that many
+ * threads; other storages ignore it.  The rest of the query is
+ * evaluated on the calling thread.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+librdf_query_set_workers(librdf_query *query, int workers)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, librdf_query, 1);
+
+  if(workers < 0)
+    return 1;
+
+  query->workers = workers;
+
+  return 0;
+}
+
+
+/**
+ * librdf_query_cancel:
+ * @query: #librdf_query query object
+ *
+ * Cancel the current execution of the query.
+ *
+ * May be called from another thread or a signal handler while the
+ * query is running.  The results end at the next limit check as if a
+ * resource limit was exceeded.  A cancel made before
+ * librdf_query_execute() applies to that execution.  It stays in
+ * effect until the results are freed with librdf_free_query_results()
+ * or the execution fails.
+ **/
+void
+librdf_query_cancel(librdf_query *query)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN(query, librdf_query);
+
+  query->cancelled = 1;
+}
+
+
+/**
+ * librdf_query_check_limits:
+ * @query: #librdf_query query object
+ *
+ * INTERNAL - Check if the current execution must stop
+ *
+ * Called by query factories as triples are matched, after
+ * incrementing the query triples_count.  The clock is only read
+ * every 256 calls to keep this cheap.
+ *
+ * Return value: non-0 if the query was cancelled or exceeded a limit
+ **/
+int
+librdf_query_check_limits(librdf_query *query)
+{
+  const char* reason = NULL;
+
+  if(query->stopped)
+    return 1;
+
+  if(query->cancelled)
+    reason = "was cancelled";
+  else if(query->max_triples > 0 && query->triples_count > query->max_triples)
+    reason = "matched too many triples";
+  else if(query->timeout > 0 && !(query->triples_count & 0xff) &&
+          librdf_query_get_time() > query->deadline)
+    reason = "timed out";
+  else
+    return 0;
+
+  query->stopped = 1;
+  librdf_log(query->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_QUERY, NULL,
+             "Query %s", reason);
+  return 1;
+}
+
+
+/**
+ * librdf_query_set_profiling:
+ * @query: #librdf_query query object
+ * @enable: non-0 to profile executions
+ *
+ * Set whether executions of the query are profiled.
+ *
+ * When enabled, each execution records for every triple pattern how
+ * it was matched against the model, how many statements were
+ * returned and bound and the time spent.  The profiles of the last
+ * execution are returned by librdf_query_get_profile() and
+ * librdf_query_write_profile().
+ *
+ * Return value: non-0 on failure
+ **/
+int
+librdf_query_set_profiling(librdf_query *query, int enable)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, librdf_query, 1);
+
+  query->profiling = enable;
+  return 0;
+}
+
+
+/**
+ * librdf_query_get_profiles_count:
+ * @query: #librdf_query query object
+ *
+ * Get the number of triple pattern profiles of the last execution.
+ *
+ * Return value: number of profiles
+ **/
+int
+librdf_query_get_profiles_count(librdf_query *query)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, librdf_query, 0);
+
+  return query->profiles_count;
+}
+
+
+/**
+ * librdf_query_get_profile:
+ * @query: #librdf_query query object
+ * @offset: index of profile
+ *
+ * Get a triple pattern profile of the last execution.
+ *
+ * Profiles are in the order the patterns were first matched.  The
+ * profile is shared and valid until the query is executed again or
+ * freed.  Counts keep growing while the results are read.
+ *
+ * Return value: profile or NULL if @offset is out of range
+ **/
+const librdf_query_profile*
+librdf_query_get_profile(librdf_query *query, int offset)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, librdf_query, NULL);
+
+  if(offset < 0 || offset >= query->profiles_count)
+    return NULL;
+
+  return query->profiles[offset];
+}
+
+
+/**
+ * librdf_query_add_profile:
+ * @query: #librdf_query query object
+ * @key: query factory key of a triple pattern
+ *
+ * INTERNAL - Get the profile of a triple pattern, adding it if new
+ *
+ * A new profile is zeroed; the caller fills in the pattern and
+ * access when access is NULL.
+ *
+ * Return value: profile or NULL on failure
+ **/
+librdf_query_profile*
+librdf_query_add_profile(librdf_query *query, const void *key)
+{
+  librdf_query_profile* profile;
+  int i;
+
+  for(i = 0; i < query->profiles_count; i++) {
+    if(query->profile_keys[i] == key)
+      return query->profiles[i];
+  }
+
+  if(query->profiles_count == query->profiles_size) {
+    int size = query->profiles_size ? query->profiles_size * 2 : 8;
+    librdf_query_profile** profiles;
+    const void** keys;
+
+    profiles = LIBRDF_CALLOC(librdf_query_profile**, LIBRDF_GOOD_CAST(size_t, size),
+                             sizeof(*profiles));
+    keys = LIBRDF_CALLOC(const void**, LIBRDF_GOOD_CAST(size_t, size),
+                         sizeof(*keys));
+    if(!profiles || !keys) {
+      if(profiles)
+        LIBRDF_FREE(librdf_query_profile**, profiles);
+      if(keys)
+        LIBRDF_FREE(void**, keys);
+      return NULL;
+    }
+
+    if(query->profiles_count) {
+      memcpy(profiles, query->profiles,
+             LIBRDF_GOOD_CAST(size_t, query->profiles_count) * sizeof(*profiles));
+      memcpy(keys, query->profile_keys,
+             LIBRDF_GOOD_CAST(size_t, query->profiles_count) * sizeof(*keys));
+    }
+    if(query->profiles)
+      LIBRDF_FREE(librdf_query_profile**, query->profiles);
+    if(query->profile_keys)
+      LIBRDF_FREE(void**, query->profile_keys);
+
+    query->profiles = profiles;
+    query->profile_keys = keys;
+    query->profiles_size = size;
+  }
+
+  profile = LIBRDF_CALLOC(librdf_query_profile*, 1, sizeof(*profile));
+  if(!profile)
+    return NULL;
+
+  query->profiles[query->profiles_count] = profile;
+  query->profile_keys[query->profiles_count] = key;
+  query->profiles_count++;
+
+  return profile;
+}
+
+
+/**
+ * librdf_query_write_profile:
+ * @query: #librdf_query query object
+ * @iostr: iostream to write to
+ *
+ * Write the triple pattern profiles of the last execution as text.
+ *
+ * Writes one line per pattern with the tab separated pattern, access,
+ * times opened, statements scanned, statements bound and seconds.
+ * Variables in patterns are written as ?.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+librdf_query_write_profile(librdf_query *query, raptor_iostream *iostr)
+{
+  char time_buffer[64];
+  int i;
+  int j;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, librdf_query, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(iostr, raptor_iostream, 1);
+
+  for(i = 0; i < query->profiles_count; i++) {
+    librdf_query_profile* profile = query->profiles[i];
+    librdf_node* parts[4];
+
+    if(!profile->pattern)
+      continue;
+
+    parts[0] = librdf_statement_get_subject(profile->pattern);
+    parts[1] = librdf_statement_get_predicate(profile->pattern);
+    parts[2] = librdf_statement_get_object(profile->pattern);
+    parts[3] = profile->context;
+
+    for(j = 0; j < 4; j++) {
+      if(j == 3 && !parts[j])
+        break;
+      if(j)
+        raptor_iostream_write_byte(' ', iostr);
+      if(!parts[j])
+        raptor_iostream_write_byte('?', iostr);
+      else if(librdf_node_write(parts[j], iostr))
+        return 1;
+    }
+
+    raptor_iostream_write_byte('\t', iostr);
+    if(profile->access)
+      raptor_iostream_string_write(profile->access, iostr);
+    raptor_iostream_write_byte('\t', iostr);
+    raptor_iostream_decimal_write(profile->opened, iostr);
+    raptor_iostream_write_byte('\t', iostr);
+    raptor_iostream_decimal_write((int)profile->scanned, iostr);
+    raptor_iostream_write_byte('\t', iostr);
+    raptor_iostream_decimal_write((int)profile->bound, iostr);
+    raptor_iostream_write_byte('\t', iostr);
+    sprintf(time_buffer, "%.6f", profile->time);
+    raptor_iostream_string_write(time_buffer, iostr);
+    raptor_iostream_write_byte('\n', iostr);
+  }
+
+  return 0;
+}
+
 #endif
 
 
@@ -650,12 +1339,22 @@ int main(int argc, char *argv[]);
 #define DATA "@prefix ex: <http://example.org/> .\
 ex:fido a ex:Dog ;\
         ex:label \"Fido\" .\
+ex:rex a ex:Dog .\
+ex:spot a ex:Dog .\
 "
 #define DATA_LANGUAGE "turtle"
 #define DATA_BASE_URI "http://example.org/"
 #define QUERY_STRING "SELECT ?x WHERE { ?x a ?y }"
 #define QUERY_LANGUAGE "sparql"
 #define VARIABLES_COUNT 1
+#define BOUND_QUERY_STRING "SELECT ?y WHERE { ?x a ?y }"
+#define LIMIT_QUERY_STRING "SELECT ?x WHERE { ?x a ?y } LIMIT 2"
+#define OFFSET_QUERY_STRING "PREFIX ex: <http://example.org/> SELECT ?x WHERE { ?x a ex:Dog } LIMIT 2 OFFSET 1"
+#define ASK_QUERY_STRING "PREFIX ex: <http://example.org/> ASK { ex:fido a ex:Dog . ex:rex a ex:Dog . ex:spot a ex:Dog }"
+#define JOIN_QUERY_STRING "PREFIX ex: <http://example.org/> SELECT ?x ?l WHERE { ?x a ex:Dog . ?x ex:label ?l }"
+#define WORKERS_QUERY_STRING "PREFIX ex: <http://example.org/> SELECT ?x WHERE { ?x ex:value \"3\" }"
+#define TEST_WORKERS 4
+#define TEST_WORKERS_STATEMENTS 20000
 
 int
 main(int argc, char *argv[]) 
@@ -671,7 +1370,12 @@ main(int argc, char *argv[])
   size_t string_length;
   unsigned char *string;
   const char *query_string=QUERY_STRING;
+  librdf_query* cached_query;
+  librdf_node* node;
+  librdf_statement* statement;
+  unsigned long modification_count;
   int i;
+  int workers;
   
   world=librdf_new_world();
   librdf_world_open(world);
@@ -795,6 +1499,394 @@ main(int argc, char *argv[])
   fprintf(stdout, "%s: Freeing query\n", program);
   librdf_free_query(query);
 
+
+  fprintf(stdout, "%s: Executing a cached query with a bound variable\n",
+          program);
+  query=librdf_new_query_from_cache(world, QUERY_LANGUAGE, NULL,
+                                    (const unsigned char*)BOUND_QUERY_STRING,
+                                    NULL);
+  if(!query) {
+    fprintf(stderr, "%s: Failed to get cached query\n", program);
+    return 1;
+  }
+  cached_query=query;
+  librdf_free_query(query);
+
+  query=librdf_new_query_from_cache(world, QUERY_LANGUAGE, NULL,
+                                    (const unsigned char*)BOUND_QUERY_STRING,
+                                    NULL);
+  if(query != cached_query) {
+    fprintf(stderr, "%s: Query cache did not return the cached query\n",
+            program);
+    return 1;
+  }
+
+  node=librdf_new_node_from_uri_string(world,
+                                       (const unsigned char*)DATA_BASE_URI "fido");
+  librdf_query_bind_variable(query, "x", node);
+  librdf_free_node(node);
+  librdf_query_set_results_cache(query, 1);
+  /* executions served from the results cache match no triples */
+  librdf_query_set_profiling(query, 1);
+
+  if(!(results=librdf_model_query_execute(model, query))) {
+    fprintf(stderr, "%s: Query of model with '%s' failed\n", 
+            program, BOUND_QUERY_STRING);
+    return 1;
+  }
+  while(!librdf_query_results_finished(results))
+    librdf_query_results_next(results);
+  if(librdf_query_results_get_count(results) != 1) {
+    fprintf(stderr, "%s: Bound query returned %d results, expected 1\n",
+            program, librdf_query_results_get_count(results));
+    return 1;
+  }
+  librdf_free_query_results(results);
+
+  fprintf(stdout, "%s: Executing the cached query again\n", program);
+  modification_count = librdf_model_get_modification_count(model);
+  if(!(results=librdf_model_query_execute(model, query))) {
+    fprintf(stderr, "%s: Repeated query of model with '%s' failed\n", 
+            program, BOUND_QUERY_STRING);
+    return 1;
+  }
+  while(!librdf_query_results_finished(results))
+    librdf_query_results_next(results);
+  if(librdf_query_results_get_count(results) != 1 ||
+     librdf_model_get_modification_count(model) != modification_count) {
+    fprintf(stderr, "%s: Cached query results returned %d results, expected 1\n",
+            program, librdf_query_results_get_count(results));
+    return 1;
+  }
+  if(librdf_query_get_profiles_count(query)) {
+    fprintf(stderr, "%s: Repeated query was not served from the results cache\n",
+            program);
+    return 1;
+  }
+  librdf_free_query_results(results);
+
+  fprintf(stdout, "%s: Executing the cached query after changing the model\n",
+          program);
+  statement=librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)DATA_BASE_URI "fido"),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://www.w3.org/1999/02/22-rdf-syntax-ns#type"),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)DATA_BASE_URI "Animal"));
+  librdf_model_add_statement(model, statement);
+  if(librdf_model_get_modification_count(model) == modification_count) {
+    fprintf(stderr, "%s: Adding a statement did not change the model modification count\n",
+            program);
+    return 1;
+  }
+  if(!(results=librdf_model_query_execute(model, query))) {
+    fprintf(stderr, "%s: Query of changed model with '%s' failed\n", 
+            program, BOUND_QUERY_STRING);
+    return 1;
+  }
+  while(!librdf_query_results_finished(results))
+    librdf_query_results_next(results);
+  if(librdf_query_results_get_count(results) != 2 ||
+     !librdf_query_get_profiles_count(query)) {
+    fprintf(stderr, "%s: Query of changed model returned %d results, expected 2\n",
+            program, librdf_query_results_get_count(results));
+    return 1;
+  }
+  librdf_free_query_results(results);
+  librdf_free_query(query);
+  librdf_model_remove_statement(model, statement);
+  librdf_free_statement(statement);
+
+
+  fprintf(stdout, "%s: Executing a query with a limit and offset\n", program);
+  query=librdf_new_query(world, QUERY_LANGUAGE, NULL,
+                         (const unsigned char*)OFFSET_QUERY_STRING, NULL);
+  if(!query) {
+    fprintf(stderr, "%s: Failed to create new query\n", program);
+    return(1);
+  }
+  for(i = 0; i < 2; i++) {
+    /* 3 dogs: LIMIT 2 OFFSET 1 gives 2 rows, then OFFSET 2 gives 1 */
+    int expected = 2 - i;
+
+    if(i)
+      librdf_query_set_offset(query, 2);
+    if(!(results=librdf_model_query_execute(model, query))) {
+      fprintf(stderr, "%s: Query of model with '%s' failed\n", 
+              program, OFFSET_QUERY_STRING);
+      return 1;
+    }
+    while(!librdf_query_results_finished(results))
+      librdf_query_results_next(results);
+    if(librdf_query_results_get_count(results) != expected) {
+      fprintf(stderr, "%s: Query with offset %d returned %d results, expected %d\n",
+              program, librdf_query_get_offset(query),
+              librdf_query_results_get_count(results), expected);
+      return 1;
+    }
+    librdf_free_query_results(results);
+  }
+  librdf_free_query(query);
+
+
+  fprintf(stdout, "%s: Reusing a cached query after changing its limit\n",
+          program);
+  query=librdf_new_query_from_cache(world, QUERY_LANGUAGE, NULL,
+                                    (const unsigned char*)LIMIT_QUERY_STRING,
+                                    NULL);
+  if(!query) {
+    fprintf(stderr, "%s: Failed to get cached query\n", program);
+    return 1;
+  }
+  cached_query=query;
+  librdf_query_set_limit(query, 1);
+  librdf_query_set_resource_limits(query, 0, 1000, 0);
+  librdf_query_set_results_cache(query, 1);
+  if(!(results=librdf_model_query_execute(model, query))) {
+    fprintf(stderr, "%s: Query of model with '%s' failed\n", 
+            program, LIMIT_QUERY_STRING);
+    return 1;
+  }
+  while(!librdf_query_results_finished(results))
+    librdf_query_results_next(results);
+  if(librdf_query_results_get_count(results) != 1) {
+    fprintf(stderr, "%s: Query with limit 1 returned %d results, expected 1\n",
+            program, librdf_query_results_get_count(results));
+    return 1;
+  }
+  librdf_free_query_results(results);
+  librdf_free_query(query);
+
+  query=librdf_new_query_from_cache(world, QUERY_LANGUAGE, NULL,
+                                    (const unsigned char*)LIMIT_QUERY_STRING,
+                                    NULL);
+  if(query != cached_query) {
+    fprintf(stderr, "%s: Query cache did not return the cached query\n",
+            program);
+    return 1;
+  }
+  if(librdf_query_get_limit(query) != 2) {
+    fprintf(stderr, "%s: Reused query has limit %d, expected 2\n",
+            program, librdf_query_get_limit(query));
+    return 1;
+  }
+  if(!(results=librdf_model_query_execute(model, query))) {
+    fprintf(stderr, "%s: Reused query of model with '%s' failed\n", 
+            program, LIMIT_QUERY_STRING);
+    return 1;
+  }
+  while(!librdf_query_results_finished(results))
+    librdf_query_results_next(results);
+  if(librdf_query_results_get_count(results) != 2) {
+    fprintf(stderr, "%s: Reused query returned %d results, expected 2\n",
+            program, librdf_query_results_get_count(results));
+    return 1;
+  }
+  librdf_free_query_results(results);
+  librdf_free_query(query);
+
+
+  fprintf(stdout, "%s: Stopping an ASK query at a triple limit\n", program);
+  query=librdf_new_query(world, QUERY_LANGUAGE, NULL,
+                         (const unsigned char*)ASK_QUERY_STRING, NULL);
+  if(!query) {
+    fprintf(stderr, "%s: Failed to create new query\n", program);
+    return(1);
+  }
+  librdf_query_set_resource_limits(query, 0, 1, 0);
+  results=librdf_model_query_execute(model, query);
+  if(results && librdf_query_results_get_boolean(results) >= 0) {
+    fprintf(stderr, "%s: ASK query over its triple limit did not fail\n",
+            program);
+    return 1;
+  }
+  if(results)
+    librdf_free_query_results(results);
+
+  /* without the limit the same query is true */
+  librdf_query_set_resource_limits(query, 0, 0, 0);
+  results=librdf_model_query_execute(model, query);
+  if(!results || librdf_query_results_get_boolean(results) <= 0) {
+    fprintf(stderr, "%s: ASK query without a limit was not true\n",
+            program);
+    return 1;
+  }
+  librdf_free_query_results(results);
+
+  /* a cancel made before executing stops only that execution */
+  librdf_query_cancel(query);
+  results=librdf_model_query_execute(model, query);
+  if(results && librdf_query_results_get_boolean(results) >= 0) {
+    fprintf(stderr, "%s: ASK query cancelled before executing was not stopped\n",
+            program);
+    return 1;
+  }
+  if(results)
+    librdf_free_query_results(results);
+  results=librdf_model_query_execute(model, query);
+  if(!results || librdf_query_results_get_boolean(results) <= 0) {
+    fprintf(stderr, "%s: ASK query after a cancelled execution was not true\n",
+            program);
+    return 1;
+  }
+  librdf_free_query_results(results);
+  librdf_free_query(query);
+
+  librdf_free_model(model);
+  librdf_free_storage(storage);
+
+
+  fprintf(stdout, "%s: Executing a join on a hashes storage\n",
+          program);
+  storage=librdf_new_storage(world, "hashes", "test",
+                             "hash-type='memory'");
+  if(!storage) {
+    fprintf(stderr, "%s: Failed to create new hashes storage\n", program);
+    return(1);
+  }
+  model=librdf_new_model(world, storage, NULL);
+  if(!model) {
+    fprintf(stderr, "%s: Failed to create new model\n", program);
+    return(1);
+  }
+  uri=librdf_new_uri(world, (const unsigned char*)DATA_BASE_URI);
+  parser=librdf_new_parser(world, DATA_LANGUAGE, NULL, NULL);
+  librdf_parser_parse_string_into_model(parser, (const unsigned char*)DATA,
+                                        uri, model);
+  librdf_free_parser(parser);
+  librdf_free_uri(uri);
+
+  query=librdf_new_query(world, QUERY_LANGUAGE, NULL,
+                         (const unsigned char*)JOIN_QUERY_STRING, NULL);
+  if(!query) {
+    fprintf(stderr, "%s: Failed to create new query\n", program);
+    return(1);
+  }
+  librdf_query_set_profiling(query, 1);
+  if(!(results=librdf_model_query_execute(model, query))) {
+    fprintf(stderr, "%s: Query of model with '%s' failed\n", 
+            program, JOIN_QUERY_STRING);
+    return 1;
+  }
+  while(!librdf_query_results_finished(results)) {
+    node=librdf_query_results_get_binding_value_by_name(results, "x");
+    if(!node ||
+       strcmp((const char*)librdf_uri_as_string(librdf_node_get_uri(node)),
+              DATA_BASE_URI "fido")) {
+      fprintf(stderr, "%s: Join query returned the wrong binding for x\n",
+              program);
+      return 1;
+    }
+    librdf_free_node(node);
+    node=librdf_query_results_get_binding_value_by_name(results, "l");
+    if(!node || !librdf_node_is_literal(node) ||
+       strcmp((const char*)librdf_node_get_literal_value(node), "Fido")) {
+      fprintf(stderr, "%s: Join query returned the wrong binding for l\n",
+              program);
+      return 1;
+    }
+    librdf_free_node(node);
+    librdf_query_results_next(results);
+  }
+  if(librdf_query_results_get_count(results) != 1) {
+    fprintf(stderr, "%s: Join query returned %d results, expected 1\n",
+            program, librdf_query_results_get_count(results));
+    return 1;
+  }
+
+  /* one profile per triple pattern, each matched and bound */
+  if(librdf_query_get_profiles_count(query) != 2) {
+    fprintf(stderr, "%s: Join query has %d profiles, expected 2\n",
+            program, librdf_query_get_profiles_count(query));
+    return 1;
+  }
+  for(i = 0; i < 2; i++) {
+    const librdf_query_profile* profile = librdf_query_get_profile(query, i);
+
+    if(!profile || !profile->pattern || !profile->access ||
+       profile->opened < 1 || profile->bound < 1) {
+      fprintf(stderr, "%s: Join query profile %d is incomplete\n",
+              program, i);
+      return 1;
+    }
+  }
+  librdf_free_query_results(results);
+  librdf_free_query(query);
+
+  librdf_free_model(model);
+  librdf_free_storage(storage);
+
+
+  /* only spo is indexed so ?x p o is matched against every statement */
+  fprintf(stdout, "%s: Executing a query with %d workers on a trees storage\n",
+          program, TEST_WORKERS);
+  storage=librdf_new_storage(world, "trees", "test", "index-spo='yes'");
+  if(!storage) {
+    fprintf(stderr, "%s: Failed to create new trees storage\n", program);
+    return(1);
+  }
+  model=librdf_new_model(world, storage, NULL);
+  if(!model) {
+    fprintf(stderr, "%s: Failed to create new model\n", program);
+    return(1);
+  }
+  for(i = 0; i < TEST_WORKERS_STATEMENTS; i++) {
+    char subject[64];
+    char value[16];
+
+    sprintf(subject, DATA_BASE_URI "s%d", i);
+    sprintf(value, "%d", i % 10);
+    statement=librdf_new_statement_from_nodes(world,
+      librdf_new_node_from_uri_string(world, (const unsigned char*)subject),
+      librdf_new_node_from_uri_string(world, (const unsigned char*)DATA_BASE_URI "value"),
+      librdf_new_node_from_literal(world, (const unsigned char*)value, NULL, 0));
+    if(!statement || librdf_model_add_statement(model, statement)) {
+      fprintf(stderr, "%s: Failed to add statement %d\n", program, i);
+      return 1;
+    }
+    librdf_free_statement(statement);
+  }
+
+  query=librdf_new_query(world, QUERY_LANGUAGE, NULL,
+                         (const unsigned char*)WORKERS_QUERY_STRING, NULL);
+  if(!query) {
+    fprintf(stderr, "%s: Failed to create new query\n", program);
+    return(1);
+  }
+  /* the same results on the calling thread alone and on the workers */
+  for(workers = 1; workers <= TEST_WORKERS; workers += TEST_WORKERS - 1) {
+    if(librdf_query_set_workers(query, workers)) {
+      fprintf(stderr, "%s: Failed to set %d query workers\n", program,
+              workers);
+      return 1;
+    }
+    if(!(results=librdf_model_query_execute(model, query))) {
+      fprintf(stderr, "%s: Query of model with '%s' on %d workers failed\n",
+              program, WORKERS_QUERY_STRING, workers);
+      return 1;
+    }
+    while(!librdf_query_results_finished(results)) {
+      const char* x;
+
+      node=librdf_query_results_get_binding_value_by_name(results, "x");
+      x=node ? (const char*)librdf_uri_as_string(librdf_node_get_uri(node)) : NULL;
+      if(!x || strncmp(x, DATA_BASE_URI "s", strlen(DATA_BASE_URI) + 1) ||
+         atoi(x + strlen(DATA_BASE_URI) + 1) % 10 != 3) {
+        fprintf(stderr, "%s: Query on %d workers returned the wrong binding for x\n",
+                program, workers);
+        return 1;
+      }
+      librdf_free_node(node);
+      librdf_query_results_next(results);
+    }
+    if(librdf_query_results_get_count(results) != TEST_WORKERS_STATEMENTS / 10) {
+      fprintf(stderr, "%s: Query on %d workers returned %d results, expected %d\n",
+              program, workers, librdf_query_results_get_count(results),
+              TEST_WORKERS_STATEMENTS / 10);
+      return 1;
+    }
+    librdf_free_query_results(results);
+  }
+  librdf_free_query(query);
+
   librdf_free_model(model);
   librdf_free_storage(storage);
 
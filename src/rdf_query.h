@@ -35,6 +35,30 @@ extern "C" {
 #endif
 
 /* class methods */
+/**
+ * librdf_query_profile_s:
+ * @pattern: triple pattern with NULL for variables
+ * @context: context node or NULL if the pattern has no constant context
+ * @access: storage access used, such as the storage name and the find method with the parts bound when first opened
+ * @opened: number of times the pattern was matched against the model
+ * @scanned: number of statements returned by the storage
+ * @bound: number of statements that gave variable bindings
+ * @time: seconds spent in the storage and in binding
+ *
+ * Profile of the matching of one triple pattern during a query execution.
+ */
+struct librdf_query_profile_s
+{
+  librdf_statement* pattern;
+  librdf_node* context;
+  char* access;
+  int opened;
+  long scanned;
+  long bound;
+  double time;
+};
+
+
 REDLAND_API
 void librdf_query_register_factory(librdf_world *world, const char *name, const unsigned char *uri_string, void (*factory) (librdf_query_factory*));
 REDLAND_API REDLAND_DEPRECATED
@@ -49,6 +73,8 @@ REDLAND_API
 librdf_query* librdf_new_query_from_query (librdf_query* old_query);
 REDLAND_API
 librdf_query* librdf_new_query_from_factory(librdf_world* world, librdf_query_factory* factory, const char *name, librdf_uri* uri, const unsigned char* query_string, librdf_uri* base_uri);
+REDLAND_API
+librdf_query* librdf_new_query_from_cache(librdf_world* world, const char *name, librdf_uri* uri, const unsigned char *query_string, librdf_uri* base_uri);
 
 /* destructor */
 REDLAND_API
@@ -66,6 +92,24 @@ REDLAND_API
 int librdf_query_get_offset(librdf_query *query);
 REDLAND_API
 int librdf_query_set_offset(librdf_query *query, int offset);
+REDLAND_API
+int librdf_query_bind_variable(librdf_query *query, const char *name, librdf_node *value);
+REDLAND_API
+int librdf_query_set_results_cache(librdf_query *query, int enable);
+REDLAND_API
+int librdf_query_set_resource_limits(librdf_query *query, long timeout, long max_triples, long max_rows);
+REDLAND_API
+int librdf_query_set_workers(librdf_query *query, int workers);
+REDLAND_API
+void librdf_query_cancel(librdf_query *query);
+REDLAND_API
+int librdf_query_set_profiling(librdf_query *query, int enable);
+REDLAND_API
+int librdf_query_get_profiles_count(librdf_query *query);
+REDLAND_API
+const librdf_query_profile* librdf_query_get_profile(librdf_query *query, int offset);
+REDLAND_API
+int librdf_query_write_profile(librdf_query *query, raptor_iostream *iostr);
 
 REDLAND_API
 librdf_stream* librdf_query_results_as_stream(librdf_query_results* query_results);
@@ -87,6 +131,8 @@ REDLAND_API
 librdf_node* librdf_query_results_get_binding_value_by_name(librdf_query_results* query_results, const char *name);
 REDLAND_API
 int librdf_query_results_get_bindings_count(librdf_query_results* query_results);
+REDLAND_API
+int librdf_query_results_get_bindings_batch(librdf_query_results* query_results, librdf_node **values, int rows);
 REDLAND_API REDLAND_DEPRECATED
 unsigned char* librdf_query_results_to_counted_string(librdf_query_results *query_results, librdf_uri *format_uri, librdf_uri *base_uri, size_t *length_p);
 REDLAND_API
@@ -30,6 +30,9 @@
 extern "C" {
 #endif
 
+/* for sig_atomic_t */
+#include <signal.h>
+
 /** A query object */
 struct librdf_query_s
 {
@@ -40,6 +43,31 @@ struct librdf_query_s
 
   /* list of all the results for this query */
   librdf_query_results* results;
+
+  /* resource limits set by librdf_query_set_resource_limits(), 0 for none */
+  long timeout; /* milliseconds */
+  long max_triples;
+  long max_rows;
+
+  /* most threads scanning the storage, set by librdf_query_set_workers() */
+  int workers;
+
+  /* set by librdf_query_cancel(), possibly from a signal handler, and
+   * cleared when the execution it stopped ends */
+  volatile sig_atomic_t cancelled;
+
+  /* state of the current execution for checking the limits */
+  int stopped;
+  long triples_count;
+  double deadline;
+
+  /* triple pattern profiles of the last execution if profiling */
+  int profiling;
+  librdf_query_profile** profiles;
+  /* query factory keys identifying the patterns of profiles */
+  const void** profile_keys;
+  int profiles_count;
+  int profiles_size;
 };
 
 
@@ -50,6 +78,11 @@ struct librdf_query_results_s
 
   /* next query result */
   librdf_query_results* next;
+
+  /* nodes lent by librdf_query_results_get_bindings_batch() */
+  librdf_node** batch;
+  int batch_count;
+  int batch_size;
 };
 
 
@@ -114,6 +147,18 @@ struct librdf_query_factory_s {
   int (*get_offset)(librdf_query *query);
   int (*set_offset)(librdf_query *query, int offset);
 
+  /* bind a variable to a value for following executions or
+   * remove the binding if value is NULL, all bindings if name is NULL
+   * - OPTIONAL */
+  int (*bind_variable)(librdf_query *query, const char *name, librdf_node *value);
+
+  /* enable/disable keeping results for repeated executions - OPTIONAL */
+  int (*set_results_cache)(librdf_query *query, int enable);
+
+  /* remove the variable bindings, limit, offset and results cache set
+   * since init so the query can be reused - OPTIONAL */
+  int (*reset)(librdf_query *query);
+
   /* get the query results as a stream - OPTIONAL */
   librdf_stream* (*results_as_stream)(librdf_query_results* query_results);
 
@@ -161,12 +206,27 @@ struct librdf_query_factory_s {
 };
 
 
+/* Default number of parsed queries kept by librdf_new_query_from_cache() */
+#define LIBRDF_QUERY_CACHE_SIZE 16
+
+/* World query cache entry: the query and the key it was created with */
+typedef struct librdf_query_cache_entry_s
+{
+  librdf_query_factory* factory;
+  unsigned char* query_string;
+  librdf_uri* base_uri;
+  librdf_query* query;
+} librdf_query_cache_entry;
+
+
 /* module init */
 int librdf_init_query(librdf_world *world);
 
 /* module terminate */
 void librdf_finish_query(librdf_world *world);
 
+void librdf_query_cache_resize(librdf_world *world, int size);
+
 /* class methods */
 librdf_query_factory* librdf_get_query_factory(librdf_world *world, const char *name, librdf_uri* uri);
 
@@ -178,6 +238,9 @@ void librdf_init_query_virtuoso(librdf_world *world);
 
 void librdf_query_rasqal_destructor(librdf_world *world);
 
+int librdf_query_check_limits(librdf_query *query);
+double librdf_query_get_time(void);
+librdf_query_profile* librdf_query_add_profile(librdf_query *query, const void *key);
 void librdf_query_add_query_result(librdf_query *query, librdf_query_results* query_results);
 void librdf_query_remove_query_result(librdf_query *query, librdf_query_results* query_results);
 
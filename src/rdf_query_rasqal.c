@@ -58,6 +58,28 @@ typedef struct
 
   int errors;
   int warnings;
+
+  /* variables bound with librdf_query_bind_variable() */
+  char **binding_names;
+  librdf_node **binding_values;
+  int bindings_count;
+  int bindings_size;
+
+  /* limit and offset given in the query string, restored on reset
+   * when query_limits_saved is non-0 */
+  int query_limit;
+  int query_offset;
+  int query_limits_saved;
+
+  /* non-0 if results are kept for repeated executions */
+  int cache_results;
+  /* non-0 if results are valid for model at model_modification_count */
+  int results_cached;
+  unsigned long model_modification_count;
+
+  /* triples source of the current execution, used to convert result
+   * values with its term cache */
+  struct rasqal_redland_triples_source_user_data_s *rtsc;
 } librdf_query_rasqal_context;
 
 
@@ -140,11 +162,141 @@ librdf_query_rasqal_init(librdf_query* query,
 }
 
 
+/*
+ * librdf_query_rasqal_bind_variable:
+ * @query: #librdf_query object
+ * @name: variable name or NULL to remove all bindings
+ * @value: value or NULL to remove the binding
+ *
+ * INTERNAL - Record a variable binding applied when the query is executed
+ *
+ * Return value: non-0 on failure
+ */
+static int
+librdf_query_rasqal_bind_variable(librdf_query* query, const char *name,
+                                  librdf_node *value)
+{
+  librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
+  librdf_node* node;
+  size_t len;
+  int i;
+
+  if(!name) {
+    if(context->bindings_count)
+      context->results_cached = 0;
+    for(i = 0; i < context->bindings_count; i++) {
+      if(context->rq)
+        rasqal_query_set_variable2(context->rq, RASQAL_VARIABLE_TYPE_NORMAL,
+                                   (const unsigned char*)context->binding_names[i],
+                                   NULL);
+      LIBRDF_FREE(char*, context->binding_names[i]);
+      librdf_free_node(context->binding_values[i]);
+    }
+    context->bindings_count = 0;
+    return 0;
+  }
+
+  for(i = 0; i < context->bindings_count; i++) {
+    if(!strcmp(context->binding_names[i], name))
+      break;
+  }
+
+  if(!value) {
+    if(i == context->bindings_count)
+      return 0;
+
+    context->results_cached = 0;
+
+    /* unset any value left from an earlier execution */
+    if(context->rq)
+      rasqal_query_set_variable2(context->rq, RASQAL_VARIABLE_TYPE_NORMAL,
+                                 (const unsigned char*)name, NULL);
+    LIBRDF_FREE(char*, context->binding_names[i]);
+    librdf_free_node(context->binding_values[i]);
+    context->bindings_count--;
+    context->binding_names[i] = context->binding_names[context->bindings_count];
+    context->binding_values[i] = context->binding_values[context->bindings_count];
+    return 0;
+  }
+
+  if(i < context->bindings_count &&
+     librdf_node_equals(context->binding_values[i], value))
+    return 0;
+
+  node = librdf_new_node_from_node(value);
+  if(!node)
+    return 1;
+
+  context->results_cached = 0;
+
+  if(i < context->bindings_count) {
+    librdf_free_node(context->binding_values[i]);
+    context->binding_values[i] = node;
+    return 0;
+  }
+
+  if(context->bindings_count == context->bindings_size) {
+    int size = context->bindings_size ? context->bindings_size * 2 : 4;
+    char **names;
+    librdf_node **values;
+
+    names = LIBRDF_CALLOC(char**, LIBRDF_GOOD_CAST(size_t, size), sizeof(char*));
+    values = LIBRDF_CALLOC(librdf_node**, LIBRDF_GOOD_CAST(size_t, size),
+                           sizeof(librdf_node*));
+    if(!names || !values) {
+      if(names)
+        LIBRDF_FREE(char**, names);
+      if(values)
+        LIBRDF_FREE(librdf_node**, values);
+      librdf_free_node(node);
+      return 1;
+    }
+
+    if(context->bindings_count) {
+      memcpy(names, context->binding_names,
+             LIBRDF_GOOD_CAST(size_t, context->bindings_count) * sizeof(char*));
+      memcpy(values, context->binding_values,
+             LIBRDF_GOOD_CAST(size_t, context->bindings_count) * sizeof(librdf_node*));
+    }
+    if(context->binding_names)
+      LIBRDF_FREE(char**, context->binding_names);
+    if(context->binding_values)
+      LIBRDF_FREE(librdf_node**, context->binding_values);
+
+    context->binding_names = names;
+    context->binding_values = values;
+    context->bindings_size = size;
+  }
+
+  len = strlen(name);
+  context->binding_names[i] = LIBRDF_MALLOC(char*, len + 1);
+  if(!context->binding_names[i]) {
+    librdf_free_node(node);
+    return 1;
+  }
+  memcpy(context->binding_names[i], name, len + 1);
+  context->binding_values[i] = node;
+  context->bindings_count++;
+
+  return 0;
+}
+
+
 static void
 librdf_query_rasqal_terminate(librdf_query* query)
 {
   librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
 
+  librdf_query_rasqal_bind_variable(query, NULL, NULL);
+  if(context->binding_names)
+    LIBRDF_FREE(char**, context->binding_names);
+  if(context->binding_values)
+    LIBRDF_FREE(librdf_node**, context->binding_values);
+
+  /* results kept by the results cache */
+  if(context->results)
+    rasqal_free_query_results(context->results);
+
   if(context->rq)
     rasqal_free_query(context->rq);
 
@@ -272,13 +424,306 @@ redland_node_to_rasqal_literal(librdf_world* world, librdf_node *node)
 }
 
 
+/* Number of entries in each direction of the per-query term cache;
+ * must be a power of 2
+ */
+#define RASQAL_REDLAND_TERM_CACHE_SIZE 1024
+
+typedef struct {
+  librdf_node* node;
+  rasqal_literal* literal;
+} rasqal_redland_term_cache_entry;
+
+/* Direct-mapped caches of converted terms.  Both directions hold a
+ * reference to the node and the literal; holding the literal keeps
+ * its address from being reused so it can be used as the key.
+ */
 typedef struct {
+  /* librdf_node to rasqal_literal, keyed by node value */
+  rasqal_redland_term_cache_entry nodes[RASQAL_REDLAND_TERM_CACHE_SIZE];
+  /* rasqal_literal to librdf_node, keyed by literal pointer */
+  rasqal_redland_term_cache_entry literals[RASQAL_REDLAND_TERM_CACHE_SIZE];
+} rasqal_redland_term_cache;
+
+
+typedef struct rasqal_redland_triples_source_user_data_s {
   librdf_world *world;
   librdf_query *query;
   librdf_model *model;
+  rasqal_redland_term_cache *term_cache;
+  /* find statements options passing a row limit to the storage or NULL */
+  librdf_hash *find_options;
 } rasqal_redland_triples_source_user_data;
 
 
+static void
+rasqal_redland_term_cache_entry_set(rasqal_redland_term_cache_entry* entry,
+                                    librdf_node* node, rasqal_literal* l)
+{
+  if(entry->node)
+    librdf_free_node(entry->node);
+  if(entry->literal)
+    rasqal_free_literal(entry->literal);
+  entry->node = librdf_new_node_from_node(node);
+  entry->literal = rasqal_new_literal_from_literal(l);
+}
+
+
+static void
+rasqal_redland_free_term_cache(rasqal_redland_term_cache* cache)
+{
+  int i;
+
+  for(i = 0; i < RASQAL_REDLAND_TERM_CACHE_SIZE; i++) {
+    if(cache->nodes[i].node)
+      librdf_free_node(cache->nodes[i].node);
+    if(cache->nodes[i].literal)
+      rasqal_free_literal(cache->nodes[i].literal);
+    if(cache->literals[i].node)
+      librdf_free_node(cache->literals[i].node);
+    if(cache->literals[i].literal)
+      rasqal_free_literal(cache->literals[i].literal);
+  }
+  LIBRDF_FREE(rasqal_redland_term_cache, cache);
+}
+
+
+/* FNV-1a of the node string; equal-string nodes of different
+ * language or datatype collide and are told apart on lookup
+ */
+static unsigned int
+rasqal_redland_node_slot(librdf_node* node)
+{
+  const unsigned char* string = NULL;
+  size_t len = 0;
+  unsigned int h = 2166136261U;
+
+  switch(librdf_node_get_type(node)) {
+    case LIBRDF_NODE_TYPE_RESOURCE:
+      string = librdf_uri_as_counted_string(librdf_node_get_uri(node), &len);
+      break;
+    case LIBRDF_NODE_TYPE_LITERAL:
+      string = librdf_node_get_literal_value_as_counted_string(node, &len);
+      break;
+    case LIBRDF_NODE_TYPE_BLANK:
+      string = librdf_node_get_counted_blank_identifier(node, &len);
+      break;
+    case LIBRDF_NODE_TYPE_UNKNOWN:
+    default:
+      break;
+  }
+
+  h = (h ^ (unsigned int)librdf_node_get_type(node)) * 16777619U;
+  while(len--)
+    h = (h ^ *string++) * 16777619U;
+
+  return h & (RASQAL_REDLAND_TERM_CACHE_SIZE - 1);
+}
+
+
+static unsigned int
+rasqal_redland_literal_slot(rasqal_literal* l)
+{
+  size_t p = (size_t)l;
+
+  return (unsigned int)((p >> 4) * 2654435761U) & (RASQAL_REDLAND_TERM_CACHE_SIZE - 1);
+}
+
+
+/*
+ * rasqal_redland_node_to_literal:
+ * @rtsc: triples source
+ * @node: node
+ *
+ * INTERNAL - Convert a node to a new rasqal literal reference, once per distinct term
+ */
+static rasqal_literal*
+rasqal_redland_node_to_literal(rasqal_redland_triples_source_user_data* rtsc,
+                               librdf_node* node)
+{
+  rasqal_redland_term_cache* cache = rtsc->term_cache;
+  rasqal_redland_term_cache_entry* entry;
+  rasqal_literal* l;
+
+  if(!cache)
+    return redland_node_to_rasqal_literal(rtsc->world, node);
+
+  entry = &cache->nodes[rasqal_redland_node_slot(node)];
+  if(entry->node && librdf_node_equals(entry->node, node))
+    return rasqal_new_literal_from_literal(entry->literal);
+
+  l = redland_node_to_rasqal_literal(rtsc->world, node);
+  if(!l)
+    return NULL;
+
+  rasqal_redland_term_cache_entry_set(entry, node, l);
+  /* the literal will usually come back as a variable value */
+  rasqal_redland_term_cache_entry_set(&cache->literals[rasqal_redland_literal_slot(l)],
+                                      node, l);
+  return l;
+}
+
+
+/*
+ * rasqal_redland_literal_peek_node:
+ * @cache: term cache
+ * @world: redland world
+ * @l: rasqal literal
+ *
+ * INTERNAL - Get the cached node for a rasqal literal, converting it on a miss
+ *
+ * Return value: shared node owned by the cache (valid until the next
+ * conversion) or NULL on failure
+ */
+static librdf_node*
+rasqal_redland_literal_peek_node(rasqal_redland_term_cache* cache,
+                                 librdf_world* world, rasqal_literal* l)
+{
+  rasqal_redland_term_cache_entry* entry;
+  librdf_node* node;
+
+  entry = &cache->literals[rasqal_redland_literal_slot(l)];
+  if(entry->literal == l)
+    return entry->node;
+
+  node = rasqal_literal_to_redland_node(world, l);
+  if(!node)
+    return NULL;
+
+  rasqal_redland_term_cache_entry_set(entry, node, l);
+  librdf_free_node(node);
+  return entry->node;
+}
+
+
+/*
+ * rasqal_redland_literal_to_node:
+ * @rtsc: triples source
+ * @l: rasqal literal or NULL
+ *
+ * INTERNAL - Convert a rasqal literal to a new node, once per literal
+ */
+static librdf_node*
+rasqal_redland_literal_to_node(rasqal_redland_triples_source_user_data* rtsc,
+                               rasqal_literal* l)
+{
+  librdf_node* node;
+
+  if(!l)
+    return NULL;
+
+  if(!rtsc->term_cache)
+    return rasqal_literal_to_redland_node(rtsc->world, l);
+
+  node = rasqal_redland_literal_peek_node(rtsc->term_cache, rtsc->world, l);
+  return node ? librdf_new_node_from_node(node) : NULL;
+}
+
+
+
+/*
+ * rasqal_redland_graph_pattern_is_basic:
+ * @gp: graph pattern
+ *
+ * INTERNAL - Check a graph pattern is only groups of triple patterns
+ *
+ * Return value: non-0 if the graph pattern has no filters or operators
+ * that could remove matched rows
+ */
+static int
+rasqal_redland_graph_pattern_is_basic(rasqal_graph_pattern* gp)
+{
+  rasqal_graph_pattern_operator op;
+  rasqal_graph_pattern* sgp;
+  int i;
+
+  op=rasqal_graph_pattern_get_operator(gp);
+  if(op != RASQAL_GRAPH_PATTERN_OPERATOR_BASIC &&
+     op != RASQAL_GRAPH_PATTERN_OPERATOR_GROUP)
+    return 0;
+
+  if(rasqal_graph_pattern_get_filter_expression(gp))
+    return 0;
+
+  for(i=0; (sgp=rasqal_graph_pattern_get_sub_graph_pattern(gp, i)); i++) {
+    if(!rasqal_redland_graph_pattern_is_basic(sgp))
+      return 0;
+  }
+
+  return 1;
+}
+
+
+/*
+ * rasqal_redland_get_find_limit:
+ * @rq: rasqal query
+ *
+ * INTERNAL - Get the number of statements a storage needs to return
+ *
+ * A query with a LIMIT and a single triple pattern returns one row
+ * per matched statement, in storage order, as long as nothing
+ * reorders, merges or rejects rows.  The storage can then stop after
+ * LIMIT+OFFSET statements.
+ *
+ * Return value: the statement limit or <0 if the whole match is needed
+ */
+static long
+rasqal_redland_get_find_limit(rasqal_query* rq)
+{
+  raptor_sequence* seq;
+  rasqal_graph_pattern* gp;
+  rasqal_triple* t;
+  rasqal_variable* v;
+  rasqal_variable* vars[4];
+  int limit;
+  int offset;
+  int i;
+  int j;
+
+  limit=rasqal_query_get_limit(rq);
+  if(limit <= 0)
+    return -1;
+
+  if(rasqal_query_get_verb(rq) != RASQAL_QUERY_VERB_SELECT ||
+     rasqal_query_get_distinct(rq) ||
+     rasqal_query_get_order_condition(rq, 0) ||
+     rasqal_query_get_group_condition(rq, 0) ||
+     rasqal_query_get_having_condition(rq, 0))
+    return -1;
+
+  /* aggregates and other projected expressions */
+  seq=rasqal_query_get_bound_variable_sequence(rq);
+  for(i=0; seq && i < raptor_sequence_size(seq); i++) {
+    v=(rasqal_variable*)raptor_sequence_get_at(seq, i);
+    if(v && v->expression)
+      return -1;
+  }
+
+  seq=rasqal_query_get_triple_sequence(rq);
+  if(!seq || raptor_sequence_size(seq) != 1)
+    return -1;
+
+  gp=rasqal_query_get_query_graph_pattern(rq);
+  if(!gp || !rasqal_redland_graph_pattern_is_basic(gp))
+    return -1;
+
+  /* a variable used twice makes bind_match reject some statements */
+  t=(rasqal_triple*)raptor_sequence_get_at(seq, 0);
+  vars[0]=rasqal_literal_as_variable(t->subject);
+  vars[1]=rasqal_literal_as_variable(t->predicate);
+  vars[2]=rasqal_literal_as_variable(t->object);
+  vars[3]=t->origin ? rasqal_literal_as_variable(t->origin) : NULL;
+  for(i=0; i < 4; i++) {
+    for(j=i+1; j < 4; j++) {
+      if(vars[i] && vars[i] == vars[j])
+        return -1;
+    }
+  }
+
+  offset=rasqal_query_get_offset(rq);
+  return (long)limit + (offset > 0 ? offset : 0);
+}
+
 
 static int
 rasqal_redland_new_triples_source(rasqal_query* rdf_query,
@@ -291,12 +736,39 @@ rasqal_redland_new_triples_source(rasqal_query* rdf_query,
   raptor_sequence *seq;
   librdf_query_rasqal_context *context;
   librdf_iterator* cit;
+  long find_limit;
 
   rtsc->world = world;
   rtsc->query = (librdf_query*)rasqal_query_get_user_data(rdf_query);
   context = (librdf_query_rasqal_context*)rtsc->query->context;
   rtsc->model = context->model;
 
+  /* Without a cache every term is converted each time it is seen */
+  rtsc->term_cache = LIBRDF_CALLOC(rasqal_redland_term_cache*, 1,
+                                   sizeof(*rtsc->term_cache));
+  context->rtsc = rtsc;
+
+  find_limit = rasqal_redland_get_find_limit(rdf_query);
+  if(find_limit > 0 || rtsc->query->workers > 1)
+    rtsc->find_options = librdf_new_hash(world, NULL);
+  if(rtsc->find_options) {
+    char buffer[32];
+    int rc = 0;
+
+    if(find_limit > 0) {
+      sprintf(buffer, "%ld", find_limit);
+      rc = librdf_hash_put_strings(rtsc->find_options, "limit", buffer);
+    }
+    if(!rc && rtsc->query->workers > 1) {
+      sprintf(buffer, "%d", rtsc->query->workers);
+      rc = librdf_hash_put_strings(rtsc->find_options, "workers", buffer);
+    }
+    if(rc) {
+      librdf_free_hash(rtsc->find_options);
+      rtsc->find_options = NULL;
+    }
+  }
+
   seq = rasqal_query_get_data_graph_sequence(rdf_query);
   
   /* FIXME: queries with data graphs in them (such as FROM in SPARQL)
@@ -346,25 +818,192 @@ rasqal_redland_new_triples_source(rasqal_query* rdf_query,
 }
 
 
+/*
+ * rasqal_redland_check_limits:
+ * @rtsc: triples source context
+ *
+ * INTERNAL - Check if the current execution must stop
+ *
+ * Results cut short by a stop are not kept for repeated executions.
+ *
+ * Return value: non-0 if the query was cancelled or exceeded a limit
+ */
 static int
-rasqal_redland_triple_present(rasqal_triples_source *rts, void *user_data, 
-                              rasqal_triple *t) 
+rasqal_redland_check_limits(rasqal_redland_triples_source_user_data* rtsc)
 {
-  rasqal_redland_triples_source_user_data* rtsc=(rasqal_redland_triples_source_user_data*)user_data;
+  librdf_query_rasqal_context *context;
+
+  if(!librdf_query_check_limits(rtsc->query))
+    return 0;
+
+  context=(librdf_query_rasqal_context*)rtsc->query->context;
+  context->results_cached = 0;
+  return 1;
+}
+
+
+/*
+ * rasqal_redland_get_profile:
+ * @rtsc: triples source context
+ * @t: triple pattern
+ * @method: name of the model method used to match it
+ * @nodes: parts bound when matching or NULL if all are bound
+ *
+ * INTERNAL - Get the query profile of a triple pattern
+ *
+ * Return value: profile or NULL on failure
+ */
+static librdf_query_profile*
+rasqal_redland_get_profile(rasqal_redland_triples_source_user_data* rtsc,
+                           rasqal_triple *t, const char* method,
+                           librdf_node** nodes)
+{
+  librdf_query_profile* profile;
+  rasqal_literal* literals[4];
+  librdf_node* pattern_nodes[4];
+  librdf_statement* pattern;
+  char* access;
+  librdf_storage* storage;
+  const char* storage_name;
+  size_t len;
+  int i;
+
+  profile=librdf_query_add_profile(rtsc->query, t);
+  if(!profile || profile->access)
+    return profile;
+
+  literals[0]=t->subject;
+  literals[1]=t->predicate;
+  literals[2]=t->object;
+  literals[3]=t->origin;
+  for(i=0; i < 4; i++) {
+    if(!literals[i] || rasqal_literal_as_variable(literals[i]))
+      pattern_nodes[i]=NULL;
+    else
+      pattern_nodes[i]=rasqal_redland_literal_to_node(rtsc, literals[i]);
+  }
+  pattern=librdf_new_statement_from_nodes(rtsc->world,
+                                          pattern_nodes[0],
+                                          pattern_nodes[1],
+                                          pattern_nodes[2]);
+
+  storage=librdf_model_get_storage(rtsc->model);
+  storage_name=storage ? storage->factory->name : "model";
+
+  /* "<storage> <method>(s,p,o)" with - for parts not bound */
+  len=strlen(storage_name) + strlen(method) + 9;
+  access=LIBRDF_MALLOC(char*, len);
+  if(!pattern || !access) {
+    /* the profile is filled in on the next call */
+    if(pattern)
+      librdf_free_statement(pattern);
+    if(access)
+      LIBRDF_FREE(char*, access);
+    if(pattern_nodes[3])
+      librdf_free_node(pattern_nodes[3]);
+    return profile;
+  }
+  sprintf(access, "%s %s(%c,%c,%c)", storage_name, method,
+          (!nodes || nodes[0]) ? 's' : '-',
+          (!nodes || nodes[1]) ? 'p' : '-',
+          (!nodes || nodes[2]) ? 'o' : '-');
+
+  profile->pattern=pattern;
+  profile->context=pattern_nodes[3];
+  profile->access=access;
+
+  return profile;
+}
+
+
+static int
+rasqal_redland_contains_triple(rasqal_redland_triples_source_user_data* rtsc,
+                               rasqal_triple *t) 
+{
+  rasqal_literal* literals[3];
   librdf_node* nodes[3];
-  librdf_statement *s;
+  librdf_statement s; /* on stack, parts shared with the term cache */
+  librdf_statement *statement;
+  int i;
   int rc;
   
   /* ASSUMPTION: all the parts of the triple are not variables */
-  /* FIXME: and no error checks */
-  nodes[0]=rasqal_literal_to_redland_node(rtsc->world, t->subject);
-  nodes[1]=rasqal_literal_to_redland_node(rtsc->world, t->predicate);
-  nodes[2]=rasqal_literal_to_redland_node(rtsc->world, t->object);
+  literals[0]=t->subject;
+  literals[1]=t->predicate;
+  literals[2]=t->object;
+
+  if(rtsc->term_cache) {
+    rasqal_redland_term_cache* cache=rtsc->term_cache;
+
+    for(i=0; i < 3; i++) {
+      nodes[i]=rasqal_redland_literal_peek_node(cache, rtsc->world,
+                                                literals[i]);
+      if(!nodes[i])
+        return 0;
+    }
+
+    /* Unless a later part displaced an earlier one from the cache,
+     * probe with a stack statement sharing the cached nodes
+     */
+    for(i=0; i < 2; i++) {
+      if(cache->literals[rasqal_redland_literal_slot(literals[i])].literal != literals[i])
+        break;
+    }
+    if(i == 2) {
+      librdf_statement_init(rtsc->world, &s);
+      s.subject=nodes[0];
+      s.predicate=nodes[1];
+      s.object=nodes[2];
+
+      /* -1 if present; the statement is not cleared since the cache
+       * owns its nodes
+       */
+      return (librdf_model_contains_statement(rtsc->model, &s) < 0);
+    }
+  }
+
+  for(i=0; i < 3; i++)
+    nodes[i]=rasqal_literal_to_redland_node(rtsc->world, literals[i]);
+  statement=librdf_new_statement_from_nodes(rtsc->world, nodes[0], nodes[1],
+                                            nodes[2]);
+  if(!statement)
+    return 0;
+  rc=(librdf_model_contains_statement(rtsc->model, statement) < 0);
+  librdf_free_statement(statement);
+
+  return rc;
+}
+
+
+static int
+rasqal_redland_triple_present(rasqal_triples_source *rts, void *user_data, 
+                              rasqal_triple *t) 
+{
+  rasqal_redland_triples_source_user_data* rtsc=(rasqal_redland_triples_source_user_data*)user_data;
+  librdf_query_profile* profile=NULL;
+  double start=0.0;
+  int rc;
+
+  /* the stop is reported as an error when the results are read */
+  rtsc->query->triples_count++;
+  if(rasqal_redland_check_limits(rtsc))
+    return 0;
+
+  if(rtsc->query->profiling) {
+    start=librdf_query_get_time();
+    profile=rasqal_redland_get_profile(rtsc, t, "contains_statement", NULL);
+  }
+
+  rc=rasqal_redland_contains_triple(rtsc, t);
+
+  if(profile) {
+    profile->opened++;
+    profile->scanned++;
+    if(rc)
+      profile->bound++;
+    profile->time += librdf_query_get_time() - start;
+  }
 
-  s=librdf_new_statement_from_nodes(rtsc->world, nodes[0], nodes[1], nodes[2]);
-  
-  rc=librdf_model_contains_statement(rtsc->model, s);
-  librdf_free_statement(s);
   return rc;
 }
 
@@ -373,7 +1012,22 @@ rasqal_redland_triple_present(rasqal_triples_source *rts, void *user_data,
 static void
 rasqal_redland_free_triples_source(void *user_data)
 {
-  /* rasqal_redland_triples_source_user_data* rtsc=(rasqal_redland_triples_source_user_data*)user_data; */
+  rasqal_redland_triples_source_user_data* rtsc=(rasqal_redland_triples_source_user_data*)user_data;
+  librdf_query_rasqal_context *context;
+
+  context=(librdf_query_rasqal_context*)rtsc->query->context;
+  if(context->rtsc == rtsc)
+    context->rtsc=NULL;
+
+  if(rtsc->term_cache) {
+    rasqal_redland_free_term_cache(rtsc->term_cache);
+    rtsc->term_cache=NULL;
+  }
+
+  if(rtsc->find_options) {
+    librdf_free_hash(rtsc->find_options);
+    rtsc->find_options=NULL;
+  }
 }
 
 
@@ -399,25 +1053,27 @@ rasqal_redland_register_triples_source_factory(rasqal_triples_source_factory *fa
 
 
 typedef struct {
+  rasqal_redland_triples_source_user_data* rtsc;
   librdf_node* nodes[3];
   librdf_node* origin;
   /* query statement, made from the nodes above (even when exact) */
   librdf_statement *qstatement;
   librdf_stream *stream;
+  /* profile of the triple pattern if the query is profiled */
+  librdf_query_profile* profile;
 } rasqal_redland_triples_match_context;
 
 
 static rasqal_triple_parts
-rasqal_redland_bind_match(struct rasqal_triples_match_s* rtm,
-                          void *user_data,
-                          rasqal_variable* bindings[4],
-                          rasqal_triple_parts parts) 
+rasqal_redland_bind_statement(struct rasqal_triples_match_s* rtm,
+                              rasqal_variable* bindings[4],
+                              rasqal_triple_parts parts) 
 {
   rasqal_redland_triples_match_context* rtmc=(rasqal_redland_triples_match_context*)rtm->user_data;
   rasqal_literal* l;
   librdf_statement* statement;
   rasqal_triple_parts result=(rasqal_triple_parts)0;
-  librdf_world *world = rtmc->stream->world;
+  rasqal_redland_triples_source_user_data* rtsc = rtmc->rtsc;
 
   statement=librdf_stream_get_object(rtmc->stream);
   if(!statement)
@@ -435,7 +1091,7 @@ rasqal_redland_bind_match(struct rasqal_triples_match_s* rtm,
 #if defined(LIBRDF_DEBUG) && LIBRDF_DEBUG > 1
     LIBRDF_DEBUG1("binding subject to variable\n");
 #endif
-    l = redland_node_to_rasqal_literal(world,
+    l = rasqal_redland_node_to_literal(rtsc,
                                        librdf_statement_get_subject(statement));
     rasqal_variable_set_value(bindings[0], l);
     result= RASQAL_TRIPLE_SUBJECT;
@@ -454,7 +1110,7 @@ rasqal_redland_bind_match(struct rasqal_triples_match_s* rtm,
 #if defined(LIBRDF_DEBUG) && LIBRDF_DEBUG > 1
       LIBRDF_DEBUG1("binding predicate to variable\n");
 #endif
-      l = redland_node_to_rasqal_literal(world,
+      l = rasqal_redland_node_to_literal(rtsc,
                                          librdf_statement_get_predicate(statement));
       rasqal_variable_set_value(bindings[1], l);
       result= (rasqal_triple_parts)(result | RASQAL_TRIPLE_PREDICATE);
@@ -493,7 +1149,7 @@ rasqal_redland_bind_match(struct rasqal_triples_match_s* rtm,
 #if defined(LIBRDF_DEBUG) && LIBRDF_DEBUG > 1
       LIBRDF_DEBUG1("binding object to variable\n");
 #endif
-      l = redland_node_to_rasqal_literal(world,
+      l = rasqal_redland_node_to_literal(rtsc,
                                          librdf_statement_get_object(statement));
       rasqal_variable_set_value(bindings[2], l);
       result= (rasqal_triple_parts)(result | RASQAL_TRIPLE_OBJECT);
@@ -543,7 +1199,7 @@ rasqal_redland_bind_match(struct rasqal_triples_match_s* rtm,
       LIBRDF_DEBUG1("binding origin to variable\n");
 #endif
       if(context_node)
-        l = redland_node_to_rasqal_literal(world, context_node);
+        l = rasqal_redland_node_to_literal(rtsc, context_node);
       else
         l=NULL;
       rasqal_variable_set_value(bindings[3], l);
@@ -555,13 +1211,44 @@ rasqal_redland_bind_match(struct rasqal_triples_match_s* rtm,
 }
 
 
+static rasqal_triple_parts
+rasqal_redland_bind_match(struct rasqal_triples_match_s* rtm,
+                          void *user_data,
+                          rasqal_variable* bindings[4],
+                          rasqal_triple_parts parts) 
+{
+  rasqal_redland_triples_match_context* rtmc=(rasqal_redland_triples_match_context*)rtm->user_data;
+  rasqal_triple_parts result;
+  double start;
+
+  if(!rtmc->profile)
+    return rasqal_redland_bind_statement(rtm, bindings, parts);
+
+  start=librdf_query_get_time();
+  result=rasqal_redland_bind_statement(rtm, bindings, parts);
+  rtmc->profile->scanned++;
+  if(result)
+    rtmc->profile->bound++;
+  rtmc->profile->time += librdf_query_get_time() - start;
+
+  return result;
+}
+
+
 static void
 rasqal_redland_next_match(struct rasqal_triples_match_s* rtm,
                           void *user_data)
 {
   rasqal_redland_triples_match_context* rtmc=(rasqal_redland_triples_match_context*)rtm->user_data;
 
-  librdf_stream_next(rtmc->stream);
+  rtmc->rtsc->query->triples_count++;
+  if(rtmc->profile) {
+    double start=librdf_query_get_time();
+
+    librdf_stream_next(rtmc->stream);
+    rtmc->profile->time += librdf_query_get_time() - start;
+  } else
+    librdf_stream_next(rtmc->stream);
 }
 
 static int
@@ -570,6 +1257,10 @@ rasqal_redland_is_end(struct rasqal_triples_match_s* rtm,
 {
   rasqal_redland_triples_match_context* rtmc=(rasqal_redland_triples_match_context*)rtm->user_data;
 
+  /* a cancelled query or one over its limits ends every match */
+  if(rasqal_redland_check_limits(rtmc->rtsc))
+    return 1;
+
   return librdf_stream_end(rtmc->stream);
 }
 
@@ -592,6 +1283,38 @@ rasqal_redland_finish_triples_match(struct rasqal_triples_match_s* rtm,
 }
 
 
+/*
+ * rasqal_redland_variable_to_node:
+ * @rtsc: triples source context
+ * @var: variable
+ *
+ * INTERNAL - Get the current value of a variable as a new node
+ *
+ * Variables bound with librdf_query_bind_variable() keep their value
+ * even when the query engine resets them between matches.
+ *
+ * Return value: new node or NULL if the variable is unbound
+ */
+static librdf_node*
+rasqal_redland_variable_to_node(rasqal_redland_triples_source_user_data* rtsc,
+                                rasqal_variable* var)
+{
+  librdf_query_rasqal_context *context;
+  int i;
+
+  if(var->value)
+    return rasqal_redland_literal_to_node(rtsc, var->value);
+
+  context = (librdf_query_rasqal_context*)rtsc->query->context;
+  for(i = 0; i < context->bindings_count; i++) {
+    if(!strcmp(context->binding_names[i], (const char*)var->name))
+      return librdf_new_node_from_node(context->binding_values[i]);
+  }
+
+  return NULL;
+}
+
+
 static int
 rasqal_redland_init_triples_match(rasqal_triples_match* rtm,
                                   rasqal_triples_source *rts, void *user_data,
@@ -600,17 +1323,25 @@ rasqal_redland_init_triples_match(rasqal_triples_match* rtm,
   rasqal_redland_triples_source_user_data* rtsc=(rasqal_redland_triples_source_user_data*)user_data;
   rasqal_redland_triples_match_context* rtmc;
   rasqal_variable* var;
+  double start=0.0;
 
   rtm->bind_match=rasqal_redland_bind_match;
   rtm->next_match=rasqal_redland_next_match;
   rtm->is_end=rasqal_redland_is_end;
   rtm->finish=rasqal_redland_finish_triples_match;
 
+  if(librdf_query_check_limits(rtsc->query))
+    return 1;
+
+  if(rtsc->query->profiling)
+    start=librdf_query_get_time();
+
   rtmc = LIBRDF_CALLOC(rasqal_redland_triples_match_context*, 1, sizeof(*rtmc));
   if(!rtmc)
     return 1;
 
   rtm->user_data=rtmc;
+  rtmc->rtsc=rtsc;
 
 
   /* at least one of the triple terms is a variable and we need to
@@ -620,45 +1351,35 @@ rasqal_redland_init_triples_match(rasqal_triples_match* rtm,
    * pick the most efficient, indexed way to get the answer.
    */
 
-  if((var=rasqal_literal_as_variable(t->subject))) {
-    if(var->value)
-      rtmc->nodes[0]=rasqal_literal_to_redland_node(rtsc->world, var->value);
-    else
-      rtmc->nodes[0]=NULL;
-  } else
-    rtmc->nodes[0]=rasqal_literal_to_redland_node(rtsc->world, t->subject);
+  if((var=rasqal_literal_as_variable(t->subject)))
+    rtmc->nodes[0]=rasqal_redland_variable_to_node(rtsc, var);
+  else
+    rtmc->nodes[0]=rasqal_redland_literal_to_node(rtsc, t->subject);
 
   m->bindings[0]=var;
   
 
-  if((var=rasqal_literal_as_variable(t->predicate))) {
-    if(var->value)
-      rtmc->nodes[1]=rasqal_literal_to_redland_node(rtsc->world, var->value);
-    else
-      rtmc->nodes[1]=NULL;
-  } else
-    rtmc->nodes[1]=rasqal_literal_to_redland_node(rtsc->world, t->predicate);
+  if((var=rasqal_literal_as_variable(t->predicate)))
+    rtmc->nodes[1]=rasqal_redland_variable_to_node(rtsc, var);
+  else
+    rtmc->nodes[1]=rasqal_redland_literal_to_node(rtsc, t->predicate);
 
   m->bindings[1]=var;
   
 
-  if((var=rasqal_literal_as_variable(t->object))) {
-    if(var->value)
-      rtmc->nodes[2]=rasqal_literal_to_redland_node(rtsc->world, var->value);
-    else
-      rtmc->nodes[2]=NULL;
-  } else
-    rtmc->nodes[2]=rasqal_literal_to_redland_node(rtsc->world, t->object);
+  if((var=rasqal_literal_as_variable(t->object)))
+    rtmc->nodes[2]=rasqal_redland_variable_to_node(rtsc, var);
+  else
+    rtmc->nodes[2]=rasqal_redland_literal_to_node(rtsc, t->object);
 
   m->bindings[2]=var;
   
 
   if(t->origin) {
-    if((var=rasqal_literal_as_variable(t->origin))) {
-      if(var->value)
-        rtmc->origin=rasqal_literal_to_redland_node(rtsc->world, var->value);
-    } else
-      rtmc->origin=rasqal_literal_to_redland_node(rtsc->world, t->origin);
+    if((var=rasqal_literal_as_variable(t->origin)))
+      rtmc->origin=rasqal_redland_variable_to_node(rtsc, var);
+    else
+      rtmc->origin=rasqal_redland_literal_to_node(rtsc, t->origin);
     m->bindings[3]=var;
   }
 
@@ -680,7 +1401,14 @@ rasqal_redland_init_triples_match(rasqal_triples_match* rtm,
   fputc('\n', stderr);
 #endif
   
-  if(rtmc->origin)
+  if(rtsc->find_options)
+    /* only the first LIMIT+OFFSET statements are ever read and the
+     * storage may scan on the query workers */
+    rtmc->stream=librdf_model_find_statements_with_options(rtsc->model,
+                                                           rtmc->qstatement,
+                                                           rtmc->origin,
+                                                           rtsc->find_options);
+  else if(rtmc->origin)
     rtmc->stream=librdf_model_find_statements_in_context(rtsc->model, 
                                                          rtmc->qstatement,
                                                          rtmc->origin);
@@ -690,6 +1418,16 @@ rasqal_redland_init_triples_match(rasqal_triples_match* rtm,
   if(!rtmc->stream)
     return 1;
 
+  if(rtsc->query->profiling) {
+    rtmc->profile=rasqal_redland_get_profile(rtsc, t,
+                                             rtmc->origin ? "find_statements_in_context" : "find_statements",
+                                             rtmc->nodes);
+    if(rtmc->profile) {
+      rtmc->profile->opened++;
+      rtmc->profile->time += librdf_query_get_time() - start;
+    }
+  }
+
 #if defined(LIBRDF_DEBUG) && LIBRDF_DEBUG > 1
   LIBRDF_DEBUG1("rasqal_init_triples_match done\n");
 #endif
@@ -698,11 +1436,67 @@ rasqal_redland_init_triples_match(rasqal_triples_match* rtm,
 }
 
 
+/*
+ * librdf_query_rasqal_prepare:
+ * @context: query context
+ *
+ * INTERNAL - Parse and prepare the query if not done already
+ *
+ * Return value: non-0 on failure
+ */
+static int
+librdf_query_rasqal_prepare(librdf_query_rasqal_context *context)
+{
+  /* This assumes raptor's URI implementation is librdf_uri */
+  return rasqal_query_prepare(context->rq, context->query_string,
+                              (raptor_uri*)context->uri);
+}
+
+
+/*
+ * librdf_query_rasqal_save_limits:
+ * @context: query context
+ *
+ * INTERNAL - Remember the limit and offset of the query string before changing them
+ *
+ * The query is prepared first so that parsing does not replace the
+ * new values.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+librdf_query_rasqal_save_limits(librdf_query_rasqal_context *context)
+{
+  if(context->query_limits_saved)
+    return 0;
+
+  if(librdf_query_rasqal_prepare(context))
+    return 1;
+
+  context->query_limit = rasqal_query_get_limit(context->rq);
+  context->query_offset = rasqal_query_get_offset(context->rq);
+  context->query_limits_saved = 1;
+  return 0;
+}
+
+
 static librdf_query_results*
 librdf_query_rasqal_execute(librdf_query* query, librdf_model* model)
 {
   librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
   librdf_query_results* results;
+  int i;
+
+  if(context->results_cached && context->results &&
+     context->model == model &&
+     context->model_modification_count == librdf_model_get_modification_count(model) &&
+     !rasqal_query_results_rewind(context->results)) {
+    results = LIBRDF_CALLOC(librdf_query_results*, 1, sizeof(*results));
+    if(results)
+      results->query = query;
+    return results;
+  }
+  context->results_cached = 0;
 
   if (context->model)
     librdf_free_model(context->model);
@@ -710,19 +1504,51 @@ librdf_query_rasqal_execute(librdf_query* query, librdf_model* model)
   context->model = model;
   librdf_model_add_reference(model);
 
-  /* This assumes raptor's URI implementation is librdf_uri */
-  if(rasqal_query_prepare(context->rq, context->query_string, 
-                          (raptor_uri*)context->uri))
+  if(librdf_query_rasqal_prepare(context))
     return NULL;
 
+  for(i = 0; i < context->bindings_count; i++) {
+    rasqal_literal* l;
+
+    l = redland_node_to_rasqal_literal(query->world, context->binding_values[i]);
+    if(!l)
+      return NULL;
+
+    /* the variable takes ownership of the literal */
+    if(rasqal_query_set_variable2(context->rq, RASQAL_VARIABLE_TYPE_NORMAL,
+                                  (const unsigned char*)context->binding_names[i],
+                                  l)) {
+      rasqal_free_literal(l);
+      librdf_log(query->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_QUERY, NULL,
+                 "Query has no variable named '%s' to bind",
+                 context->binding_names[i]);
+      return NULL;
+    }
+  }
+
   if(context->results)
     rasqal_free_query_results(context->results);
   
   context->results=rasqal_query_execute(context->rq);
   if(!context->results)
     return NULL;
+
+  /* results computed while executing are incomplete after a stop */
+  if(query->stopped) {
+    rasqal_free_query_results(context->results);
+    context->results=NULL;
+    return NULL;
+  }
+
+  /* Graph results cannot be rewound so are never kept */
+  if(context->cache_results &&
+     (rasqal_query_results_is_bindings(context->results) ||
+      rasqal_query_results_is_boolean(context->results))) {
+    context->results_cached = 1;
+    context->model_modification_count = librdf_model_get_modification_count(model);
+  }
   
-  results = LIBRDF_MALLOC(librdf_query_results*, sizeof(*results));
+  results = LIBRDF_CALLOC(librdf_query_results*, 1, sizeof(*results));
   if(!results) {
     rasqal_free_query_results(context->results);
     context->results=NULL;
@@ -746,7 +1572,10 @@ static int
 librdf_query_rasqal_set_limit(librdf_query* query, int limit)
 {
   librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
+  if(librdf_query_rasqal_save_limits(context))
+    return 1;
   rasqal_query_set_limit(context->rq, limit);
+  context->results_cached = 0;
   return 0;
 }
 
@@ -763,11 +1592,71 @@ static int
 librdf_query_rasqal_set_offset(librdf_query* query, int offset)
 {
   librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
+  if(librdf_query_rasqal_save_limits(context))
+    return 1;
   rasqal_query_set_offset(context->rq, offset);
+  context->results_cached = 0;
+  return 0;
+}
+
+
+static int
+librdf_query_rasqal_set_results_cache(librdf_query* query, int enable)
+{
+  librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
+
+  /* rasqal must store the rows to be able to rewind them */
+  if(rasqal_query_set_store_results(context->rq, enable))
+    return 1;
+
+  context->cache_results = enable;
+  if(!enable)
+    context->results_cached = 0;
   return 0;
 }
 
 
+/*
+ * librdf_query_rasqal_reset:
+ * @query: #librdf_query object
+ *
+ * INTERNAL - Remove the settings made since init for reuse of a cached query
+ *
+ * Return value: non-0 on failure
+ */
+static int
+librdf_query_rasqal_reset(librdf_query* query)
+{
+  librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
+  int rc = 0;
+
+  librdf_query_rasqal_bind_variable(query, NULL, NULL);
+
+  if(context->query_limits_saved) {
+    rasqal_query_set_limit(context->rq, context->query_limit);
+    rasqal_query_set_offset(context->rq, context->query_offset);
+    context->query_limits_saved = 0;
+  }
+
+  if(context->cache_results)
+    rc = librdf_query_rasqal_set_results_cache(query, 0);
+  context->results_cached = 0;
+
+  /* not shared: a cached query is only reused with no results left */
+  if(context->results) {
+    rasqal_free_query_results(context->results);
+    context->results = NULL;
+  }
+
+  if(context->model) {
+    librdf_free_model(context->model);
+    context->model = NULL;
+  }
+
+  return rc;
+}
+
+
 static int
 librdf_query_rasqal_results_get_count(librdf_query_results *query_results)
 {
@@ -803,6 +1692,34 @@ librdf_query_rasqal_results_finished(librdf_query_results *query_results)
 }
 
 
+/*
+ * librdf_query_rasqal_result_node:
+ * @query: query
+ * @l: result value or NULL
+ *
+ * INTERNAL - Turn a result value into a new node
+ *
+ * Values are usually literals the triples source bound from nodes,
+ * so while it exists its term cache mostly returns a new reference to
+ * an existing node instead of building a new one.
+ *
+ * Return value: new node or NULL
+ */
+static librdf_node*
+librdf_query_rasqal_result_node(librdf_query* query, rasqal_literal* l)
+{
+  librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
+
+  if(!l)
+    return NULL;
+
+  if(context->rtsc)
+    return rasqal_redland_literal_to_node(context->rtsc, l);
+
+  return rasqal_literal_to_redland_node(query->world, l);
+}
+
+
 static int
 librdf_query_rasqal_results_get_bindings(librdf_query_results *query_results, 
                                          const char ***names, 
@@ -826,7 +1743,7 @@ librdf_query_rasqal_results_get_bindings(librdf_query_results *query_results,
     return rc;
 
   for(i=0; i<rasqal_query_results_get_bindings_count(context->results); i++)
-    values[i]=rasqal_literal_to_redland_node(query->world, literals[i]);
+    values[i]=librdf_query_rasqal_result_node(query, literals[i]);
 
   return 0;
 }
@@ -841,7 +1758,7 @@ librdf_query_rasqal_results_get_binding_value(librdf_query_results *query_result
 
   literal=rasqal_query_results_get_binding_value(context->results, offset);
 
-  return rasqal_literal_to_redland_node(query->world, literal);
+  return librdf_query_rasqal_result_node(query, literal);
 }
 
 
@@ -870,7 +1787,7 @@ librdf_query_rasqal_results_get_binding_value_by_name(librdf_query_results *quer
   
   literal=rasqal_query_results_get_binding_value_by_name(context->results, (const unsigned char*)name);
 
-  return rasqal_literal_to_redland_node(query->world, literal);
+  return librdf_query_rasqal_result_node(query, literal);
 }
 
 
@@ -893,7 +1810,7 @@ librdf_query_rasqal_free_results(librdf_query_results* query_results)
   librdf_query *query=query_results->query;
   librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
 
-  if(!context->results)
+  if(!context->results || context->results_cached)
     return;
   
   rasqal_free_query_results(context->results);
@@ -958,11 +1875,18 @@ librdf_query_rasqal_results_get_boolean(librdf_query_results* query_results)
 {
   librdf_query *query=query_results->query;
   librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
+  int rc;
 
   if(!context->results)
     return -1;
   
-  return rasqal_query_results_get_boolean(context->results);
+  rc=rasqal_query_results_get_boolean(context->results);
+
+  /* a stopped query did not check every triple pattern */
+  if(query->stopped)
+    return -1;
+
+  return rc;
 }
 
 
@@ -1245,6 +2169,9 @@ librdf_query_rasqal_register_factory(librdf_query_factory *factory)
   factory->set_limit          = librdf_query_rasqal_set_limit;
   factory->get_offset         = librdf_query_rasqal_get_offset;
   factory->set_offset         = librdf_query_rasqal_set_offset;
+  factory->bind_variable      = librdf_query_rasqal_bind_variable;
+  factory->set_results_cache  = librdf_query_rasqal_set_results_cache;
+  factory->reset              = librdf_query_rasqal_reset;
 
   factory->results_get_count           = librdf_query_rasqal_results_get_count;
   factory->results_next                = librdf_query_rasqal_results_next;
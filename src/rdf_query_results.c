@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include <sys/types.h>
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
@@ -77,12 +78,25 @@ librdf_query_results_get_count(librdf_query_results *query_results)
 int
 librdf_query_results_next(librdf_query_results *query_results)
 {
+  librdf_query* query;
+  int rc;
+
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, librdf_query_results, 1);
 
-  if(query_results->query->factory->results_next)
-    return query_results->query->factory->results_next(query_results);
-  else
+  query = query_results->query;
+  if(!query->factory->results_next || librdf_query_check_limits(query))
     return 1;
+
+  rc = query->factory->results_next(query_results);
+  if(!rc && query->max_rows > 0 &&
+     librdf_query_results_get_count(query_results) > query->max_rows) {
+    query->stopped = 1;
+    librdf_log(query->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_QUERY, NULL,
+               "Query returned too many rows");
+    rc = 1;
+  }
+
+  return rc;
 }
 
 
@@ -99,6 +113,9 @@ librdf_query_results_finished(librdf_query_results *query_results)
 {
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, librdf_query_results, 1);
 
+  if(query_results->query->stopped)
+    return 1;
+
   if(query_results->query->factory->results_finished)
     return query_results->query->factory->results_finished(query_results);
   else
@@ -240,6 +257,107 @@ librdf_query_results_get_bindings_count(librdf_query_results *query_results)
 }
 
 
+/*
+ * librdf_query_results_clear_batch - release the nodes lent by the last batch
+ */
+static void
+librdf_query_results_clear_batch(librdf_query_results *query_results)
+{
+  int i;
+
+  for(i = 0; i < query_results->batch_count; i++) {
+    if(query_results->batch[i])
+      librdf_free_node(query_results->batch[i]);
+  }
+  query_results->batch_count = 0;
+}
+
+
+/**
+ * librdf_query_results_get_bindings_batch:
+ * @query_results: #librdf_query_results query results
+ * @values: array of at least @rows times the bindings count node pointers
+ * @rows: maximum number of rows to get
+ *
+ * Get the values of several binding results at once.
+ *
+ * Fills @values row by row with the values of the current and
+ * following results, one per binding in the order of
+ * librdf_query_results_get_binding_name(), and moves past them.
+ * Unbound values are NULL.
+ *
+ * The nodes are shared and must not be freed.  They are valid until
+ * the next call of this function or until @query_results is freed;
+ * copy them with librdf_new_node_from_node() to keep them longer.
+ * 
+ * Return value: number of rows returned, 0 if the results are finished or <0 on failure
+ **/
+int
+librdf_query_results_get_bindings_batch(librdf_query_results *query_results,
+                                        librdf_node **values, int rows)
+{
+  librdf_query* query;
+  int count;
+  int row;
+  int i;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, librdf_query_results, -1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(values, librdf_node, -1);
+
+  query = query_results->query;
+  librdf_query_results_clear_batch(query_results);
+
+  if(rows <= 0 ||
+     (!query->factory->results_get_bindings &&
+      !query->factory->results_get_binding_value) ||
+     !librdf_query_results_is_bindings(query_results))
+    return -1;
+
+  count = librdf_query_results_get_bindings_count(query_results);
+  if(count < 0)
+    return -1;
+
+  /* values holds count * rows nodes */
+  if(count && rows > INT_MAX / count)
+    return -1;
+
+  if(count * rows > query_results->batch_size) {
+    librdf_node** batch;
+
+    batch = LIBRDF_MALLOC(librdf_node**,
+                          LIBRDF_GOOD_CAST(size_t, count * rows) * sizeof(librdf_node*));
+    if(!batch)
+      return -1;
+    if(query_results->batch)
+      LIBRDF_FREE(librdf_node**, query_results->batch);
+    query_results->batch = batch;
+    query_results->batch_size = count * rows;
+  }
+
+  for(row = 0; row < rows; row++) {
+    if(librdf_query_results_finished(query_results))
+      break;
+
+    /* the whole row is fetched at once when the factory can */
+    if(query->factory->results_get_bindings) {
+      if(query->factory->results_get_bindings(query_results, NULL,
+                                              &values[row * count]))
+        break;
+    } else {
+      for(i = 0; i < count; i++)
+        values[row * count + i] = query->factory->results_get_binding_value(query_results, i);
+    }
+
+    for(i = 0; i < count; i++)
+      query_results->batch[query_results->batch_count++] = values[row * count + i];
+
+    librdf_query_results_next(query_results);
+  }
+
+  return row;
+}
+
+
 /**
  * librdf_free_query_results:
  * @query_results: #librdf_query_results object
@@ -253,9 +371,16 @@ librdf_free_query_results(librdf_query_results* query_results)
   if(!query_results)
     return;
   
+  librdf_query_results_clear_batch(query_results);
+  if(query_results->batch)
+    LIBRDF_FREE(librdf_node**, query_results->batch);
+
   if(query_results->query->factory->free_results)
     query_results->query->factory->free_results(query_results);
 
+  /* the execution a cancel applied to is over */
+  query_results->query->cancelled = 0;
+
   librdf_query_remove_query_result(query_results->query, query_results);
 
   LIBRDF_FREE(librdf_query_results, query_results);
@@ -344,7 +344,7 @@ librdf_query_virtuoso_execute(librdf_query* query, librdf_model* model)
     context->eof = 0;
   }
 
-  results = LIBRDF_MALLOC(librdf_query_results*, sizeof(*results));
+  results = LIBRDF_CALLOC(librdf_query_results*, 1, sizeof(*results));
   if(!results) {
     SQLCloseCursor(context->vc->hstmt);
   } else {
@@ -30,9 +30,17 @@
 #include <win32_rdf_config.h>
 #endif
 
+#include <stdio.h>
+#include <string.h>
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include <redland.h>
 
@@ -111,58 +119,298 @@ librdf_raptor_log_handler(void *data, raptor_log_message *message)
 }
 
 
-int
-librdf_raptor_free_bnode_hash(librdf_world* world)
+/* Initial number of slots in the bnode map table (power of 2) */
+#define LIBRDF_RAPTOR_BNODE_MAP_INITIAL_SIZE 1024
+
+/* Size of each block of the bnode map arena */
+#define LIBRDF_RAPTOR_BNODE_MAP_BLOCK_SIZE 65536
+
+typedef struct librdf_raptor_bnode_block_s librdf_raptor_bnode_block;
+
+struct librdf_raptor_bnode_block_s {
+  librdf_raptor_bnode_block* next;
+  size_t size;
+  size_t used;
+  /* followed by size bytes of entry data */
+};
+
+typedef struct {
+  unsigned long hash;
+  /* length of the user identifier */
+  size_t length;
+  /* user identifier NUL, mapped identifier NUL in the arena */
+  unsigned char *label;
+} librdf_raptor_bnode_entry;
+
+struct librdf_raptor_bnode_map_s {
+  librdf_raptor_bnode_entry* entries;
+  size_t size;
+  size_t count;
+
+  /* arena holding the identifiers; the first block is kept on reset */
+  librdf_raptor_bnode_block* blocks;
+};
+
+
+/*
+ * librdf_raptor_bnode_map_hash - INTERNAL - FNV-1a hash of a bnode identifier
+ */
+static unsigned long
+librdf_raptor_bnode_map_hash(const unsigned char *label, size_t length)
+{
+  unsigned long hash = 2166136261UL;
+
+  while(length--) {
+    hash ^= *label++;
+    hash *= 16777619UL;
+  }
+
+  return hash;
+}
+
+
+/*
+ * librdf_raptor_bnode_map_alloc - INTERNAL - Allocate bytes from the bnode map arena
+ */
+static unsigned char*
+librdf_raptor_bnode_map_alloc(librdf_raptor_bnode_map* map, size_t length)
+{
+  librdf_raptor_bnode_block* block = map->blocks;
+
+  if(!block || block->size - block->used < length) {
+    size_t size = LIBRDF_RAPTOR_BNODE_MAP_BLOCK_SIZE;
+
+    if(length > size)
+      size = length;
+
+    block = LIBRDF_MALLOC(librdf_raptor_bnode_block*,
+                          sizeof(*block) + size);
+    if(!block)
+      return NULL;
+
+    block->size = size;
+    block->used = 0;
+    block->next = map->blocks;
+    map->blocks = block;
+  }
+
+  block->used += length;
+  return (unsigned char*)(block + 1) + block->used - length;
+}
+
+
+/*
+ * librdf_raptor_bnode_map_grow - INTERNAL - Double the size of the bnode map table
+ */
+static int
+librdf_raptor_bnode_map_grow(librdf_raptor_bnode_map* map)
 {
-  if(world->bnode_hash) {
-    librdf_free_hash(world->bnode_hash);
-    world->bnode_hash = NULL;
+  librdf_raptor_bnode_entry* entries;
+  size_t size = map->size << 1;
+  size_t i;
+
+  entries = LIBRDF_CALLOC(librdf_raptor_bnode_entry*, size, sizeof(*entries));
+  if(!entries)
+    return 1;
+
+  for(i = 0; i < map->size; i++) {
+    librdf_raptor_bnode_entry* entry = &map->entries[i];
+    size_t j;
+
+    if(!entry->label)
+      continue;
+
+    for(j = entry->hash & (size - 1); entries[j].label; j = (j + 1) & (size - 1))
+      ;
+    entries[j] = *entry;
   }
 
+  LIBRDF_FREE(librdf_raptor_bnode_entry*, map->entries);
+  map->entries = entries;
+  map->size = size;
+
   return 0;
 }
 
 
+/*
+ * librdf_raptor_free_bnode_map - INTERNAL - Free the bnode identifier map
+ */
+static void
+librdf_raptor_free_bnode_map(librdf_raptor_bnode_map* map)
+{
+  while(map->blocks) {
+    librdf_raptor_bnode_block* next = map->blocks->next;
+    LIBRDF_FREE(librdf_raptor_bnode_block*, map->blocks);
+    map->blocks = next;
+  }
+
+  if(map->entries)
+    LIBRDF_FREE(librdf_raptor_bnode_entry*, map->entries);
+
+  LIBRDF_FREE(librdf_raptor_bnode_map*, map);
+}
+
+
+/**
+ * librdf_raptor_reset_bnode_map:
+ * @world: librdf_world object
+ *
+ * INTERNAL - Forget all mapped blank node identifiers
+ *
+ * Called when a parsed document ends since blank node identifiers are
+ * scoped to a document.  Memory used by a large document is released
+ * back down to the initial table and one arena block.
+ *
+ * Return value: non-0 on failure
+ **/
 int
-librdf_raptor_reset_bnode_hash(librdf_world* world)
+librdf_raptor_reset_bnode_map(librdf_world* world)
 {
-  librdf_raptor_free_bnode_hash(world);
+  librdf_raptor_bnode_map* map = world->bnode_map;
 
-  world->bnode_hash = librdf_new_hash(world, NULL);
-  if(!world->bnode_hash)
-    return 1;
+  if(!map) {
+    map = LIBRDF_CALLOC(librdf_raptor_bnode_map*, 1, sizeof(*map));
+    if(!map)
+      return 1;
+    world->bnode_map = map;
+  } else if(!map->count && map->entries)
+    return 0;
+
+  if(map->blocks) {
+    librdf_raptor_bnode_block* block = map->blocks;
+
+    /* keep the oldest block, which is of the standard size */
+    while(block->next) {
+      librdf_raptor_bnode_block* next = block->next;
+      LIBRDF_FREE(librdf_raptor_bnode_block*, block);
+      block = next;
+    }
+    block->used = 0;
+    map->blocks = block;
+  }
+
+  if(map->entries && map->size > LIBRDF_RAPTOR_BNODE_MAP_INITIAL_SIZE) {
+    LIBRDF_FREE(librdf_raptor_bnode_entry*, map->entries);
+    map->entries = NULL;
+  }
+
+  if(map->entries)
+    memset(map->entries, 0, map->size * sizeof(*map->entries));
+  else {
+    map->size = LIBRDF_RAPTOR_BNODE_MAP_INITIAL_SIZE;
+    map->entries = LIBRDF_CALLOC(librdf_raptor_bnode_entry*, map->size,
+                                 sizeof(*map->entries));
+    if(!map->entries) {
+      map->size = 0;
+      librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
+                 "Out of memory creating blank node identifier map");
+      return 1;
+    }
+  }
+  map->count = 0;
 
   return 0;
 }
 
+
+/**
+ * librdf_raptor_map_bnodeid:
+ * @world: librdf_world object
+ * @user_bnodeid: blank node identifier from the parsed syntax
+ *
+ * INTERNAL - Map a parsed blank node identifier to a world-unique one
+ *
+ * The same @user_bnodeid is mapped to the same identifier until the
+ * bnode map is reset at the end of a parsed document.
+ *
+ * Return value: new identifier or NULL on failure
+ **/
+unsigned char*
+librdf_raptor_map_bnodeid(librdf_world* world,
+                          const unsigned char *user_bnodeid)
+{
+  librdf_raptor_bnode_map* map = world->bnode_map;
+  librdf_raptor_bnode_entry* entry;
+  unsigned char *mapped_id;
+  unsigned char *label;
+  unsigned long hash;
+  size_t user_length;
+  size_t mapped_length;
+  size_t i;
+
+  if(!user_bnodeid || !map || !map->entries)
+    return librdf_world_get_genid(world);
+
+  user_length = strlen((const char*)user_bnodeid);
+  hash = librdf_raptor_bnode_map_hash(user_bnodeid, user_length);
+
+  for(i = hash & (map->size - 1); map->entries[i].label;
+      i = (i + 1) & (map->size - 1)) {
+    entry = &map->entries[i];
+
+    if(entry->hash == hash && entry->length == user_length &&
+       !memcmp(entry->label, user_bnodeid, user_length)) {
+      label = entry->label + user_length + 1;
+      mapped_length = strlen((const char*)label) + 1;
+
+      mapped_id = LIBRDF_MALLOC(unsigned char*, mapped_length);
+      if(mapped_id)
+        memcpy(mapped_id, label, mapped_length);
+      return mapped_id;
+    }
+  }
+
+  mapped_id = librdf_world_get_genid(world);
+  if(!mapped_id)
+    return NULL;
+  mapped_length = strlen((const char*)mapped_id) + 1;
+
+  /* keep the table at most 3/4 full */
+  if((map->count + 1) * 4 > map->size * 3) {
+    if(librdf_raptor_bnode_map_grow(map))
+      goto failed;
+
+    for(i = hash & (map->size - 1); map->entries[i].label;
+        i = (i + 1) & (map->size - 1))
+      ;
+  }
+
+  label = librdf_raptor_bnode_map_alloc(map, user_length + 1 + mapped_length);
+  if(!label)
+    goto failed;
+
+  memcpy(label, user_bnodeid, user_length + 1);
+  memcpy(label + user_length + 1, mapped_id, mapped_length);
+
+  entry = &map->entries[i];
+  entry->hash = hash;
+  entry->length = user_length;
+  entry->label = label;
+  map->count++;
+
+  return mapped_id;
+
+  failed:
+  LIBRDF_FREE(char*, mapped_id);
+  return NULL;
+}
+
+
 static unsigned char*
 librdf_raptor_generate_id_handler(void *user_data,
                                   unsigned char *user_bnodeid)
 {
   librdf_world* world = (librdf_world*)user_data;
+  unsigned char *mapped_id;
 
-  if(user_bnodeid && world->bnode_hash) {
-    unsigned char *mapped_id;
-
-    mapped_id = (unsigned char*)librdf_hash_get(world->bnode_hash,
-                                                (const char*)user_bnodeid);
-    if(!mapped_id) {
-      mapped_id = librdf_world_get_genid(world);
+  mapped_id = librdf_raptor_map_bnodeid(world, user_bnodeid);
 
-      if(mapped_id &&
-         librdf_hash_put_strings(world->bnode_hash,
-                                 (char*)user_bnodeid, (char*)mapped_id)) {
-        /* error -> free mapped_id and return NULL */
-        LIBRDF_FREE(char*, mapped_id);
-        mapped_id = NULL;
-      }
-    }
-    /* always free passed in bnodeid */
+  /* always free passed in bnodeid */
+  if(user_bnodeid)
     raptor_free_memory(user_bnodeid);
 
-    return mapped_id;
-  } else
-    return librdf_world_get_genid(world);
+  return mapped_id;
 }
 
 
@@ -195,9 +443,8 @@ librdf_init_raptor(librdf_world* world)
     }
   }
 
-  /* New in-memory hash for mapping bnode IDs */
-  world->bnode_hash = librdf_new_hash(world, NULL);
-  if(!world->bnode_hash)
+  /* New in-memory map for mapping bnode IDs */
+  if(librdf_raptor_reset_bnode_map(world))
     return 1;
 
 
@@ -250,6 +497,794 @@ librdf_finish_raptor(librdf_world* world)
     world->raptor_world_ptr = NULL;
   }
 
-  if(world->bnode_hash)
-    librdf_free_hash(world->bnode_hash);
+  if(world->bnode_map) {
+    librdf_raptor_free_bnode_map(world->bnode_map);
+    world->bnode_map = NULL;
+  }
+}
+
+
+
+/* Size of the compressed data buffer of a compressed iostream */
+#define LIBRDF_RAPTOR_COMPRESS_BUFFER_SIZE 65536
+
+typedef struct {
+  FILE* fh;
+  librdf_compression compression;
+  int writing;
+
+  /* compressed data read from or to be written to the file */
+  unsigned char* buffer;
+  size_t buffer_length;
+  size_t buffer_offset;
+
+  /* reading: all of the file has been read */
+  int input_eof;
+  /* reading: all of the content has been returned */
+  int eof;
+  /* writing: the end of the compressed data has been written */
+  int ended;
+
+#ifdef HAVE_ZLIB
+  z_stream zs;
+  int zs_open;
+#endif
+#ifdef HAVE_ZSTD
+  ZSTD_DStream* zds;
+  ZSTD_CStream* zcs;
+#endif
+} librdf_raptor_compress_context;
+
+
+/**
+ * librdf_get_compression_from_filename:
+ * @filename: file name
+ *
+ * Get the compression to use for a file from its name.
+ *
+ * Names ending in .gz are gzip and names ending in .zst are Zstandard,
+ * when redland was built with support for them.
+ *
+ * Return value: compression or LIBRDF_COMPRESSION_NONE
+ **/
+librdf_compression
+librdf_get_compression_from_filename(const char* filename)
+{
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+  size_t length;
+
+  if(!filename)
+    return LIBRDF_COMPRESSION_NONE;
+
+  length = strlen(filename);
+#endif
+#ifdef HAVE_ZLIB
+  if(length > 3 && !strcmp(filename + length - 3, ".gz"))
+    return LIBRDF_COMPRESSION_GZIP;
+#endif
+#ifdef HAVE_ZSTD
+  if(length > 4 && !strcmp(filename + length - 4, ".zst"))
+    return LIBRDF_COMPRESSION_ZSTD;
+#endif
+
+  return LIBRDF_COMPRESSION_NONE;
+}
+
+
+static librdf_compression
+librdf_raptor_get_compression_from_magic(const unsigned char* magic,
+                                         size_t length)
+{
+#ifdef HAVE_ZLIB
+  if(length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+    return LIBRDF_COMPRESSION_GZIP;
+#endif
+#ifdef HAVE_ZSTD
+  if(length >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+     magic[2] == 0x2f && magic[3] == 0xfd)
+    return LIBRDF_COMPRESSION_ZSTD;
+#endif
+
+  return LIBRDF_COMPRESSION_NONE;
+}
+
+
+/**
+ * librdf_raptor_get_file_compression:
+ * @fh: file handle
+ *
+ * INTERNAL - Get the compression of a file from its first bytes
+ *
+ * The file position is left unchanged.  A handle that cannot seek,
+ * such as a pipe, is reported as not compressed.
+ *
+ * Return value: compression or LIBRDF_COMPRESSION_NONE
+ **/
+librdf_compression
+librdf_raptor_get_file_compression(FILE* fh)
+{
+  unsigned char magic[4];
+  size_t length;
+  long offset;
+
+  offset = ftell(fh);
+  if(offset < 0)
+    return LIBRDF_COMPRESSION_NONE;
+
+  length = fread(magic, 1, sizeof(magic), fh);
+  if(fseek(fh, offset, SEEK_SET))
+    return LIBRDF_COMPRESSION_NONE;
+
+  return librdf_raptor_get_compression_from_magic(magic, length);
+}
+
+
+/* read more compressed data into the empty buffer */
+static size_t
+librdf_raptor_compress_fill(librdf_raptor_compress_context* ccontext)
+{
+  size_t length;
+
+  if(ccontext->input_eof)
+    return 0;
+
+  length = fread(ccontext->buffer, 1, LIBRDF_RAPTOR_COMPRESS_BUFFER_SIZE,
+                 ccontext->fh);
+  if(!length)
+    ccontext->input_eof = 1;
+
+  ccontext->buffer_length = length;
+  ccontext->buffer_offset = 0;
+
+  return length;
+}
+
+
+static int
+librdf_raptor_compress_read_bytes(void *context, void *ptr,
+                                  size_t size, size_t nmemb)
+{
+  librdf_raptor_compress_context* ccontext = (librdf_raptor_compress_context*)context;
+  size_t length = size * nmemb;
+  size_t done = 0;
+
+  if(ccontext->eof || !length)
+    return 0;
+
+  switch(ccontext->compression) {
+#ifdef HAVE_ZLIB
+    case LIBRDF_COMPRESSION_GZIP:
+      ccontext->zs.next_out = (Bytef*)ptr;
+      ccontext->zs.avail_out = (uInt)length;
+      while(ccontext->zs.avail_out) {
+        int rc;
+
+        if(!ccontext->zs.avail_in && librdf_raptor_compress_fill(ccontext)) {
+          ccontext->zs.next_in = ccontext->buffer;
+          ccontext->zs.avail_in = (uInt)ccontext->buffer_length;
+        }
+
+        rc = inflate(&ccontext->zs, Z_NO_FLUSH);
+        if(rc == Z_STREAM_END) {
+          if(!ccontext->zs.avail_in && librdf_raptor_compress_fill(ccontext)) {
+            ccontext->zs.next_in = ccontext->buffer;
+            ccontext->zs.avail_in = (uInt)ccontext->buffer_length;
+          }
+          if(!ccontext->zs.avail_in) {
+            ccontext->eof = 1;
+            break;
+          }
+          /* concatenated gzip members */
+          inflateReset(&ccontext->zs);
+        } else if(rc != Z_OK &&
+                  !(rc == Z_BUF_ERROR && !ccontext->input_eof)) {
+          /* corrupt or truncated */
+          ccontext->eof = 1;
+          break;
+        }
+      }
+      done = length - ccontext->zs.avail_out;
+      break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case LIBRDF_COMPRESSION_ZSTD:
+      {
+        ZSTD_outBuffer out;
+
+        out.dst = ptr;
+        out.size = length;
+        out.pos = 0;
+        while(out.pos < out.size) {
+          ZSTD_inBuffer in;
+          size_t before = out.pos;
+          size_t rc;
+
+          if(ccontext->buffer_offset == ccontext->buffer_length)
+            librdf_raptor_compress_fill(ccontext);
+
+          in.src = ccontext->buffer;
+          in.size = ccontext->buffer_length;
+          in.pos = ccontext->buffer_offset;
+          rc = ZSTD_decompressStream(ccontext->zds, &out, &in);
+          ccontext->buffer_offset = in.pos;
+
+          if(ZSTD_isError(rc) ||
+             (ccontext->input_eof && in.pos == in.size && out.pos == before)) {
+            ccontext->eof = 1;
+            break;
+          }
+        }
+        done = out.pos;
+      }
+      break;
+#endif
+
+    case LIBRDF_COMPRESSION_NONE:
+    default:
+      /* bytes read when looking for a compression magic */
+      done = ccontext->buffer_length - ccontext->buffer_offset;
+      if(done > length)
+        done = length;
+      memcpy(ptr, ccontext->buffer + ccontext->buffer_offset, done);
+      ccontext->buffer_offset += done;
+
+      if(done < length)
+        done += fread((unsigned char*)ptr + done, 1, length - done,
+                      ccontext->fh);
+      if(done < length)
+        ccontext->eof = 1;
+      break;
+  }
+
+  return (int)(done / size);
+}
+
+
+static int
+librdf_raptor_compress_read_eof(void *context)
+{
+  librdf_raptor_compress_context* ccontext = (librdf_raptor_compress_context*)context;
+
+  return ccontext->eof;
+}
+
+
+/* write the compressed data in the buffer to the file */
+static int
+librdf_raptor_compress_flush(librdf_raptor_compress_context* ccontext,
+                             size_t length)
+{
+  if(length && fwrite(ccontext->buffer, 1, length, ccontext->fh) != length)
+    return 1;
+
+  return 0;
+}
+
+
+static int
+librdf_raptor_compress_write_bytes(void *context, const void *ptr,
+                                   size_t size, size_t nmemb)
+{
+  librdf_raptor_compress_context* ccontext = (librdf_raptor_compress_context*)context;
+  size_t length = size * nmemb;
+
+  switch(ccontext->compression) {
+#ifdef HAVE_ZLIB
+    case LIBRDF_COMPRESSION_GZIP:
+      ccontext->zs.next_in = (Bytef*)ptr;
+      ccontext->zs.avail_in = (uInt)length;
+      while(ccontext->zs.avail_in) {
+        ccontext->zs.next_out = ccontext->buffer;
+        ccontext->zs.avail_out = LIBRDF_RAPTOR_COMPRESS_BUFFER_SIZE;
+        if(deflate(&ccontext->zs, Z_NO_FLUSH) == Z_STREAM_ERROR ||
+           librdf_raptor_compress_flush(ccontext, LIBRDF_RAPTOR_COMPRESS_BUFFER_SIZE - ccontext->zs.avail_out))
+          return 0;
+      }
+      break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case LIBRDF_COMPRESSION_ZSTD:
+      {
+        ZSTD_inBuffer in;
+
+        in.src = ptr;
+        in.size = length;
+        in.pos = 0;
+        while(in.pos < in.size) {
+          ZSTD_outBuffer out;
+
+          out.dst = ccontext->buffer;
+          out.size = LIBRDF_RAPTOR_COMPRESS_BUFFER_SIZE;
+          out.pos = 0;
+          if(ZSTD_isError(ZSTD_compressStream(ccontext->zcs, &out, &in)) ||
+             librdf_raptor_compress_flush(ccontext, out.pos))
+            return 0;
+        }
+      }
+      break;
+#endif
+
+    case LIBRDF_COMPRESSION_NONE:
+    default:
+      if(fwrite(ptr, 1, length, ccontext->fh) != length)
+        return 0;
+      break;
+  }
+
+  return (int)nmemb;
+}
+
+
+static int
+librdf_raptor_compress_write_byte(void *context, const int byte)
+{
+  unsigned char c = (unsigned char)byte;
+
+  return librdf_raptor_compress_write_bytes(context, &c, 1, 1) == 1 ? 0 : 1;
+}
+
+
+static int
+librdf_raptor_compress_write_end(void *context)
+{
+  librdf_raptor_compress_context* ccontext = (librdf_raptor_compress_context*)context;
+  int status = 0;
+
+  if(ccontext->ended)
+    return 0;
+  ccontext->ended = 1;
+
+  switch(ccontext->compression) {
+#ifdef HAVE_ZLIB
+    case LIBRDF_COMPRESSION_GZIP:
+      {
+        int rc;
+
+        ccontext->zs.next_in = NULL;
+        ccontext->zs.avail_in = 0;
+        do {
+          ccontext->zs.next_out = ccontext->buffer;
+          ccontext->zs.avail_out = LIBRDF_RAPTOR_COMPRESS_BUFFER_SIZE;
+          rc = deflate(&ccontext->zs, Z_FINISH);
+          if(rc == Z_STREAM_ERROR ||
+             librdf_raptor_compress_flush(ccontext, LIBRDF_RAPTOR_COMPRESS_BUFFER_SIZE - ccontext->zs.avail_out)) {
+            status = 1;
+            break;
+          }
+        } while(rc != Z_STREAM_END);
+      }
+      break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case LIBRDF_COMPRESSION_ZSTD:
+      {
+        size_t remaining;
+
+        do {
+          ZSTD_outBuffer out;
+
+          out.dst = ccontext->buffer;
+          out.size = LIBRDF_RAPTOR_COMPRESS_BUFFER_SIZE;
+          out.pos = 0;
+          remaining = ZSTD_endStream(ccontext->zcs, &out);
+          if(ZSTD_isError(remaining) ||
+             librdf_raptor_compress_flush(ccontext, out.pos)) {
+            status = 1;
+            break;
+          }
+        } while(remaining);
+      }
+      break;
+#endif
+
+    case LIBRDF_COMPRESSION_NONE:
+    default:
+      break;
+  }
+
+  if(fflush(ccontext->fh))
+    status = 1;
+
+  return status;
+}
+
+
+static void
+librdf_raptor_compress_finish(void *context)
+{
+  librdf_raptor_compress_context* ccontext = (librdf_raptor_compress_context*)context;
+
+  if(ccontext->writing)
+    librdf_raptor_compress_write_end(context);
+
+#ifdef HAVE_ZLIB
+  if(ccontext->zs_open) {
+    if(ccontext->writing)
+      deflateEnd(&ccontext->zs);
+    else
+      inflateEnd(&ccontext->zs);
+  }
+#endif
+#ifdef HAVE_ZSTD
+  if(ccontext->zds)
+    ZSTD_freeDStream(ccontext->zds);
+  if(ccontext->zcs)
+    ZSTD_freeCStream(ccontext->zcs);
+#endif
+
+  if(ccontext->buffer)
+    LIBRDF_FREE(char*, ccontext->buffer);
+  LIBRDF_FREE(librdf_raptor_compress_context*, ccontext);
+}
+
+
+static const raptor_iostream_handler librdf_raptor_compress_read_handler = {
+  /* .version =     */ 2,
+  /* .init  =       */ NULL,
+  /* .finish =      */ librdf_raptor_compress_finish,
+  /* .write_byte =  */ NULL,
+  /* .write_bytes = */ NULL,
+  /* .write_end =   */ NULL,
+  /* .read_bytes =  */ librdf_raptor_compress_read_bytes,
+  /* .read_eof =    */ librdf_raptor_compress_read_eof
+};
+
+
+static const raptor_iostream_handler librdf_raptor_compress_write_handler = {
+  /* .version =     */ 2,
+  /* .init  =       */ NULL,
+  /* .finish =      */ librdf_raptor_compress_finish,
+  /* .write_byte =  */ librdf_raptor_compress_write_byte,
+  /* .write_bytes = */ librdf_raptor_compress_write_bytes,
+  /* .write_end =   */ librdf_raptor_compress_write_end,
+  /* .read_bytes =  */ NULL,
+  /* .read_eof =    */ NULL
+};
+
+
+/*
+ * librdf_raptor_new_compress_iostream:
+ * @world: librdf_world object
+ * @ccontext: compressed iostream context (ownership taken)
+ * @handler: iostream handler
+ *
+ * INTERNAL - Make an iostream from a compressed iostream context
+ *
+ * Return value: new #raptor_iostream or NULL on failure
+ */
+static raptor_iostream*
+librdf_raptor_new_compress_iostream(librdf_world* world,
+                                    librdf_raptor_compress_context* ccontext,
+                                    const raptor_iostream_handler* handler)
+{
+  raptor_iostream* iostr;
+
+  iostr = raptor_new_iostream_from_handler(world->raptor_world_ptr, ccontext,
+                                           handler);
+  if(!iostr)
+    librdf_raptor_compress_finish(ccontext);
+
+  return iostr;
+}
+
+
+/**
+ * librdf_new_iostream_from_compressed_file_handle:
+ * @world: librdf_world object
+ * @fh: file handle to read
+ *
+ * Constructor - create an iostream reading the content of a file
+ * that may be compressed.
+ *
+ * gzip and Zstandard content is recognised by its first bytes and
+ * decompressed as it is read; other content is read unchanged.  The
+ * file handle is not closed when the iostream is freed.
+ *
+ * Return value: new #raptor_iostream or NULL on failure
+ **/
+raptor_iostream*
+librdf_new_iostream_from_compressed_file_handle(librdf_world* world, FILE* fh)
+{
+  librdf_raptor_compress_context* ccontext;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, librdf_world, NULL);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(fh, FILE*, NULL);
+
+  librdf_world_open(world);
+
+  ccontext = LIBRDF_CALLOC(librdf_raptor_compress_context*, 1,
+                           sizeof(*ccontext));
+  if(!ccontext)
+    return NULL;
+
+  ccontext->fh = fh;
+  ccontext->buffer = LIBRDF_MALLOC(unsigned char*,
+                                   LIBRDF_RAPTOR_COMPRESS_BUFFER_SIZE);
+  if(!ccontext->buffer) {
+    librdf_raptor_compress_finish(ccontext);
+    return NULL;
+  }
+
+  /* the magic bytes stay in the buffer as the first content read */
+  ccontext->buffer_length = fread(ccontext->buffer, 1, 4, fh);
+  ccontext->compression = librdf_raptor_get_compression_from_magic(ccontext->buffer,
+                                                                   ccontext->buffer_length);
+
+#ifdef HAVE_ZLIB
+  if(ccontext->compression == LIBRDF_COMPRESSION_GZIP) {
+    /* gzip header only */
+    if(inflateInit2(&ccontext->zs, 16 + MAX_WBITS) != Z_OK) {
+      librdf_raptor_compress_finish(ccontext);
+      return NULL;
+    }
+    ccontext->zs_open = 1;
+    ccontext->zs.next_in = ccontext->buffer;
+    ccontext->zs.avail_in = (uInt)ccontext->buffer_length;
+  }
+#endif
+#ifdef HAVE_ZSTD
+  if(ccontext->compression == LIBRDF_COMPRESSION_ZSTD) {
+    ccontext->zds = ZSTD_createDStream();
+    if(!ccontext->zds || ZSTD_isError(ZSTD_initDStream(ccontext->zds))) {
+      librdf_raptor_compress_finish(ccontext);
+      return NULL;
+    }
+  }
+#endif
+
+  return librdf_raptor_new_compress_iostream(world, ccontext,
+                                             &librdf_raptor_compress_read_handler);
+}
+
+
+/**
+ * librdf_new_iostream_to_compressed_file_handle:
+ * @world: librdf_world object
+ * @fh: file handle to write
+ * @compression: compression to use
+ *
+ * Constructor - create an iostream writing compressed content to a
+ * file.
+ *
+ * The compressed data is completed when the iostream is ended or
+ * freed.  The file handle is not closed when the iostream is freed.
+ *
+ * Return value: new #raptor_iostream or NULL on failure or if the
+ * compression is not supported
+ **/
+raptor_iostream*
+librdf_new_iostream_to_compressed_file_handle(librdf_world* world, FILE* fh,
+                                              librdf_compression compression)
+{
+  librdf_raptor_compress_context* ccontext;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, librdf_world, NULL);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(fh, FILE*, NULL);
+
+  librdf_world_open(world);
+
+  ccontext = LIBRDF_CALLOC(librdf_raptor_compress_context*, 1,
+                           sizeof(*ccontext));
+  if(!ccontext)
+    return NULL;
+
+  ccontext->fh = fh;
+  ccontext->writing = 1;
+  ccontext->compression = compression;
+  ccontext->buffer = LIBRDF_MALLOC(unsigned char*,
+                                   LIBRDF_RAPTOR_COMPRESS_BUFFER_SIZE);
+  if(!ccontext->buffer) {
+    librdf_raptor_compress_finish(ccontext);
+    return NULL;
+  }
+
+  switch(compression) {
+#ifdef HAVE_ZLIB
+    case LIBRDF_COMPRESSION_GZIP:
+      if(deflateInit2(&ccontext->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                      16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        ccontext->ended = 1;
+        librdf_raptor_compress_finish(ccontext);
+        return NULL;
+      }
+      ccontext->zs_open = 1;
+      break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case LIBRDF_COMPRESSION_ZSTD:
+      ccontext->zcs = ZSTD_createCStream();
+      if(!ccontext->zcs ||
+         ZSTD_isError(ZSTD_initCStream(ccontext->zcs, ZSTD_CLEVEL_DEFAULT))) {
+        ccontext->ended = 1;
+        librdf_raptor_compress_finish(ccontext);
+        return NULL;
+      }
+      break;
+#endif
+
+    case LIBRDF_COMPRESSION_NONE:
+      break;
+
+    default:
+      librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_RAPTOR, NULL,
+                 "Compression %d is not supported", (int)compression);
+      ccontext->ended = 1;
+      librdf_raptor_compress_finish(ccontext);
+      return NULL;
+  }
+
+  return librdf_raptor_new_compress_iostream(world, ccontext,
+                                             &librdf_raptor_compress_write_handler);
+}
+
+
+/*
+ * Terms are passed between threads as plain bytes since raptor and
+ * librdf objects belong to one world and are not thread-safe.  A term
+ * is a type byte ('U' URI, 'B' blank, 'L' literal or '-' none)
+ * followed by its strings, each a size_t length and the bytes with a
+ * NUL.  A literal has its value, language and datatype URI strings.
+ */
+
+/**
+ * librdf_raptor_buffer_write:
+ * @buffer: buffer
+ * @data: bytes to append
+ * @length: length of @data
+ *
+ * INTERNAL - Append bytes to a buffer, growing it as needed
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_raptor_buffer_write(librdf_raptor_buffer* buffer,
+                           const void* data, size_t length)
+{
+  if(buffer->length + length > buffer->size) {
+    size_t size = buffer->size ? buffer->size : 4096;
+    unsigned char *new_data;
+
+    while(size < buffer->length + length)
+      size <<= 1;
+
+    new_data = LIBRDF_MALLOC(unsigned char*, size);
+    if(!new_data)
+      return 1;
+    if(buffer->data) {
+      memcpy(new_data, buffer->data, buffer->length);
+      LIBRDF_FREE(char*, buffer->data);
+    }
+    buffer->data = new_data;
+    buffer->size = size;
+  }
+
+  memcpy(buffer->data + buffer->length, data, length);
+  buffer->length += length;
+
+  return 0;
+}
+
+
+/**
+ * librdf_raptor_buffer_write_string:
+ * @buffer: buffer
+ * @string: string or NULL
+ * @length: length of @string
+ *
+ * INTERNAL - Append an encoded string to a buffer
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_raptor_buffer_write_string(librdf_raptor_buffer* buffer,
+                                  const unsigned char* string, size_t length)
+{
+  if(!string)
+    length = 0;
+
+  if(librdf_raptor_buffer_write(buffer, &length, sizeof(length)) ||
+     librdf_raptor_buffer_write(buffer, string ? string : (const unsigned char*)"", length) ||
+     librdf_raptor_buffer_write(buffer, "", 1))
+    return 1;
+
+  return 0;
+}
+
+
+/**
+ * librdf_raptor_buffer_write_term:
+ * @buffer: buffer
+ * @term: term or NULL
+ *
+ * INTERNAL - Append an encoded term to a buffer
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_raptor_buffer_write_term(librdf_raptor_buffer* buffer,
+                                raptor_term* term)
+{
+  const unsigned char* string;
+  size_t length = 0;
+  int rc;
+
+  if(!term)
+    return librdf_raptor_buffer_write(buffer, "-", 1);
+
+  switch(term->type) {
+    case RAPTOR_TERM_TYPE_URI:
+      string = raptor_uri_as_counted_string(term->value.uri, &length);
+      rc = librdf_raptor_buffer_write(buffer, "U", 1) ||
+           librdf_raptor_buffer_write_string(buffer, string, length);
+      break;
+
+    case RAPTOR_TERM_TYPE_BLANK:
+      rc = librdf_raptor_buffer_write(buffer, "B", 1) ||
+           librdf_raptor_buffer_write_string(buffer, term->value.blank.string,
+                                             term->value.blank.string_len);
+      break;
+
+    case RAPTOR_TERM_TYPE_LITERAL:
+      string = NULL;
+      if(term->value.literal.datatype)
+        string = raptor_uri_as_counted_string(term->value.literal.datatype,
+                                              &length);
+      rc = librdf_raptor_buffer_write(buffer, "L", 1) ||
+           librdf_raptor_buffer_write_string(buffer, term->value.literal.string,
+                                             term->value.literal.string_len) ||
+           librdf_raptor_buffer_write_string(buffer, term->value.literal.language,
+                                             term->value.literal.language_len) ||
+           librdf_raptor_buffer_write_string(buffer, string, length);
+      break;
+
+    case RAPTOR_TERM_TYPE_UNKNOWN:
+    default:
+      rc = librdf_raptor_buffer_write(buffer, "-", 1);
+      break;
+  }
+
+  return rc;
+}
+
+
+/**
+ * librdf_raptor_buffer_read_string:
+ * @p: address of an encoded string, moved past it
+ * @length_p: address to store the string length
+ *
+ * INTERNAL - Decode a string of an encoded term
+ *
+ * Return value: the NUL terminated string, pointing into the buffer
+ **/
+const unsigned char*
+librdf_raptor_buffer_read_string(const unsigned char** p, size_t* length_p)
+{
+  const unsigned char* string;
+
+  memcpy(length_p, *p, sizeof(*length_p));
+  string = *p + sizeof(*length_p);
+  *p = string + *length_p + 1;
+
+  return string;
+}
+
+
+/**
+ * librdf_raptor_buffer_clear:
+ * @buffer: buffer
+ *
+ * INTERNAL - Free the contents of a buffer
+ **/
+void
+librdf_raptor_buffer_clear(librdf_raptor_buffer* buffer)
+{
+  if(buffer->data)
+    LIBRDF_FREE(char*, buffer->data);
+  buffer->data = NULL;
+  buffer->length = 0;
+  buffer->size = 0;
 }
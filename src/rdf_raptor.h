@@ -26,6 +26,20 @@
 #ifndef LIBRDF_RAPTOR_H
 #define LIBRDF_RAPTOR_H
 
+/**
+ * librdf_compression:
+ * @LIBRDF_COMPRESSION_NONE: Not compressed.
+ * @LIBRDF_COMPRESSION_GZIP: gzip (RFC 1952).
+ * @LIBRDF_COMPRESSION_ZSTD: Zstandard (RFC 8878).
+ *
+ * Compression of file content read or written through a #raptor_iostream.
+ */
+typedef enum {
+  LIBRDF_COMPRESSION_NONE = 0,
+  LIBRDF_COMPRESSION_GZIP,
+  LIBRDF_COMPRESSION_ZSTD
+} librdf_compression;
+
 #ifdef LIBRDF_INTERNAL
 #include <rdf_raptor_internal.h>
 #endif
@@ -39,6 +53,13 @@ void librdf_world_set_raptor(librdf_world* world, raptor_world* raptor_world_ptr
 REDLAND_API
 raptor_world* librdf_world_get_raptor(librdf_world* world);
 
+REDLAND_API
+librdf_compression librdf_get_compression_from_filename(const char* filename);
+REDLAND_API
+raptor_iostream* librdf_new_iostream_from_compressed_file_handle(librdf_world* world, FILE* fh);
+REDLAND_API
+raptor_iostream* librdf_new_iostream_to_compressed_file_handle(librdf_world* world, FILE* fh, librdf_compression compression);
+
 
 #ifdef __cplusplus
 }
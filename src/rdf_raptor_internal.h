@@ -33,8 +33,22 @@ extern "C" {
 int librdf_init_raptor(librdf_world* world);
 void librdf_finish_raptor(librdf_world* world);
 
-int librdf_raptor_free_bnode_hash(librdf_world* world);
-int librdf_raptor_reset_bnode_hash(librdf_world* world);
+int librdf_raptor_reset_bnode_map(librdf_world* world);
+unsigned char* librdf_raptor_map_bnodeid(librdf_world* world, const unsigned char *user_bnodeid);
+librdf_compression librdf_raptor_get_file_compression(FILE* fh);
+
+/* growable buffer of bytes such as terms encoded to pass between threads */
+typedef struct {
+  unsigned char *data;
+  size_t length;
+  size_t size;
+} librdf_raptor_buffer;
+
+int librdf_raptor_buffer_write(librdf_raptor_buffer* buffer, const void* data, size_t length);
+int librdf_raptor_buffer_write_string(librdf_raptor_buffer* buffer, const unsigned char* string, size_t length);
+int librdf_raptor_buffer_write_term(librdf_raptor_buffer* buffer, raptor_term* term);
+const unsigned char* librdf_raptor_buffer_read_string(const unsigned char** p, size_t* length_p);
+void librdf_raptor_buffer_clear(librdf_raptor_buffer* buffer);
 
 #ifdef __cplusplus
 }
@@ -56,6 +56,7 @@ void
 librdf_init_serializer(librdf_world *world) 
 {
   librdf_serializer_raptor_constructor(world);
+  librdf_serializer_binary_constructor(world);
 }
 
 
@@ -544,6 +545,9 @@ librdf_serializer_serialize_model_to_file_handle(librdf_serializer* serializer,
  *
  * Write a #librdf_stream to a file.
  * 
+ * A @name ending in .gz or .zst is written compressed with gzip or
+ * Zstandard, when supported.
+ *
  * Return value: non 0 on failure
  **/
 int
@@ -554,6 +558,7 @@ librdf_serializer_serialize_stream_to_file(librdf_serializer* serializer,
 {
   FILE* fh;
   int status;
+  librdf_compression compression;
   
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(serializer, librdf_serializer, 1);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(name, string, 1);
@@ -567,8 +572,23 @@ librdf_serializer_serialize_stream_to_file(librdf_serializer* serializer,
     return 1;
   }
   
-  status=librdf_serializer_serialize_stream_to_file_handle(serializer, fh, 
-                                                           base_uri, stream);
+  compression=librdf_get_compression_from_filename(name);
+  if(compression != LIBRDF_COMPRESSION_NONE) {
+    raptor_iostream* iostr;
+
+    /* the iostream is freed by the serializer, completing the file */
+    iostr=librdf_new_iostream_to_compressed_file_handle(serializer->world,
+                                                        fh, compression);
+    if(iostr)
+      status=librdf_serializer_serialize_stream_to_iostream(serializer, base_uri,
+                                                            stream, iostr);
+    else
+      status=1;
+    if(ferror(fh))
+      status=1;
+  } else
+    status=librdf_serializer_serialize_stream_to_file_handle(serializer, fh, 
+                                                             base_uri, stream);
   fclose(fh);
   return status;
 }
@@ -583,6 +603,9 @@ librdf_serializer_serialize_stream_to_file(librdf_serializer* serializer,
  *
  * Write a serialized #librdf_model to a file.
  * 
+ * A @name ending in .gz or .zst is written compressed with gzip or
+ * Zstandard, when supported.
+ *
  * Return value: non 0 on failure
  **/
 int
@@ -593,6 +616,7 @@ librdf_serializer_serialize_model_to_file(librdf_serializer* serializer,
 {
   FILE* fh;
   int status;
+  librdf_compression compression;
   
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(serializer, librdf_serializer, 1);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(name, string, 1);
@@ -606,8 +630,23 @@ librdf_serializer_serialize_model_to_file(librdf_serializer* serializer,
     return 1;
   }
   
-  status=librdf_serializer_serialize_model_to_file_handle(serializer, fh, 
-                                                          base_uri, model);
+  compression=librdf_get_compression_from_filename(name);
+  if(compression != LIBRDF_COMPRESSION_NONE) {
+    raptor_iostream* iostr;
+
+    /* the iostream is freed by the serializer, completing the file */
+    iostr=librdf_new_iostream_to_compressed_file_handle(serializer->world,
+                                                        fh, compression);
+    if(iostr)
+      status=librdf_serializer_serialize_model_to_iostream(serializer, base_uri,
+                                                            model, iostr);
+    else
+      status=1;
+    if(ferror(fh))
+      status=1;
+  } else
+    status=librdf_serializer_serialize_model_to_file_handle(serializer, fh, 
+                                                            base_uri, model);
   fclose(fh);
   return status;
 }
@@ -957,18 +996,40 @@ log_handler(void *user_data, librdf_log_message *message)
 "<http://purl.org/net/dajobe/> <http://purl.org/dc/elements/1.1/title> \"Dave Beckett's Home Page\" . \n"
 
 
+/* statements written on threads, over several chunks */
+#define TEST_THREADS 4
+#define TEST_THREADS_STATEMENTS 20000
+
+
 int
 main(int argc, char *argv[]) 
 {
   const char *program=librdf_basename((const char*)argv[0]);
   const char *test_serializer_types[]={"rdfxml", "ntriples", NULL};
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+  const char *test_compressed_filenames[]={
+#ifdef HAVE_ZLIB
+    "test.nt.gz",
+#endif
+#ifdef HAVE_ZSTD
+    "test.nt.zst",
+#endif
+    NULL
+  };
+#endif
   int i;
   const char *type;
   unsigned char *string;
   size_t string_length;
+  unsigned char *string2;
+  size_t string2_length;
   librdf_world *world;
   librdf_storage *storage;
   librdf_model* model;
+  librdf_storage *storage2;
+  librdf_model* model2;
+  librdf_storage *storage3;
+  librdf_model* model3;
   librdf_uri* base_uri;
   librdf_statement* statement;
   librdf_serializer* serializer;
@@ -1128,6 +1189,252 @@ main(int argc, char *argv[])
   
   librdf_free_stream(stream);
 
+  librdf_free_serializer(serializer); serializer=NULL;
+
+
+  fprintf(stderr, "%s: Round-tripping the model through %s\n", program,
+          "redland-binary");
+
+  serializer=librdf_new_serializer(world, "redland-binary", NULL, NULL);
+  parser=librdf_new_parser(world, "redland-binary", NULL, NULL);
+  if(!serializer || !parser) {
+    fprintf(stderr, "%s: Failed to create redland-binary parser or serializer\n",
+            program);
+    return 1;
+  }
+
+  storage3=librdf_new_storage(world, NULL, NULL, NULL);
+  model3=librdf_new_model(world, storage3, NULL);
+  stream=librdf_model_as_stream(model);
+  librdf_model_add_statements(model3, stream);
+  librdf_free_stream(stream);
+
+  /* terms of every kind: language and datatyped literals, blank nodes */
+  statement=librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_blank_identifier(world, (const unsigned char*)"b1"),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://purl.org/dc/elements/1.1/title"),
+    librdf_new_node_from_literal(world, (const unsigned char*)"Bonjour", "fr", 0));
+  librdf_model_add_statement(model3, statement);
+  librdf_free_statement(statement);
+
+  base_uri=librdf_new_uri(world, (const unsigned char*)"http://www.w3.org/2001/XMLSchema#integer");
+  statement=librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://purl.org/net/dajobe/"),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/age"),
+    librdf_new_node_from_typed_literal(world, (const unsigned char*)"42", NULL, base_uri));
+  librdf_model_add_statement(model3, statement);
+  librdf_free_statement(statement);
+  librdf_free_uri(base_uri); base_uri=NULL;
+
+  statement=librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://purl.org/net/dajobe/"),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/knows"),
+    librdf_new_node_from_blank_identifier(world, (const unsigned char*)"b1"));
+  librdf_model_add_statement(model3, statement);
+  librdf_free_statement(statement);
+
+  string=librdf_serializer_serialize_model_to_counted_string(serializer,
+                                                             NULL, model3,
+                                                             &string_length);
+  if(!string) {
+    fprintf(stderr, "%s: Failed to serialize model to redland-binary\n",
+            program);
+    return 1;
+  }
+
+  storage2=librdf_new_storage(world, NULL, NULL, NULL);
+  model2=librdf_new_model(world, storage2, NULL);
+  if(librdf_parser_parse_counted_string_into_model(parser, string,
+                                                   string_length, NULL,
+                                                   model2) ||
+     librdf_model_size(model2) != librdf_model_size(model3)) {
+    fprintf(stderr, "%s: Parsing redland-binary returned %d statements, expected %d\n",
+            program, librdf_model_size(model2), librdf_model_size(model3));
+    return 1;
+  }
+  librdf_free_memory(string);
+
+  stream=librdf_model_as_stream(model3);
+  while(!librdf_stream_end(stream)) {
+    statement=librdf_stream_get_object(stream);
+    if(!librdf_model_contains_statement(model2, statement)) {
+      fprintf(stderr, "%s: Parsing redland-binary lost statement ", program);
+      librdf_statement_print(statement, stderr);
+      fputc('\n', stderr);
+      return 1;
+    }
+    librdf_stream_next(stream);
+  }
+  librdf_free_stream(stream);
+
+  librdf_free_model(model2);
+  librdf_free_storage(storage2);
+  librdf_free_model(model3);
+  librdf_free_storage(storage3);
+  librdf_free_parser(parser);
+
+  librdf_free_serializer(serializer); serializer=NULL;
+
+
+  fprintf(stderr, "%s: Writing N-Triples directly from a hashes storage\n",
+          program);
+
+  storage2=librdf_new_storage(world, "hashes", "test", "hash-type='memory'");
+  model2=librdf_new_model(world, storage2, NULL);
+  serializer=librdf_new_serializer(world, "ntriples", NULL, NULL);
+  if(!model2 || !serializer) {
+    fprintf(stderr, "%s: Failed to create hashes model or ntriples serializer\n",
+            program);
+    return 1;
+  }
+
+  stream=librdf_model_as_stream(model);
+  librdf_model_add_statements(model2, stream);
+  librdf_free_stream(stream);
+
+  stream=librdf_model_as_stream(model2);
+  string=librdf_serializer_serialize_stream_to_counted_string(serializer,
+                                                              NULL, stream,
+                                                              &string_length);
+  librdf_free_stream(stream);
+  string2=librdf_serializer_serialize_model_to_counted_string(serializer,
+                                                              NULL, model2,
+                                                              &string2_length);
+  if(!string || !string2 || string_length != string2_length ||
+     memcmp(string, string2, string_length)) {
+    fprintf(stderr, "%s: Writing N-Triples directly returned '%s', expected '%s'\n",
+            program, string2, string);
+    return 1;
+  }
+  librdf_free_memory(string);
+  librdf_free_memory(string2);
+
+  librdf_free_model(model2);
+  librdf_free_storage(storage2);
+
+
+  fprintf(stderr, "%s: Writing N-Triples on %d threads\n", program,
+          TEST_THREADS);
+
+  storage2=librdf_new_storage(world, "hashes", "test", "hash-type='memory'");
+  model2=librdf_new_model(world, storage2, NULL);
+  for(i=0; i < TEST_THREADS_STATEMENTS; i++) {
+    char value[40];
+
+    sprintf(value, "value %d", i);
+    statement=librdf_new_statement_from_nodes(world,
+      librdf_new_node_from_blank_identifier(world, (const unsigned char*)(value + 6)),
+      librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/property"),
+      librdf_new_node_from_literal(world, (const unsigned char*)value,
+                                   (i % 2) ? "en" : NULL, 0));
+    librdf_model_add_statement(model2, statement);
+    librdf_free_statement(statement);
+  }
+
+  stream=librdf_model_as_stream(model2);
+  string=librdf_serializer_serialize_stream_to_counted_string(serializer,
+                                                              NULL, stream,
+                                                              &string_length);
+  librdf_free_stream(stream);
+
+  {
+    librdf_uri* feature;
+    librdf_node* value;
+    char threads_string[10];
+
+    sprintf(threads_string, "%d", TEST_THREADS);
+    feature=librdf_new_uri(world, (const unsigned char*)LIBRDF_SERIALIZER_FEATURE_THREADS);
+    value=librdf_new_node_from_literal(world,
+                                       (const unsigned char*)threads_string,
+                                       NULL, 0);
+    librdf_serializer_set_feature(serializer, feature, value);
+    librdf_free_node(value);
+    librdf_free_uri(feature);
+  }
+
+#define THREADS_FILENAME "test.nt"
+  stream=librdf_model_as_stream(model2);
+  if(!string ||
+     librdf_serializer_serialize_stream_to_file(serializer, THREADS_FILENAME,
+                                                NULL, stream)) {
+    fprintf(stderr, "%s: Failed to write N-Triples on %d threads\n", program,
+            TEST_THREADS);
+    return 1;
+  }
+  librdf_free_stream(stream);
+
+  string2=NULL;
+  stat(THREADS_FILENAME, &st_buf);
+  string2_length=(size_t)st_buf.st_size;
+  fh=fopen(THREADS_FILENAME, "rb");
+  if(fh) {
+    string2=(unsigned char*)malloc(string2_length + 1);
+    if(string2 && fread(string2, 1, string2_length, fh) != string2_length) {
+      free(string2);
+      string2=NULL;
+    }
+    fclose(fh);
+  }
+  unlink(THREADS_FILENAME);
+
+  if(!string2 || string_length != string2_length ||
+     memcmp(string, string2, string_length)) {
+    fprintf(stderr, "%s: Writing N-Triples on %d threads returned %d bytes, expected the %d bytes written serially\n",
+            program, TEST_THREADS, (int)string2_length, (int)string_length);
+    return 1;
+  }
+  librdf_free_memory(string);
+  free(string2);
+
+  librdf_free_model(model2);
+  librdf_free_storage(storage2);
+
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+  for(i=0; (type=test_compressed_filenames[i]); i++) {
+    librdf_uri* file_uri;
+
+    fprintf(stderr, "%s: Round-tripping the model through %s\n", program,
+            type);
+
+    if(librdf_serializer_serialize_model_to_file(serializer, type, NULL,
+                                                 model)) {
+      fprintf(stderr, "%s: Failed to serialize model to %s\n", program, type);
+      return 1;
+    }
+
+    storage2=librdf_new_storage(world, NULL, NULL, NULL);
+    model2=librdf_new_model(world, storage2, NULL);
+    parser=librdf_new_parser(world, "ntriples", NULL, NULL);
+    file_uri=librdf_new_uri_from_filename(world, type);
+    if(!parser || !file_uri ||
+       librdf_parser_parse_into_model(parser, file_uri, NULL, model2) ||
+       librdf_model_size(model2) != librdf_model_size(model)) {
+      fprintf(stderr, "%s: Parsing %s returned %d statements, expected %d\n",
+              program, type, librdf_model_size(model2),
+              librdf_model_size(model));
+      return 1;
+    }
+
+    stream=librdf_model_as_stream(model);
+    while(!librdf_stream_end(stream)) {
+      if(!librdf_model_contains_statement(model2,
+                                          librdf_stream_get_object(stream))) {
+        fprintf(stderr, "%s: Parsing %s lost a statement\n", program, type);
+        return 1;
+      }
+      librdf_stream_next(stream);
+    }
+    librdf_free_stream(stream);
+
+    unlink(type);
+    librdf_free_uri(file_uri);
+    librdf_free_parser(parser);
+    librdf_free_model(model2);
+    librdf_free_storage(storage2);
+  }
+#endif
+
 
   librdf_free_serializer(serializer); serializer=NULL;
   librdf_free_model(model); model=NULL;
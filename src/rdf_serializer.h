@@ -88,6 +88,17 @@ void librdf_serializer_set_error(librdf_serializer* serializer, void *user_data,
 REDLAND_API
 void librdf_serializer_set_warning(librdf_serializer* serializer, void *user_data, void (*warning_fn)(void *user_data, const char *msg, ...));
 
+/**
+ * LIBRDF_SERIALIZER_FEATURE_THREADS:
+ *
+ * Serializer feature URI string for the number of threads used to
+ * serialize N-Triples and N-Quads to a file handle or iostream.  The
+ * default of 1 serializes on the calling thread.  Raptor options set
+ * on the serializer apply to every thread.  Only used when built with
+ * thread support.
+ */
+#define LIBRDF_SERIALIZER_FEATURE_THREADS "http://feature.librdf.org/serializer-threads"
+
 REDLAND_API
 librdf_node* librdf_serializer_get_feature(librdf_serializer* serializer, librdf_uri *feature);
 REDLAND_API
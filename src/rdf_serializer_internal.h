@@ -103,6 +103,7 @@ void librdf_init_serializer(librdf_world *world);
 void librdf_finish_serializer(librdf_world *world);
                     
 void librdf_serializer_raptor_constructor(librdf_world* world);
+void librdf_serializer_binary_constructor(librdf_world* world);
 void librdf_serializer_rdfxml_constructor(librdf_world* world);
 
 
@@ -33,10 +33,26 @@
 
 #include <stdio.h>
 #include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
 
 #include <redland.h>
 
 
+#ifdef WITH_THREADS
+/* Number of statements in each chunk handed to the threads of a
+ * parallel serialization */
+#define LIBRDF_SERIALIZER_RAPTOR_CHUNK_STATEMENTS 8192
+
+/* Most threads a parallel serialization can use */
+#define LIBRDF_SERIALIZER_RAPTOR_MAX_THREADS 64
+#endif
+
+
 typedef struct {
   librdf_serializer *serializer;        /* librdf serializer object */
   raptor_serializer *rdf_serializer;    /* raptor serializer object */
@@ -44,6 +60,13 @@ typedef struct {
 
   int errors;
   int warnings;
+
+  /* threads used to serialize line-based syntaxes */
+  int threads;
+
+  /* raptor option values set with librdf_serializer_set_feature() or
+   * NULL, for setting on the serializers of threads */
+  char* options[RAPTOR_OPTION_LAST + 1];
 } librdf_serializer_raptor_context;
 
 
@@ -83,9 +106,15 @@ static void
 librdf_serializer_raptor_terminate(void *context) 
 {
   librdf_serializer_raptor_context* scontext=(librdf_serializer_raptor_context*)context;
+  int i;
   
   if(scontext->rdf_serializer)
     raptor_free_serializer(scontext->rdf_serializer);
+
+  for(i = 0; i <= RAPTOR_OPTION_LAST; i++) {
+    if(scontext->options[i])
+      LIBRDF_FREE(char*, scontext->options[i]);
+  }
 }
 
 
@@ -112,6 +141,12 @@ librdf_serializer_raptor_get_feature(void *context, librdf_uri* feature) {
   if(!uri_string)
     return NULL;
   
+  if(!strcmp((const char*)uri_string, LIBRDF_SERIALIZER_FEATURE_THREADS)) {
+    sprintf((char*)intbuffer, "%d", scontext->threads ? scontext->threads : 1);
+    return librdf_new_node_from_typed_literal(scontext->serializer->world,
+                                              intbuffer, NULL, NULL);
+  }
+
   feature_i = raptor_world_get_option_from_uri(scontext->serializer->world->raptor_world_ptr, (raptor_uri*)feature);
 
   if((int)feature_i >= 0) {
@@ -139,6 +174,25 @@ librdf_serializer_raptor_set_feature(void *context,
   if(!feature)
     return 1;
 
+  if(!strcmp((const char*)librdf_uri_as_string(feature),
+             LIBRDF_SERIALIZER_FEATURE_THREADS)) {
+    long threads;
+
+    if(!librdf_node_is_literal(value))
+      return 1;
+
+    threads = strtol((const char*)librdf_node_get_literal_value(value),
+                     NULL, 10);
+    if(threads < 1)
+      return 1;
+#ifdef WITH_THREADS
+    if(threads > LIBRDF_SERIALIZER_RAPTOR_MAX_THREADS)
+      threads = LIBRDF_SERIALIZER_RAPTOR_MAX_THREADS;
+#endif
+    scontext->threads = (int)threads;
+    return 0;
+  }
+
   /* try a raptor feature */
   feature_i = raptor_world_get_option_from_uri(scontext->serializer->world->raptor_world_ptr, (raptor_uri*)feature);
 
@@ -150,8 +204,19 @@ librdf_serializer_raptor_set_feature(void *context,
   
   value_s=(const unsigned char*)librdf_node_get_literal_value(value);
 
-  return raptor_serializer_set_option(scontext->rdf_serializer, feature_i,
-                                      (const char *)value_s, 0);
+  if(raptor_serializer_set_option(scontext->rdf_serializer, feature_i,
+                                  (const char *)value_s, 0))
+    return 1;
+
+  /* remembered for the serializers of threads */
+  if(scontext->options[feature_i])
+    LIBRDF_FREE(char*, scontext->options[feature_i]);
+  scontext->options[feature_i] = LIBRDF_MALLOC(char*, strlen((const char*)value_s) + 1);
+  if(!scontext->options[feature_i])
+    return 1;
+  strcpy(scontext->options[feature_i], (const char*)value_s);
+
+  return 0;
 }
 
 
@@ -175,6 +240,518 @@ librdf_serializer_raptor_serialize_statement(raptor_serializer *rserializer,
 }
 
 
+/*
+ * librdf_serializer_raptor_is_line_based:
+ * @scontext: serializer context
+ *
+ * INTERNAL - Check if the serializer writes N-Triples or N-Quads lines
+ *
+ * Return value: non 0 for N-Triples or N-Quads
+ */
+static int
+librdf_serializer_raptor_is_line_based(librdf_serializer_raptor_context* scontext)
+{
+  return !strcmp(scontext->serializer_name, "ntriples") ||
+         !strcmp(scontext->serializer_name, "nquads");
+}
+
+
+/*
+ * librdf_serializer_raptor_serialize_model_direct:
+ * @scontext: serializer context
+ * @model: model
+ * @iostr: iostream to write to
+ *
+ * INTERNAL - Write a model as N-Triples or N-Quads straight from its storage
+ *
+ * Storages that support librdf_storage_write_ntriples() skip making
+ * a statement object for each line.  This is not used when raptor
+ * options or more than one thread are set on the serializer, since the
+ * storage writes the lines itself.
+ *
+ * Return value: non 0 on failure, < 0 if the model must be serialized
+ * from a stream instead
+ */
+static int
+librdf_serializer_raptor_serialize_model_direct(librdf_serializer_raptor_context* scontext,
+                                                librdf_model* model,
+                                                raptor_iostream* iostr)
+{
+  librdf_storage* storage;
+  int i;
+
+  if(!librdf_serializer_raptor_is_line_based(scontext) ||
+     scontext->threads > 1)
+    return -1;
+
+  for(i = 0; i <= RAPTOR_OPTION_LAST; i++) {
+    if(scontext->options[i])
+      return -1;
+  }
+
+  storage = librdf_model_get_storage(model);
+  if(!storage)
+    return -1;
+
+  return librdf_storage_write_ntriples(storage, iostr,
+                                       !strcmp(scontext->serializer_name,
+                                               "nquads"));
+}
+
+
+#ifdef WITH_THREADS
+
+typedef enum {
+  LIBRDF_SERIALIZER_RAPTOR_CHUNK_FREE,
+  LIBRDF_SERIALIZER_RAPTOR_CHUNK_READY,
+  LIBRDF_SERIALIZER_RAPTOR_CHUNK_SERIALIZING,
+  LIBRDF_SERIALIZER_RAPTOR_CHUNK_DONE
+} librdf_serializer_raptor_chunk_state;
+
+/* Statements encoded as four terms each by librdf_raptor_buffer_write_term()
+ * and the syntax they are serialized to.
+ */
+typedef struct {
+  librdf_serializer_raptor_chunk_state state;
+
+  librdf_raptor_buffer input;
+  librdf_raptor_buffer output;
+
+  int errors;
+} librdf_serializer_raptor_chunk;
+
+typedef struct {
+  const char *serializer_name;
+  /* raptor option values of the serializer, set on those of the threads */
+  char** options;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  librdf_serializer_raptor_chunk *chunks;
+  int chunks_count;
+  /* number of the next chunk a thread will serialize */
+  int next_serialize;
+  int shutdown;
+} librdf_serializer_raptor_parallel;
+
+
+static int
+librdf_serializer_raptor_parallel_write_bytes(void *context, const void *ptr,
+                                              size_t size, size_t nmemb)
+{
+  librdf_serializer_raptor_chunk* chunk = *(librdf_serializer_raptor_chunk**)context;
+
+  if(librdf_raptor_buffer_write(&chunk->output, ptr, size * nmemb))
+    return 0;
+
+  return (int)nmemb;
+}
+
+
+static int
+librdf_serializer_raptor_parallel_write_byte(void *context, const int byte)
+{
+  unsigned char c = (unsigned char)byte;
+
+  return librdf_serializer_raptor_parallel_write_bytes(context, &c, 1, 1) == 1 ? 0 : 1;
+}
+
+
+static const raptor_iostream_handler librdf_serializer_raptor_parallel_handler = {
+  /* .version     = */ 2,
+  /* .init        = */ NULL,
+  /* .finish      = */ NULL,
+  /* .write_byte  = */ librdf_serializer_raptor_parallel_write_byte,
+  /* .write_bytes = */ librdf_serializer_raptor_parallel_write_bytes,
+  /* .write_end   = */ NULL,
+  /* .read_bytes  = */ NULL,
+  /* .read_eof    = */ NULL
+};
+
+
+/*
+ * librdf_serializer_raptor_parallel_read_term:
+ * @rworld: raptor world of the thread
+ * @p: address of the encoded term, moved past it
+ * @term_p: address to store the new term or NULL for no term
+ *
+ * INTERNAL - Make a term from an encoded one in a thread's own world
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_serializer_raptor_parallel_read_term(raptor_world* rworld,
+                                            const unsigned char** p,
+                                            raptor_term** term_p)
+{
+  const unsigned char* string;
+  const unsigned char* language;
+  const unsigned char* datatype;
+  size_t length;
+  size_t language_length;
+  size_t datatype_length;
+  raptor_uri* datatype_uri = NULL;
+  char type = (char)**p;
+
+  (*p)++;
+  *term_p = NULL;
+
+  switch(type) {
+    case 'U':
+      string = librdf_raptor_buffer_read_string(p, &length);
+      *term_p = raptor_new_term_from_counted_uri_string(rworld, string, length);
+      break;
+
+    case 'B':
+      string = librdf_raptor_buffer_read_string(p, &length);
+      *term_p = raptor_new_term_from_counted_blank(rworld, string, length);
+      break;
+
+    case 'L':
+      string = librdf_raptor_buffer_read_string(p, &length);
+      language = librdf_raptor_buffer_read_string(p, &language_length);
+      datatype = librdf_raptor_buffer_read_string(p, &datatype_length);
+      if(datatype_length) {
+        datatype_uri = raptor_new_uri_from_counted_string(rworld, datatype,
+                                                          datatype_length);
+        if(!datatype_uri)
+          return 1;
+      }
+      *term_p = raptor_new_term_from_counted_literal(rworld, string, length,
+                                                     datatype_uri,
+                                                     language_length ? language : NULL,
+                                                     (unsigned char)language_length);
+      if(datatype_uri)
+        raptor_free_uri(datatype_uri);
+      break;
+
+    case '-':
+      return 0;
+
+    default:
+      return 1;
+  }
+
+  return *term_p ? 0 : 1;
+}
+
+
+/*
+ * librdf_serializer_raptor_parallel_serialize_chunk:
+ * @rworld: raptor world of the thread
+ * @rserializer: raptor serializer of the thread
+ * @iostr: iostream writing to the output of the chunk
+ * @chunk: chunk
+ *
+ * INTERNAL - Serialize the encoded statements of a chunk to its output
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_serializer_raptor_parallel_serialize_chunk(raptor_world* rworld,
+                                                  raptor_serializer* rserializer,
+                                                  raptor_iostream* iostr,
+                                                  librdf_serializer_raptor_chunk* chunk)
+{
+  const unsigned char* p = chunk->input.data;
+  const unsigned char* end = chunk->input.data + chunk->input.length;
+  raptor_statement statement;
+  int rc = 0;
+
+  if(raptor_serializer_start_to_iostream(rserializer, NULL, iostr))
+    return 1;
+
+  raptor_statement_init(&statement, rworld);
+  while(!rc && p < end) {
+    if(librdf_serializer_raptor_parallel_read_term(rworld, &p, &statement.subject) ||
+       librdf_serializer_raptor_parallel_read_term(rworld, &p, &statement.predicate) ||
+       librdf_serializer_raptor_parallel_read_term(rworld, &p, &statement.object) ||
+       librdf_serializer_raptor_parallel_read_term(rworld, &p, &statement.graph))
+      rc = 1;
+    else
+      rc = raptor_serializer_serialize_statement(rserializer, &statement);
+
+    raptor_statement_clear(&statement);
+  }
+
+  if(raptor_serializer_serialize_end(rserializer))
+    rc = 1;
+
+  return rc;
+}
+
+
+/*
+ * librdf_serializer_raptor_parallel_thread:
+ * @arg: parallel serialization
+ *
+ * INTERNAL - Serialize ready chunks in order until shut down
+ *
+ * Each thread has its own raptor world and serializer, given the raptor
+ * options of the librdf serializer, so that no raptor or librdf objects
+ * are shared with other threads.
+ *
+ * Return value: NULL
+ */
+static void*
+librdf_serializer_raptor_parallel_thread(void* arg)
+{
+  librdf_serializer_raptor_parallel* parallel = (librdf_serializer_raptor_parallel*)arg;
+  librdf_serializer_raptor_chunk* chunk = NULL;
+  raptor_world* rworld;
+  raptor_serializer* rserializer = NULL;
+  raptor_iostream* iostr = NULL;
+  int i;
+
+  rworld = raptor_new_world();
+  if(rworld && !raptor_world_open(rworld)) {
+    rserializer = raptor_new_serializer(rworld, parallel->serializer_name);
+    if(rserializer) {
+      for(i = 0; i <= RAPTOR_OPTION_LAST; i++) {
+        if(parallel->options[i])
+          raptor_serializer_set_option(rserializer, (raptor_option)i,
+                                       parallel->options[i], 0);
+      }
+    }
+    iostr = raptor_new_iostream_from_handler(rworld, &chunk,
+                                             &librdf_serializer_raptor_parallel_handler);
+  }
+
+  pthread_mutex_lock(&parallel->mutex);
+  while(1) {
+    librdf_serializer_raptor_chunk* next;
+
+    next = &parallel->chunks[parallel->next_serialize % parallel->chunks_count];
+    if(parallel->shutdown)
+      break;
+    if(next->state != LIBRDF_SERIALIZER_RAPTOR_CHUNK_READY) {
+      pthread_cond_wait(&parallel->cond, &parallel->mutex);
+      continue;
+    }
+
+    next->state = LIBRDF_SERIALIZER_RAPTOR_CHUNK_SERIALIZING;
+    parallel->next_serialize++;
+    pthread_mutex_unlock(&parallel->mutex);
+
+    chunk = next;
+    chunk->output.length = 0;
+    if(!rserializer || !iostr ||
+       librdf_serializer_raptor_parallel_serialize_chunk(rworld, rserializer,
+                                                         iostr, chunk))
+      chunk->errors++;
+    chunk = NULL;
+
+    pthread_mutex_lock(&parallel->mutex);
+    next->state = LIBRDF_SERIALIZER_RAPTOR_CHUNK_DONE;
+    pthread_cond_broadcast(&parallel->cond);
+  }
+  pthread_mutex_unlock(&parallel->mutex);
+
+  if(iostr)
+    raptor_free_iostream(iostr);
+  if(rserializer)
+    raptor_free_serializer(rserializer);
+  if(rworld)
+    raptor_free_world(rworld);
+
+  return NULL;
+}
+
+
+/*
+ * librdf_serializer_raptor_parallel_read:
+ * @scontext: serializer context
+ * @stream: statements to serialize
+ * @chunk: chunk to fill
+ *
+ * INTERNAL - Encode the next statements of a stream into a chunk
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_serializer_raptor_parallel_read(librdf_serializer_raptor_context* scontext,
+                                       librdf_stream* stream,
+                                       librdf_serializer_raptor_chunk* chunk)
+{
+  /* N-Triples has no graph so do not copy it */
+  int with_graph = !strcmp(scontext->serializer_name, "nquads");
+  int count;
+
+  chunk->input.length = 0;
+
+  for(count = 0;
+      count < LIBRDF_SERIALIZER_RAPTOR_CHUNK_STATEMENTS && !librdf_stream_end(stream);
+      count++) {
+    librdf_statement *statement = librdf_stream_get_object(stream);
+    librdf_node *graph = with_graph ? librdf_stream_get_context2(stream) : NULL;
+
+    if(librdf_raptor_buffer_write_term(&chunk->input, statement->subject) ||
+       librdf_raptor_buffer_write_term(&chunk->input, statement->predicate) ||
+       librdf_raptor_buffer_write_term(&chunk->input, statement->object) ||
+       librdf_raptor_buffer_write_term(&chunk->input, graph))
+      return 1;
+
+    librdf_stream_next(stream);
+  }
+
+  return 0;
+}
+
+
+/*
+ * librdf_serializer_raptor_can_serialize_parallel:
+ * @scontext: serializer context
+ *
+ * INTERNAL - Check if the serializer writes a line per statement on several threads
+ *
+ * Return value: non 0 if a parallel serialization can be used
+ */
+static int
+librdf_serializer_raptor_can_serialize_parallel(librdf_serializer_raptor_context* scontext)
+{
+  return scontext->threads > 1 &&
+         librdf_serializer_raptor_is_line_based(scontext);
+}
+
+
+/*
+ * librdf_serializer_raptor_serialize_parallel:
+ * @scontext: serializer context
+ * @stream: statements to serialize
+ * @iostr: iostream to write to
+ *
+ * INTERNAL - Serialize a line-based syntax on several threads
+ *
+ * The calling thread reads the stream, since models and storage are
+ * not thread-safe, and encodes chunks of statements that a pool of
+ * threads format.  Each formatted chunk is written to @iostr in
+ * stream order with one write.  At most two chunks per thread are
+ * held in memory.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_serializer_raptor_serialize_parallel(librdf_serializer_raptor_context* scontext,
+                                            librdf_stream* stream,
+                                            raptor_iostream* iostr)
+{
+  librdf_world* world = scontext->serializer->world;
+  librdf_serializer_raptor_parallel parallel;
+  pthread_t threads[LIBRDF_SERIALIZER_RAPTOR_MAX_THREADS];
+  int threads_count = 0;
+  int read_count = 0;
+  int written_count = 0;
+  int eof = 0;
+  int status = 0;
+  int i;
+
+  memset(&parallel, 0, sizeof(parallel));
+  parallel.serializer_name = scontext->serializer_name;
+  parallel.options = scontext->options;
+
+  parallel.chunks_count = scontext->threads * 2;
+  parallel.chunks = LIBRDF_CALLOC(librdf_serializer_raptor_chunk*,
+                                  LIBRDF_GOOD_CAST(size_t, parallel.chunks_count),
+                                  sizeof(librdf_serializer_raptor_chunk));
+  if(!parallel.chunks)
+    return 1;
+
+  pthread_mutex_init(&parallel.mutex, NULL);
+  pthread_cond_init(&parallel.cond, NULL);
+
+  for(i = 0; i < scontext->threads; i++) {
+    if(pthread_create(&threads[threads_count], NULL,
+                      librdf_serializer_raptor_parallel_thread, &parallel))
+      break;
+    threads_count++;
+  }
+
+  if(!threads_count) {
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_SERIALIZER, NULL,
+               "Cannot start serializer threads");
+    status = 1;
+    eof = 1;
+  }
+
+  while(1) {
+    librdf_serializer_raptor_chunk* chunk;
+
+    /* keep every chunk filled with statements */
+    while(!eof && read_count - written_count < parallel.chunks_count) {
+      chunk = &parallel.chunks[read_count % parallel.chunks_count];
+      if(librdf_serializer_raptor_parallel_read(scontext, stream, chunk)) {
+        status = 1;
+        eof = 1;
+        break;
+      }
+      if(!chunk->input.length) {
+        eof = 1;
+        break;
+      }
+
+      pthread_mutex_lock(&parallel.mutex);
+      chunk->state = LIBRDF_SERIALIZER_RAPTOR_CHUNK_READY;
+      pthread_cond_broadcast(&parallel.cond);
+      pthread_mutex_unlock(&parallel.mutex);
+      read_count++;
+    }
+
+    if(written_count == read_count)
+      break;
+
+    chunk = &parallel.chunks[written_count % parallel.chunks_count];
+    pthread_mutex_lock(&parallel.mutex);
+    while(chunk->state != LIBRDF_SERIALIZER_RAPTOR_CHUNK_DONE)
+      pthread_cond_wait(&parallel.cond, &parallel.mutex);
+    pthread_mutex_unlock(&parallel.mutex);
+
+    /* like a serial serialization, nothing is written after an error */
+    if(!status) {
+      if(chunk->errors ||
+         (chunk->output.length &&
+          raptor_iostream_write_bytes(chunk->output.data, 1,
+                                      chunk->output.length, iostr) !=
+          (int)chunk->output.length))
+        status = 1;
+      if(status)
+        eof = 1;
+    }
+
+    chunk->errors = 0;
+    pthread_mutex_lock(&parallel.mutex);
+    chunk->state = LIBRDF_SERIALIZER_RAPTOR_CHUNK_FREE;
+    pthread_mutex_unlock(&parallel.mutex);
+    written_count++;
+  }
+
+  pthread_mutex_lock(&parallel.mutex);
+  parallel.shutdown = 1;
+  pthread_cond_broadcast(&parallel.cond);
+  pthread_mutex_unlock(&parallel.mutex);
+
+  for(i = 0; i < threads_count; i++)
+    pthread_join(threads[i], NULL);
+
+  pthread_cond_destroy(&parallel.cond);
+  pthread_mutex_destroy(&parallel.mutex);
+
+  for(i = 0; i < parallel.chunks_count; i++) {
+    librdf_raptor_buffer_clear(&parallel.chunks[i].input);
+    librdf_raptor_buffer_clear(&parallel.chunks[i].output);
+  }
+  LIBRDF_FREE(librdf_serializer_raptor_chunk*, parallel.chunks);
+
+  if(status)
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_SERIALIZER, NULL,
+               "Cannot serialize statements");
+
+  return status;
+}
+
+#endif
+
+
 static int
 librdf_serializer_raptor_serialize_stream_to_file_handle(void *context,
                                                          FILE *handle, 
@@ -187,6 +764,20 @@ librdf_serializer_raptor_serialize_stream_to_file_handle(void *context,
   if(!stream)
     return 1;
 
+#ifdef WITH_THREADS
+  if(librdf_serializer_raptor_can_serialize_parallel(scontext)) {
+    raptor_iostream *iostr;
+
+    iostr = raptor_new_iostream_to_file_handle(scontext->serializer->world->raptor_world_ptr,
+                                               handle);
+    if(!iostr)
+      return 1;
+    rc = librdf_serializer_raptor_serialize_parallel(scontext, stream, iostr);
+    raptor_free_iostream(iostr);
+    return rc;
+  }
+#endif
+
   /* start the serialize */
   rc = raptor_serializer_start_to_file_handle(scontext->rdf_serializer,
                                               (raptor_uri*)base_uri, handle);
@@ -225,9 +816,23 @@ librdf_serializer_raptor_serialize_model_to_file_handle(void *context,
                                                         librdf_uri* base_uri,
                                                         librdf_model *model) 
 {
+  librdf_serializer_raptor_context* scontext=(librdf_serializer_raptor_context*)context;
   int rc;
   librdf_stream *stream;
 
+  if(librdf_serializer_raptor_is_line_based(scontext)) {
+    raptor_iostream *iostr;
+
+    iostr = raptor_new_iostream_to_file_handle(scontext->serializer->world->raptor_world_ptr,
+                                               handle);
+    if(!iostr)
+      return 1;
+    rc = librdf_serializer_raptor_serialize_model_direct(scontext, model, iostr);
+    raptor_free_iostream(iostr);
+    if(rc >= 0)
+      return rc;
+  }
+
   stream=librdf_model_as_stream(model);
   if(!stream)
     return 1;
@@ -313,9 +918,34 @@ librdf_serializer_raptor_serialize_model_to_counted_string(void *context,
                                                            librdf_model *model,
                                                            size_t* length_p)
 {
+  librdf_serializer_raptor_context* scontext=(librdf_serializer_raptor_context*)context;
   unsigned char *string=NULL;
   librdf_stream *stream;
 
+  if(librdf_serializer_raptor_is_line_based(scontext)) {
+    raptor_iostream *iostr;
+    void *direct_string=NULL;
+    size_t direct_string_length=0;
+    int rc;
+
+    iostr = raptor_new_iostream_to_string(raptor_serializer_get_world(scontext->rdf_serializer),
+                                          &direct_string,
+                                          &direct_string_length, malloc);
+    if(!iostr)
+      return NULL;
+    rc = librdf_serializer_raptor_serialize_model_direct(scontext, model, iostr);
+    /* the string is only complete once the iostream is freed */
+    raptor_free_iostream(iostr);
+    if(!rc) {
+      if(length_p)
+        *length_p=direct_string_length;
+      return (unsigned char*)direct_string;
+    }
+    raptor_free_memory(direct_string);
+    if(rc > 0)
+      return NULL;
+  }
+
   stream=librdf_model_as_stream(model);
   if(!stream)
     return NULL;
@@ -345,6 +975,14 @@ librdf_serializer_raptor_serialize_stream_to_iostream(void *context,
   if(!stream)
     return 1;
 
+#ifdef WITH_THREADS
+  if(librdf_serializer_raptor_can_serialize_parallel(scontext)) {
+    rc = librdf_serializer_raptor_serialize_parallel(scontext, stream, iostr);
+    raptor_free_iostream(iostr);
+    return rc;
+  }
+#endif
+
   /* start the serialize */
   rc = raptor_serializer_start_to_iostream(scontext->rdf_serializer,
                                            (raptor_uri*)base_uri, iostr);
@@ -386,11 +1024,19 @@ librdf_serializer_raptor_serialize_model_to_iostream(void *context,
                                                      librdf_model *model,
                                                      raptor_iostream* iostr)
 {
+  librdf_serializer_raptor_context* scontext=(librdf_serializer_raptor_context*)context;
   int rc=0;
   librdf_stream *stream;
   
   if(!iostr)
     return 1;
+
+  /* nothing is written when the storage cannot do this */
+  rc=librdf_serializer_raptor_serialize_model_direct(scontext, model, iostr);
+  if(rc >= 0) {
+    raptor_free_iostream(iostr);
+    return rc;
+  }
   
   stream=librdf_model_as_stream(model);
   if(!stream)
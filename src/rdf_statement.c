@@ -891,6 +891,102 @@ librdf_statement_decode2(librdf_world* world,
   return total_length;
 }
 
+
+/*
+ * librdf_statement_encoded_write:
+ * @key: statement parts encoded by librdf_statement_encode_parts()
+ * @key_length: key size
+ * @value: remaining encoded statement parts or NULL
+ * @value_length: value size
+ * @write_context: non-0 to write the context node if present
+ * @iostr: iostream to write to
+ *
+ * INTERNAL - Write encoded statement parts as an N-Triples or N-Quads line
+ *
+ * The subject, predicate, object and context can be split between
+ * @key and @value in any order, as they are in storage index hashes.
+ * The nodes are written without being decoded and nothing is written
+ * if the encoding is bad or a part is missing.
+ *
+ * Return value: non-0 on failure
+ */
+int
+librdf_statement_encoded_write(const unsigned char *key, size_t key_length,
+                               const unsigned char *value, size_t value_length,
+                               int write_context, raptor_iostream *iostr)
+{
+  const unsigned char *buffers[2];
+  size_t lengths[2];
+  const unsigned char *parts[4] = { NULL, NULL, NULL, NULL };
+  size_t parts_lengths[4];
+  int i;
+
+  buffers[0] = key;
+  lengths[0] = key_length;
+  buffers[1] = value;
+  lengths[1] = value_length;
+
+  for(i = 0; i < 2; i++) {
+    const unsigned char *p = buffers[i];
+    size_t length = lengths[i];
+
+    if(!p)
+      continue;
+
+    if(length < 1 || *p++ != 'x')
+      return 1;
+    length--;
+
+    while(length > 0) {
+      size_t node_len;
+      int part;
+
+      switch(*p++) {
+        case 's': /* subject */
+          part = 0;
+          break;
+        case 'p': /* predicate */
+          part = 1;
+          break;
+        case 'o': /* object */
+          part = 2;
+          break;
+        case 'c': /* context */
+          part = 3;
+          break;
+        default:
+          return 1;
+      }
+      length--;
+
+      if(librdf_node_encoded_write(p, length, &node_len, NULL))
+        return 1;
+
+      parts[part] = p;
+      parts_lengths[part] = node_len;
+      p += node_len;
+      length -= node_len;
+    }
+  }
+
+  if(!parts[0] || !parts[1] || !parts[2])
+    return 1;
+
+  if(!write_context)
+    parts[3] = NULL;
+
+  for(i = 0; i < 4; i++) {
+    if(!parts[i])
+      continue;
+    if(i)
+      raptor_iostream_write_byte(' ', iostr);
+    librdf_node_encoded_write(parts[i], parts_lengths[i], NULL, iostr);
+  }
+  raptor_iostream_counted_string_write(" .\n", 3, iostr);
+
+  return 0;
+}
+
 #endif
 
 
@@ -36,6 +36,8 @@ extern "C" {
 void librdf_init_statement(librdf_world *world);
 void librdf_finish_statement(librdf_world *world);
 
+int librdf_statement_encoded_write(const unsigned char *key, size_t key_length, const unsigned char *value, size_t value_length, int write_context, raptor_iostream *iostr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -864,6 +864,72 @@ librdf_storage_size(librdf_storage* storage)
 }
 
 
+/**
+ * librdf_storage_estimate_statements:
+ * @storage: #librdf_storage object
+ * @statement: triple pattern with NULL parts matching anything, or NULL
+ * @context_node: context node or NULL for all contexts
+ *
+ * Estimate the number of statements matching a triple pattern.
+ *
+ * Intended for query planning: storages answer from index sizes or
+ * counters, may count matches up to a limit and may overestimate when
+ * no index applies.  Storages without an estimator only know the
+ * answer when nothing is bound.
+ * 
+ * Return value: estimated number of statements or < 0 if unknown
+ **/
+int
+librdf_storage_estimate_statements(librdf_storage* storage,
+                                   librdf_statement* statement,
+                                   librdf_node* context_node)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, -1);
+
+  if(storage->factory->estimate_statements)
+    return storage->factory->estimate_statements(storage, statement,
+                                                 context_node);
+
+  if(!context_node &&
+     (!statement || (!librdf_statement_get_subject(statement) &&
+                     !librdf_statement_get_predicate(statement) &&
+                     !librdf_statement_get_object(statement))))
+    return librdf_storage_size(storage);
+
+  return -1;
+}
+
+
+/**
+ * librdf_storage_write_ntriples:
+ * @storage: #librdf_storage object
+ * @iostr: iostream to write to
+ * @write_context: non-0 to write N-Quads with the context of each statement
+ *
+ * Write all statements in the storage as N-Triples or N-Quads.
+ *
+ * Storages that support this write straight from their own
+ * representation of statements, such as encoded index keys, without
+ * making statement or node objects.  If the storage does not
+ * support it nothing is written and the statements must be
+ * serialized from librdf_storage_serialise() instead.
+ * 
+ * Return value: non 0 on failure, < 0 if not supported by the storage
+ **/
+int
+librdf_storage_write_ntriples(librdf_storage* storage,
+                              raptor_iostream* iostr, int write_context)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(iostr, raptor_iostream, 1);
+
+  if(storage->factory->write_ntriples)
+    return storage->factory->write_ntriples(storage, iostr, write_context);
+
+  return -1;
+}
+
+
 /**
  * librdf_storage_add_statement:
  * @storage: #librdf_storage object
@@ -1869,6 +1935,11 @@ librdf_storage_set_feature(librdf_storage* storage, librdf_uri* feature,
  * If options is given then the match is made according to
  * the given options.  If options is NULL, this is equivalent
  * to librdf_storage_find_statements_in_context.
+ *
+ * The "limit" option gives the most statements the caller will read
+ * so a storage may stop early and the "workers" option the most
+ * threads a storage may use to scan for matches; storages are free
+ * to ignore them.
  * 
  * Return value:  #librdf_stream of matching statements (may be empty) or NULL on failure
  **/
@@ -1880,6 +1951,8 @@ librdf_storage_find_statements_with_options(librdf_storage* storage,
 {
   if(storage->factory->find_statements_with_options)
     return storage->factory->find_statements_with_options(storage, statement, context_node, options);
+  else if(!context_node)
+    return librdf_storage_find_statements(storage, statement);
   else
     return librdf_storage_find_statements_in_context(storage, statement, context_node);
 }
@@ -1989,6 +2062,120 @@ librdf_storage_transaction_get_handle(librdf_storage* storage)
 int main(int argc, char *argv[]);
 
 
+#define BULK_TEST_STATEMENTS 100
+
+/*
+ * Add the same statements twice to a storage with a bulk loader and
+ * check the second add finds them all already stored.  Returns 0 if
+ * the storage is not available.
+ */
+static int
+test_bulk_add_twice(librdf_world* world, const char* program,
+                    const char* type, const char* name, const char* options)
+{
+  librdf_storage* storage;
+  librdf_storage* source_storage;
+  librdf_model* model;
+  librdf_model* source;
+  librdf_stream* stream;
+  librdf_statement* statement;
+  int failures = 0;
+  int size;
+  int pass;
+  int i;
+
+  storage = librdf_new_storage(world, type, name, options);
+  if(!storage) {
+    fprintf(stderr, "%s: WARNING: Failed to create new bulk storage %s\n",
+            program, type);
+    return 0;
+  }
+  model = librdf_new_model(world, storage, NULL);
+  source_storage = librdf_new_storage(world, "hashes", "source",
+                                      "hash-type='memory'");
+  source = source_storage ? librdf_new_model(world, source_storage, NULL) : NULL;
+  if(!model || !source) {
+    fprintf(stderr, "%s: Failed to create models for bulk storage %s\n",
+            program, type);
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; i < BULK_TEST_STATEMENTS; i++) {
+    char subject[64];
+    char value[32];
+    char label[32];
+
+    sprintf(subject, "http://example.org/s%d", i);
+    sprintf(value, "value %d", i);
+    sprintf(label, "b%d", i);
+    statement = librdf_new_statement_from_nodes(world,
+      librdf_new_node_from_uri_string(world, (const unsigned char*)subject),
+      librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/p"),
+      (i % 2) ? librdf_new_node_from_literal(world, (const unsigned char*)value, NULL, 0) :
+                librdf_new_node_from_blank_identifier(world, (const unsigned char*)label));
+    librdf_model_add_statement(source, statement);
+    librdf_free_statement(statement);
+  }
+
+  fprintf(stdout, "%s: Bulk adding %d statements twice to storage %s\n",
+          program, BULK_TEST_STATEMENTS, type);
+  for(pass = 0; pass < 2; pass++) {
+    stream = librdf_model_as_stream(source);
+    if(!stream || librdf_model_add_statements(model, stream)) {
+      fprintf(stderr, "%s: Bulk add %d to storage %s failed\n",
+              program, pass + 1, type);
+      failures++;
+    }
+    if(stream)
+      librdf_free_stream(stream);
+
+    size = librdf_model_size(model);
+    if(size != BULK_TEST_STATEMENTS) {
+      fprintf(stderr, "%s: Storage %s has %d statements after bulk add %d, expected %d\n",
+              program, type, size, pass + 1, BULK_TEST_STATEMENTS);
+      failures++;
+    }
+  }
+
+  /* every statement is found once */
+  stream = librdf_model_as_stream(source);
+  while(stream && !librdf_stream_end(stream)) {
+    librdf_stream* found;
+    int count = 0;
+
+    statement = librdf_stream_get_object(stream);
+    found = librdf_model_find_statements(model, statement);
+    while(found && !librdf_stream_end(found)) {
+      count++;
+      librdf_stream_next(found);
+    }
+    if(found)
+      librdf_free_stream(found);
+    if(count != 1) {
+      fprintf(stderr, "%s: Storage %s found a bulk added statement %d times, expected once\n",
+              program, type, count);
+      failures++;
+      break;
+    }
+    librdf_stream_next(stream);
+  }
+  if(stream)
+    librdf_free_stream(stream);
+
+  tidy:
+  if(source)
+    librdf_free_model(source);
+  if(source_storage)
+    librdf_free_storage(source_storage);
+  if(model)
+    librdf_free_model(model);
+  librdf_free_storage(storage);
+
+  return failures;
+}
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -2026,6 +2213,18 @@ main(int argc, char *argv[])
 	NULL, NULL, NULL
   };
 
+  /* triples of arguments for storages with a bulk loader */
+  const char* const bulk_storages[] = {
+    #ifdef STORAGE_MYSQL
+      "mysql", "test", "host='localhost',database='test',new='yes',bulk='yes',load-data='yes'",
+      "mysql", "test", "host='localhost',database='test',new='yes',bulk='yes'",
+    #endif
+    #ifdef STORAGE_POSTGRESQL
+      "postgresql", "test", "host='localhost',database='test',new='yes',bulk='yes'",
+    #endif
+	NULL, NULL, NULL
+  };
+
   int test = 0;
   int ret  = 0;
   
@@ -2064,6 +2263,10 @@ main(int argc, char *argv[])
     librdf_free_storage(storage);
 
   }
+
+  for(test = 0; bulk_storages[test] != NULL; test += 3)
+    ret += test_bulk_add_twice(world, program, bulk_storages[test],
+                               bulk_storages[test+1], bulk_storages[test+2]);
   
 
   librdf_free_world(world);
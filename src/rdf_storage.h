@@ -80,6 +80,10 @@ int librdf_storage_close(librdf_storage* storage);
 
 REDLAND_API
 int librdf_storage_size(librdf_storage* storage);
+REDLAND_API
+int librdf_storage_estimate_statements(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node);
+REDLAND_API
+int librdf_storage_write_ntriples(librdf_storage* storage, raptor_iostream* iostr, int write_context);
 
 REDLAND_API
 int librdf_storage_add_statement(librdf_storage* storage, librdf_statement* statement);
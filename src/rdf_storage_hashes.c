@@ -44,6 +44,9 @@
 #include <rdf_storage.h>
 
 
+/* Encoded statement parts up to this size are probed from the stack */
+#define LIBRDF_STORAGE_HASHES_STACK_BUFFER_SIZE 512
+
 typedef struct 
 {
   const char *name;
@@ -146,6 +149,8 @@ static int librdf_storage_hashes_add_statement(librdf_storage* storage, librdf_s
 static int librdf_storage_hashes_add_statements(librdf_storage* storage, librdf_stream* statement_stream);
 static int librdf_storage_hashes_remove_statement(librdf_storage* storage, librdf_statement* statement);
 static int librdf_storage_hashes_contains_statement(librdf_storage* storage, librdf_statement* statement);
+static int librdf_storage_hashes_estimate_statements(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node);
+static int librdf_storage_hashes_write_ntriples(librdf_storage* storage, raptor_iostream* iostr, int write_context);
 static librdf_stream* librdf_storage_hashes_serialise(librdf_storage* storage);
 static librdf_stream* librdf_storage_hashes_find_statements(librdf_storage* storage, librdf_statement* statement);
 static librdf_iterator* librdf_storage_hashes_find_sources(librdf_storage* storage, librdf_node* arc, librdf_node *target);
@@ -768,6 +773,9 @@ librdf_storage_hashes_contains_statement(librdf_storage* storage, librdf_stateme
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   librdf_hash_datum hd_key, hd_value; /* on stack */
   unsigned char *key_buffer, *value_buffer;
+  /* most statements encode small enough to probe without allocating */
+  unsigned char key_stack[LIBRDF_STORAGE_HASHES_STACK_BUFFER_SIZE];
+  unsigned char value_stack[LIBRDF_STORAGE_HASHES_STACK_BUFFER_SIZE];
   size_t key_len, value_len;
   int hash_index=context->all_statements_hash_index;
   librdf_statement_part fields;
@@ -796,13 +804,18 @@ librdf_storage_hashes_contains_statement(librdf_storage* storage, librdf_stateme
                                            NULL, 0, fields);
   if(!key_len)
     return 1;
-  key_buffer = LIBRDF_MALLOC(unsigned char*, key_len);
-  if(!key_buffer)
-    return 1;
+  if(key_len <= sizeof(key_stack))
+    key_buffer = key_stack;
+  else {
+    key_buffer = LIBRDF_MALLOC(unsigned char*, key_len);
+    if(!key_buffer)
+      return 1;
+  }
        
   if(!librdf_statement_encode_parts2(world, statement, NULL,
                                      key_buffer, key_len, fields)) {
-    LIBRDF_FREE(data, key_buffer);
+    if(key_buffer != key_stack)
+      LIBRDF_FREE(data, key_buffer);
     return 1;
   }
 
@@ -811,21 +824,29 @@ librdf_storage_hashes_contains_statement(librdf_storage* storage, librdf_stateme
   value_len = librdf_statement_encode_parts2(world, statement, NULL,
                                              NULL, 0, fields);
   if(!value_len) {
-    LIBRDF_FREE(data, key_buffer);
+    if(key_buffer != key_stack)
+      LIBRDF_FREE(data, key_buffer);
     return 1;
   }
     
-  value_buffer = LIBRDF_MALLOC(unsigned char*, value_len);
-  if(!value_buffer) {
-    LIBRDF_FREE(data, key_buffer);
-    return 1;
+  if(value_len <= sizeof(value_stack))
+    value_buffer = value_stack;
+  else {
+    value_buffer = LIBRDF_MALLOC(unsigned char*, value_len);
+    if(!value_buffer) {
+      if(key_buffer != key_stack)
+        LIBRDF_FREE(data, key_buffer);
+      return 1;
+    }
   }
 
        
   if(!librdf_statement_encode_parts2(world, statement, NULL,
                                      value_buffer, value_len, fields)) {
-    LIBRDF_FREE(data, key_buffer);
-    LIBRDF_FREE(data, value_buffer);
+    if(key_buffer != key_stack)
+      LIBRDF_FREE(data, key_buffer);
+    if(value_buffer != value_stack)
+      LIBRDF_FREE(data, value_buffer);
     return 1;
   }
 
@@ -838,8 +859,10 @@ librdf_storage_hashes_contains_statement(librdf_storage* storage, librdf_stateme
   hd_value.data=value_buffer; hd_value.size=value_len;
   status=librdf_hash_exists(context->hashes[hash_index], &hd_key, &hd_value);
   
-  LIBRDF_FREE(data, key_buffer);
-  LIBRDF_FREE(data, value_buffer);
+  if(key_buffer != key_stack)
+    LIBRDF_FREE(data, key_buffer);
+  if(value_buffer != value_stack)
+    LIBRDF_FREE(data, value_buffer);
 
   /* DO NOT free statement, ownership was not passed in */
   return status;
@@ -1458,6 +1481,150 @@ librdf_storage_hashes_find_targets(librdf_storage* storage,
                                                     LIBRDF_STATEMENT_OBJECT);
 }
 
+/**
+ * librdf_storage_hashes_estimate_statements:
+ * @storage: #librdf_storage object
+ * @statement: triple pattern or NULL
+ * @context_node: context node or NULL
+ *
+ * Estimate the number of statements matching a pattern.
+ *
+ * Patterns with two parts bound are counted in the sources, arcs or
+ * targets hash and (? p ?) in the p2so hash, up to
+ * LIBRDF_STORAGE_ESTIMATE_LIMIT matches.  Anything else needs a full
+ * scan so the size of the store is returned as an upper bound.
+ *
+ * Return value: estimated number of statements or < 0 if unknown
+ **/
+static int
+librdf_storage_hashes_estimate_statements(librdf_storage* storage,
+                                          librdf_statement* statement,
+                                          librdf_node* context_node)
+{
+  librdf_storage_hashes_instance* scontext=(librdf_storage_hashes_instance*)storage->instance;
+  librdf_node *subject, *predicate, *object;
+  librdf_iterator* iterator=NULL;
+  librdf_stream* stream=NULL;
+  int count;
+
+  if(context_node)
+    return -1;
+
+  if(!statement)
+    return librdf_storage_hashes_size(storage);
+
+  subject=librdf_statement_get_subject(statement);
+  predicate=librdf_statement_get_predicate(statement);
+  object=librdf_statement_get_object(statement);
+
+  if(subject && predicate && object)
+    return librdf_storage_hashes_contains_statement(storage, statement);
+
+  if(subject && predicate && !object && scontext->targets_index >= 0)
+    iterator=librdf_storage_hashes_find_targets(storage, subject, predicate);
+  else if(!subject && predicate && object && scontext->sources_index >= 0)
+    iterator=librdf_storage_hashes_find_sources(storage, predicate, object);
+  else if(subject && !predicate && object && scontext->arcs_index >= 0)
+    iterator=librdf_storage_hashes_find_arcs(storage, subject, object);
+  else if(!subject && predicate && !object && scontext->p2so_index >= 0)
+    stream=librdf_storage_hashes_find_statements(storage, statement);
+  else
+    return librdf_storage_hashes_size(storage);
+
+  count=0;
+  if(iterator) {
+    while(count < LIBRDF_STORAGE_ESTIMATE_LIMIT &&
+          !librdf_iterator_end(iterator)) {
+      count++;
+      librdf_iterator_next(iterator);
+    }
+    librdf_free_iterator(iterator);
+  } else if(stream) {
+    while(count < LIBRDF_STORAGE_ESTIMATE_LIMIT &&
+          !librdf_stream_end(stream)) {
+      count++;
+      librdf_stream_next(stream);
+    }
+    librdf_free_stream(stream);
+  } else
+    return -1;
+
+  return count;
+}
+
+
+/**
+ * librdf_storage_hashes_write_ntriples:
+ * @storage: #librdf_storage object
+ * @iostr: iostream to write to
+ * @write_context: non-0 to write the context of each statement
+ *
+ * Write all statements as N-Triples or N-Quads.
+ *
+ * Each line is written straight from the encoded key and value of
+ * the hash holding all statements, so no nodes are decoded.
+ * 
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_storage_hashes_write_ntriples(librdf_storage* storage,
+                                     raptor_iostream* iostr,
+                                     int write_context)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  librdf_hash_datum *key, *value;
+  librdf_hash_datum *hd_key, *hd_value;
+  librdf_iterator* iterator;
+  int status=0;
+
+  if(context->all_statements_hash_index < 0)
+    return -1;
+
+  key=librdf_new_hash_datum(storage->world, NULL, 0);
+  value=librdf_new_hash_datum(storage->world, NULL, 0);
+  if(!key || !value) {
+    if(key)
+      librdf_free_hash_datum(key);
+    if(value)
+      librdf_free_hash_datum(value);
+    return 1;
+  }
+
+  iterator=librdf_hash_get_all(context->hashes[context->all_statements_hash_index],
+                               key, value);
+  if(!iterator)
+    status=1;
+
+  while(!status && !librdf_iterator_end(iterator)) {
+    hd_key=(librdf_hash_datum*)librdf_iterator_get_key(iterator);
+    hd_value=(librdf_hash_datum*)librdf_iterator_get_value(iterator);
+
+    if(librdf_statement_encoded_write((const unsigned char*)hd_key->data,
+                                      hd_key->size,
+                                      (const unsigned char*)hd_value->data,
+                                      hd_value->size,
+                                      write_context, iostr)) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE,
+                 NULL, "Bad statement encoding in hash %s",
+                 context->names[context->all_statements_hash_index]);
+      status=1;
+    }
+
+    librdf_iterator_next(iterator);
+  }
+
+  if(iterator)
+    librdf_free_iterator(iterator);
+
+  key->data=NULL;
+  librdf_free_hash_datum(key);
+  value->data=NULL;
+  librdf_free_hash_datum(value);
+
+  return status;
+}
+
+
 /**
  * librdf_storage_hashes_context_add_statement:
  * @storage: #librdf_storage object
@@ -1946,6 +2113,8 @@ librdf_storage_hashes_register_factory(librdf_storage_factory *factory)
   factory->add_statements     = librdf_storage_hashes_add_statements;
   factory->remove_statement   = librdf_storage_hashes_remove_statement;
   factory->contains_statement = librdf_storage_hashes_contains_statement;
+  factory->estimate_statements = librdf_storage_hashes_estimate_statements;
+  factory->write_ntriples     = librdf_storage_hashes_write_ntriples;
   factory->serialise          = librdf_storage_hashes_serialise;
 
   factory->find_statements    = librdf_storage_hashes_find_statements;
@@ -27,6 +27,7 @@
 #define LIBRDF_STORAGE_INTERNAL_H
 
 #include "rdf_storage_module.h"
+#include "rdf_types.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,6 +51,9 @@ struct librdf_storage_s
   struct librdf_storage_factory_s* factory;
 };
 
+/* Most matches an estimate_statements method counts before giving up */
+#define LIBRDF_STORAGE_ESTIMATE_LIMIT 1000
+
 void librdf_init_storage_list(librdf_world *world);
 
 void librdf_init_storage_hashes(librdf_world *world);
@@ -116,6 +120,22 @@ typedef enum {
 
 extern const char* librdf_storage_sql_dbconfig_predicates[DBCONFIG_CREATE_TABLE_LAST+2];
 
+/* Node ID functions for SQL storages */
+typedef enum {
+  /* first 8 bytes of MD5 - compatible with existing databases */
+  LIBRDF_SQL_NODE_ID_MD5,
+  /* 64-bit MurmurHash64A - non-cryptographic, much faster */
+  LIBRDF_SQL_NODE_ID_MURMUR64
+} librdf_sql_node_id_type;
+
+typedef struct librdf_sql_node_id_s librdf_sql_node_id;
+
+librdf_sql_node_id* librdf_new_sql_node_id(librdf_world* world, const char* name, int cache_size);
+librdf_sql_node_id* librdf_new_sql_node_id_for_storage(librdf_storage* storage, librdf_hash* options);
+void librdf_free_sql_node_id(librdf_sql_node_id* node_id);
+u64 librdf_sql_node_id_hash(librdf_sql_node_id* node_id, const char* type, const unsigned char* string, size_t length);
+u64 librdf_sql_node_id_for_node(librdf_sql_node_id* node_id, librdf_node* node);
+
 
 
 #ifdef __cplusplus
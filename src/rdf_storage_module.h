@@ -112,6 +112,10 @@ typedef void* librdf_storage_instance;
  * @transaction_commit: Commit a transaction. OPTIONAL
  * @transaction_rollback: Rollback a transaction. OPTIONAL
  * @transaction_get_handle: Get opaque data handle passed to transaction_start_with_handle. OPTIONAL
+ * @supports_query: Check if storage supports a query language. OPTIONAL
+ * @query_execute: Run a query against the storage. OPTIONAL
+ * @estimate_statements: Return an estimate of the number of statements matching a triple pattern, optionally in a context, or < 0 if unknown.  Must be much cheaper than counting a find_statements stream. OPTIONAL
+ * @write_ntriples: Write all statements as N-Triples, or N-Quads when writing contexts, to an iostream without making statement objects.  Return < 0 without writing anything if not possible. OPTIONAL
  * 
  * A Storage Factory
  */
@@ -240,6 +244,12 @@ struct librdf_storage_factory_s {
 
   /** Storage engine returns query results - OPTIONAL */
   librdf_query_results* (*query_execute)(librdf_storage* storage, librdf_query *query);
+
+  /** Estimate the number of statements matching a pattern - OPTIONAL */
+  int (*estimate_statements)(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node);
+
+  /** Write all statements as N-Triples or N-Quads - OPTIONAL */
+  int (*write_ntriples)(librdf_storage* storage, raptor_iostream* iostr, int write_context);
 };
 
 
@@ -122,6 +122,35 @@ static const table_info mysql_tables[TABLE_LAST+1]={
 };
 
 
+/* Default number of rows buffered per table by the bulk loader */
+#define LIBRDF_STORAGE_MYSQL_BULK_BATCH_SIZE 10000
+
+/* Flush a multi-row INSERT before it gets near max_allowed_packet */
+#define LIBRDF_STORAGE_MYSQL_BULK_MAX_QUERY_LENGTH (1 << 20)
+
+typedef struct {
+  /* connection used for the whole load */
+  MYSQL *handle;
+
+  /* if rows are buffered as TSV for LOAD DATA LOCAL INFILE rather
+   * than as multi-row INSERT value lists
+   */
+  int load_data;
+
+  /* buffered rows for Resources, Bnodes, Literals and Statements */
+  raptor_stringbuffer* buffers[TABLE_STATEMENTS+1];
+  int rows[TABLE_STATEMENTS+1];
+
+  /* node hashes already buffered in the current batch */
+  librdf_hash* seen_nodes;
+
+  /* buffer being read by the LOAD DATA LOCAL INFILE handler */
+  const unsigned char* infile_data;
+  size_t infile_length;
+  size_t infile_offset;
+} librdf_storage_mysql_bulk_loader;
+
+
 typedef enum {
   /* Status of individual MySQL connections */
   LIBRDF_STORAGE_MYSQL_CONNECTION_CLOSED = 0,
@@ -153,14 +182,20 @@ typedef struct {
   /* if inserts should be optimized by locking and index optimizations */
   int bulk;
 
+  /* rows buffered per table by the bulk loader before a flush */
+  int bulk_batch_size;
+
+  /* if the bulk loader should use LOAD DATA LOCAL INFILE */
+  int load_data;
+
   /* if a table with merged models should be maintained */
   int merge;
 
   /* if mysql MYSQL_OPT_RECONNECT should be set on new connections */
   int reconnect;
 
-  /* digest object for node hashes */
-  librdf_digest *digest;
+  /* node ID (hash) function and cache */
+  librdf_sql_node_id *node_id;
 
   MYSQL* transaction_handle;
   
@@ -297,7 +332,7 @@ void librdf_storage_module_register_factory(librdf_world *world);
  * @string: a string to get hash for
  * @length: length of string
  *
- * Find hash value of string.
+ * Find hash value of string with the node-id function.
  *
  * Return value: Non-zero on succes.
  **/
@@ -306,30 +341,9 @@ librdf_storage_mysql_hash(librdf_storage* storage, const char *type,
                           const char *string, size_t length)
 {
   librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
-  u64 hash;
-  byte* digest;
-  uint i;
 
-  /* (Re)initialize digest object */
-  librdf_digest_init(context->digest);
-  
-  /* Update digest with data */
-  if(type)
-    librdf_digest_update(context->digest, (unsigned char*)type, 1);
-  librdf_digest_update(context->digest, (unsigned char*)string, length);
-  librdf_digest_final(context->digest);
-  
-  /* Copy first 8 bytes of digest into unsigned 64bit hash
-   * using a method portable across big/little endianness
-   *
-   * Fixes Issue#0000023 - http://bugs.librdf.org/mantis/view.php?id=23
-   */
-  digest = (byte*) librdf_digest_get_digest(context->digest);
-  hash = 0;
-  for(i=0; i<8; i++)
-    hash += ((u64) digest[i]) << (i*8);
-  
-  return hash;
+  return librdf_sql_node_id_hash(context->node_id, type,
+                                 (const unsigned char*)string, length);
 }
 
 
@@ -452,6 +466,13 @@ librdf_storage_mysql_get_handle(librdf_storage* storage)
   }
 #endif
 
+#ifdef HAVE_MYSQL_SET_LOCAL_INFILE_HANDLER
+  if(context->load_data) {
+    unsigned int value=1;
+    mysql_options(connection->handle, MYSQL_OPT_LOCAL_INFILE, &value);
+  }
+#endif
+
   /* Create connection to database for handle */
   if(!mysql_real_connect(connection->handle,
                          context->host, context->user, context->password,
@@ -502,7 +523,8 @@ librdf_storage_mysql_release_handle(librdf_storage* storage, MYSQL *handle)
  * librdf_storage_mysql_init:
  * @storage: the storage
  * @name: model name
- * @options: host, port, database, user, password [, new] [, bulk] [, merge].
+ * @options: host, port, database, user, password [, new] [, bulk] [, merge]
+ *   [, bulk-batch-size] [, load-data].
  *
  * .
  *
@@ -515,6 +537,11 @@ librdf_storage_mysql_release_handle(librdf_storage* storage, MYSQL *handle)
  * The boolean merge option can be set to true if a merged "view" of all
  * models should be maintained. This "view" will be a table with TYPE=MERGE.
  *
+ * With bulk set, statements added from a stream are buffered and
+ * sent in batches of bulk-batch-size rows per table (default 10000)
+ * as multi-row INSERTs, or with LOAD DATA LOCAL INFILE when the
+ * boolean load-data option is set and the server allows it.
+ *
  * Return value: Non-zero on failure.
  **/
 static int
@@ -531,6 +558,7 @@ librdf_storage_mysql_init(librdf_storage* storage, const char *name,
   MYSQL *handle;
   const char* default_layout="v1";
   long lport;
+  long lbatch;
 
   /* Must have connection parameters passed as options */
   if(!options)
@@ -545,8 +573,9 @@ librdf_storage_mysql_init(librdf_storage* storage, const char *name,
   }
   librdf_storage_set_instance(storage, context);
 
-  /* Create digest */
-  if(!(context->digest = librdf_new_digest(storage->world,"MD5"))) {
+  /* Create node ID function */
+  context->node_id = librdf_new_sql_node_id_for_storage(storage, options);
+  if(!context->node_id) {
     librdf_free_hash(options);
     return 1;
   }
@@ -587,6 +616,17 @@ librdf_storage_mysql_init(librdf_storage* storage, const char *name,
   /* Reconnect? */
   context->reconnect = (librdf_hash_get_as_boolean(options, "reconnect")>0);
 
+  /* Bulk loader batch size and LOAD DATA LOCAL INFILE use */
+  lbatch = librdf_hash_get_as_long(options, "bulk-batch-size");
+  if(lbatch <= 0 || lbatch > INT_MAX)
+    context->bulk_batch_size = LIBRDF_STORAGE_MYSQL_BULK_BATCH_SIZE;
+  else
+    context->bulk_batch_size = LIBRDF_GOOD_CAST(int, lbatch);
+
+#ifdef HAVE_MYSQL_SET_LOCAL_INFILE_HANDLER
+  context->load_data = (librdf_hash_get_as_boolean(options, "load-data")>0);
+#endif
+
   context->layout = librdf_hash_get_del(options, "layout");
   if(!context->layout) {
     context->layout = LIBRDF_MALLOC(char*, strlen(default_layout) + 1);
@@ -853,8 +893,8 @@ librdf_storage_mysql_terminate(librdf_storage* storage)
   if(context->host)
     LIBRDF_FREE(char*, context->host);
 
-  if(context->digest)
-    librdf_free_digest(context->digest);
+  if(context->node_id)
+    librdf_free_sql_node_id(context->node_id);
 
   if(context->transaction_handle)
     librdf_storage_mysql_transaction_rollback(storage);
@@ -993,7 +1033,8 @@ librdf_storage_mysql_add_statement(librdf_storage* storage,
  *
  * .
  *
- * Add statements in stream to storage, without context.
+ * Add statements in stream to storage, without context.  Duplicate
+ * statements are skipped.
  *
  * Return value: Non-zero on failure.
  **/
@@ -1001,8 +1042,15 @@ static int
 librdf_storage_mysql_add_statements(librdf_storage* storage,
                                     librdf_stream* statement_stream)
 {
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
   int helper=0;
 
+  /* Bulk loads send statements in batches and skip duplicates as
+   * each batch is copied to the statements table */
+  if(context->bulk)
+    return librdf_storage_mysql_context_add_statements(storage, NULL,
+                                                       statement_stream);
+
   while(!helper && !librdf_stream_end(statement_stream)) {
     librdf_statement* statement=librdf_stream_get_object(statement_stream);
     /* Do not add duplicate statements */
@@ -1137,7 +1185,7 @@ librdf_storage_mysql_node_hash_common(librdf_storage* storage,
   MYSQL *handle;
   unsigned char *uri=NULL;
   unsigned char *value=NULL, *datatype=NULL;
-  char *lang=NULL, *nodestring;
+  char *lang=NULL;
   librdf_uri *dt;
   size_t valuelen, langlen=0, datatypelen=0;
   unsigned char *name=NULL;
@@ -1163,7 +1211,7 @@ librdf_storage_mysql_node_hash_common(librdf_storage* storage,
       node_type=TRIPLE_URI;
 
       uri=librdf_uri_as_counted_string(librdf_node_get_uri(node), &nodelen);
-      hash=librdf_storage_mysql_hash(storage, "R", (char*)uri, nodelen);
+      hash=librdf_sql_node_id_for_node(context->node_id, node);
       break;
       
     case LIBRDF_NODE_TYPE_LITERAL:
@@ -1177,22 +1225,7 @@ librdf_storage_mysql_node_hash_common(librdf_storage* storage,
       if(dt)
         datatype=librdf_uri_as_counted_string(dt, &datatypelen);
 
-      /* Create composite node string for hash generation */
-      nodestring = LIBRDF_MALLOC(char*, valuelen + langlen + datatypelen + 3);
-      if(!nodestring) {
-        librdf_storage_mysql_release_handle(storage, handle);
-        return 0;
-      }
-      strcpy(nodestring, (const char*)value);
-      strcat(nodestring, "<");
-      if(lang)
-        strcat(nodestring, lang);
-      strcat(nodestring, ">");
-      if(datatype)
-        strcat(nodestring, (const char*)datatype);
-      nodelen=valuelen+langlen+datatypelen+2;
-      hash=librdf_storage_mysql_hash(storage, "L", nodestring, nodelen);
-      LIBRDF_FREE(char*, nodestring);
+      hash=librdf_sql_node_id_for_node(context->node_id, node);
       break;
     
     case LIBRDF_NODE_TYPE_BLANK:
@@ -1200,7 +1233,7 @@ librdf_storage_mysql_node_hash_common(librdf_storage* storage,
       
       name=librdf_node_get_blank_identifier(node);
       nodelen=strlen((const char*)name);
-      hash=librdf_storage_mysql_hash(storage, "B", (char*)name, nodelen);
+      hash=librdf_sql_node_id_for_node(context->node_id, node);
       break;
       
     case LIBRDF_NODE_TYPE_UNKNOWN:
@@ -1212,7 +1245,7 @@ librdf_storage_mysql_node_hash_common(librdf_storage* storage,
       goto tidy;
   }
   
-  if(mode != NODE_HASH_MODE_STORE_NODE)
+  if(!hash || mode != NODE_HASH_MODE_STORE_NODE)
     goto tidy;
 
   
@@ -1400,9 +1433,9 @@ static int
 librdf_storage_mysql_start_bulk(librdf_storage* storage)
 {
   librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
-  char disable_statement_keys[]="ALTER TABLE Statements" UINT64_T_FMT " DISABLE KEYS";
   char disable_literal_keys[]="ALTER TABLE Literals DISABLE KEYS";
-  char lock_tables[]="LOCK TABLES Statements" UINT64_T_FMT " WRITE, Resources WRITE, Bnodes WRITE, Literals WRITE";
+  /* the bulk loader reads the statements table as Existing */
+  char lock_tables[]="LOCK TABLES Statements" UINT64_T_FMT " WRITE, Statements" UINT64_T_FMT " AS Existing READ, Resources WRITE, Bnodes WRITE, Literals WRITE";
   char lock_tables_extra[]=", Statements WRITE";
   char *query=NULL;
   MYSQL *handle;
@@ -1412,27 +1445,9 @@ librdf_storage_mysql_start_bulk(librdf_storage* storage)
   if(!handle)
     return 1;
 
-  query = LIBRDF_MALLOC(char*, strlen(disable_statement_keys) + 21);
-  if(!query) {
-    librdf_storage_mysql_release_handle(storage, handle);
-    return 1;
-  }
-  sprintf(query, disable_statement_keys, context->model);
-
+  /* Statement keys stay enabled as duplicates are looked up in them */
 #ifdef LIBRDF_DEBUG_SQL
-  LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
-#endif
-  if(mysql_real_query(handle, query, strlen(query))) {
-    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-               "MySQL statement key disabling failed: %s",
-               mysql_error(handle));
-    librdf_storage_mysql_release_handle(storage, handle);
-    return -1;
-  }
-  LIBRDF_FREE(char*, query);
-
-#ifdef LIBRDF_DEBUG_SQL
-  LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
+  LIBRDF_DEBUG2("SQL: >>%s<<\n", disable_literal_keys);
 #endif
   if(mysql_real_query(handle, disable_literal_keys,
                       strlen(disable_literal_keys))) {
@@ -1444,12 +1459,12 @@ librdf_storage_mysql_start_bulk(librdf_storage* storage)
   }
 
   query = LIBRDF_MALLOC(char*, strlen(lock_tables) + 
-                        strlen(lock_tables_extra) + 21);
+                        strlen(lock_tables_extra) + 41);
   if(!query) {
     librdf_storage_mysql_release_handle(storage, handle);
     return 1;
   }
-  sprintf(query, lock_tables, context->model);
+  sprintf(query, lock_tables, context->model, context->model);
   if(context->merge)
     strcat(query, lock_tables_extra);
 
@@ -1482,11 +1497,9 @@ static int
 librdf_storage_mysql_stop_bulk(librdf_storage* storage)
 {
   librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
-  char enable_statement_keys[]="ALTER TABLE Statements" UINT64_T_FMT " ENABLE KEYS";
   char enable_literal_keys[]="ALTER TABLE Literals ENABLE KEYS";
   char unlock_tables[]="UNLOCK TABLES";
   char flush_statements[]="FLUSH TABLE Statements";
-  char *query=NULL;
   MYSQL *handle;
 
   /* Get MySQL connection handle */
@@ -1506,25 +1519,6 @@ librdf_storage_mysql_stop_bulk(librdf_storage* storage)
     return 1;
   }
 
-  query = LIBRDF_MALLOC(char*, strlen(enable_statement_keys) + 21);
-  if(!query) {
-    librdf_storage_mysql_release_handle(storage, handle);
-    return 1;
-  }
-  sprintf(query, enable_statement_keys, context->model);
-
-#ifdef LIBRDF_DEBUG_SQL
-  LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
-#endif
-  if(mysql_real_query(handle, query, strlen(query))) {
-    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-               "MySQL statement key re-enabling failed: %s",
-               mysql_error(handle));
-    librdf_storage_mysql_release_handle(storage, handle);
-    return -1;
-  }
-  LIBRDF_FREE(char*, query);
-
 #ifdef LIBRDF_DEBUG_SQL
   LIBRDF_DEBUG2("SQL: >>%s<<\n", enable_literal_keys);
 #endif
@@ -1554,6 +1548,632 @@ librdf_storage_mysql_stop_bulk(librdf_storage* storage)
 }
 
 
+#ifdef HAVE_MYSQL_SET_LOCAL_INFILE_HANDLER
+/*
+ * LOAD DATA LOCAL INFILE handlers that read from the bulk loader's
+ * in-memory buffer rather than from a file.
+ */
+static int
+librdf_storage_mysql_bulk_infile_init(void **ptr, const char *filename,
+                                      void *userdata)
+{
+  librdf_storage_mysql_bulk_loader* loader;
+
+  loader=(librdf_storage_mysql_bulk_loader*)userdata;
+  loader->infile_offset=0;
+  *ptr=loader;
+  return 0;
+}
+
+
+static int
+librdf_storage_mysql_bulk_infile_read(void *ptr, char *buf,
+                                      unsigned int buf_len)
+{
+  librdf_storage_mysql_bulk_loader* loader;
+  size_t len;
+
+  loader=(librdf_storage_mysql_bulk_loader*)ptr;
+  len=loader->infile_length - loader->infile_offset;
+  if(len > buf_len)
+    len=buf_len;
+  if(len) {
+    memcpy(buf, loader->infile_data + loader->infile_offset, len);
+    loader->infile_offset += len;
+  }
+  return LIBRDF_GOOD_CAST(int, len);
+}
+
+
+static void
+librdf_storage_mysql_bulk_infile_end(void *ptr)
+{
+}
+
+
+static int
+librdf_storage_mysql_bulk_infile_error(void *ptr, char *error_msg,
+                                       unsigned int error_msg_len)
+{
+  return 0;
+}
+#endif
+
+
+/*
+ * librdf_storage_mysql_bulk_loader_reset - Start a new batch
+ * @storage: the storage
+ * @loader: bulk loader
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_mysql_bulk_loader_reset(librdf_storage* storage,
+                                       librdf_storage_mysql_bulk_loader* loader)
+{
+  int i;
+
+  for(i=0; i <= TABLE_STATEMENTS; i++) {
+    if(loader->buffers[i])
+      raptor_free_stringbuffer(loader->buffers[i]);
+    loader->buffers[i]=raptor_new_stringbuffer();
+    if(!loader->buffers[i])
+      return 1;
+    loader->rows[i]=0;
+  }
+
+  if(loader->seen_nodes)
+    librdf_free_hash(loader->seen_nodes);
+  loader->seen_nodes=librdf_new_hash(storage->world, NULL);
+  if(!loader->seen_nodes)
+    return 1;
+  if(librdf_hash_open(loader->seen_nodes, NULL, 0, 1, 1, NULL))
+    return 1;
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_mysql_bulk_exec - Run a query on the bulk loader connection
+ * @storage: the storage
+ * @loader: bulk loader
+ * @query: SQL query
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_mysql_bulk_exec(librdf_storage* storage,
+                               librdf_storage_mysql_bulk_loader* loader,
+                               const char* query)
+{
+#ifdef LIBRDF_DEBUG_SQL
+  LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
+#endif
+  if(mysql_real_query(loader->handle, query, strlen(query))) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "MySQL bulk load query failed: %s", mysql_error(loader->handle));
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_mysql_free_bulk_loader - Free bulk loader
+ * @storage: the storage
+ * @loader: bulk loader
+ **/
+static void
+librdf_storage_mysql_free_bulk_loader(librdf_storage* storage,
+                                      librdf_storage_mysql_bulk_loader* loader)
+{
+  int i;
+
+  for(i=0; i <= TABLE_STATEMENTS; i++) {
+    if(loader->buffers[i])
+      raptor_free_stringbuffer(loader->buffers[i]);
+  }
+
+  if(loader->seen_nodes)
+    librdf_free_hash(loader->seen_nodes);
+
+  if(loader->handle) {
+    librdf_storage_mysql_bulk_exec(storage, loader,
+                                   "DROP TEMPORARY TABLE IF EXISTS BulkStatements");
+    librdf_storage_mysql_release_handle(storage, loader->handle);
+  }
+
+  LIBRDF_FREE(librdf_storage_mysql_bulk_loader, loader);
+}
+
+
+/*
+ * librdf_storage_mysql_new_bulk_loader - Create bulk loader
+ * @storage: the storage
+ *
+ * LOAD DATA LOCAL INFILE is used only if the load-data option is set
+ * and the server has local_infile enabled; otherwise rows are sent
+ * as multi-row INSERTs.
+ *
+ * Statements are loaded into the BulkStatements temporary table of
+ * the loader connection, unique on all columns, and moved from there
+ * to the model's statements table by librdf_storage_mysql_bulk_flush().
+ *
+ * Return value: new bulk loader or NULL on failure.
+ **/
+static librdf_storage_mysql_bulk_loader*
+librdf_storage_mysql_new_bulk_loader(librdf_storage* storage)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
+  librdf_storage_mysql_bulk_loader* loader;
+  const char create_bulk_statements[]="\
+CREATE TEMPORARY TABLE IF NOT EXISTS BulkStatements (\
+  Subject bigint unsigned NOT NULL,\
+  Predicate bigint unsigned NOT NULL,\
+  Object bigint unsigned NOT NULL,\
+  Context bigint unsigned NOT NULL,\
+  UNIQUE KEY Statement (Subject,Predicate,Object,Context)\
+) ENGINE=MEMORY";
+
+  loader = LIBRDF_CALLOC(librdf_storage_mysql_bulk_loader*, 1,
+                         sizeof(*loader));
+  if(!loader)
+    return NULL;
+
+  loader->handle=librdf_storage_mysql_get_handle(storage);
+  if(!loader->handle) {
+    librdf_storage_mysql_free_bulk_loader(storage, loader);
+    return NULL;
+  }
+
+  if(librdf_storage_mysql_bulk_exec(storage, loader, create_bulk_statements) ||
+     librdf_storage_mysql_bulk_exec(storage, loader,
+                                    "DELETE FROM BulkStatements")) {
+    librdf_storage_mysql_free_bulk_loader(storage, loader);
+    return NULL;
+  }
+
+#ifdef HAVE_MYSQL_SET_LOCAL_INFILE_HANDLER
+  if(context->load_data) {
+    const char check_local_infile[]="SELECT @@local_infile";
+    MYSQL_RES *res;
+    MYSQL_ROW row;
+
+#ifdef LIBRDF_DEBUG_SQL
+    LIBRDF_DEBUG2("SQL: >>%s<<\n", check_local_infile);
+#endif
+    if(!mysql_real_query(loader->handle, check_local_infile,
+                         strlen(check_local_infile)) &&
+       (res=mysql_store_result(loader->handle))) {
+      row=mysql_fetch_row(res);
+      if(row && row[0] && !strcmp(row[0], "1"))
+        loader->load_data=1;
+      mysql_free_result(res);
+    }
+
+    if(loader->load_data)
+      mysql_set_local_infile_handler(loader->handle,
+                                     librdf_storage_mysql_bulk_infile_init,
+                                     librdf_storage_mysql_bulk_infile_read,
+                                     librdf_storage_mysql_bulk_infile_end,
+                                     librdf_storage_mysql_bulk_infile_error,
+                                     loader);
+    else
+      librdf_log(storage->world, 0, LIBRDF_LOG_WARN, LIBRDF_FROM_STORAGE,
+                 NULL,
+                 "MySQL server does not allow LOAD DATA LOCAL INFILE - using INSERT");
+  }
+#else
+  (void)context;
+#endif
+
+  if(librdf_storage_mysql_bulk_loader_reset(storage, loader)) {
+    librdf_storage_mysql_free_bulk_loader(storage, loader);
+    return NULL;
+  }
+
+  return loader;
+}
+
+
+/*
+ * librdf_storage_mysql_bulk_append_field - Append a column value to a buffered row
+ * @loader: bulk loader
+ * @sb: row buffer
+ * @string: value
+ * @length: length of value
+ *
+ * Values are escaped for the LOAD DATA default field format (tab
+ * separated, backslash escaped) or quoted for an INSERT value list.
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_mysql_bulk_append_field(librdf_storage_mysql_bulk_loader* loader,
+                                       raptor_stringbuffer* sb,
+                                       const unsigned char* string,
+                                       size_t length)
+{
+  size_t i;
+  size_t start=0;
+  char *escaped;
+
+  if(!loader->load_data) {
+    escaped = LIBRDF_MALLOC(char*, length * 2 + 1);
+    if(!escaped)
+      return 1;
+    length=mysql_real_escape_string(loader->handle, escaped,
+                                    (const char*)string, length);
+    raptor_stringbuffer_append_counted_string(sb,
+                                    (const unsigned char*)"'", 1, 1);
+    raptor_stringbuffer_append_counted_string(sb,
+                                    (const unsigned char*)escaped, length, 1);
+    raptor_stringbuffer_append_counted_string(sb,
+                                    (const unsigned char*)"'", 1, 1);
+    LIBRDF_FREE(char*, escaped);
+    return 0;
+  }
+
+  for(i=0; i < length; i++) {
+    const char *escape;
+
+    switch(string[i]) {
+      case '\\': escape="\\\\"; break;
+      case '\t': escape="\\t"; break;
+      case '\n': escape="\\n"; break;
+      case '\r': escape="\\r"; break;
+      case '\0': escape="\\0"; break;
+      default:
+        continue;
+    }
+    if(i > start)
+      raptor_stringbuffer_append_counted_string(sb, string + start,
+                                                i - start, 1);
+    raptor_stringbuffer_append_counted_string(sb,
+                                    (const unsigned char*)escape, 2, 1);
+    start=i+1;
+  }
+  if(length > start)
+    raptor_stringbuffer_append_counted_string(sb, string + start,
+                                              length - start, 1);
+  return 0;
+}
+
+
+/*
+ * librdf_storage_mysql_bulk_append_row - Append a row to a table buffer
+ * @loader: bulk loader
+ * @table: table number
+ * @uints: integer columns
+ * @uints_count: number of integer columns
+ * @strings: string columns following the integer ones
+ * @strings_len: lengths of string columns
+ * @strings_count: number of string columns
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_mysql_bulk_append_row(librdf_storage_mysql_bulk_loader* loader,
+                                     int table,
+                                     u64* uints, int uints_count,
+                                     const unsigned char** strings,
+                                     size_t* strings_len, int strings_count)
+{
+  raptor_stringbuffer* sb=loader->buffers[table];
+  const unsigned char* separator;
+  size_t separator_len;
+  char uint64_buffer[64];
+  int i;
+
+  if(loader->load_data) {
+    separator=(const unsigned char*)"\t";
+    separator_len=1;
+  } else {
+    separator=(const unsigned char*)", ";
+    separator_len=2;
+    if(loader->rows[table])
+      raptor_stringbuffer_append_counted_string(sb, separator,
+                                                separator_len, 1);
+    raptor_stringbuffer_append_counted_string(sb,
+                                    (const unsigned char*)"(", 1, 1);
+  }
+
+  for(i=0; i < uints_count + strings_count; i++) {
+    if(i > 0)
+      raptor_stringbuffer_append_counted_string(sb, separator,
+                                                separator_len, 1);
+    if(i < uints_count) {
+      sprintf(uint64_buffer, UINT64_T_FMT, uints[i]);
+      raptor_stringbuffer_append_string(sb,
+                                    (const unsigned char*)uint64_buffer, 1);
+    } else if(librdf_storage_mysql_bulk_append_field(loader, sb,
+                                        strings[i - uints_count],
+                                        strings_len[i - uints_count]))
+      return 1;
+  }
+
+  if(loader->load_data)
+    raptor_stringbuffer_append_counted_string(sb,
+                                    (const unsigned char*)"\n", 1, 1);
+  else
+    raptor_stringbuffer_append_counted_string(sb,
+                                    (const unsigned char*)")", 1, 1);
+
+  loader->rows[table]++;
+  return 0;
+}
+
+
+/*
+ * librdf_storage_mysql_bulk_flush - Send all buffered rows to the database
+ * @storage: the storage
+ * @loader: bulk loader
+ *
+ * Node tables are loaded before the statements.  Rows are loaded
+ * with IGNORE so nodes already stored, which may have been sent in an
+ * earlier batch, are kept as they are.  Statements go through
+ * BulkStatements, which drops duplicates within the batch, and only
+ * those not already in the model's statements table are copied to it.
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_mysql_bulk_flush(librdf_storage* storage,
+                                librdf_storage_mysql_bulk_loader* loader)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
+  const char move_statements[]="\
+INSERT INTO Statements" UINT64_T_FMT " (Subject, Predicate, Object, Context) \
+SELECT b.Subject, b.Predicate, b.Object, b.Context FROM BulkStatements AS b \
+WHERE NOT EXISTS (SELECT 1 FROM Statements" UINT64_T_FMT " AS Existing \
+WHERE Existing.Subject=b.Subject AND Existing.Predicate=b.Predicate AND \
+Existing.Object=b.Object AND Existing.Context=b.Context)";
+  char move_query[sizeof(move_statements) + 40];
+  int statements=loader->rows[TABLE_STATEMENTS];
+  int i;
+
+  for(i=0; i <= TABLE_STATEMENTS; i++) {
+    const table_info *table=&mysql_tables[i];
+    raptor_stringbuffer* sb;
+    char table_name[64];
+    char *query;
+    size_t query_len;
+    size_t rows_len;
+    int rc;
+
+    if(!loader->rows[i])
+      continue;
+
+    if(i == TABLE_STATEMENTS)
+      strcpy(table_name, "BulkStatements");
+    else
+      strcpy(table_name, table->name);
+
+    rows_len=raptor_stringbuffer_length(loader->buffers[i]);
+
+    sb=raptor_new_stringbuffer();
+    if(!sb)
+      return 1;
+    if(loader->load_data) {
+      raptor_stringbuffer_append_string(sb,
+                      (const unsigned char*)"LOAD DATA LOCAL INFILE '", 1);
+      raptor_stringbuffer_append_string(sb,
+                      (const unsigned char*)table_name, 1);
+      raptor_stringbuffer_append_string(sb,
+                      (const unsigned char*)"' IGNORE INTO TABLE ", 1);
+      raptor_stringbuffer_append_string(sb,
+                      (const unsigned char*)table_name, 1);
+    } else {
+      raptor_stringbuffer_append_string(sb,
+                      (const unsigned char*)"INSERT IGNORE INTO ", 1);
+      raptor_stringbuffer_append_string(sb,
+                      (const unsigned char*)table_name, 1);
+    }
+    raptor_stringbuffer_append_counted_string(sb,
+                      (const unsigned char*)" (", 2, 1);
+    if(i != TABLE_STATEMENTS)
+      raptor_stringbuffer_append_counted_string(sb,
+                      (const unsigned char*)"ID, ", 4, 1);
+    raptor_stringbuffer_append_string(sb,
+                      (const unsigned char*)table->columns, 1);
+    raptor_stringbuffer_append_counted_string(sb,
+                      (const unsigned char*)")", 1, 1);
+
+    if(loader->load_data) {
+      loader->infile_data=raptor_stringbuffer_as_string(loader->buffers[i]);
+      loader->infile_length=rows_len;
+      loader->infile_offset=0;
+    } else {
+      raptor_stringbuffer_append_counted_string(sb,
+                      (const unsigned char*)" VALUES ", 8, 1);
+      raptor_stringbuffer_append_stringbuffer(sb, loader->buffers[i]);
+    }
+
+    query_len=raptor_stringbuffer_length(sb);
+    query=(char*)raptor_stringbuffer_as_string(sb);
+
+#ifdef LIBRDF_DEBUG_SQL
+    LIBRDF_DEBUG4("SQL: >>%s<< (%d rows, %d bytes)\n",
+                  loader->load_data ? query : table_name,
+                  loader->rows[i], (int)rows_len);
+#endif
+    rc=mysql_real_query(loader->handle, query, query_len);
+    loader->infile_data=NULL;
+    raptor_free_stringbuffer(sb);
+
+    if(rc) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE,
+                 NULL, "MySQL bulk load into %s failed: %s",
+                 table_name, mysql_error(loader->handle));
+      return 1;
+    }
+  }
+
+  if(statements) {
+    sprintf(move_query, move_statements, context->model, context->model);
+    if(librdf_storage_mysql_bulk_exec(storage, loader, move_query) ||
+       librdf_storage_mysql_bulk_exec(storage, loader,
+                                      "DELETE FROM BulkStatements"))
+      return 1;
+  }
+
+  return librdf_storage_mysql_bulk_loader_reset(storage, loader);
+}
+
+
+/*
+ * librdf_storage_mysql_bulk_add_node - Buffer a node for the bulk loader
+ * @storage: the storage
+ * @loader: bulk loader
+ * @node: node
+ *
+ * Return value: node hash or 0 on failure.
+ **/
+static u64
+librdf_storage_mysql_bulk_add_node(librdf_storage* storage,
+                                   librdf_storage_mysql_bulk_loader* loader,
+                                   librdf_node* node)
+{
+  u64 hash;
+  librdf_hash_datum hd_key, hd_value; /* on stack - not allocated */
+  const unsigned char* strings[3];
+  size_t strings_len[3];
+  int strings_count;
+  int table;
+  librdf_uri* dt;
+
+  hash=librdf_storage_mysql_get_node_hash(storage, node);
+  if(!hash)
+    return 0;
+
+  hd_key.data=&hash;
+  hd_key.size=sizeof(u64);
+  if(librdf_hash_exists(loader->seen_nodes, &hd_key, NULL) > 0)
+    return hash;
+
+  switch(librdf_node_get_type(node)) {
+    case LIBRDF_NODE_TYPE_RESOURCE:
+      table=TABLE_RESOURCES;
+      strings[0]=librdf_uri_as_counted_string(librdf_node_get_uri(node),
+                                              &strings_len[0]);
+      strings_count=1;
+      break;
+
+    case LIBRDF_NODE_TYPE_LITERAL:
+      table=TABLE_LITERALS;
+      strings[0]=librdf_node_get_literal_value_as_counted_string(node,
+                                                          &strings_len[0]);
+      strings[1]=(const unsigned char*)librdf_node_get_literal_value_language(node);
+      if(!strings[1])
+        strings[1]=(const unsigned char*)"";
+      strings_len[1]=strlen((const char*)strings[1]);
+      dt=librdf_node_get_literal_value_datatype_uri(node);
+      if(dt)
+        strings[2]=librdf_uri_as_counted_string(dt, &strings_len[2]);
+      else {
+        strings[2]=(const unsigned char*)"";
+        strings_len[2]=0;
+      }
+      strings_count=3;
+      break;
+
+    case LIBRDF_NODE_TYPE_BLANK:
+      table=TABLE_BNODES;
+      strings[0]=librdf_node_get_blank_identifier(node);
+      strings_len[0]=strlen((const char*)strings[0]);
+      strings_count=1;
+      break;
+
+    case LIBRDF_NODE_TYPE_UNKNOWN:
+    default:
+      return 0;
+  }
+
+  if(librdf_storage_mysql_bulk_append_row(loader, table, &hash, 1,
+                                          strings, strings_len,
+                                          strings_count))
+    return 0;
+
+  hd_value.data=(void*)"1";
+  hd_value.size=2;
+  if(librdf_hash_put(loader->seen_nodes, &hd_key, &hd_value))
+    return 0;
+
+  return hash;
+}
+
+
+/*
+ * librdf_storage_mysql_bulk_load - Load a stream of statements in batches
+ * @storage: the storage
+ * @ctxt: u64 context hash
+ * @statement_stream: the stream of statements
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_mysql_bulk_load(librdf_storage* storage, u64 ctxt,
+                               librdf_stream* statement_stream)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
+  librdf_storage_mysql_bulk_loader* loader;
+  int rc=0;
+
+  loader=librdf_storage_mysql_new_bulk_loader(storage);
+  if(!loader)
+    return 1;
+
+  while(!rc && !librdf_stream_end(statement_stream)) {
+    librdf_statement* statement=librdf_stream_get_object(statement_stream);
+    u64 uints[4];
+    int i;
+
+    uints[0]=librdf_storage_mysql_bulk_add_node(storage, loader,
+                                  librdf_statement_get_subject(statement));
+    uints[1]=librdf_storage_mysql_bulk_add_node(storage, loader,
+                                  librdf_statement_get_predicate(statement));
+    uints[2]=librdf_storage_mysql_bulk_add_node(storage, loader,
+                                  librdf_statement_get_object(statement));
+    uints[3]=ctxt;
+    if(!uints[0] || !uints[1] || !uints[2]) {
+      rc=1;
+      break;
+    }
+
+    rc=librdf_storage_mysql_bulk_append_row(loader, TABLE_STATEMENTS,
+                                            uints, 4, NULL, NULL, 0);
+    if(rc)
+      break;
+
+    for(i=0; i <= TABLE_STATEMENTS; i++) {
+      if(loader->rows[i] >= context->bulk_batch_size ||
+         (!loader->load_data &&
+          raptor_stringbuffer_length(loader->buffers[i]) >= 
+            LIBRDF_STORAGE_MYSQL_BULK_MAX_QUERY_LENGTH)) {
+        rc=librdf_storage_mysql_bulk_flush(storage, loader);
+        break;
+      }
+    }
+
+    librdf_stream_next(statement_stream);
+  }
+
+  if(!rc)
+    rc=librdf_storage_mysql_bulk_flush(storage, loader);
+
+#ifdef HAVE_MYSQL_SET_LOCAL_INFILE_HANDLER
+  if(loader->load_data)
+    mysql_set_local_infile_default(loader->handle);
+#endif
+
+  librdf_storage_mysql_free_bulk_loader(storage, loader);
+
+  return rc;
+}
+
+
 /**
  * librdf_storage_mysql_context_add_statements:
  * @storage: the storage
@@ -1588,6 +2208,10 @@ librdf_storage_mysql_context_add_statements(librdf_storage* storage,
       return 1;
   }
 
+  /* Buffer and send in batches unless inside a transaction */
+  if(context->bulk && !context->transaction_handle)
+    return librdf_storage_mysql_bulk_load(storage, ctxt, statement_stream);
+
   while(!helper && !librdf_stream_end(statement_stream)) {
     librdf_statement* statement=librdf_stream_get_object(statement_stream);
     helper=librdf_storage_mysql_context_add_statement_helper(storage, ctxt,
@@ -2076,6 +2700,7 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
   char where[256];
   char joins[640];
   librdf_stream *stream;
+  long limit=-1;
 
   /* Initialize sos context */
   sos = LIBRDF_CALLOC(librdf_storage_mysql_sos_context*, 1, sizeof(*sos));
@@ -2094,6 +2719,8 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
 
   if(options) {
     sos->is_literal_match=librdf_hash_get_as_boolean(options, "match-substring");
+    /* the caller reads no more than this many statements */
+    limit=librdf_hash_get_as_long(options, "limit");
   }
 
   /* Get MySQL connection handle */
@@ -2260,6 +2887,14 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
     return NULL;
   }
 
+  if(limit > 0) {
+    sprintf(tmp, " LIMIT %ld", limit);
+    if(librdf_storage_mysql_find_statements_in_context_augment_query(&query, tmp)) {
+      librdf_storage_mysql_find_statements_in_context_finished((void*)sos);
+      return NULL;
+    }
+  }
+
   /* Start query... */
 #ifdef LIBRDF_DEBUG_SQL
   LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
@@ -39,12 +39,56 @@
 #include <stdlib.h>
 #endif
 #include <sys/types.h>
+#include <limits.h>
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
 
 #include <redland.h>
 #include <rdf_types.h>
 
 #include <libpq-fe.h>
 
+/* Default number of rows buffered per table by the COPY loader */
+#define LIBRDF_STORAGE_POSTGRESQL_BULK_BATCH_SIZE 10000
+
+/* Default number of rows fetched at a time by statement streams */
+#define LIBRDF_STORAGE_POSTGRESQL_FETCH_SIZE 1000
+
+/* Number of statements added per pipeline sync */
+#define LIBRDF_STORAGE_POSTGRESQL_PIPELINE_SIZE 1000
+
+/* Type OIDs of prepared query parameters (numeric, text) */
+#define LIBRDF_STORAGE_POSTGRESQL_NUMERIC_OID 1700
+#define LIBRDF_STORAGE_POSTGRESQL_TEXT_OID 25
+
+/* Largest block of data passed to PQputCopyData */
+#define LIBRDF_STORAGE_POSTGRESQL_COPY_CHUNK (1 << 16)
+
+/* Buffer index of the statements table in the COPY loader; node
+ * tables Resources, Bnodes and Literals come first
+ */
+#define LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS 3
+
+typedef struct {
+  /* connection used for the whole load */
+  PGconn *handle;
+
+  /* buffered rows in COPY text format */
+  raptor_stringbuffer* buffers[LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS+1];
+  int rows[LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS+1];
+
+  /* node hashes already buffered in the current batch */
+  librdf_hash* seen_nodes;
+} librdf_storage_postgresql_copy_loader;
+
+
 typedef enum {
   /* Status of individual postgresql connections */
   LIBRDF_STORAGE_POSTGRESQL_CONNECTION_CLOSED = 0,
@@ -56,8 +100,23 @@ typedef struct {
   /* A postgresql connection */
   librdf_storage_postgresql_connection_status status;
   PGconn *handle;
+  /* if the prepared queries have been created on this connection */
+  int prepared;
 } librdf_storage_postgresql_connection;
 
+/* Queries prepared once on each connection */
+typedef enum {
+  LIBRDF_STORAGE_POSTGRESQL_ADD_RESOURCE,
+  LIBRDF_STORAGE_POSTGRESQL_ADD_BNODE,
+  LIBRDF_STORAGE_POSTGRESQL_ADD_LITERAL,
+  LIBRDF_STORAGE_POSTGRESQL_ADD_STATEMENT,
+  LIBRDF_STORAGE_POSTGRESQL_ADD_NEW_STATEMENT,
+  LIBRDF_STORAGE_POSTGRESQL_CONTAINS_STATEMENT,
+  LIBRDF_STORAGE_POSTGRESQL_DELETE_STATEMENT,
+  LIBRDF_STORAGE_POSTGRESQL_DELETE_STATEMENT_WITH_CONTEXT,
+  LIBRDF_STORAGE_POSTGRESQL_PREPARED_COUNT
+} librdf_storage_postgresql_prepared_query;
+
 typedef struct {
   /* postgresql connection parameters */
   char *host;
@@ -73,14 +132,23 @@ typedef struct {
   /* hash of model name in the database (table Models, column ID) */
   u64 model;
 
-  /* if inserts should be optimized by locking and index optimizations */
+  /* if streams of statements should be loaded with COPY */
   int bulk;
 
+  /* rows buffered per table by the COPY loader before a flush */
+  int bulk_batch_size;
+
+  /* rows fetched at a time from find statement cursors */
+  int fetch_size;
+
+  /* counter for unique cursor names on a shared connection */
+  int cursor_count;
+
   /* if a table with merged models should be maintained */
   int merge;
 
-  /* digest object for node hashes */
-  librdf_digest *digest;
+  /* node ID (hash) function and cache */
+  librdf_sql_node_id *node_id;
 
   PGconn* transaction_handle;
 
@@ -152,6 +220,14 @@ typedef struct {
   int current_rowno;
   char **row;
   int is_literal_match;
+  /* server-side cursor the results are fetched from in batches */
+  char cursor[32];
+  int cursor_open;
+  /* if the cursor transaction was started for this stream */
+  int own_transaction;
+  /* if the last FETCH returned a full batch */
+  int more_results;
+  int fetch_size;
 } librdf_storage_postgresql_sos_context;
 
 typedef struct {
@@ -168,12 +244,18 @@ static u64 librdf_storage_postgresql_hash(librdf_storage* storage,
                                           const char *string, size_t length);
 static u64 librdf_storage_postgresql_node_hash(librdf_storage* storage,
                                                librdf_node* node, int add);
+static int librdf_storage_postgresql_add_node(librdf_storage* storage,
+                                              PGconn *handle,
+                                              librdf_node* node, u64 hash,
+                                              int pipeline);
 static int librdf_storage_postgresql_start_bulk(librdf_storage* storage);
 static int librdf_storage_postgresql_stop_bulk(librdf_storage* storage);
 static int librdf_storage_postgresql_context_add_statement_helper(librdf_storage* storage,
                                                                   u64 ctxt,
                                                                   librdf_statement* statement);
 static int librdf_storage_postgresql_find_statements_in_context_augment_query(char **query, const char *addition);
+static int librdf_storage_postgresql_find_statements_in_context_declare(librdf_storage_postgresql_sos_context* sos, const char *query);
+static int librdf_storage_postgresql_find_statements_in_context_fetch(librdf_storage_postgresql_sos_context* sos);
 
 /* methods for stream of statements */
 static int librdf_storage_postgresql_find_statements_in_context_end_of_stream(void* context);
@@ -203,7 +285,7 @@ static int librdf_storage_postgresql_transaction_rollback(librdf_storage* storag
  * @string: a string to get hash for
  * @length: length of string
  *
- * Find hash value of string.
+ * Find hash value of string with the node-id function.
  *
  * Return value: Non-zero on succes.
  **/
@@ -212,35 +294,14 @@ librdf_storage_postgresql_hash(librdf_storage* storage, const char *type,
                                const char *string, size_t length)
 {
   librdf_storage_postgresql_instance* context;
-  u64 hash;
-  byte* digest;
-  int i;
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 0);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(string, char*, 0);
 
   context = (librdf_storage_postgresql_instance*)storage->instance;
 
-  /* (Re)initialize digest object */
-  librdf_digest_init(context->digest);
-
-  /* Update digest with data */
-  if(type)
-    librdf_digest_update(context->digest, (unsigned char*)type, 1);
-  librdf_digest_update(context->digest, (unsigned char*)string, length);
-  librdf_digest_final(context->digest);
-
-  /* Copy first 8 bytes of digest into unsigned 64bit hash
-   * using a method portable across big/little endianness
-   *
-   * Fixes Issue#0000023 - http://bugs.librdf.org/mantis/view.php?id=23
-   */
-  digest = (byte*) librdf_digest_get_digest(context->digest);
-  hash = 0;
-  for(i=0; i<8; i++)
-    hash += ((u64) digest[i]) << (i*8);
-
-  return hash;
+  return librdf_sql_node_id_hash(context->node_id, type,
+                                 (const unsigned char*)string, length);
 }
 
 
@@ -377,6 +438,7 @@ librdf_storage_postgresql_get_handle(librdf_storage* storage)
     if(connection->handle) {
     	if( PQstatus(connection->handle) == CONNECTION_OK ) {
         connection->status=LIBRDF_STORAGE_POSTGRESQL_CONNECTION_BUSY;
+        connection->prepared=0;
       } else {
         librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
                    "Connection to postgresql database %s:%s name %s as user %s failed: %s",
@@ -425,17 +487,184 @@ librdf_storage_postgresql_release_handle(librdf_storage* storage, PGconn *handle
 }
 
 
+#define N LIBRDF_STORAGE_POSTGRESQL_NUMERIC_OID
+#define T LIBRDF_STORAGE_POSTGRESQL_TEXT_OID
+
+/* Node inserts skip existing rows rather than violating the primary
+ * key so that they neither abort a transaction nor a pipeline.
+ * Statements<model> table names are formatted in at prepare time.
+ */
+static const struct {
+  const char* name;
+  const char* query;
+  int params_count;
+  Oid types[5];
+} librdf_storage_postgresql_prepared_queries[LIBRDF_STORAGE_POSTGRESQL_PREPARED_COUNT] = {
+  { "librdf_add_resource",
+    "INSERT INTO Resources (ID,URI) SELECT $1,$2 WHERE NOT EXISTS (SELECT 1 FROM Resources WHERE ID=$1)",
+    2, { N, T } },
+  { "librdf_add_bnode",
+    "INSERT INTO Bnodes (ID,Name) SELECT $1,$2 WHERE NOT EXISTS (SELECT 1 FROM Bnodes WHERE ID=$1)",
+    2, { N, T } },
+  { "librdf_add_literal",
+    "INSERT INTO Literals (ID,Value,Language,Datatype) SELECT $1,$2,$3,$4 WHERE NOT EXISTS (SELECT 1 FROM Literals WHERE ID=$1)",
+    4, { N, T, T, T } },
+  { "librdf_add_statement",
+    "INSERT INTO Statements" UINT64_T_FMT " (Subject,Predicate,Object,Context) VALUES ($1,$2,$3,$4)",
+    4, { N, N, N, N } },
+  { "librdf_add_new_statement",
+    "INSERT INTO Statements" UINT64_T_FMT " (Subject,Predicate,Object,Context) SELECT $1,$2,$3,$4 WHERE NOT EXISTS (SELECT 1 FROM Statements" UINT64_T_FMT " WHERE Subject=$1 AND Predicate=$2 AND Object=$3)",
+    4, { N, N, N, N } },
+  { "librdf_contains_statement",
+    "SELECT 1 FROM Statements" UINT64_T_FMT " WHERE Subject=$1 AND Predicate=$2 AND Object=$3 limit 1",
+    3, { N, N, N } },
+  { "librdf_delete_statement",
+    "DELETE FROM Statements" UINT64_T_FMT " WHERE Subject=$1 AND Predicate=$2 AND Object=$3",
+    3, { N, N, N } },
+  { "librdf_delete_statement_with_context",
+    "DELETE FROM Statements" UINT64_T_FMT " WHERE Subject=$1 AND Predicate=$2 AND Object=$3 AND Context=$4",
+    4, { N, N, N, N } }
+};
+
+#undef N
+#undef T
+
+
+/*
+ * librdf_storage_postgresql_prepare_handle:
+ * @storage: the storage
+ * @handle: postgresql connection
+ *
+ * INTERNAL - Prepare the fixed queries on a connection, once
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_prepare_handle(librdf_storage* storage,
+                                         PGconn *handle)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  librdf_storage_postgresql_connection* connection=NULL;
+  char query[512];
+  int i;
+
+  for(i=0; i < context->connections_count; i++) {
+    if(context->connections[i].handle == handle) {
+      connection=&context->connections[i];
+      break;
+    }
+  }
+  if(!connection)
+    return 1;
+
+  if(connection->prepared)
+    return 0;
+
+  for(i=0; i < LIBRDF_STORAGE_POSTGRESQL_PREPARED_COUNT; i++) {
+    PGresult *res;
+    int status=1;
+
+    /* Queries without a Statements table ignore the model arguments */
+    sprintf(query, librdf_storage_postgresql_prepared_queries[i].query,
+            context->model, context->model);
+
+    res=PQprepare(handle, librdf_storage_postgresql_prepared_queries[i].name,
+                  query, librdf_storage_postgresql_prepared_queries[i].params_count,
+                  librdf_storage_postgresql_prepared_queries[i].types);
+    if(res) {
+      if(PQresultStatus(res) == PGRES_COMMAND_OK)
+        status=0;
+      else
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "postgresql prepare of %s failed: %s", query,
+                   PQresultErrorMessage(res));
+      PQclear(res);
+    } else
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql prepare of %s failed: %s", query,
+                 PQerrorMessage(handle));
+    if(status)
+      return 1;
+  }
+
+  connection->prepared=1;
+  return 0;
+}
+
+
+/*
+ * librdf_storage_postgresql_exec_prepared:
+ * @storage: the storage
+ * @handle: postgresql connection
+ * @prepared: prepared query
+ * @values: text parameter values
+ *
+ * INTERNAL - Run a prepared query, preparing the connection if needed
+ *
+ * Return value: result (to be freed with PQclear) or NULL on failure
+ */
+static PGresult*
+librdf_storage_postgresql_exec_prepared(librdf_storage* storage,
+                                        PGconn *handle,
+                                        librdf_storage_postgresql_prepared_query prepared,
+                                        const char* const* values)
+{
+  if(librdf_storage_postgresql_prepare_handle(storage, handle))
+    return NULL;
+
+  return PQexecPrepared(handle,
+                        librdf_storage_postgresql_prepared_queries[prepared].name,
+                        librdf_storage_postgresql_prepared_queries[prepared].params_count,
+                        values, NULL, NULL, 0);
+}
+
+
+/*
+ * librdf_storage_postgresql_statement_params:
+ * @ids: buffers for the formatted IDs
+ * @values: parameter values to set
+ * @subject: subject hash
+ * @predicate: predicate hash
+ * @object: object hash
+ * @ctxt: context hash
+ *
+ * INTERNAL - Format statement node IDs as prepared query parameters
+ */
+static void
+librdf_storage_postgresql_statement_params(char ids[4][21],
+                                           const char* values[4],
+                                           u64 subject, u64 predicate,
+                                           u64 object, u64 ctxt)
+{
+  u64 uints[4];
+  int i;
+
+  uints[0] = subject;
+  uints[1] = predicate;
+  uints[2] = object;
+  uints[3] = ctxt;
+  for(i = 0; i < 4; i++) {
+    sprintf(ids[i], UINT64_T_FMT, uints[i]);
+    values[i] = ids[i];
+  }
+}
+
+
 /*
  * librdf_storage_postgresql_init:
  * @storage: the storage
  * @name: model name
- * @options: host, port, database, user, password [, new] [, bulk] [, merge].
+ * @options: host, port, database, user, password [, new] [, bulk] [, merge]
+ *   [, bulk-batch-size] [, fetch-size].
  *
  * INTERNAL - Create connection to database.  Defaults to port 5432 if not given.
  *
- * The boolean bulk option can be set to true if optimized inserts (table
- * locks and temporary key disabling) is wanted. Note that this will block
- * all other access, and requires table locking and alter table privileges.
+ * The boolean bulk option can be set to true if streams of statements
+ * should be loaded with COPY in batches of bulk-batch-size rows per
+ * table (default 10000).  Duplicate statements are skipped.
+ *
+ * Statement streams read their results through a server-side cursor
+ * fetch-size rows at a time (default 1000).
  *
  * The boolean merge option can be set to true if a merged "view" of all
  * models should be maintained. This "view" will be a table with TYPE=MERGE.
@@ -498,6 +727,7 @@ librdf_storage_postgresql_init(librdf_storage* storage, const char *name,
   char *query=NULL;
   PGresult *res=NULL;
   PGconn *handle;
+  long lbatch;
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(name, char*, 1);
@@ -516,8 +746,9 @@ librdf_storage_postgresql_init(librdf_storage* storage, const char *name,
   librdf_storage_set_instance(storage, context);
 
 
-  /* Create digest */
-  if(!(context->digest=librdf_new_digest(storage->world,"MD5"))) {
+  /* Create node ID function */
+  context->node_id = librdf_new_sql_node_id_for_storage(storage, options);
+  if(!context->node_id) {
     librdf_free_hash(options);
     return 1;
   }
@@ -693,6 +924,18 @@ librdf_storage_postgresql_init(librdf_storage* storage, const char *name,
   /* Optimize loads? */
   context->bulk=(librdf_hash_get_as_boolean(options, "bulk")>0);
 
+  lbatch=librdf_hash_get_as_long(options, "bulk-batch-size");
+  if(lbatch <= 0 || lbatch > INT_MAX)
+    context->bulk_batch_size=LIBRDF_STORAGE_POSTGRESQL_BULK_BATCH_SIZE;
+  else
+    context->bulk_batch_size=LIBRDF_GOOD_CAST(int, lbatch);
+
+  lbatch=librdf_hash_get_as_long(options, "fetch-size");
+  if(lbatch <= 0 || lbatch > INT_MAX)
+    context->fetch_size=LIBRDF_STORAGE_POSTGRESQL_FETCH_SIZE;
+  else
+    context->fetch_size=LIBRDF_GOOD_CAST(int, lbatch);
+
   /* Truncate model? */
    if(!status && (librdf_hash_get_as_boolean(options, "new")>0))
     status=librdf_storage_postgresql_context_remove_statements(storage, NULL);
@@ -822,8 +1065,8 @@ librdf_storage_postgresql_terminate(librdf_storage* storage)
   if(context->host)
     LIBRDF_FREE(char*, (char*)context->host);
 
-  if(context->digest)
-    librdf_free_digest(context->digest);
+  if(context->node_id)
+    librdf_free_sql_node_id(context->node_id);
 
   if(context->transaction_handle)
     librdf_storage_postgresql_transaction_rollback(storage);
@@ -975,6 +1218,98 @@ librdf_storage_postgresql_add_statements(librdf_storage* storage,
                                                      statement_stream);
 }
 
+/*
+ * librdf_storage_postgresql_add_node:
+ * @storage: the storage
+ * @handle: postgresql connection
+ * @node: node to add
+ * @hash: node hash
+ * @pipeline: non-0 to only queue the insert on a connection in pipeline mode
+ *
+ * INTERNAL - Add a node to the database unless already present
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_postgresql_add_node(librdf_storage* storage, PGconn *handle,
+                                   librdf_node* node, u64 hash, int pipeline)
+{
+  librdf_storage_postgresql_prepared_query prepared;
+  const char* values[4];
+  char id[21];
+  librdf_uri *dt;
+  PGresult *res;
+  int status = 1;
+
+  sprintf(id, UINT64_T_FMT, hash);
+  values[0] = id;
+
+  switch(librdf_node_get_type(node)) {
+    case LIBRDF_NODE_TYPE_RESOURCE:
+      prepared = LIBRDF_STORAGE_POSTGRESQL_ADD_RESOURCE;
+      values[1] = (const char*)librdf_uri_as_string(librdf_node_get_uri(node));
+      break;
+
+    case LIBRDF_NODE_TYPE_BLANK:
+      prepared = LIBRDF_STORAGE_POSTGRESQL_ADD_BNODE;
+      values[1] = (const char*)librdf_node_get_blank_identifier(node);
+      break;
+
+    case LIBRDF_NODE_TYPE_LITERAL:
+      prepared = LIBRDF_STORAGE_POSTGRESQL_ADD_LITERAL;
+      values[1] = (const char*)librdf_node_get_literal_value(node);
+      values[2] = librdf_node_get_literal_value_language(node);
+      if(!values[2])
+        values[2] = "";
+      dt = librdf_node_get_literal_value_datatype_uri(node);
+      values[3] = dt ? (const char*)librdf_uri_as_string(dt) : "";
+      break;
+
+    case LIBRDF_NODE_TYPE_UNKNOWN:
+    default:
+      /* Some node type we don't know about? */
+      return 1;
+  }
+
+  if(pipeline) {
+    if(PQsendQueryPrepared(handle,
+                           librdf_storage_postgresql_prepared_queries[prepared].name,
+                           librdf_storage_postgresql_prepared_queries[prepared].params_count,
+                           values, NULL, NULL, 0) == 1)
+      return 0;
+
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql insert of node failed: %s",
+               PQerrorMessage(handle));
+    return 1;
+  }
+
+  if((res=librdf_storage_postgresql_exec_prepared(storage, handle, prepared,
+                                                  values))) {
+    if(PQresultStatus(res) == PGRES_COMMAND_OK) {
+      status = 0;
+    } else {
+      const char* sqlstate = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+      if(sqlstate && !strcmp("23505", sqlstate)) {
+        /* Don't care about unique key violations from concurrent adds */
+        status = 0;
+      } else {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "postgresql insert of node failed: %s",
+                   PQresultErrorMessage(res));
+      }
+    }
+    PQclear(res);
+  } else {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql insert of node failed: %s",
+               PQerrorMessage(handle));
+  }
+
+  return status;
+}
+
+
 /*
  * librdf_storage_postgresql_node_hash - Create hash value for node
  * @storage: the storage
@@ -988,250 +1323,24 @@ librdf_storage_postgresql_node_hash(librdf_storage* storage,
                                librdf_node* node,
                                int add)
 {
-  librdf_node_type type=librdf_node_get_type(node);
+  librdf_storage_postgresql_instance *context=(librdf_storage_postgresql_instance*)storage->instance;
   u64 hash;
-  size_t nodelen;
-  char *query;
   PGconn *handle;
-  PGresult *res;
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 0);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(node, librdf_node, 0);
 
+  hash = librdf_sql_node_id_for_node(context->node_id, node);
+  if(!hash || !add)
+    return hash;
+
   /* Get postgresql connection handle */
   handle=librdf_storage_postgresql_get_handle(storage);
   if(!handle)
     return 0;
 
-  if(type==LIBRDF_NODE_TYPE_RESOURCE) {
-    /* Get hash */
-    unsigned char *uri=librdf_uri_as_counted_string(librdf_node_get_uri(node), &nodelen);
-    hash = librdf_storage_postgresql_hash(storage, "R", (char*)uri, nodelen);
-
-    if(add) {
-      char create_resource[]="INSERT INTO Resources (ID,URI) VALUES (" UINT64_T_FMT ",'%s')";
-      int add_status = 0;
-      char *escaped_uri;
-
-      escaped_uri = LIBRDF_MALLOC(char*, nodelen * 2 + 1);
-      if(escaped_uri) {
-        int error = 0;
-        PQescapeStringConn(handle, escaped_uri,
-                           (const char*)uri, nodelen,
-                           &error);
-        if(error) {
-          librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                     "postgresql escapeStringConn() failed: %s",
-                     PQerrorMessage(handle));
-        }
-
-        query = LIBRDF_MALLOC(char*, strlen(create_resource) + 20 + nodelen + 1);
-        if(query) {
-          sprintf(query, create_resource, hash, escaped_uri);
-          if((res=PQexec(handle, query))) {
-            if(PQresultStatus(res) == PGRES_COMMAND_OK) {
-              add_status = 1;
-            } else {
-              if (0 == strncmp("23505", PQresultErrorField(res, PG_DIAG_SQLSTATE), strlen("23505"))) {
-                /* Don't care about unique key viloations */
-                add_status = 1;
-              } else {
-                librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                           "postgresql insert into Resources failed: %s",
-                           PQresultErrorMessage(res));
-              }
-            }
-            PQclear(res);
-          } else {
-            librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                       "postgresql insert into Resources failed");
-          }
-          LIBRDF_FREE(char*, query);
-        }
-        LIBRDF_FREE(char*, escaped_uri);
-      }
-      if(!add_status) {
-        librdf_storage_postgresql_release_handle(storage, handle);
-        return 0;
-      }
-    }
-
-  } else if(type==LIBRDF_NODE_TYPE_LITERAL) {
-    /* Get hash */
-    unsigned char *value, *datatype=0;
-    char *lang, *nodestring;
-    librdf_uri *dt;
-    size_t valuelen, langlen=0, datatypelen=0;
-
-    value=librdf_node_get_literal_value_as_counted_string(node,&valuelen);
-    lang=librdf_node_get_literal_value_language(node);
-    if(lang)
-      langlen=strlen(lang);
-    dt=librdf_node_get_literal_value_datatype_uri(node);
-    if(dt)
-      datatype=librdf_uri_as_counted_string(dt,&datatypelen);
-    if(datatype)
-      datatypelen=strlen((const char*)datatype);
-
-    /* Create composite node string for hash generation */
-    nodestring = LIBRDF_MALLOC(char*, valuelen + langlen + datatypelen + 3);
-    if(!nodestring) {
-      librdf_storage_postgresql_release_handle(storage, handle);
-      return 0;
-    }
-    strcpy(nodestring, (const char*)value);
-    strcat(nodestring, "<");
-    if(lang)
-      strcat(nodestring, lang);
-    strcat(nodestring, ">");
-    if(datatype)
-      strcat(nodestring, (const char*)datatype);
-    nodelen=valuelen+langlen+datatypelen+2;
-    hash = librdf_storage_postgresql_hash(storage, "L", nodestring, nodelen);
-    LIBRDF_FREE(char*, nodestring);
-
-    if(add) {
-      char create_literal[]="INSERT INTO Literals (ID,Value,Language,Datatype) VALUES (" UINT64_T_FMT ",'%s','%s','%s')";
-      int add_status = 0;
-      char *escaped_value, *escaped_lang, *escaped_datatype;
-
-      escaped_value = LIBRDF_MALLOC(char*, valuelen * 2 + 1);
-      if(escaped_value) {
-        int error = 0;
-        PQescapeStringConn(handle, escaped_value,
-                           (const char*)value, valuelen,
-                           &error);
-        if(error) {
-          librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                     "postgresql escapeStringConn() failed: %s",
-                     PQerrorMessage(handle));
-        }
-
-        escaped_lang = LIBRDF_MALLOC(char*, langlen * 2 + 1);
-        if(escaped_lang) {
-          if(lang) {
-            PQescapeStringConn(handle, escaped_lang,
-                               (const char*)lang, langlen,
-                               &error);
-            if(error) {
-              librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                         "postgresql escapeStringConn() failed: %s",
-                         PQerrorMessage(handle));
-            }
-          } else
-            strcpy(escaped_lang,"");
-
-          escaped_datatype = LIBRDF_MALLOC(char*, datatypelen * 2 + 1);
-          if(escaped_datatype) {
-            if(datatype) {
-              PQescapeStringConn(handle, escaped_datatype,
-                                 (const char*)datatype, datatypelen,
-                                 &error);
-              if(error) {
-                librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                           "postgresql escapeStringConn() failed: %s",
-                           PQerrorMessage(handle));
-              }
-            } else
-              strcpy(escaped_datatype,"");
-
-            query = LIBRDF_MALLOC(char*,
-                                  strlen(create_literal) +
-                                  strlen(escaped_value) +
-                                  strlen(escaped_lang) +
-                                  strlen(escaped_datatype) + 21);
-            if(query) {
-              sprintf(query, create_literal, hash, escaped_value, escaped_lang, escaped_datatype);
-              if((res=PQexec(handle, query))) {
-                if(PQresultStatus(res) == PGRES_COMMAND_OK) {
-                  add_status = 1;
-                } else {
-                  if (0 == strncmp("23505", PQresultErrorField(res, PG_DIAG_SQLSTATE), strlen("23505"))) {
-                    /* Don't care about unique key viloations */
-                    add_status = 1;
-                  } else {
-                    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                               "postgresql insert into Resources failed: %s",
-                               PQresultErrorMessage(res));
-                  }
-                }
-                PQclear(res);
-              } else {
-                librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                           "postgresql insert into Resources failed");
-              }
-              LIBRDF_FREE(char*, query);
-            }
-            LIBRDF_FREE(char*, escaped_datatype);
-          }
-          LIBRDF_FREE(char*, escaped_lang);
-        }
-        LIBRDF_FREE(char*, escaped_value);
-      }
-      if(!add_status) {
-        librdf_storage_postgresql_release_handle(storage, handle);
-        return 0;
-      }
-    }
-
-  } else if(type==LIBRDF_NODE_TYPE_BLANK) {
-    /* Get hash */
-    unsigned char *name = librdf_node_get_blank_identifier(node);
-    nodelen = strlen((const char*)name);
-    hash = librdf_storage_postgresql_hash(storage, "B", (char*)name, nodelen);
-
-    if(add) {
-      char create_bnode[]="INSERT INTO Bnodes (ID,Name) VALUES (" UINT64_T_FMT ",'%s')";
-      int add_status = 0;
-      char *escaped_name;
-
-      escaped_name = LIBRDF_MALLOC(char*, nodelen * 2 + 1);
-      if(escaped_name) {
-        int error = 0;
-        PQescapeStringConn(handle, escaped_name,
-                           (const char*)name, nodelen,
-                           &error);
-        if(error) {
-          librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                     "postgresql escapeStringConn() failed: %s",
-                     PQerrorMessage(handle));
-        }
-
-        query = LIBRDF_MALLOC(char*, strlen(create_bnode) + 20 + nodelen + 1);
-        if(query) {
-          sprintf(query, create_bnode, hash, escaped_name);
-          if((res=PQexec(handle, query))) {
-            if(PQresultStatus(res) == PGRES_COMMAND_OK) {
-              add_status = 1;
-            } else {
-              if (0 == strncmp("23505", PQresultErrorField(res, PG_DIAG_SQLSTATE), strlen("23505"))) {
-                /* Don't care about unique key viloations */
-                add_status = 1;
-              } else {
-                librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                           "postgresql insert into Resources failed: %s",
-                           PQresultErrorMessage(res));
-              }
-            }
-            PQclear(res);
-          } else {
-            librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                       "postgresql insert into Bnodes failed");
-          }
-          LIBRDF_FREE(char*, query);
-        }
-        LIBRDF_FREE(char*, escaped_name);
-      }
-      if(!add_status) {
-        librdf_storage_postgresql_release_handle(storage, handle);
-        return 0;
-      }
-    }
-  } else {
-    /* Some node type we don't know about? */
-    librdf_storage_postgresql_release_handle(storage, handle);
-    return 0;
-  }
+  if(librdf_storage_postgresql_add_node(storage, handle, node, hash, 0))
+    hash = 0;
 
   librdf_storage_postgresql_release_handle(storage, handle);
 
@@ -1250,8 +1359,8 @@ librdf_storage_postgresql_node_hash(librdf_storage* storage,
 static int
 librdf_storage_postgresql_start_bulk(librdf_storage* storage)
 {
-
-  return 1;
+  /* Nothing to prepare; the COPY loader sets up its own connection */
+  return 0;
 }
 
 
@@ -1266,77 +1375,869 @@ librdf_storage_postgresql_start_bulk(librdf_storage* storage)
 static int
 librdf_storage_postgresql_stop_bulk(librdf_storage* storage)
 {
-  return 1;
+  return 0;
 }
 
 
 /*
- * librdf_storage_postgresql_context_add_statements:
+ * librdf_storage_postgresql_exec:
  * @storage: the storage
- * @context_node: #librdf_node object
- * @statement_stream: the stream of statements
+ * @handle: postgresql connection
+ * @query: SQL query
+ * @expected: expected result status
  *
- * INTERNAL - Add statements in stream to storage, with context.
+ * INTERNAL - Run a query that returns no rows worth keeping
  *
  * Return value: Non-zero on failure.
- **/
+ */
 static int
-librdf_storage_postgresql_context_add_statements(librdf_storage* storage,
-                                            librdf_node* context_node,
-                                            librdf_stream* statement_stream)
+librdf_storage_postgresql_exec(librdf_storage* storage, PGconn* handle,
+                               const char* query, ExecStatusType expected)
 {
-  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
-  u64 ctxt=0;
-  int helper=0;
-
-  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
-  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement_stream, librdf_stream, 1);
-
-  /* Optimize for bulk loads? */
-  if(context->bulk) {
-    if(librdf_storage_postgresql_start_bulk(storage))
-      return 1;
-  }
+  PGresult *res;
+  int status = 1;
 
-  /* Find hash for context, creating if necessary */
-  if(context_node) {
-    ctxt=librdf_storage_postgresql_node_hash(storage,context_node,1);
-    if(!ctxt)
-      return 1;
-  }
+  res = PQexec(handle, query);
+  if(res) {
+    if(PQresultStatus(res) == expected)
+      status = 0;
+    else
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql query %s failed: %s", query,
+                 PQresultErrorMessage(res));
+    PQclear(res);
+  } else
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql query %s failed: %s", query,
+               PQerrorMessage(handle));
 
-  while(!helper && !librdf_stream_end(statement_stream)) {
-    librdf_statement* statement=librdf_stream_get_object(statement_stream);
-    if(!context->bulk) {
-      /* Do not add duplicate statements
-       * but do not check for this when in bulk mode.
-       */
-      if(librdf_storage_postgresql_contains_statement(storage, statement)) {
-        librdf_stream_next(statement_stream);
-        continue;
-      }
-    }
+  return status;
+}
 
-    helper=librdf_storage_postgresql_context_add_statement_helper(storage, ctxt,
-                                                             statement);
-    librdf_stream_next(statement_stream);
-  }
 
-  return helper;
-}
+/* Node tables loaded through COPY staging tables */
+static const struct {
+  const char* table;
+  const char* columns;
+} librdf_storage_postgresql_copy_tables[LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS] = {
+  { "Resources", "ID, URI" },
+  { "Bnodes",    "ID, Name" },
+  { "Literals",  "ID, Value, Language, Datatype" }
+};
 
 
 /*
- * librdf_storage_postgresql_context_add_statement:
- * @storage: #librdf_storage object
- * @context_node: #librdf_node object
- * @statement: #librdf_statement statement to add
+ * librdf_storage_postgresql_copy_loader_reset:
+ * @storage: the storage
+ * @loader: COPY loader
  *
- * INTERNAL - Add a statement to a storage context
+ * INTERNAL - Start a new batch
  *
- * Return value: non 0 on failure
- **/
-static int
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_copy_loader_reset(librdf_storage* storage,
+                                            librdf_storage_postgresql_copy_loader* loader)
+{
+  int i;
+
+  for(i = 0; i <= LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS; i++) {
+    if(loader->buffers[i])
+      raptor_free_stringbuffer(loader->buffers[i]);
+    loader->buffers[i] = raptor_new_stringbuffer();
+    if(!loader->buffers[i])
+      return 1;
+    loader->rows[i] = 0;
+  }
+
+  if(loader->seen_nodes)
+    librdf_free_hash(loader->seen_nodes);
+  loader->seen_nodes = librdf_new_hash(storage->world, NULL);
+  if(!loader->seen_nodes)
+    return 1;
+  if(librdf_hash_open(loader->seen_nodes, NULL, 0, 1, 1, NULL))
+    return 1;
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_postgresql_free_copy_loader:
+ * @storage: the storage
+ * @loader: COPY loader
+ *
+ * INTERNAL - Free COPY loader
+ */
+static void
+librdf_storage_postgresql_free_copy_loader(librdf_storage* storage,
+                                           librdf_storage_postgresql_copy_loader* loader)
+{
+  int i;
+
+  for(i = 0; i <= LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS; i++) {
+    if(loader->buffers[i])
+      raptor_free_stringbuffer(loader->buffers[i]);
+  }
+
+  if(loader->seen_nodes)
+    librdf_free_hash(loader->seen_nodes);
+
+  if(loader->handle)
+    librdf_storage_postgresql_release_handle(storage, loader->handle);
+
+  LIBRDF_FREE(librdf_storage_postgresql_copy_loader, loader);
+}
+
+
+/*
+ * librdf_storage_postgresql_new_copy_loader:
+ * @storage: the storage
+ *
+ * INTERNAL - Create COPY loader and its session staging tables
+ *
+ * Return value: new loader or NULL on failure
+ */
+static librdf_storage_postgresql_copy_loader*
+librdf_storage_postgresql_new_copy_loader(librdf_storage* storage)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  librdf_storage_postgresql_copy_loader* loader;
+  char query[256];
+  int i;
+
+  loader = LIBRDF_CALLOC(librdf_storage_postgresql_copy_loader*, 1,
+                         sizeof(*loader));
+  if(!loader)
+    return NULL;
+
+  loader->handle = librdf_storage_postgresql_get_handle(storage);
+  if(!loader->handle) {
+    librdf_storage_postgresql_free_copy_loader(storage, loader);
+    return NULL;
+  }
+
+  /* Temporary tables are private to this connection; nodes and
+   * statements are copied here first so that ones already stored can
+   * be skipped rather than violating the node table primary keys or
+   * duplicating statements.
+   */
+  for(i = 0; i <= LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS; i++) {
+    if(i == LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS)
+      sprintf(query, "CREATE TEMPORARY TABLE IF NOT EXISTS librdf_copy_Statements (LIKE Statements" UINT64_T_FMT ")",
+              context->model);
+    else {
+      const char* table = librdf_storage_postgresql_copy_tables[i].table;
+
+      sprintf(query, "CREATE TEMPORARY TABLE IF NOT EXISTS librdf_copy_%s (LIKE %s)",
+              table, table);
+    }
+    if(librdf_storage_postgresql_exec(storage, loader->handle, query,
+                                      PGRES_COMMAND_OK)) {
+      librdf_storage_postgresql_free_copy_loader(storage, loader);
+      return NULL;
+    }
+  }
+
+  if(librdf_storage_postgresql_copy_loader_reset(storage, loader)) {
+    librdf_storage_postgresql_free_copy_loader(storage, loader);
+    return NULL;
+  }
+
+  return loader;
+}
+
+
+/*
+ * librdf_storage_postgresql_copy_append_field:
+ * @sb: row buffer
+ * @string: value
+ * @length: length of value
+ *
+ * INTERNAL - Append a value escaped for COPY text format
+ */
+static void
+librdf_storage_postgresql_copy_append_field(raptor_stringbuffer* sb,
+                                            const unsigned char* string,
+                                            size_t length)
+{
+  size_t i;
+  size_t start = 0;
+
+  for(i = 0; i < length; i++) {
+    const char *escape;
+
+    switch(string[i]) {
+      case '\\': escape = "\\\\"; break;
+      case '\t': escape = "\\t"; break;
+      case '\n': escape = "\\n"; break;
+      case '\r': escape = "\\r"; break;
+      default:
+        continue;
+    }
+    if(i > start)
+      raptor_stringbuffer_append_counted_string(sb, string + start,
+                                                i - start, 1);
+    raptor_stringbuffer_append_counted_string(sb,
+                                    (const unsigned char*)escape, 2, 1);
+    start = i + 1;
+  }
+  if(length > start)
+    raptor_stringbuffer_append_counted_string(sb, string + start,
+                                              length - start, 1);
+}
+
+
+/*
+ * librdf_storage_postgresql_copy_append_row:
+ * @loader: COPY loader
+ * @table: table buffer index
+ * @uints: integer columns
+ * @uints_count: number of integer columns
+ * @strings: string columns following the integer ones
+ * @strings_len: lengths of string columns
+ * @strings_count: number of string columns
+ *
+ * INTERNAL - Append a row in COPY text format to a table buffer
+ */
+static void
+librdf_storage_postgresql_copy_append_row(librdf_storage_postgresql_copy_loader* loader,
+                                          int table,
+                                          u64* uints, int uints_count,
+                                          const unsigned char** strings,
+                                          size_t* strings_len,
+                                          int strings_count)
+{
+  raptor_stringbuffer* sb = loader->buffers[table];
+  char uint64_buffer[64];
+  int i;
+
+  for(i = 0; i < uints_count + strings_count; i++) {
+    if(i > 0)
+      raptor_stringbuffer_append_counted_string(sb,
+                                    (const unsigned char*)"\t", 1, 1);
+    if(i < uints_count) {
+      sprintf(uint64_buffer, UINT64_T_FMT, uints[i]);
+      raptor_stringbuffer_append_string(sb,
+                                    (const unsigned char*)uint64_buffer, 1);
+    } else
+      librdf_storage_postgresql_copy_append_field(sb,
+                                    strings[i - uints_count],
+                                    strings_len[i - uints_count]);
+  }
+  raptor_stringbuffer_append_counted_string(sb,
+                                    (const unsigned char*)"\n", 1, 1);
+
+  loader->rows[table]++;
+}
+
+
+/*
+ * librdf_storage_postgresql_copy_in:
+ * @storage: the storage
+ * @loader: COPY loader
+ * @query: COPY ... FROM STDIN query
+ * @sb: rows in COPY text format
+ *
+ * INTERNAL - Stream a buffer of rows with the COPY protocol
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_copy_in(librdf_storage* storage,
+                                  librdf_storage_postgresql_copy_loader* loader,
+                                  const char* query, raptor_stringbuffer* sb)
+{
+  PGconn* handle = loader->handle;
+  PGresult *res;
+  const char* data;
+  size_t length;
+  int status = 0;
+
+  res = PQexec(handle, query);
+  if(!res || PQresultStatus(res) != PGRES_COPY_IN) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql query %s failed: %s", query,
+               res ? PQresultErrorMessage(res) : PQerrorMessage(handle));
+    if(res)
+      PQclear(res);
+    return 1;
+  }
+  PQclear(res);
+
+  data = (const char*)raptor_stringbuffer_as_string(sb);
+  length = raptor_stringbuffer_length(sb);
+  while(length) {
+    int chunk = (length > LIBRDF_STORAGE_POSTGRESQL_COPY_CHUNK) ?
+      LIBRDF_STORAGE_POSTGRESQL_COPY_CHUNK : LIBRDF_GOOD_CAST(int, length);
+
+    if(PQputCopyData(handle, data, chunk) != 1) {
+      status = 1;
+      break;
+    }
+    data += chunk;
+    length -= LIBRDF_GOOD_CAST(size_t, chunk);
+  }
+
+  if(PQputCopyEnd(handle, status ? "librdf COPY aborted" : NULL) != 1)
+    status = 1;
+
+  /* Collect the COPY command result */
+  while((res = PQgetResult(handle))) {
+    if(PQresultStatus(res) != PGRES_COMMAND_OK) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql query %s failed: %s", query,
+                 PQresultErrorMessage(res));
+      status = 1;
+    }
+    PQclear(res);
+  }
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_copy_flush:
+ * @storage: the storage
+ * @loader: COPY loader
+ *
+ * INTERNAL - Send all buffered rows to the database
+ *
+ * Nodes and statements are copied into the staging tables and only
+ * the ones not already stored are moved into the node tables and the
+ * model's statements table, each statement once.  The batch is done
+ * in one transaction unless a user transaction is active.
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_copy_flush(librdf_storage* storage,
+                                     librdf_storage_postgresql_copy_loader* loader)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  char query[512];
+  int own_transaction;
+  int status = 0;
+  int i;
+
+  own_transaction = !context->transaction_handle;
+  if(own_transaction &&
+     librdf_storage_postgresql_exec(storage, loader->handle,
+                                    "START TRANSACTION", PGRES_COMMAND_OK))
+    return 1;
+
+  for(i = 0; !status && i < LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS; i++) {
+    const char* table = librdf_storage_postgresql_copy_tables[i].table;
+    const char* columns = librdf_storage_postgresql_copy_tables[i].columns;
+
+    if(!loader->rows[i])
+      continue;
+
+    sprintf(query, "COPY librdf_copy_%s (%s) FROM STDIN", table, columns);
+    status = librdf_storage_postgresql_copy_in(storage, loader, query,
+                                               loader->buffers[i]);
+    if(status)
+      break;
+
+    sprintf(query, "INSERT INTO %s (%s) SELECT %s FROM librdf_copy_%s c WHERE NOT EXISTS (SELECT 1 FROM %s t WHERE t.ID = c.ID)",
+            table, columns, columns, table, table);
+    status = librdf_storage_postgresql_exec(storage, loader->handle, query,
+                                            PGRES_COMMAND_OK);
+    if(status)
+      break;
+
+    sprintf(query, "TRUNCATE librdf_copy_%s", table);
+    status = librdf_storage_postgresql_exec(storage, loader->handle, query,
+                                            PGRES_COMMAND_OK);
+  }
+
+  if(!status && loader->rows[LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS]) {
+    status = librdf_storage_postgresql_copy_in(storage, loader,
+                  "COPY librdf_copy_Statements (Subject, Predicate, Object, Context) FROM STDIN",
+                  loader->buffers[LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS]);
+
+    if(!status) {
+      sprintf(query, "INSERT INTO Statements" UINT64_T_FMT " (Subject, Predicate, Object, Context) SELECT DISTINCT Subject, Predicate, Object, Context FROM librdf_copy_Statements c WHERE NOT EXISTS (SELECT 1 FROM Statements" UINT64_T_FMT " t WHERE t.Subject = c.Subject AND t.Predicate = c.Predicate AND t.Object = c.Object AND t.Context = c.Context)",
+              context->model, context->model);
+      status = librdf_storage_postgresql_exec(storage, loader->handle, query,
+                                              PGRES_COMMAND_OK);
+    }
+
+    if(!status)
+      status = librdf_storage_postgresql_exec(storage, loader->handle,
+                                              "TRUNCATE librdf_copy_Statements",
+                                              PGRES_COMMAND_OK);
+  }
+
+  if(own_transaction) {
+    if(status)
+      librdf_storage_postgresql_exec(storage, loader->handle,
+                                     "ROLLBACK TRANSACTION", PGRES_COMMAND_OK);
+    else
+      status = librdf_storage_postgresql_exec(storage, loader->handle,
+                                              "COMMIT TRANSACTION",
+                                              PGRES_COMMAND_OK);
+  }
+
+  if(status)
+    return status;
+
+  return librdf_storage_postgresql_copy_loader_reset(storage, loader);
+}
+
+
+/*
+ * librdf_storage_postgresql_copy_add_node:
+ * @storage: the storage
+ * @loader: COPY loader
+ * @node: node
+ *
+ * INTERNAL - Buffer a node unless already buffered in this batch
+ *
+ * Return value: node hash or 0 on failure.
+ */
+static u64
+librdf_storage_postgresql_copy_add_node(librdf_storage* storage,
+                                        librdf_storage_postgresql_copy_loader* loader,
+                                        librdf_node* node)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  u64 hash;
+  librdf_hash_datum hd_key, hd_value; /* on stack - not allocated */
+  const unsigned char* strings[3];
+  size_t strings_len[3];
+  int strings_count;
+  int table;
+  librdf_uri* dt;
+
+  hash = librdf_sql_node_id_for_node(context->node_id, node);
+  if(!hash)
+    return 0;
+
+  hd_key.data = &hash;
+  hd_key.size = sizeof(u64);
+  if(librdf_hash_exists(loader->seen_nodes, &hd_key, NULL) > 0)
+    return hash;
+
+  switch(librdf_node_get_type(node)) {
+    case LIBRDF_NODE_TYPE_RESOURCE:
+      table = 0;
+      strings[0] = librdf_uri_as_counted_string(librdf_node_get_uri(node),
+                                                &strings_len[0]);
+      strings_count = 1;
+      break;
+
+    case LIBRDF_NODE_TYPE_BLANK:
+      table = 1;
+      strings[0] = librdf_node_get_counted_blank_identifier(node,
+                                                            &strings_len[0]);
+      strings_count = 1;
+      break;
+
+    case LIBRDF_NODE_TYPE_LITERAL:
+      table = 2;
+      strings[0] = librdf_node_get_literal_value_as_counted_string(node,
+                                                            &strings_len[0]);
+      strings[1] = (const unsigned char*)librdf_node_get_literal_value_language(node);
+      if(!strings[1])
+        strings[1] = (const unsigned char*)"";
+      strings_len[1] = strlen((const char*)strings[1]);
+      dt = librdf_node_get_literal_value_datatype_uri(node);
+      if(dt)
+        strings[2] = librdf_uri_as_counted_string(dt, &strings_len[2]);
+      else {
+        strings[2] = (const unsigned char*)"";
+        strings_len[2] = 0;
+      }
+      strings_count = 3;
+      break;
+
+    case LIBRDF_NODE_TYPE_UNKNOWN:
+    default:
+      return 0;
+  }
+
+  librdf_storage_postgresql_copy_append_row(loader, table, &hash, 1,
+                                            strings, strings_len,
+                                            strings_count);
+
+  hd_value.data = (void*)"1";
+  hd_value.size = 2;
+  if(librdf_hash_put(loader->seen_nodes, &hd_key, &hd_value))
+    return 0;
+
+  return hash;
+}
+
+
+/*
+ * librdf_storage_postgresql_copy_load:
+ * @storage: the storage
+ * @ctxt: u64 context hash
+ * @statement_stream: the stream of statements
+ *
+ * INTERNAL - Load a stream of statements in batches using COPY
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_copy_load(librdf_storage* storage, u64 ctxt,
+                                    librdf_stream* statement_stream)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  librdf_storage_postgresql_copy_loader* loader;
+  int status = 0;
+
+  loader = librdf_storage_postgresql_new_copy_loader(storage);
+  if(!loader)
+    return 1;
+
+  while(!status && !librdf_stream_end(statement_stream)) {
+    librdf_statement* statement = librdf_stream_get_object(statement_stream);
+    u64 uints[4];
+    int i;
+
+    uints[0] = librdf_storage_postgresql_copy_add_node(storage, loader,
+                                  librdf_statement_get_subject(statement));
+    uints[1] = librdf_storage_postgresql_copy_add_node(storage, loader,
+                                  librdf_statement_get_predicate(statement));
+    uints[2] = librdf_storage_postgresql_copy_add_node(storage, loader,
+                                  librdf_statement_get_object(statement));
+    uints[3] = ctxt;
+    if(!uints[0] || !uints[1] || !uints[2]) {
+      status = 1;
+      break;
+    }
+
+    librdf_storage_postgresql_copy_append_row(loader,
+                                  LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS,
+                                  uints, 4, NULL, NULL, 0);
+
+    for(i = 0; i <= LIBRDF_STORAGE_POSTGRESQL_COPY_STATEMENTS; i++) {
+      if(loader->rows[i] >= context->bulk_batch_size) {
+        status = librdf_storage_postgresql_copy_flush(storage, loader);
+        break;
+      }
+    }
+
+    librdf_stream_next(statement_stream);
+  }
+
+  if(!status)
+    status = librdf_storage_postgresql_copy_flush(storage, loader);
+
+  librdf_storage_postgresql_free_copy_loader(storage, loader);
+
+  return status;
+}
+
+
+#ifdef LIBPQ_HAS_PIPELINING
+/*
+ * librdf_storage_postgresql_pipeline_wait:
+ * @handle: non-blocking postgresql connection
+ * @write: non-0 to also wait until more can be sent
+ *
+ * INTERNAL - Wait until results can be read or, if @write, sent
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_pipeline_wait(PGconn *handle, int write)
+{
+  int fd = PQsocket(handle);
+  fd_set read_fds;
+  fd_set write_fds;
+
+  if(fd < 0)
+    return 1;
+
+  FD_ZERO(&read_fds);
+  FD_ZERO(&write_fds);
+  FD_SET(fd, &read_fds);
+  if(write)
+    FD_SET(fd, &write_fds);
+
+  if(select(fd + 1, &read_fds, &write_fds, NULL, NULL) < 0 && errno != EINTR)
+    return 1;
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_postgresql_pipeline_collect:
+ * @storage: the storage
+ * @handle: non-blocking postgresql connection in pipeline mode
+ * @pending: number of queued queries and syncs with results not yet read
+ * @wait: non-0 to wait until all are sent and their results read
+ *
+ * INTERNAL - Send queued queries and read the results that have arrived
+ *
+ * Sending and reading are interleaved so that neither side blocks
+ * writing while the other is not reading, however many queries are
+ * queued.  Each query's results end with a NULL result and each sync
+ * with a PGRES_PIPELINE_SYNC one.
+ *
+ * Return value: <0 if the connection failed, >0 if a query failed, 0 otherwise
+ */
+static int
+librdf_storage_postgresql_pipeline_collect(librdf_storage* storage,
+                                           PGconn *handle, int *pending,
+                                           int wait)
+{
+  int status = 0;
+
+  while(1) {
+    int unsent = PQflush(handle);
+
+    if(unsent < 0 || !PQconsumeInput(handle)) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql pipeline failed: %s", PQerrorMessage(handle));
+      return -1;
+    }
+
+    while(*pending && !PQisBusy(handle)) {
+      PGresult *res = PQgetResult(handle);
+      ExecStatusType res_status;
+
+      if(!res) {
+        /* End of one query's results */
+        (*pending)--;
+        continue;
+      }
+
+      res_status = PQresultStatus(res);
+      if(res_status == PGRES_PIPELINE_SYNC)
+        (*pending)--;
+      else if(res_status == PGRES_FATAL_ERROR) {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "postgresql pipelined insert failed: %s",
+                   PQresultErrorMessage(res));
+        status = 1;
+      } else if(res_status == PGRES_PIPELINE_ABORTED)
+        status = 1;
+
+      PQclear(res);
+    }
+
+    if(!wait || (!*pending && !unsent))
+      break;
+
+    if(librdf_storage_postgresql_pipeline_wait(handle, unsent)) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql pipeline wait failed");
+      return -1;
+    }
+  }
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_pipeline_add_statements:
+ * @storage: the storage
+ * @ctxt: u64 context hash
+ * @statement_stream: the stream of statements
+ *
+ * INTERNAL - Add a stream of statements using pipeline mode
+ *
+ * Node and statement inserts are queued on a non-blocking connection
+ * with a sync every LIBRDF_STORAGE_POSTGRESQL_PIPELINE_SIZE
+ * statements, so each batch runs as one transaction (or inside the
+ * user transaction, if any).  Queries are sent and results read as
+ * statements are queued rather than waiting for each batch.
+ * Duplicate statements are skipped by the server.
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_pipeline_add_statements(librdf_storage* storage,
+                                                  u64 ctxt,
+                                                  librdf_stream* statement_stream)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  PGconn *handle;
+  int queued = 0;
+  int pending = 0;
+  int status = 0;
+  int rc = 0;
+
+  handle = librdf_storage_postgresql_get_handle(storage);
+  if(!handle)
+    return 1;
+
+  /* Prepared queries cannot be created once in pipeline mode */
+  if(librdf_storage_postgresql_prepare_handle(storage, handle) ||
+     PQsetnonblocking(handle, 1) ||
+     PQenterPipelineMode(handle) != 1) {
+    PQsetnonblocking(handle, 0);
+    librdf_storage_postgresql_release_handle(storage, handle);
+    return 1;
+  }
+
+  while(!status && !librdf_stream_end(statement_stream)) {
+    librdf_statement* statement = librdf_stream_get_object(statement_stream);
+    librdf_node* nodes[3];
+    u64 uints[3];
+    char ids[4][21];
+    const char* values[4];
+    int i;
+
+    nodes[0] = librdf_statement_get_subject(statement);
+    nodes[1] = librdf_statement_get_predicate(statement);
+    nodes[2] = librdf_statement_get_object(statement);
+    for(i = 0; !status && i < 3; i++) {
+      uints[i] = librdf_sql_node_id_for_node(context->node_id, nodes[i]);
+      if(!uints[i] ||
+         librdf_storage_postgresql_add_node(storage, handle, nodes[i],
+                                            uints[i], 1))
+        status = 1;
+      else
+        pending++;
+    }
+    if(status)
+      break;
+
+    librdf_storage_postgresql_statement_params(ids, values, uints[0],
+                                               uints[1], uints[2], ctxt);
+    if(PQsendQueryPrepared(handle,
+                           librdf_storage_postgresql_prepared_queries[LIBRDF_STORAGE_POSTGRESQL_ADD_NEW_STATEMENT].name,
+                           4, values, NULL, NULL, 0) != 1) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql insert into Statements failed: %s",
+                 PQerrorMessage(handle));
+      status = 1;
+      break;
+    }
+    pending++;
+
+    if(++queued == LIBRDF_STORAGE_POSTGRESQL_PIPELINE_SIZE) {
+      if(PQpipelineSync(handle) != 1) {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE,
+                   NULL, "postgresql pipeline sync failed: %s",
+                   PQerrorMessage(handle));
+        status = 1;
+        break;
+      }
+      pending++;
+      queued = 0;
+    }
+
+    rc = librdf_storage_postgresql_pipeline_collect(storage, handle,
+                                                    &pending, 0);
+    if(rc)
+      status = 1;
+
+    librdf_stream_next(statement_stream);
+  }
+
+  /* Always sync and drain anything queued, also after a failure */
+  if(rc >= 0) {
+    if(queued || status) {
+      if(PQpipelineSync(handle) == 1)
+        pending++;
+      else {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE,
+                   NULL, "postgresql pipeline sync failed: %s",
+                   PQerrorMessage(handle));
+        status = 1;
+      }
+    }
+    if(librdf_storage_postgresql_pipeline_collect(storage, handle,
+                                                  &pending, 1))
+      status = 1;
+  }
+
+  PQexitPipelineMode(handle);
+  PQsetnonblocking(handle, 0);
+  librdf_storage_postgresql_release_handle(storage, handle);
+
+  return status;
+}
+#endif
+
+
+/*
+ * librdf_storage_postgresql_context_add_statements:
+ * @storage: the storage
+ * @context_node: #librdf_node object
+ * @statement_stream: the stream of statements
+ *
+ * INTERNAL - Add statements in stream to storage, with context.
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_postgresql_context_add_statements(librdf_storage* storage,
+                                            librdf_node* context_node,
+                                            librdf_stream* statement_stream)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  u64 ctxt=0;
+#ifndef LIBPQ_HAS_PIPELINING
+  int helper=0;
+#endif
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement_stream, librdf_stream, 1);
+
+  /* Optimize for bulk loads? */
+  if(context->bulk) {
+    if(librdf_storage_postgresql_start_bulk(storage))
+      return 1;
+  }
+
+  /* Find hash for context, creating if necessary */
+  if(context_node) {
+    ctxt=librdf_storage_postgresql_node_hash(storage,context_node,1);
+    if(!ctxt)
+      return 1;
+  }
+
+  if(context->bulk)
+    return librdf_storage_postgresql_copy_load(storage, ctxt,
+                                               statement_stream);
+
+#ifdef LIBPQ_HAS_PIPELINING
+  return librdf_storage_postgresql_pipeline_add_statements(storage, ctxt,
+                                                           statement_stream);
+#else
+  while(!helper && !librdf_stream_end(statement_stream)) {
+    librdf_statement* statement=librdf_stream_get_object(statement_stream);
+    if(!context->bulk) {
+      /* Do not add duplicate statements
+       * but do not check for this when in bulk mode.
+       */
+      if(librdf_storage_postgresql_contains_statement(storage, statement)) {
+        librdf_stream_next(statement_stream);
+        continue;
+      }
+    }
+
+    helper=librdf_storage_postgresql_context_add_statement_helper(storage, ctxt,
+                                                             statement);
+    librdf_stream_next(statement_stream);
+  }
+
+  return helper;
+#endif
+}
+
+
+/*
+ * librdf_storage_postgresql_context_add_statement:
+ * @storage: #librdf_storage object
+ * @context_node: #librdf_node object
+ * @statement: #librdf_statement statement to add
+ *
+ * INTERNAL - Add a statement to a storage context
+ *
+ * Return value: non 0 on failure
+ **/
+static int
 librdf_storage_postgresql_context_add_statement(librdf_storage* storage,
                                           librdf_node* context_node,
                                           librdf_statement* statement)
@@ -1372,8 +2273,6 @@ static int
 librdf_storage_postgresql_context_add_statement_helper(librdf_storage* storage,
                                           u64 ctxt, librdf_statement* statement)
 {
-  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
-  char insert_statement[]="INSERT INTO Statements" UINT64_T_FMT " (Subject,Predicate,Object,Context) VALUES (" UINT64_T_FMT "," UINT64_T_FMT "," UINT64_T_FMT "," UINT64_T_FMT ")";
   u64 subject, predicate, object;
   PGconn *handle;
   int status = 1;
@@ -1392,27 +2291,27 @@ librdf_storage_postgresql_context_add_statement_helper(librdf_storage* storage,
     object=librdf_storage_postgresql_node_hash(storage,
                                           librdf_statement_get_object(statement),1);
     if(subject && predicate && object) {
-      char *query;
+      char ids[4][21];
+      const char* values[4];
       PGresult *res;
 
-      query = LIBRDF_MALLOC(char*, strlen(insert_statement) + (20 * 5) + 1);
-      if(query) {
-        sprintf(query, insert_statement, context->model, subject, predicate, object, ctxt);
-        if((res=PQexec(handle, query))) {
-          if(PQresultStatus(res) == PGRES_COMMAND_OK) {
-            status = 0;
-          } else {
-            librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                       "postgresql insert into Statements failed: %s",
-                       PQresultErrorMessage(res));
-          }
-          PQclear(res);
+      librdf_storage_postgresql_statement_params(ids, values, subject,
+                                                 predicate, object, ctxt);
+      if((res=librdf_storage_postgresql_exec_prepared(storage, handle,
+                                    LIBRDF_STORAGE_POSTGRESQL_ADD_STATEMENT,
+                                    values))) {
+        if(PQresultStatus(res) == PGRES_COMMAND_OK) {
+          status = 0;
         } else {
           librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
                      "postgresql insert into Statements failed: %s",
-                     PQerrorMessage(handle));
+                     PQresultErrorMessage(res));
         }
-        LIBRDF_FREE(char*, query);
+        PQclear(res);
+      } else {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "postgresql insert into Statements failed: %s",
+                   PQerrorMessage(handle));
       }
     }
     librdf_storage_postgresql_release_handle(storage, handle);
@@ -1435,8 +2334,6 @@ static int
 librdf_storage_postgresql_contains_statement(librdf_storage* storage,
                                              librdf_statement* statement)
 {
-  librdf_storage_postgresql_instance* context = (librdf_storage_postgresql_instance*)storage->instance;
-  char find_statement[]="SELECT 1 FROM Statements" UINT64_T_FMT " WHERE Subject=" UINT64_T_FMT " AND Predicate=" UINT64_T_FMT " AND Object=" UINT64_T_FMT " limit 1";
   u64 subject, predicate, object;
   PGconn *handle;
   int status = 0;
@@ -1456,26 +2353,25 @@ librdf_storage_postgresql_contains_statement(librdf_storage* storage,
                                           librdf_statement_get_object(statement),0);
 
     if(subject && predicate && object) {
-      char *query;
-      size_t len = strlen(find_statement)+(20*4)+1;
-      query = LIBRDF_MALLOC(char*, len);
-      if(query) {
-        PGresult *res;
-        snprintf(query, len, find_statement, context->model,
-                 subject, predicate, object);
-        if((res=PQexec(handle, query))) {
-          if(PQresultStatus(res) == PGRES_TUPLES_OK) {
-            if(PQntuples(res)) {
-              status = 1;
-            }
-          } else {
-            librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                       "postgresql insert into Statements failed: %s",
-                       PQresultErrorMessage(res));
+      char ids[4][21];
+      const char* values[4];
+      PGresult *res;
+
+      librdf_storage_postgresql_statement_params(ids, values, subject,
+                                                 predicate, object, 0);
+      if((res=librdf_storage_postgresql_exec_prepared(storage, handle,
+                                    LIBRDF_STORAGE_POSTGRESQL_CONTAINS_STATEMENT,
+                                    values))) {
+        if(PQresultStatus(res) == PGRES_TUPLES_OK) {
+          if(PQntuples(res)) {
+            status = 1;
           }
-          PQclear(res);
+        } else {
+          librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                     "postgresql select from Statements failed: %s",
+                     PQresultErrorMessage(res));
         }
-        LIBRDF_FREE(char*, query);
+        PQclear(res);
       }
     }
     librdf_storage_postgresql_release_handle(storage, handle);
@@ -1516,9 +2412,6 @@ librdf_storage_postgresql_context_remove_statement(librdf_storage* storage,
                                              librdf_node* context_node,
                                              librdf_statement* statement)
 {
-  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
-  char delete_statement[]="DELETE FROM Statements" UINT64_T_FMT " WHERE Subject=" UINT64_T_FMT " AND Predicate=" UINT64_T_FMT " AND Object=" UINT64_T_FMT;
-  char delete_statement_with_context[]="DELETE FROM Statements" UINT64_T_FMT " WHERE Subject=" UINT64_T_FMT " AND Predicate=" UINT64_T_FMT " AND Object=" UINT64_T_FMT " AND Context=" UINT64_T_FMT;
   u64 subject, predicate, object, ctxt=0;
   PGconn *handle=NULL;
   int status = 1;
@@ -1536,40 +2429,32 @@ librdf_storage_postgresql_context_remove_statement(librdf_storage* storage,
     object=librdf_storage_postgresql_node_hash(storage,
                                           librdf_statement_get_object(statement),0);
 
-    if (subject && predicate && object) {
-      char *query=NULL;
-      if(context_node) {
-        ctxt=librdf_storage_postgresql_node_hash(storage,context_node,0);
-        if(ctxt) {
-          query = LIBRDF_MALLOC(char*,
-                                strlen(delete_statement_with_context) + (20 * 5) + 1);
-  if(query) {
-            sprintf(query, delete_statement_with_context, context->model, subject, predicate, object, ctxt);
-          }
-        }
-      } else {
-        query = LIBRDF_MALLOC(char*, strlen(delete_statement) + (20 * 4) + 1);
-        if(query) {
-          sprintf(query, delete_statement, context->model, subject, predicate, object);
-        }
-      }
-      if(query) {
-        PGresult *res=NULL;
-        if((res=PQexec(handle, query))) {
-          if(PQresultStatus(res) == PGRES_COMMAND_OK) {
-            status = 0;
-          } else {
-            librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                       "postgresql delete from Statements failed: %s",
-                       PQresultErrorMessage(res));
-          }
-          PQclear(res);
+    if(context_node)
+      ctxt=librdf_storage_postgresql_node_hash(storage,context_node,0);
+
+    if (subject && predicate && object && (ctxt || !context_node)) {
+      char ids[4][21];
+      const char* values[4];
+      PGresult *res=NULL;
+
+      librdf_storage_postgresql_statement_params(ids, values, subject,
+                                                 predicate, object, ctxt);
+      if((res=librdf_storage_postgresql_exec_prepared(storage, handle,
+                                    context_node ?
+                                    LIBRDF_STORAGE_POSTGRESQL_DELETE_STATEMENT_WITH_CONTEXT :
+                                    LIBRDF_STORAGE_POSTGRESQL_DELETE_STATEMENT,
+                                    values))) {
+        if(PQresultStatus(res) == PGRES_COMMAND_OK) {
+          status = 0;
         } else {
           librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                   "postgresql delete from Statements failed");
+                     "postgresql delete from Statements failed: %s",
+                     PQresultErrorMessage(res));
         }
-
-        LIBRDF_FREE(char*, query);
+        PQclear(res);
+      } else {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "postgresql delete from Statements failed");
       }
     }
 
@@ -1746,6 +2631,7 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
   char where[256];
   char joins[640];
   librdf_stream *stream;
+  long limit=-1;
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
 
@@ -1764,9 +2650,14 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
   sos->current_statement=NULL;
   sos->current_context=NULL;
   sos->results=NULL;
+  sos->fetch_size=context->fetch_size;
 
   if(options) {
     sos->is_literal_match=librdf_hash_get_as_boolean(options, "match-substring");
+    /* the caller reads no more than this many statements */
+    limit=librdf_hash_get_as_long(options, "limit");
+    if(limit > 0 && limit < sos->fetch_size)
+      sos->fetch_size=(int)limit;
   }
 
   /* Get postgresql connection handle */
@@ -1934,27 +2825,28 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
     return NULL;
   }
 
-
-  /* Start query... */
-  sos->results=PQexec(sos->handle, query);
-  LIBRDF_FREE(char*, query);
-  if (sos->results) {
-    if (PQresultStatus(sos->results) != PGRES_TUPLES_OK) {
-      librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                 "postgresql query failed: %s",
-                 PQresultErrorMessage(sos->results));
+  if(limit > 0) {
+    sprintf(tmp, " LIMIT %ld", limit);
+    if(librdf_storage_postgresql_find_statements_in_context_augment_query(&query, tmp)) {
       librdf_storage_postgresql_find_statements_in_context_finished((void*)sos);
       return NULL;
     }
-  } else {
-    librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-               "postgresql query failed: %s",
-               PQerrorMessage(sos->handle));
+  }
+
+
+  /* Start query... */
+  if(librdf_storage_postgresql_find_statements_in_context_declare(sos, query)) {
+    LIBRDF_FREE(char*, query);
+    librdf_storage_postgresql_find_statements_in_context_finished((void*)sos);
+    return NULL;
+  }
+  LIBRDF_FREE(char*, query);
+
+  if(librdf_storage_postgresql_find_statements_in_context_fetch(sos)) {
     librdf_storage_postgresql_find_statements_in_context_finished((void*)sos);
     return NULL;
   }
 
-  sos->current_rowno=0;
   sos->row = LIBRDF_CALLOC(char**, LIBRDF_GOOD_CAST(size_t, PQnfields(sos->results) + 1), sizeof(char*));
   if(!sos->row) {
     librdf_storage_postgresql_find_statements_in_context_finished((void*)sos);
@@ -2002,6 +2894,93 @@ librdf_storage_postgresql_find_statements_in_context_augment_query(char **query,
 }
 
 
+/*
+ * librdf_storage_postgresql_find_statements_in_context_declare:
+ * @sos: stream context
+ * @query: SELECT query
+ *
+ * INTERNAL - Open a server-side cursor for a find statements query
+ *
+ * Cursors only live inside a transaction; one is started unless the
+ * stream is using the connection of a user transaction.
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_find_statements_in_context_declare(librdf_storage_postgresql_sos_context* sos,
+                                                            const char *query)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)sos->storage->instance;
+  char *declare;
+  int status;
+
+  if(sos->handle != context->transaction_handle) {
+    if(librdf_storage_postgresql_exec(sos->storage, sos->handle,
+                                      "START TRANSACTION", PGRES_COMMAND_OK))
+      return 1;
+    sos->own_transaction=1;
+  }
+
+  sprintf(sos->cursor, "librdf_cursor_%d", context->cursor_count++);
+
+  declare = LIBRDF_MALLOC(char*, strlen(sos->cursor) + strlen(query) + 32);
+  if(!declare)
+    return 1;
+  sprintf(declare, "DECLARE %s NO SCROLL CURSOR FOR %s", sos->cursor, query);
+
+#ifdef LIBRDF_DEBUG_SQL
+  LIBRDF_DEBUG2("SQL: >>%s<<\n", declare);
+#endif
+
+  status = librdf_storage_postgresql_exec(sos->storage, sos->handle, declare,
+                                          PGRES_COMMAND_OK);
+  LIBRDF_FREE(char*, declare);
+  if(!status)
+    sos->cursor_open=1;
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_find_statements_in_context_fetch:
+ * @sos: stream context
+ *
+ * INTERNAL - Fetch the next batch of rows from the cursor
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_find_statements_in_context_fetch(librdf_storage_postgresql_sos_context* sos)
+{
+  char query[64];
+
+  if(sos->results)
+    PQclear(sos->results);
+
+  sprintf(query, "FETCH %d FROM %s", sos->fetch_size, sos->cursor);
+  sos->results=PQexec(sos->handle, query);
+  if (sos->results) {
+    if (PQresultStatus(sos->results) != PGRES_TUPLES_OK) {
+      librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql query failed: %s",
+                 PQresultErrorMessage(sos->results));
+      return 1;
+    }
+  } else {
+    librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql query failed: %s",
+               PQerrorMessage(sos->handle));
+    return 1;
+  }
+
+  sos->current_rowno=0;
+  sos->more_results=(PQntuples(sos->results) == sos->fetch_size);
+
+  return 0;
+}
+
+
 static int
 librdf_storage_postgresql_find_statements_in_context_end_of_stream(void* context)
 {
@@ -2024,6 +3003,11 @@ librdf_storage_postgresql_find_statements_in_context_next_statement(void* contex
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(context, void, 1);
 
+  if(sos->current_rowno >= PQntuples(sos->results) && sos->more_results) {
+    if(librdf_storage_postgresql_find_statements_in_context_fetch(sos))
+      return 1;
+  }
+
   if( sos->current_rowno < PQntuples(sos->results) ) {
      for(i=0;i<PQnfields(sos->results);i++) {
        if(PQgetlength(sos->results,sos->current_rowno,i) > 0 ) {
@@ -2216,8 +3200,20 @@ librdf_storage_postgresql_find_statements_in_context_finished(void* context)
   if(sos->results)
     PQclear(sos->results);
 
-  if(sos->handle)
+  if(sos->handle) {
+    char query[64];
+
+    if(sos->cursor_open) {
+      sprintf(query, "CLOSE %s", sos->cursor);
+      librdf_storage_postgresql_exec(sos->storage, sos->handle, query,
+                                     PGRES_COMMAND_OK);
+    }
+    if(sos->own_transaction)
+      librdf_storage_postgresql_exec(sos->storage, sos->handle,
+                                     "COMMIT TRANSACTION", PGRES_COMMAND_OK);
+
     librdf_storage_postgresql_release_handle(sos->storage, sos->handle);
+  }
 
   if(sos->current_statement)
     librdf_free_statement(sos->current_statement);
@@ -32,6 +32,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 /* for access() and R_OK */
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
@@ -230,3 +231,489 @@ librdf_free_sql_config(librdf_sql_config* config)
 
   LIBRDF_FREE(char*, config);
 }
+
+
+/* Default number of node IDs remembered by a librdf_sql_node_id */
+#define LIBRDF_SQL_NODE_ID_CACHE_SIZE 10000
+
+typedef struct librdf_sql_node_id_entry_s librdf_sql_node_id_entry;
+
+struct librdf_sql_node_id_entry_s
+{
+  /* next entry in the same bucket */
+  librdf_sql_node_id_entry* bucket_next;
+
+  /* most recently used first */
+  librdf_sql_node_id_entry* lru_prev;
+  librdf_sql_node_id_entry* lru_next;
+
+  u64 id;
+  char type;
+  size_t length;
+  /* string of @length bytes follows the entry */
+};
+
+struct librdf_sql_node_id_s
+{
+  librdf_world* world;
+
+  librdf_sql_node_id_type type;
+
+  /* digest object for MD5 node IDs */
+  librdf_digest* digest;
+
+  /* LRU cache of node string to ID; only used for MD5 IDs */
+  librdf_sql_node_id_entry** buckets;
+  size_t buckets_mask;
+  librdf_sql_node_id_entry* lru_head;
+  librdf_sql_node_id_entry* lru_tail;
+  int cache_count;
+  int cache_size;
+
+  /* buffer for building node strings */
+  unsigned char* buffer;
+  size_t buffer_size;
+};
+
+
+/*
+ * librdf_sql_murmur64 - 64-bit MurmurHash64A
+ * @data: bytes to hash
+ * @length: number of bytes
+ * @seed: hash seed
+ *
+ * Reads input bytes in little-endian order so the result does not
+ * depend on the host byte order.
+ *
+ * Return value: hash
+ */
+static u64
+librdf_sql_murmur64(const unsigned char* data, size_t length, u64 seed)
+{
+  const u64 m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  u64 h = seed ^ ((u64)length * m);
+  size_t i;
+
+  for(; length >= 8; data += 8, length -= 8) {
+    u64 k = 0;
+
+    for(i = 0; i < 8; i++)
+      k |= ((u64)data[i]) << (i * 8);
+
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+
+    h ^= k;
+    h *= m;
+  }
+
+  if(length) {
+    for(i = 0; i < length; i++)
+      h ^= ((u64)data[i]) << (i * 8);
+    h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+
+  return h;
+}
+
+
+/**
+ * librdf_new_sql_node_id:
+ * @world: librdf_world
+ * @name: node ID function name "md5" or "murmur64" or NULL for "md5"
+ * @cache_size: maximum number of node IDs to cache (0 for none)
+ *
+ * Constructor - Make a node ID calculator for SQL storages
+ *
+ * The "md5" function gives the same IDs as earlier Redland versions.
+ * Only MD5 IDs are cached; murmur64 IDs are cheaper to calculate
+ * than to look up.
+ *
+ * Return value: new node ID object or NULL on failure
+ **/
+librdf_sql_node_id*
+librdf_new_sql_node_id(librdf_world* world, const char* name, int cache_size)
+{
+  librdf_sql_node_id* node_id;
+
+  node_id = LIBRDF_CALLOC(librdf_sql_node_id*, 1, sizeof(*node_id));
+  if(!node_id)
+    return NULL;
+
+  node_id->world = world;
+
+  if(!name || !strcmp(name, "md5"))
+    node_id->type = LIBRDF_SQL_NODE_ID_MD5;
+  else if(!strcmp(name, "murmur64"))
+    node_id->type = LIBRDF_SQL_NODE_ID_MURMUR64;
+  else {
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Unknown SQL node ID function '%s'", name);
+    librdf_free_sql_node_id(node_id);
+    return NULL;
+  }
+
+  if(node_id->type == LIBRDF_SQL_NODE_ID_MD5) {
+    node_id->digest = librdf_new_digest(world, "MD5");
+    if(!node_id->digest) {
+      librdf_free_sql_node_id(node_id);
+      return NULL;
+    }
+
+    if(cache_size > 0) {
+      size_t buckets_count = 16;
+
+      while(buckets_count < (size_t)cache_size)
+        buckets_count <<= 1;
+
+      node_id->buckets = LIBRDF_CALLOC(librdf_sql_node_id_entry**,
+                                       buckets_count,
+                                       sizeof(librdf_sql_node_id_entry*));
+      if(!node_id->buckets) {
+        librdf_free_sql_node_id(node_id);
+        return NULL;
+      }
+      node_id->buckets_mask = buckets_count - 1;
+      node_id->cache_size = cache_size;
+    }
+  }
+
+  return node_id;
+}
+
+
+/**
+ * librdf_new_sql_node_id_for_storage:
+ * @storage: SQL #librdf_storage
+ * @options: storage options
+ *
+ * Constructor - Make a node ID calculator from SQL storage options
+ *
+ * Uses option node-id for the function name and node-id-cache-size
+ * for the cache size (default 10000).
+ *
+ * Return value: new node ID object or NULL on failure
+ **/
+librdf_sql_node_id*
+librdf_new_sql_node_id_for_storage(librdf_storage* storage,
+                                   librdf_hash* options)
+{
+  librdf_sql_node_id* node_id;
+  char* name;
+  long cache_size;
+
+  name = librdf_hash_get(options, "node-id");
+
+  cache_size = librdf_hash_get_as_long(options, "node-id-cache-size");
+  if(cache_size < 0 || cache_size > INT_MAX)
+    cache_size = LIBRDF_SQL_NODE_ID_CACHE_SIZE;
+
+  node_id = librdf_new_sql_node_id(storage->world, name,
+                                   LIBRDF_GOOD_CAST(int, cache_size));
+  if(name)
+    LIBRDF_FREE(char*, name);
+
+  return node_id;
+}
+
+
+/**
+ * librdf_free_sql_node_id:
+ * @node_id: SQL node ID object
+ *
+ * Destructor - free a SQL node ID object.
+ **/
+void
+librdf_free_sql_node_id(librdf_sql_node_id* node_id)
+{
+  librdf_sql_node_id_entry* entry;
+
+  for(entry = node_id->lru_head; entry; ) {
+    librdf_sql_node_id_entry* next = entry->lru_next;
+    LIBRDF_FREE(librdf_sql_node_id_entry*, entry);
+    entry = next;
+  }
+
+  if(node_id->buckets)
+    LIBRDF_FREE(librdf_sql_node_id_entry**, node_id->buckets);
+
+  if(node_id->buffer)
+    LIBRDF_FREE(char*, node_id->buffer);
+
+  if(node_id->digest)
+    librdf_free_digest(node_id->digest);
+
+  LIBRDF_FREE(librdf_sql_node_id, node_id);
+}
+
+
+/**
+ * librdf_sql_node_id_hash:
+ * @node_id: SQL node ID object
+ * @type: character type of node to hash ("R", "L" or "B") or NULL
+ * @string: a string to get hash for
+ * @length: length of string
+ *
+ * Calculate the ID of a string without using the cache.
+ *
+ * Return value: ID
+ **/
+u64
+librdf_sql_node_id_hash(librdf_sql_node_id* node_id, const char* type,
+                        const unsigned char* string, size_t length)
+{
+  u64 hash;
+  byte* digest;
+  int i;
+
+  if(node_id->type == LIBRDF_SQL_NODE_ID_MURMUR64)
+    return librdf_sql_murmur64(string, length,
+                               type ? (u64)(unsigned char)*type : 0);
+
+  /* (Re)initialize digest object */
+  librdf_digest_init(node_id->digest);
+
+  /* Update digest with data */
+  if(type)
+    librdf_digest_update(node_id->digest, (const unsigned char*)type, 1);
+  librdf_digest_update(node_id->digest, string, length);
+  librdf_digest_final(node_id->digest);
+
+  /* Copy first 8 bytes of digest into unsigned 64bit hash
+   * using a method portable across big/little endianness
+   *
+   * Fixes Issue#0000023 - http://bugs.librdf.org/mantis/view.php?id=23
+   */
+  digest = (byte*)librdf_digest_get_digest(node_id->digest);
+  hash = 0;
+  for(i = 0; i < 8; i++)
+    hash += ((u64)digest[i]) << (i * 8);
+
+  return hash;
+}
+
+
+static int
+librdf_sql_node_id_ensure_buffer(librdf_sql_node_id* node_id, size_t size)
+{
+  unsigned char* buffer;
+
+  if(size <= node_id->buffer_size)
+    return 0;
+
+  if(size < 256)
+    size = 256;
+  buffer = LIBRDF_MALLOC(unsigned char*, size);
+  if(!buffer)
+    return 1;
+
+  if(node_id->buffer)
+    LIBRDF_FREE(char*, node_id->buffer);
+  node_id->buffer = buffer;
+  node_id->buffer_size = size;
+  return 0;
+}
+
+
+static void
+librdf_sql_node_id_lru_unlink(librdf_sql_node_id* node_id,
+                              librdf_sql_node_id_entry* entry)
+{
+  if(entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    node_id->lru_head = entry->lru_next;
+
+  if(entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    node_id->lru_tail = entry->lru_prev;
+
+  entry->lru_prev = entry->lru_next = NULL;
+}
+
+
+static void
+librdf_sql_node_id_lru_push(librdf_sql_node_id* node_id,
+                            librdf_sql_node_id_entry* entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = node_id->lru_head;
+  if(node_id->lru_head)
+    node_id->lru_head->lru_prev = entry;
+  else
+    node_id->lru_tail = entry;
+  node_id->lru_head = entry;
+}
+
+
+static void
+librdf_sql_node_id_evict(librdf_sql_node_id* node_id)
+{
+  librdf_sql_node_id_entry* entry = node_id->lru_tail;
+  librdf_sql_node_id_entry** prev_p;
+  u64 key;
+
+  key = librdf_sql_murmur64((const unsigned char*)(entry + 1), entry->length,
+                            (u64)(unsigned char)entry->type);
+  prev_p = &node_id->buckets[key & node_id->buckets_mask];
+  while(*prev_p != entry)
+    prev_p = &(*prev_p)->bucket_next;
+  *prev_p = entry->bucket_next;
+
+  librdf_sql_node_id_lru_unlink(node_id, entry);
+  LIBRDF_FREE(librdf_sql_node_id_entry*, entry);
+  node_id->cache_count--;
+}
+
+
+/*
+ * librdf_sql_node_id_cached_hash - Calculate the ID of a string using the cache
+ * @node_id: SQL node ID object
+ * @type: character type of node
+ * @string: node string
+ * @length: length of string
+ *
+ * Return value: ID
+ */
+static u64
+librdf_sql_node_id_cached_hash(librdf_sql_node_id* node_id, char type,
+                               const unsigned char* string, size_t length)
+{
+  librdf_sql_node_id_entry* entry;
+  librdf_sql_node_id_entry** bucket;
+  u64 key;
+  u64 id;
+
+  if(!node_id->buckets)
+    return librdf_sql_node_id_hash(node_id, &type, string, length);
+
+  key = librdf_sql_murmur64(string, length, (u64)(unsigned char)type);
+  bucket = &node_id->buckets[key & node_id->buckets_mask];
+
+  for(entry = *bucket; entry; entry = entry->bucket_next) {
+    if(entry->type == type && entry->length == length &&
+       !memcmp(entry + 1, string, length)) {
+      if(entry != node_id->lru_head) {
+        librdf_sql_node_id_lru_unlink(node_id, entry);
+        librdf_sql_node_id_lru_push(node_id, entry);
+      }
+      return entry->id;
+    }
+  }
+
+  id = librdf_sql_node_id_hash(node_id, &type, string, length);
+
+  if(node_id->cache_count >= node_id->cache_size)
+    librdf_sql_node_id_evict(node_id);
+
+  entry = LIBRDF_MALLOC(librdf_sql_node_id_entry*, sizeof(*entry) + length);
+  if(!entry)
+    return id;
+
+  entry->id = id;
+  entry->type = type;
+  entry->length = length;
+  memcpy(entry + 1, string, length);
+
+  /* eviction may have changed the bucket chain head */
+  entry->bucket_next = *bucket;
+  *bucket = entry;
+  librdf_sql_node_id_lru_push(node_id, entry);
+  node_id->cache_count++;
+
+  return id;
+}
+
+
+/**
+ * librdf_sql_node_id_for_node:
+ * @node_id: SQL node ID object
+ * @node: node
+ *
+ * Calculate the ID of a node.
+ *
+ * Resources are hashed as "R" and the URI, blank nodes as "B" and
+ * the identifier and literals as "L" and the string
+ * value&lt;language&gt;datatype URI.
+ *
+ * Return value: ID or 0 on failure
+ **/
+u64
+librdf_sql_node_id_for_node(librdf_sql_node_id* node_id, librdf_node* node)
+{
+  const unsigned char* string;
+  size_t length;
+  char type;
+
+  switch(librdf_node_get_type(node)) {
+    case LIBRDF_NODE_TYPE_RESOURCE:
+      type = 'R';
+      string = librdf_uri_as_counted_string(librdf_node_get_uri(node),
+                                            &length);
+      break;
+
+    case LIBRDF_NODE_TYPE_BLANK:
+      type = 'B';
+      string = librdf_node_get_counted_blank_identifier(node, &length);
+      break;
+
+    case LIBRDF_NODE_TYPE_LITERAL:
+      {
+        const unsigned char* value;
+        const char* lang;
+        librdf_uri* dt;
+        const unsigned char* datatype = NULL;
+        size_t value_len, lang_len = 0, datatype_len = 0;
+        unsigned char* p;
+
+        type = 'L';
+        value = librdf_node_get_literal_value_as_counted_string(node,
+                                                                &value_len);
+        lang = librdf_node_get_literal_value_language(node);
+        if(lang)
+          lang_len = strlen(lang);
+        dt = librdf_node_get_literal_value_datatype_uri(node);
+        if(dt)
+          datatype = librdf_uri_as_counted_string(dt, &datatype_len);
+
+        /* Build composite node string value<lang>datatype */
+        length = value_len + lang_len + datatype_len + 2;
+        if(librdf_sql_node_id_ensure_buffer(node_id, length))
+          return 0;
+
+        p = node_id->buffer;
+        memcpy(p, value, value_len);
+        p += value_len;
+        *p++ = '<';
+        if(lang_len) {
+          memcpy(p, lang, lang_len);
+          p += lang_len;
+        }
+        *p++ = '>';
+        if(datatype_len)
+          memcpy(p, datatype, datatype_len);
+
+        string = node_id->buffer;
+      }
+      break;
+
+    case LIBRDF_NODE_TYPE_UNKNOWN:
+    default:
+      librdf_log(node_id->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE,
+                 NULL, "Do not know how to store node type %d",
+                 librdf_node_get_type(node));
+      return 0;
+  }
+
+  if(node_id->type == LIBRDF_SQL_NODE_ID_MD5)
+    return librdf_sql_node_id_cached_hash(node_id, type, string, length);
+
+  return librdf_sql_node_id_hash(node_id, &type, string, length);
+}
@@ -91,6 +91,62 @@ main(int argc, char *argv[])
     }
   }
 
+  for(i=0; i<2; i++) {
+    const char* name=(i == 0) ? "md5" : "murmur64";
+    /* Expected IDs of resource http://example.org/ */
+    const u64 expected=(i == 0) ? 6220606045441765405ULL :
+                                  3154310099064124955ULL;
+    librdf_sql_node_id* node_id;
+    librdf_node* node;
+    int j;
+
+    fprintf(stderr, "%s: Checking SQL node IDs using %s\n", program, name);
+
+    node_id=librdf_new_sql_node_id(world, name, 2);
+    if(!node_id) {
+      fprintf(stderr, "%s: FAILED to create %s node ID\n", program, name);
+      failures++;
+      continue;
+    }
+
+    node=librdf_new_node_from_uri_string(world,
+                             (const unsigned char*)"http://example.org/");
+    /* second and third lookups are answered from the cache */
+    for(j=0; j<3; j++) {
+      u64 id=librdf_sql_node_id_for_node(node_id, node);
+      if(id != expected) {
+        fprintf(stderr, "%s: FAILED %s node ID " UINT64_T_FMT
+                " expected " UINT64_T_FMT "\n", program, name, id, expected);
+        failures++;
+        break;
+      }
+    }
+    librdf_free_node(node);
+
+    /* literals are hashed as value<language>datatype; these also
+     * evict the resource from the cache */
+    for(j=0; j<3; j++) {
+      char value[2]={(char)('a' + j), '\0'};
+      char composite[6]={(char)('a' + j), '<', 'e', 'n', '>', '\0'};
+      u64 id;
+
+      node=librdf_new_node_from_literal(world, (const unsigned char*)value,
+                                        "en", 0);
+      id=librdf_sql_node_id_for_node(node_id, node);
+      librdf_free_node(node);
+
+      if(id != librdf_sql_node_id_hash(node_id, "L",
+                                       (const unsigned char*)composite, 5)) {
+        fprintf(stderr, "%s: FAILED %s literal node ID " UINT64_T_FMT "\n",
+                program, name, id);
+        failures++;
+        break;
+      }
+    }
+
+    librdf_free_sql_node_id(node_id);
+  }
+
   librdf_free_world(world);
 
   return failures;
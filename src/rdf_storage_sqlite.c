@@ -89,6 +89,7 @@ static int librdf_storage_sqlite_add_statement(librdf_storage* storage, librdf_s
 static int librdf_storage_sqlite_add_statements(librdf_storage* storage, librdf_stream* statement_stream);
 static int librdf_storage_sqlite_remove_statement(librdf_storage* storage, librdf_statement* statement);
 static int librdf_storage_sqlite_contains_statement(librdf_storage* storage, librdf_statement* statement);
+static int librdf_storage_sqlite_estimate_statements(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node);
 static librdf_stream* librdf_storage_sqlite_serialise(librdf_storage* storage);
 static librdf_stream* librdf_storage_sqlite_find_statements(librdf_storage* storage, librdf_statement* statement);
 
@@ -1176,6 +1177,88 @@ librdf_storage_sqlite_context_contains_statement(librdf_storage* storage,
 }
 
 
+/*
+ * librdf_storage_sqlite_estimate_statements:
+ * @storage: #librdf_storage object
+ * @statement: triple pattern or NULL
+ * @context_node: context node or NULL
+ *
+ * Estimate the number of statements matching a pattern by counting
+ * up to LIBRDF_STORAGE_ESTIMATE_LIMIT matching rows of the triples
+ * table.  Nodes not yet in the database match nothing.
+ *
+ * Return value: estimated number of statements or < 0 on failure
+ */
+static int
+librdf_storage_sqlite_estimate_statements(librdf_storage* storage,
+                                          librdf_statement* statement,
+                                          librdf_node* context_node)
+{
+  triple_node_type node_types[4];
+  int node_ids[4];
+  const unsigned char* fields[4];
+  raptor_stringbuffer *sb;
+  unsigned char *request;
+  int count = 0;
+  int i;
+  int need_and = 0;
+  int rc;
+
+  if(librdf_storage_sqlite_statement_helper(storage,
+                                            statement,
+                                            context_node,
+                                            node_types, node_ids, fields,
+                                            0))
+    return -1;
+
+  sb = raptor_new_stringbuffer();
+  if(!sb)
+    return -1;
+
+  raptor_stringbuffer_append_string(sb,
+                                    (const unsigned char*)"SELECT COUNT(*) FROM (SELECT 1 FROM ",
+                                    1);
+  raptor_stringbuffer_append_string(sb,
+                                    (const unsigned char*)sqlite_tables[TABLE_TRIPLES].name, 1);
+
+  for(i = 0; i < 4; i++) {
+    if(!fields[i])
+      continue;
+
+    raptor_stringbuffer_append_string(sb,
+                                      (const unsigned char*)(need_and ? " AND " : " WHERE "),
+                                      1);
+    raptor_stringbuffer_append_string(sb, fields[i], 1);
+    raptor_stringbuffer_append_counted_string(sb,
+                                              (const unsigned char*)"=", 1, 1);
+    raptor_stringbuffer_append_decimal(sb, node_ids[i]);
+
+    need_and = 1;
+  }
+
+  raptor_stringbuffer_append_counted_string(sb,
+                                            (const unsigned char*)" LIMIT ", 7, 1);
+  raptor_stringbuffer_append_decimal(sb, LIBRDF_STORAGE_ESTIMATE_LIMIT);
+  raptor_stringbuffer_append_counted_string(sb,
+                                            (const unsigned char*)");", 2, 1);
+
+  request = raptor_stringbuffer_as_string(sb);
+
+  rc = librdf_storage_sqlite_exec(storage,
+                                  request,
+                                  librdf_storage_sqlite_get_1int_callback,
+                                  &count,
+                                  0);
+
+  raptor_free_stringbuffer(sb);
+
+  if(rc)
+    return -1;
+
+  return count;
+}
+
+
 static void
 sqlite_construct_select_helper(raptor_stringbuffer* sb) 
 {
@@ -2811,6 +2894,7 @@ librdf_storage_sqlite_register_factory(librdf_storage_factory *factory)
   factory->add_statements     = librdf_storage_sqlite_add_statements;
   factory->remove_statement   = librdf_storage_sqlite_remove_statement;
   factory->contains_statement = librdf_storage_sqlite_contains_statement;
+  factory->estimate_statements = librdf_storage_sqlite_estimate_statements;
   factory->serialise          = librdf_storage_sqlite_serialise;
   factory->find_statements    = librdf_storage_sqlite_find_statements;
   factory->context_add_statement    = librdf_storage_sqlite_context_add_statement;
@@ -41,6 +41,9 @@
 #include <stddef.h>
 #endif
 #include <sys/types.h>
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
 
 #include <redland.h>
 
@@ -79,8 +82,11 @@ static int librdf_storage_trees_add_statements(librdf_storage* storage, librdf_s
 static int librdf_storage_trees_remove_statement(librdf_storage* storage, librdf_statement* statement);
 static int librdf_storage_trees_remove_statement_internal(librdf_storage_trees_graph* graph, librdf_statement* statement);
 static int librdf_storage_trees_contains_statement(librdf_storage* storage, librdf_statement* statement);
+static int librdf_storage_trees_estimate_statements(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node);
+static int librdf_storage_trees_write_ntriples(librdf_storage* storage, raptor_iostream* iostr, int write_context);
 static librdf_stream* librdf_storage_trees_serialise(librdf_storage* storage);
 static librdf_stream* librdf_storage_trees_find_statements(librdf_storage* storage, librdf_statement* statement);
+static librdf_stream* librdf_storage_trees_find_statements_with_options(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node, librdf_hash* options);
 
 /* graph functions */
 static librdf_storage_trees_graph* librdf_storage_trees_graph_new(librdf_storage* storage, librdf_node* context);
@@ -342,6 +348,120 @@ librdf_storage_trees_contains_statement(librdf_storage* storage, librdf_statemen
 }
 
 
+/**
+ * librdf_storage_trees_estimate_statements:
+ * @storage: #librdf_storage object
+ * @statement: triple pattern or NULL
+ * @context_node: context node or NULL
+ *
+ * Estimate the number of statements matching a pattern.
+ *
+ * Counts up to LIBRDF_STORAGE_ESTIMATE_LIMIT matches in the index tree
+ * that find_statements would use.  When that index is not enabled, the
+ * size of the store is returned as an upper bound.
+ *
+ * Return value: estimated number of statements or < 0 if unknown
+ **/
+static int
+librdf_storage_trees_estimate_statements(librdf_storage* storage,
+                                         librdf_statement* statement,
+                                         librdf_node* context_node)
+{
+  librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
+  raptor_avltree* tree;
+  raptor_avltree_iterator* iterator;
+  int count;
+
+  if(context_node)
+    return -1;
+
+  if(!statement ||
+     (!statement->subject && !statement->predicate && !statement->object))
+    return raptor_avltree_size(context->graph->spo_tree);
+
+  if(statement->subject && statement->predicate && statement->object)
+    return librdf_storage_trees_contains_statement(storage, statement);
+
+  /* Same index choice as librdf_storage_trees_serialise_range */
+  if(statement->subject && statement->object)
+    tree = context->index_sop ? context->graph->sop_tree : NULL;
+  else if(statement->subject)
+    tree = context->graph->spo_tree;
+  else if(statement->object)
+    tree = context->index_ops ? context->graph->ops_tree : NULL;
+  else
+    tree = context->index_pso ? context->graph->pso_tree : NULL;
+
+  if(!tree)
+    return raptor_avltree_size(context->graph->spo_tree);
+
+  iterator = raptor_new_avltree_iterator(tree, statement, NULL, 1);
+  if(!iterator)
+    return 0;
+
+  for(count = 0; count < LIBRDF_STORAGE_ESTIMATE_LIMIT; count++) {
+    if(raptor_avltree_iterator_is_end(iterator))
+      break;
+    raptor_avltree_iterator_next(iterator);
+  }
+  raptor_free_avltree_iterator(iterator);
+
+  return count;
+}
+
+
+/**
+ * librdf_storage_trees_write_ntriples:
+ * @storage: #librdf_storage object
+ * @iostr: iostream to write to
+ * @write_context: non-0 to write the context of each statement
+ *
+ * Write all statements as N-Triples or N-Quads.
+ *
+ * The statements in the spo tree are written in place without
+ * copying them into a stream.
+ * 
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_storage_trees_write_ntriples(librdf_storage* storage,
+                                    raptor_iostream* iostr,
+                                    int write_context)
+{
+  librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
+  raptor_avltree_iterator* iterator;
+  int status=0;
+
+#ifdef RDF_STORAGE_TREES_WITH_CONTEXTS
+  /* statements in other contexts are in other trees */
+  if(context->contexts)
+    return -1;
+#endif
+
+  iterator=raptor_new_avltree_iterator(context->graph->spo_tree,
+                                       /* range */ NULL,
+                                       /* range free */ NULL,
+                                       1);
+  /* empty tree */
+  if(!iterator)
+    return 0;
+
+  while(!raptor_avltree_iterator_is_end(iterator)) {
+    librdf_statement* statement;
+
+    statement=(librdf_statement*)raptor_avltree_iterator_get(iterator);
+    if(raptor_statement_ntriples_write(statement, iostr, write_context)) {
+      status=1;
+      break;
+    }
+    raptor_avltree_iterator_next(iterator);
+  }
+  raptor_free_avltree_iterator(iterator);
+
+  return status;
+}
+
+
 typedef struct {
   librdf_storage *storage;
   raptor_avltree_iterator *avltree_iterator;
@@ -641,6 +761,298 @@ librdf_storage_trees_find_statements(librdf_storage* storage, librdf_statement*
   return stream;
 }
 
+
+#ifdef WITH_THREADS
+/* Fewest statements matched by each thread of a parallel find */
+#define LIBRDF_STORAGE_TREES_WORKER_STATEMENTS 4096
+
+typedef struct {
+  librdf_statement* range;
+  librdf_statement** statements;
+  char* matched;
+  int start;
+  int end;
+  pthread_t thread;
+  int started;
+} librdf_storage_trees_match_part;
+
+typedef struct {
+  librdf_storage *storage;
+  librdf_statement** statements;
+  int count;
+  int current;
+} librdf_storage_trees_matches_stream_context;
+
+
+/*
+ * librdf_storage_trees_range_needs_filter:
+ * @context: storage instance
+ * @range: the statement to match
+ *
+ * INTERNAL - Check if a range has no index so every statement is matched
+ *
+ * Mirrors the choice of tree made by librdf_storage_trees_serialise_range().
+ *
+ * Return value: non 0 if every statement must be matched against @range
+ */
+static int
+librdf_storage_trees_range_needs_filter(librdf_storage_trees_instance* context,
+                                        librdf_statement* range)
+{
+  /* s ?p o */
+  if(range->subject && !range->predicate && range->object)
+    return !context->index_sop;
+  /* s _ _ or ?s ?p ?o */
+  if(range->subject || (!range->predicate && !range->object))
+    return 0;
+  /* ?s _ o */
+  if(range->object)
+    return !context->index_ops;
+  /* ?s p ?o */
+  return !context->index_pso;
+}
+
+
+/*
+ * librdf_storage_trees_match_thread:
+ * @arg: #librdf_storage_trees_match_part
+ *
+ * INTERNAL - Match one part of the statements against the range
+ *
+ * The statements and range are only read, so parts are matched on
+ * several threads at once.
+ */
+static void*
+librdf_storage_trees_match_thread(void* arg)
+{
+  librdf_storage_trees_match_part* part=(librdf_storage_trees_match_part*)arg;
+  int i;
+
+  for(i=part->start; i < part->end; i++)
+    part->matched[i]=(char)librdf_statement_match(part->statements[i],
+                                                  part->range);
+
+  return NULL;
+}
+
+
+static int
+librdf_storage_trees_matches_end_of_stream(void* context)
+{
+  librdf_storage_trees_matches_stream_context* scontext=(librdf_storage_trees_matches_stream_context*)context;
+
+  return scontext->current >= scontext->count;
+}
+
+
+static int
+librdf_storage_trees_matches_next_statement(void* context)
+{
+  librdf_storage_trees_matches_stream_context* scontext=(librdf_storage_trees_matches_stream_context*)context;
+
+  scontext->current++;
+  return scontext->current >= scontext->count;
+}
+
+
+static void*
+librdf_storage_trees_matches_get_statement(void* context, int flags)
+{
+  librdf_storage_trees_matches_stream_context* scontext=(librdf_storage_trees_matches_stream_context*)context;
+
+  if(scontext->current >= scontext->count)
+    return NULL;
+
+  switch(flags) {
+    case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      return scontext->statements[scontext->current];
+
+    default:
+      return NULL;
+  }
+}
+
+
+static void
+librdf_storage_trees_matches_finished(void* context)
+{
+  librdf_storage_trees_matches_stream_context* scontext=(librdf_storage_trees_matches_stream_context*)context;
+
+  if(scontext->statements)
+    LIBRDF_FREE(librdf_statement**, scontext->statements);
+
+  if(scontext->storage)
+    librdf_storage_remove_reference(scontext->storage);
+
+  LIBRDF_FREE(librdf_storage_trees_matches_stream_context, scontext);
+}
+
+
+/*
+ * librdf_storage_trees_find_statements_parallel:
+ * @storage: the storage
+ * @range: the statement to match (freed by this function)
+ * @workers: most threads to use
+ *
+ * INTERNAL - Match every statement against a range on several threads
+ *
+ * Used for ranges with no index.  The statements of the spo tree are
+ * collected on the calling thread, split into one part per worker
+ * and matched in parallel, the calling thread matching the first
+ * part.  The matches are returned in tree order.  Small stores are
+ * matched on the calling thread alone.
+ *
+ * Return value: a #librdf_stream or NULL on failure
+ */
+static librdf_stream*
+librdf_storage_trees_find_statements_parallel(librdf_storage* storage,
+                                              librdf_statement* range,
+                                              int workers)
+{
+  librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
+  librdf_storage_trees_matches_stream_context* scontext=NULL;
+  librdf_storage_trees_match_part* parts=NULL;
+  librdf_statement** statements=NULL;
+  char* matched=NULL;
+  raptor_avltree_iterator* iterator;
+  librdf_stream* stream=NULL;
+  int size;
+  int count=0;
+  int i, j;
+
+  size=raptor_avltree_size(context->graph->spo_tree);
+  if(workers > size / LIBRDF_STORAGE_TREES_WORKER_STATEMENTS)
+    workers=size / LIBRDF_STORAGE_TREES_WORKER_STATEMENTS;
+  if(workers < 2)
+    return librdf_storage_trees_serialise_range(storage, range);
+
+  statements=LIBRDF_MALLOC(librdf_statement**, size * sizeof(*statements));
+  matched=LIBRDF_CALLOC(char*, size, 1);
+  parts=LIBRDF_CALLOC(librdf_storage_trees_match_part*, workers,
+                      sizeof(*parts));
+  scontext=LIBRDF_CALLOC(librdf_storage_trees_matches_stream_context*, 1,
+                         sizeof(*scontext));
+  if(!statements || !matched || !parts || !scontext)
+    goto tidy;
+
+  iterator=raptor_new_avltree_iterator(context->graph->spo_tree,
+                                       /* range */ NULL,
+                                       /* range free */ NULL,
+                                       1);
+  if(iterator) {
+    while(count < size && !raptor_avltree_iterator_is_end(iterator)) {
+      statements[count++]=(librdf_statement*)raptor_avltree_iterator_get(iterator);
+      raptor_avltree_iterator_next(iterator);
+    }
+    raptor_free_avltree_iterator(iterator);
+  }
+
+  for(i=0; i < workers; i++) {
+    parts[i].range=range;
+    parts[i].statements=statements;
+    parts[i].matched=matched;
+    parts[i].start=(int)((long)count * i / workers);
+    parts[i].end=(int)((long)count * (i + 1) / workers);
+  }
+
+  for(i=1; i < workers; i++)
+    parts[i].started=!pthread_create(&parts[i].thread, NULL,
+                                     librdf_storage_trees_match_thread,
+                                     &parts[i]);
+  librdf_storage_trees_match_thread(&parts[0]);
+  /* a part whose thread could not start is matched here */
+  for(i=1; i < workers; i++) {
+    if(parts[i].started)
+      pthread_join(parts[i].thread, NULL);
+    else
+      librdf_storage_trees_match_thread(&parts[i]);
+  }
+
+  for(i=0, j=0; i < count; i++) {
+    if(matched[i])
+      statements[j++]=statements[i];
+  }
+
+  scontext->storage=storage;
+  librdf_storage_add_reference(scontext->storage);
+  scontext->statements=statements;
+  scontext->count=j;
+  statements=NULL;
+
+  stream=librdf_new_stream(storage->world,
+                           (void*)scontext,
+                           &librdf_storage_trees_matches_end_of_stream,
+                           &librdf_storage_trees_matches_next_statement,
+                           &librdf_storage_trees_matches_get_statement,
+                           &librdf_storage_trees_matches_finished);
+  if(!stream)
+    librdf_storage_trees_matches_finished((void*)scontext);
+  scontext=NULL;
+
+  tidy:
+  if(scontext)
+    LIBRDF_FREE(librdf_storage_trees_matches_stream_context, scontext);
+  if(parts)
+    LIBRDF_FREE(librdf_storage_trees_match_part*, parts);
+  if(matched)
+    LIBRDF_FREE(char*, matched);
+  if(statements)
+    LIBRDF_FREE(librdf_statement**, statements);
+  librdf_free_statement(range);
+
+  return stream;
+}
+#endif
+
+
+/**
+ * librdf_storage_trees_find_statements_with_options:
+ * @storage: the storage
+ * @statement: the statement to match
+ * @context_node: context node or NULL
+ * @options: #librdf_hash of match options or NULL
+ *
+ * Find statements with options.
+ *
+ * The "workers" option sets the most threads used to match a pattern
+ * that has no index; the store is split between them.  Other options
+ * are ignored.
+ *
+ * Return value: a #librdf_stream or NULL on failure
+ **/
+static librdf_stream*
+librdf_storage_trees_find_statements_with_options(librdf_storage* storage,
+                                                  librdf_statement* statement,
+                                                  librdf_node* context_node,
+                                                  librdf_hash* options)
+{
+#ifdef WITH_THREADS
+  librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
+  long workers=0;
+#endif
+
+  if(context_node)
+    return librdf_storage_find_statements_in_context(storage, statement,
+                                                     context_node);
+
+#ifdef WITH_THREADS
+  if(options)
+    workers=librdf_hash_get_as_long(options, "workers");
+
+  if(workers > 1 && statement &&
+     librdf_storage_trees_range_needs_filter(context, statement)) {
+    librdf_statement* range=librdf_new_statement_from_statement(statement);
+    if(!range)
+      return NULL;
+
+    return librdf_storage_trees_find_statements_parallel(storage, range,
+                                                         (int)workers);
+  }
+#endif
+
+  return librdf_storage_trees_find_statements(storage, statement);
+}
+
 /* statement tree functions */
 
 static int
@@ -995,9 +1407,12 @@ librdf_storage_trees_register_factory(librdf_storage_factory *factory)
   factory->add_statements           = librdf_storage_trees_add_statements;
   factory->remove_statement         = librdf_storage_trees_remove_statement;
   factory->contains_statement       = librdf_storage_trees_contains_statement;
+  factory->estimate_statements      = librdf_storage_trees_estimate_statements;
+  factory->write_ntriples           = librdf_storage_trees_write_ntriples;
   factory->serialise                = librdf_storage_trees_serialise;
 
   factory->find_statements          = librdf_storage_trees_find_statements;
+  factory->find_statements_with_options = librdf_storage_trees_find_statements_with_options;
   /* These could be implemented, but only if all indexes are available.
    * If they returned NULL if the indexes weren't available,
    * librdf_storage_find_statements would break, unfortunately.